@@ -0,0 +1,87 @@
+//===- BatchChecks.h - Make independent checks in one call ------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that replaces the independent load/store checks of
+// a basic block with a single call to the run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_BATCHCHECKS_H_
+#define _SAFECODE_BATCHCHECKS_H_
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+//
+// Pass: BatchChecks
+//
+// Description:
+//  This pass gathers the poolchecks (and, separately, the poolcheckuis) of a
+//  stretch of a basic block that contains no call that may register or
+//  unregister objects.  Every check whose operands are available at the first
+//  check of the stretch is moved there; the checks are written into a batch
+//  descriptor on the stack, and a single call to poolcheck_batch() or
+//  poolcheckui_batch() performs them all.
+//
+//  This pass must run after DebugInstrument so that each entry of the batch
+//  keeps the source location of its check; checks left for the site table
+//  take theirs from their debug metadata.  It must run before
+//  RecordCheckSites, as the labels that pass places around every check are
+//  inline assembly, which ends a batch.
+//
+struct BatchChecks : public ModulePass {
+  public:
+    static char ID;
+    BatchChecks () : ModulePass (ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "SAFECode Batch Checks";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesCFG();
+    }
+
+  private:
+    // A batch of checks of the same kind and the function that performs it
+    struct Batch {
+      std::vector<CallInst *> Checks;
+      Function * BatchFunc;
+    };
+
+    // The type of an entry of a batch descriptor
+    StructType * EntryType;
+
+    // The functions that perform batches of poolchecks and poolcheckuis
+    Function * BatchFunc;
+    Function * BatchUIFunc;
+
+    // The strings holding the names of source files
+    std::map<std::string, Constant *> SourceFiles;
+
+    // Private methods
+    Constant * sourceFile (Module & M, const std::string & Name);
+    void findBatches (BasicBlock & BB, std::vector<Batch> & Batches);
+    void emitBatch (const Batch & B, Value * Descriptor);
+    bool batchFunction (Function & F);
+};
+
+}
+
+#endif
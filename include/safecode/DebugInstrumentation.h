@@ -57,12 +57,26 @@ class VariableSourceInfo : public GetSourceInfo {
     virtual std::pair<Value *, Value *> operator() (CallInst * I);
 };
 
+//
+// Pass: DebugInstrument
+//
+// Description:
+//  This pass renames the run-time checks to their debug versions, which take
+//  a tag, the source file, and the line number of the check as their last
+//  three arguments.
+//
+//  In site table mode, the load/store and bounds checks keep the calling
+//  convention of the checks without debug information; RecordCheckSites later
+//  gives each of their calls an entry in the site table.  Site table mode
+//  requires an ELF target; on other targets, the checks are renamed as usual.
+//
 struct DebugInstrument : public ModulePass {
   public:
     static char ID;
 
     virtual bool runOnModule(Module &M);
-    DebugInstrument () : ModulePass (ID) {
+    DebugInstrument (bool siteTable = false) : ModulePass (ID),
+                                               SiteTable (siteTable) {
       return;
     }
 
@@ -79,10 +93,54 @@ struct DebugInstrument : public ModulePass {
     // LLVM type for void pointers (void *)
     Type * VoidPtrTy;
 
+    // Whether site table mode was requested and whether it is used
+    bool SiteTable;
+    bool UseSiteTable;
+
     // Private methods
     void transformFunction (Function * F, GetSourceInfo & SI);
 };
 
+//
+// Pass: RecordCheckSites
+//
+// Description:
+//  This pass gives every call to a check that DebugInstrument left without
+//  debug arguments in site table mode an entry in the site table.  The call
+//  is bracketed by two labels, and an entry holding the labels, the tag, the
+//  source file, and the line number is placed in the sc_srcinfo section; the
+//  debug run-time looks the location of a failed check up in that table.
+//
+//  Passes that inline, cache, batch, or hoist checks move the calls away from
+//  where DebugInstrument found them, so this pass must run after all of them.
+//  The cached and batched versions of the checks are given entries as well.
+//
+struct RecordCheckSites : public ModulePass {
+  public:
+    static char ID;
+
+    virtual bool runOnModule(Module &M);
+    RecordCheckSites () : ModulePass (ID) {}
+
+    const char *getPassName() const {
+      return "SAFECode Check Site Table Pass";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesCFG();
+    };
+
+  private:
+    // LLVM type for void pointers (void *)
+    Type * VoidPtrTy;
+
+    // Size of a pointer on the target in bytes
+    unsigned PointerSize;
+
+    // Private methods
+    bool recordSites (Function * F, GetSourceInfo & SI);
+};
+
 }
 
 #endif
@@ -0,0 +1,84 @@
+//===- InlineBaggyChecks.h - Inline baggy bounds checks ---------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that expands the load/store, bounds, and exact
+// checks of the baggy bounds run-time into inline code.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_INLINEBAGGYCHECKS_H_
+#define _SAFECODE_INLINEBAGGYCHECKS_H_
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+//
+// Pass: InlineBaggyChecks
+//
+// Description:
+//  This pass performs the common case of each baggy bounds check inline: it
+//  looks up the size of the object in the baggy bounds table, computes the
+//  start of the object from its size, and compares the checked pointers with
+//  the bounds recorded in the object's metadata.  Only the checks that fail,
+//  or that the inline code cannot decide, call the run-time, which rewrites
+//  out-of-bounds pointers and reports errors as before.  The calls are moved
+//  into blocks at the end of the function.  Tagged out-of-bounds pointers
+//  of 64-bit targets are always left to the run-time.
+//
+//  This pass must run after DebugInstrument so that the calls it keeps pass
+//  on the source locations of the checks.
+//
+struct InlineBaggyChecks : public ModulePass {
+  public:
+    static char ID;
+    InlineBaggyChecks () : ModulePass (ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "SAFECode Inline Baggy Bounds Checks";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DataLayout>();
+    }
+
+  private:
+    // Layout of the target
+    const DataLayout * TD;
+
+    // The fine and coarse size tables and the unmapped range that holds
+    // rewritten out-of-bounds pointers
+    Constant * SizeTable;
+    Constant * CoarseTable;
+    Constant * InvalidLower;
+    Constant * InvalidUpper;
+
+    // Size of the metadata at the end of every object
+    uint64_t MetaDataSize;
+
+    // Private methods
+    BasicBlock * checkTag (BasicBlock * Head, Value * Ptr,
+                           BasicBlock * Slow, BasicBlock * Before);
+    Value * lookupSize (Value * Ptr, Instruction * InsertPt);
+    Value * isRewritten (Value * Ptr, Instruction * InsertPt);
+    Value * loadObjectSize (Value * Ptr, Value * Size, Value *& Start,
+                            Instruction * InsertPt);
+    void inlineLSCheck (CallInst * CI);
+    void inlineBoundsCheck (CallInst * CI);
+    void inlineExactCheck (CallInst * CI);
+};
+
+}
+
+#endif
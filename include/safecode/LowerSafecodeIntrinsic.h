@@ -8,7 +8,8 @@
 //===----------------------------------------------------------------------===//
 //
 // This pass lowers all intrinsics used by SAFECode to appropriate runtime
-// functions.
+// functions.  In sampled mode, load/store checks are lowered so that each check
+// site runs its check at only a sample of its executions.
 //
 //===----------------------------------------------------------------------===//
 
@@ -35,22 +36,30 @@ namespace llvm {
     static char ID;
 
     template<class Iterator>
-      LowerSafecodeIntrinsic(Iterator begin, Iterator end) : ModulePass(ID) {
+      LowerSafecodeIntrinsic(Iterator begin, Iterator end,
+                             bool sampled = false) :
+        ModulePass(ID), Sampled(sampled) {
         for(Iterator it = begin; it != end; ++it) {
           mReplaceList.push_back(*it);
       }
      }
     
-    LowerSafecodeIntrinsic() : ModulePass(ID), mReplaceList() {}
+    LowerSafecodeIntrinsic() : ModulePass(ID), mReplaceList(), Sampled(false) {}
 
     virtual ~LowerSafecodeIntrinsic() {};
     virtual bool runOnModule(Module & M);
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
-      AU.setPreservesCFG();
+      if (!Sampled)
+        AU.setPreservesCFG();
     }
 
   private:
     std::vector<IntrinsicMappingEntry> mReplaceList;
+
+    // Whether load/store checks are sampled
+    bool Sampled;
+
+    void sampleCheck (CallInst * CI);
   };
 
 }
@@ -0,0 +1,68 @@
+//===- ParallelChecks.h - Run checks on checker threads ---------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that makes the program send its run-time checks to
+// the checker threads of the debug run-time instead of running them itself.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_PARALLELCHECKS_H_
+#define _SAFECODE_PARALLELCHECKS_H_
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+//
+// Pass: ParallelChecks
+//
+// Description:
+//  This pass replaces the run-time checks and object registrations with their
+//  __sc_par_* versions, which hand them to a checker thread and return at
+//  once.  Before every call to an external function that the checks do not
+//  know to be harmless (a system call, for example, could let a violation
+//  escape the program), it inserts a call to __sc_par_wait_for_completion(),
+//  which waits until the checker threads have run every check sent so far.
+//
+//  This pass must run after DebugInstrument and after every other pass that
+//  adds or transforms run-time checks.
+//
+struct ParallelChecks : public ModulePass {
+  public:
+    static char ID;
+    ParallelChecks () : ModulePass (ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "SAFECode Parallel Checks";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesCFG();
+    }
+
+  private:
+    // The function that waits for the checker threads
+    Function * WaitFunc;
+
+    // Whether an indirect call may call a function that needs a wait
+    bool UnsafeIndirectCalls;
+
+    // Private methods
+    bool isSafeCallee (const Function * F) const;
+    bool sendChecks (Module & M);
+    bool insertWaits (Function & F);
+};
+
+}
+
+#endif
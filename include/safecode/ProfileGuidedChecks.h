@@ -0,0 +1,97 @@
+//===- ProfileGuidedChecks.h - Optimize checks with a profile ---*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that uses the check profile recorded by the debug
+// run-time to decide which run-time checks are worth optimizing.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_PROFILEGUIDEDCHECKS_H_
+#define _SAFECODE_PROFILEGUIDEDCHECKS_H_
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <map>
+#include <string>
+
+namespace llvm {
+
+//
+// Pass: ProfileGuidedChecks
+//
+// Description:
+//  This pass reads a check profile written by the debug run-time and finds
+//  the check sites that account for most of the time spent in checks.  The
+//  fast paths of hot exactchecks and fastlschecks are inlined so that the
+//  run-time is only called when they fail, and hot checks of loop invariant
+//  pointers are hoisted out of loops that cannot free memory.  Cold checks
+//  are left as calls to the run-time.
+//
+//  Check sites are matched by the kind, tag, source file, and line number
+//  that the DebugInstrument pass gave them, so this pass must run after it,
+//  and the profile must come from a build of the same sources with the same
+//  options.
+//
+struct ProfileGuidedChecks : public ModulePass {
+  public:
+    static char ID;
+    ProfileGuidedChecks (const std::string & Filename = "") :
+      ModulePass (ID), ProfileFilename (Filename) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "Profile-Guided SAFECode Check Optimization";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<LoopInfo>();
+    }
+
+  private:
+    // The key of a check site in the profile
+    struct SiteKey {
+      std::string Kind;
+      unsigned tag;
+      unsigned lineno;
+      std::string SourceFile;
+
+      bool operator< (const SiteKey & Other) const {
+        if (tag != Other.tag) return tag < Other.tag;
+        if (lineno != Other.lineno) return lineno < Other.lineno;
+        if (Kind != Other.Kind) return Kind < Other.Kind;
+        return SourceFile < Other.SourceFile;
+      }
+    };
+
+    // The estimated cost of each check site in the profile
+    std::map<SiteKey, double> SiteCosts;
+
+    // The file from which to read the profile
+    std::string ProfileFilename;
+
+    // Sites whose estimated cost is at least this much are hot
+    double HotThreshold;
+
+    // Whether each loop of the current function may free memory
+    std::map<Loop *, bool> LoopMayFree;
+
+    // Private methods
+    bool readProfile (void);
+    bool getSiteKey (CallInst * CI, const char * Kind, SiteKey & Key);
+    bool loopMayFree (Loop * L);
+    bool hoistCheck (CallInst * CI, Loop * L);
+    bool inlineFastPath (CallInst * CI, bool ReturnsPointer);
+};
+
+}
+
+#endif
@@ -170,7 +170,7 @@ extern "C" {
   void * bb_exactcheck2_debug (char *source, char *base, char *result,
                                unsigned size, TAG, SRC_INFO);
 
-  void __sc_bb_funccheck (unsigned num, void *f, void *g, ...);
+  void __sc_bb_funccheck (void *f, void * targets[], TAG, SRC_INFO);
   void * pchk_getActualValue (PPOOL, void * src);
 
   // Change memory protections to detect dangling pointers
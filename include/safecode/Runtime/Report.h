@@ -51,6 +51,12 @@ struct ViolationInfo {
   unsigned CWE;
 
   virtual void print(std::ostream & OS) const;
+
+  /// Find the source file and line of the check that found the violation;
+  /// the file is NULL if it is not known
+  virtual void getSourceLocation(const char * & SourceFile,
+                                 unsigned & lineNo) const;
+
   virtual ~ViolationInfo();
 };
 
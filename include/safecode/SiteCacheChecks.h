@@ -0,0 +1,68 @@
+//===- SiteCacheChecks.h - Give check sites inline caches -------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that gives load/store and bounds check sites
+// inline caches of the last object that they found.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_SITECACHECHECKS_H_
+#define _SAFECODE_SITECACHECHECKS_H_
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+//
+// Pass: SiteCacheChecks
+//
+// Description:
+//  This pass gives every poolcheck and boundscheck its own inline cache: a
+//  global holding the bounds of the last object that the check found and the
+//  epoch in which it was found.  The check only calls the run-time when the
+//  pointers being checked are not within the cached object or when objects
+//  have been unregistered since the cache was filled; the run-time fills the
+//  cache (see SiteCache in the debug run-time).
+//
+//  This pass must run after DebugInstrument, which does not know about the
+//  cached versions of the checks.
+//
+struct SiteCacheChecks : public ModulePass {
+  public:
+    static char ID;
+    SiteCacheChecks () : ModulePass (ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "SAFECode Check Site Caches";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DataLayout>();
+    }
+
+  private:
+    // Layout of the target
+    const DataLayout * TD;
+
+    // The type of an inline cache and the global epoch of the run-time
+    StructType * SiteCacheType;
+    Constant * SiteEpoch;
+
+    // Private methods
+    void cacheCheck (CallInst * CI, Function * Cached, bool IsBoundsCheck);
+};
+
+}
+
+#endif
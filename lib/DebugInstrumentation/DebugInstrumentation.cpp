@@ -20,7 +20,10 @@
 
 
 #include "llvm/DebugInfo.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
@@ -37,6 +40,7 @@
 #include "safecode/Utility.h"
 
 #include <cstdlib>
+#include <sstream>
 #include <vector>
 
 using namespace llvm;
@@ -44,11 +48,15 @@ using namespace llvm;
 namespace llvm {
 
 char DebugInstrument::ID = 0;
+char RecordCheckSites::ID = 0;
 
-// Register the pass
+// Register the passes
 static
 RegisterPass<DebugInstrument> X ("debuginstrument",
                                  "Add Debug Data to SAFECode Run-Time Checks");
+static
+RegisterPass<RecordCheckSites> Y ("sc-check-sites",
+                                  "Record SAFECode Check Sites in a Table");
 
 static int tagCounter = 0;
 
@@ -59,6 +67,26 @@ static Type * VoidType  = 0;
 static Type * Int8Type  = 0;
 static Type * Int32Type = 0;
 
+//
+// The checks that are given entries in the site table in site table mode.
+// Their versions without debug arguments perform the same checks as their
+// debug versions.  The cached and batched checks follow; later passes make
+// them out of the checks before them.
+//
+static const char * const SiteTableChecks[] = {
+  "poolcheck",
+  "poolcheckalign",
+  "boundscheck",
+  "boundscheckui",
+  "exactcheck2",
+  "fastlscheck",
+  "poolcheck_cached",
+  "boundscheck_cached",
+  "boundscheckui_cached",
+  "poolcheck_batch",
+  0
+};
+
 ///////////////////////////////////////////////////////////////////////////
 // Command line options
 ///////////////////////////////////////////////////////////////////////////
@@ -69,6 +97,7 @@ namespace {
   ///////////////////////////////////////////////////////////////////////////
   STATISTIC (FoundSrcInfo,   "Number of Source Information Locations Found");
   STATISTIC (QueriedSrcInfo, "Number of Source Information Locations Queried");
+  STATISTIC (TableSites,     "Number of Checks Given Site Table Entries");
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -123,6 +152,35 @@ copyToDefaultSection (Value * V) {
   return V;
 }
 
+//
+// Function: isSiteTableCheck()
+//
+// Description:
+//  Determine whether calls to the specified function are given entries in the
+//  site table in site table mode.
+//
+static bool
+isSiteTableCheck (Function * F) {
+  for (unsigned index = 0; SiteTableChecks[index]; ++index)
+    if (F->getName() == SiteTableChecks[index])
+      return true;
+  return false;
+}
+
+//
+// Function: hasSiteTable()
+//
+// Description:
+//  Determine whether the target of the module can have a site table.  The
+//  table is placed in a section named so that ELF linkers define symbols for
+//  its start and end.
+//
+static bool
+hasSiteTable (Module & M) {
+  Triple TargetTriple (M.getTargetTriple());
+  return !TargetTriple.isOSDarwin() && !TargetTriple.isOSWindows();
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Class Methods
 ///////////////////////////////////////////////////////////////////////////
@@ -291,6 +349,14 @@ DebugInstrument::transformFunction (Function * F, GetSourceInfo & SI) {
   // be transformed.
   if (!F) return;
 
+  //
+  // In site table mode, the load/store and bounds checks keep their calling
+  // convention; RecordCheckSites records their calls once later passes have
+  // put them where they stay.
+  //
+  if (UseSiteTable && isSiteTableCheck (F))
+    return;
+
   //
   // Create the function prototype for the debug version of the function.  This
   // function will have an identical type to the original *except* that it will
@@ -420,6 +486,8 @@ DebugInstrument::runOnModule (Module &M) {
   // Create the void pointer type
   VoidPtrTy = getVoidPtrType(M);
 
+  UseSiteTable = SiteTable && hasSiteTable (M);
+
   //
   // Create needed LLVM types.
   //
@@ -529,5 +597,100 @@ DebugInstrument::runOnModule (Module &M) {
   return true;
 }
 
+//
+// Method: recordSites()
+//
+// Description:
+//  Give every call to the specified run-time check an entry in the site
+//  table.  A label is placed before and after the call, so the return address
+//  of the call lies after the first label and no later than the second.
+//
+// Inputs:
+//  F  - The run-time check.  This *can be NULL.
+//  SI - The object used to find the source information of the calls.
+//
+// Return value:
+//  true  - Some calls were given entries.
+//  false - The check is not called.
+//
+bool
+RecordCheckSites::recordSites (Function * F, GetSourceInfo & SI) {
+  if (!F) return false;
+
+  FunctionType * BeginType = FunctionType::get (VoidType, false);
+  InlineAsm * Begin = InlineAsm::get (BeginType, "1:", "", true);
+  Type * EndParams[] = {VoidPtrTy};
+  FunctionType * EndType = FunctionType::get (VoidType, EndParams, false);
+  const char * PointerDirective = (PointerSize == 8) ? ".quad" : ".long";
+
+  std::vector<CallInst *> Worklist;
+  Function::use_iterator i, e;
+  for (i = F->use_begin(), e = F->use_end(); i != e; ++i) {
+    if (CallInst * CI = dyn_cast<CallInst>(*i)) {
+      if (CI->getCalledValue() == F)
+        Worklist.push_back (CI);
+    }
+  }
+
+  for (unsigned index = 0; index < Worklist.size(); ++index) {
+    CallInst * CI = Worklist[index];
+    std::pair<Value *, Value *> Info = SI (CI);
+    Value * SourceFile = copyToDefaultSection (Info.first);
+    uint64_t LineNumber = cast<ConstantInt>(Info.second)->getZExtValue();
+
+    //
+    // The entry holds the two labels, the source file, the tag, and the line
+    // number; see SourceSite in the debug run-time.
+    //
+    std::ostringstream Entry;
+    Entry << "2:\n"
+          << "\t.pushsection sc_srcinfo,\"aw\"\n"
+          << "\t.balign " << PointerSize << "\n"
+          << "\t" << PointerDirective << " 1b, 2b, ${0:c}\n"
+          << "\t.long " << tagCounter++ << ", " << LineNumber << "\n"
+          << "\t.popsection";
+    InlineAsm * End = InlineAsm::get (EndType, Entry.str(), "i", true);
+
+    BasicBlock::iterator After = CI;
+    ++After;
+    CallInst::Create (Begin, "", CI);
+    Value * File = castTo (SourceFile, VoidPtrTy, "", After);
+    CallInst::Create (End, File, "", After);
+    ++TableSites;
+  }
+
+  return !Worklist.empty();
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Give the calls to the checks in the site table their entries.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was left unmodified.
+//
+bool
+RecordCheckSites::runOnModule (Module &M) {
+  if (!hasSiteTable (M))
+    return false;
+
+  VoidPtrTy = getVoidPtrType(M);
+  PointerSize = DataLayout (&M).getPointerSize();
+  VoidType  = Type::getVoidTy(M.getContext());
+  Int32Type = IntegerType::getInt32Ty(M.getContext());
+
+  LocationSourceInfo LInfo (M.getContext().getMDKindID("dbg"));
+  bool modified = false;
+  for (unsigned index = 0; SiteTableChecks[index]; ++index) {
+    Function * F = M.getFunction (SiteTableChecks[index]);
+    modified |= recordSites (F, LInfo);
+  }
+
+  return modified;
+}
+
 }
 
@@ -0,0 +1,402 @@
+//===- BatchChecks.cpp - Make independent checks in one call --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass replaces the independent load/store checks of a basic block with
+// a single call to the run-time.  A loop body such as
+//
+//   poolcheck (pool, &B[i], 8);
+//   b = B[i];
+//   poolcheck (pool, &C[i], 8);
+//   c = C[i];
+//   poolcheck (pool, &A[i], 8);
+//   A[i] = b + c;
+//
+// becomes
+//
+//   batch[0] = {pool, &B[i], file, 8, line};
+//   batch[1] = {pool, &C[i], file, 8, line};
+//   batch[2] = {pool, &A[i], file, 8, line};
+//   poolcheck_batch (batch, 3);
+//   b = B[i];
+//   ...
+//
+// The run-time sorts the batch by address and checks accesses to the same
+// object with a single lookup.  Moving a check earlier in its block only
+// changes the order in which violations are reported, but a check must not
+// move above a call that may register the object that it checks; any call
+// other than another check ends the stretch of the block that is batched.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "batch-checks"
+
+#include "llvm/DebugInfo.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+
+#include "safecode/BatchChecks.h"
+
+namespace {
+  STATISTIC (BatchesMade,   "Number of batches of checks made");
+  STATISTIC (BatchedChecks, "Number of checks moved into batches");
+}
+
+namespace llvm {
+
+char BatchChecks::ID = 0;
+
+static RegisterPass<BatchChecks>
+X ("sc-batch-checks", "Perform independent load/store checks in one call");
+
+// The largest number of checks in a batch
+static const unsigned MaxBatchSize = 16;
+
+//
+// The checks that are batched, whether they are complete (poolchecks rather
+// than poolcheckuis), and whether they take the debug arguments (tag, source
+// file, and line number) after their first three.
+//
+static const struct {
+  const char * Name;
+  bool Complete;
+  bool HasDebugInfo;
+} Checks[] = {
+  {"poolcheck",         true,  false},
+  {"poolcheck_debug",   true,  true},
+  {"poolcheckui",       false, false},
+  {"poolcheckui_debug", false, true},
+  {0, false, false}
+};
+
+//
+// Run-time functions that neither register nor unregister objects; a call to
+// one of them, or to their debug versions, does not end a batch.
+//
+static const char * const HarmlessFunctions[] = {
+  "poolcheckalign",
+  "boundscheck",
+  "boundscheckui",
+  "exactcheck2",
+  "fastlscheck",
+  "funccheck",
+  "funccheckui",
+  "pchk_getActualValue",
+  0
+};
+
+//
+// Function: findCheck()
+//
+// Description:
+//  Return the index of the called check in the table of batched checks or -1
+//  if the call is not a batched check.
+//
+static int
+findCheck (CallInst * CI) {
+  Function * F = CI->getCalledFunction();
+  if (!F)
+    return -1;
+
+  for (unsigned index = 0; Checks[index].Name; ++index) {
+    if (F->getName() != Checks[index].Name)
+      continue;
+
+    unsigned NumArgs = Checks[index].HasDebugInfo ? 6 : 3;
+    if ((CI->getNumArgOperands() < NumArgs) ||
+        !CI->getArgOperand (0)->getType()->isPointerTy() ||
+        !CI->getArgOperand (1)->getType()->isPointerTy() ||
+        !CI->getArgOperand (2)->getType()->isIntegerTy())
+      return -1;
+    return index;
+  }
+  return -1;
+}
+
+//
+// Function: isHarmlessCall()
+//
+// Description:
+//  Determine whether the call can neither register nor unregister objects.
+//
+static bool
+isHarmlessCall (CallInst * CI) {
+  Function * F = CI->getCalledFunction();
+  if (!F)
+    return false;
+  if (F->isIntrinsic())
+    return true;
+
+  StringRef Name = F->getName();
+  if (Name.endswith ("_debug"))
+    Name = Name.drop_back (6);
+  for (unsigned index = 0; HarmlessFunctions[index]; ++index)
+    if (Name == HarmlessFunctions[index])
+      return true;
+  return false;
+}
+
+//
+// Function: castTo()
+//
+// Description:
+//  Convert a pointer or integer to the given type of the batch descriptor.
+//
+static Value *
+castTo (Value * V, Type * Ty, Instruction * InsertPt) {
+  if (V->getType() == Ty)
+    return V;
+  if (Ty->isPointerTy())
+    return new BitCastInst (V, Ty, "", InsertPt);
+  return CastInst::CreateIntegerCast (V, Ty, false, "", InsertPt);
+}
+
+//
+// Method: sourceFile()
+//
+// Description:
+//  Return a string holding the name of the specified source file.  Checks
+//  that take no debug arguments, such as those left for the site table, get
+//  their source location from their debug metadata; the site table only has
+//  the location of the first check of a batch.
+//
+Constant *
+BatchChecks::sourceFile (Module & M, const std::string & Name) {
+  std::map<std::string, Constant *>::iterator i = SourceFiles.find (Name);
+  if (i != SourceFiles.end())
+    return i->second;
+
+  Constant * Init = ConstantDataArray::getString (M.getContext(), Name);
+  Constant * File = new GlobalVariable (M,
+                                        Init->getType(),
+                                        true,
+                                        GlobalValue::InternalLinkage,
+                                        Init,
+                                        "sourcefile");
+  SourceFiles[Name] = File;
+  return File;
+}
+
+//
+// Method: findBatches()
+//
+// Description:
+//  Find the batches of checks in a basic block.  A check joins the open batch
+//  of its kind if its operands are computed before the first check of the
+//  batch; otherwise, it starts a new one.
+//
+void
+BatchChecks::findBatches (BasicBlock & BB, std::vector<Batch> & Batches) {
+  DenseMap<Instruction *, unsigned> Order;
+  unsigned Position = 0;
+  for (BasicBlock::iterator I = BB.begin(); I != BB.end(); ++I)
+    Order[I] = Position++;
+
+  //
+  // The open batches of poolchecks and poolcheckuis and the positions of
+  // their first checks.
+  //
+  Batch Open[2];
+  Open[0].BatchFunc = BatchFunc;
+  Open[1].BatchFunc = BatchUIFunc;
+  unsigned Start[2] = {0, 0};
+
+  for (BasicBlock::iterator I = BB.begin(); I != BB.end(); ++I) {
+    CallInst * CI = dyn_cast<CallInst>(I);
+    if (CI && !CI->isInlineAsm()) {
+      int Check = findCheck (CI);
+      if (Check >= 0) {
+        unsigned Kind = Checks[Check].Complete ? 0 : 1;
+        Batch & Current = Open[Kind];
+
+        //
+        // Determine whether the operands that the batch needs are available
+        // at the first check of the open batch.
+        //
+        bool Available = true;
+        for (unsigned arg = 0; arg < CI->getNumArgOperands(); ++arg) {
+          Instruction * Op = dyn_cast<Instruction>(CI->getArgOperand (arg));
+          if (Op && (Op->getParent() == &BB) && (Order[Op] >= Start[Kind]))
+            Available = false;
+        }
+
+        if (!Current.Checks.empty() &&
+            (!Available || (Current.Checks.size() == MaxBatchSize))) {
+          if (Current.Checks.size() > 1)
+            Batches.push_back (Current);
+          Current.Checks.clear();
+        }
+
+        if (Current.Checks.empty())
+          Start[Kind] = Order[CI];
+        Current.Checks.push_back (CI);
+        continue;
+      }
+
+      if (isHarmlessCall (CI))
+        continue;
+    }
+
+    //
+    // Any other call may register or unregister objects.
+    //
+    if (isa<CallInst>(I) || isa<InvokeInst>(I)) {
+      for (unsigned Kind = 0; Kind < 2; ++Kind) {
+        if (Open[Kind].Checks.size() > 1)
+          Batches.push_back (Open[Kind]);
+        Open[Kind].Checks.clear();
+      }
+    }
+  }
+
+  for (unsigned Kind = 0; Kind < 2; ++Kind)
+    if (Open[Kind].Checks.size() > 1)
+      Batches.push_back (Open[Kind]);
+}
+
+//
+// Method: emitBatch()
+//
+// Description:
+//  Fill the batch descriptor at the first check of the batch, call the run-time
+//  to perform the checks, and remove them.
+//
+void
+BatchChecks::emitBatch (const Batch & B, Value * Descriptor) {
+  CallInst * First = B.Checks[0];
+  LLVMContext & Context = First->getContext();
+  Type * Int32Type = Type::getInt32Ty (Context);
+  Type * VoidPtrType = Type::getInt8PtrTy (Context);
+
+  for (unsigned index = 0; index < B.Checks.size(); ++index) {
+    CallInst * CI = B.Checks[index];
+    bool HasDebugInfo = Checks[findCheck (CI)].HasDebugInfo;
+
+    Value * SourceFile = ConstantPointerNull::get (cast<PointerType>
+                                                   (VoidPtrType));
+    Value * LineNumber = ConstantInt::get (Int32Type, 0);
+    if (HasDebugInfo) {
+      SourceFile = castTo (CI->getArgOperand (4), VoidPtrType, First);
+      LineNumber = castTo (CI->getArgOperand (5), Int32Type, First);
+    } else if (MDNode * Dbg = CI->getMetadata (LLVMContext::MD_dbg)) {
+      DILocation Loc (Dbg);
+      std::string Name = Loc.getDirectory().str() + "/" +
+                         Loc.getFilename().str();
+      Module * M = First->getParent()->getParent()->getParent();
+      SourceFile = castTo (sourceFile (*M, Name), VoidPtrType, First);
+      LineNumber = ConstantInt::get (Int32Type, Loc.getLineNumber());
+    }
+
+    Value * Fields[] = {
+      castTo (CI->getArgOperand (0), VoidPtrType, First),
+      castTo (CI->getArgOperand (1), VoidPtrType, First),
+      SourceFile,
+      castTo (CI->getArgOperand (2), Int32Type, First),
+      LineNumber
+    };
+
+    for (unsigned field = 0; field < 5; ++field) {
+      Value * Indices[] = {
+        ConstantInt::get (Int32Type, 0),
+        ConstantInt::get (Int32Type, index),
+        ConstantInt::get (Int32Type, field)
+      };
+      Value * Ptr = GetElementPtrInst::CreateInBounds (Descriptor, Indices,
+                                                       "", First);
+      new StoreInst (Fields[field], Ptr, First);
+    }
+  }
+
+  Value * Indices[] = {
+    ConstantInt::get (Int32Type, 0),
+    ConstantInt::get (Int32Type, 0)
+  };
+  Value * Args[] = {
+    GetElementPtrInst::CreateInBounds (Descriptor, Indices, "", First),
+    ConstantInt::get (Int32Type, B.Checks.size())
+  };
+  CallInst * Call = CallInst::Create (B.BatchFunc, Args, "", First);
+  Call->setDebugLoc (First->getDebugLoc());
+
+  for (unsigned index = 0; index < B.Checks.size(); ++index)
+    B.Checks[index]->eraseFromParent();
+
+  ++BatchesMade;
+  BatchedChecks += B.Checks.size();
+}
+
+//
+// Method: batchFunction()
+//
+// Description:
+//  Batch the checks of a function.  All of its batches share one descriptor,
+//  which is as large as the largest of them.
+//
+bool
+BatchChecks::batchFunction (Function & F) {
+  std::vector<Batch> Batches;
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB)
+    findBatches (*BB, Batches);
+  if (Batches.empty())
+    return false;
+
+  unsigned Size = 0;
+  for (unsigned index = 0; index < Batches.size(); ++index)
+    if (Batches[index].Checks.size() > Size)
+      Size = Batches[index].Checks.size();
+
+  Type * DescriptorType = ArrayType::get (EntryType, Size);
+  Instruction * InsertPt = F.getEntryBlock().getFirstInsertionPt();
+  Value * Descriptor = new AllocaInst (DescriptorType, "sc.batch", InsertPt);
+
+  for (unsigned index = 0; index < Batches.size(); ++index)
+    emitBatch (Batches[index], Descriptor);
+  return true;
+}
+
+bool
+BatchChecks::runOnModule (Module & M) {
+  LLVMContext & Context = M.getContext();
+  Type * VoidType = Type::getVoidTy (Context);
+  Type * Int32Type = Type::getInt32Ty (Context);
+  Type * VoidPtrType = Type::getInt8PtrTy (Context);
+
+  //
+  // An entry of a batch descriptor; see CheckBatchEntry in the debug run-time.
+  //
+  EntryType = StructType::get (VoidPtrType, VoidPtrType, VoidPtrType,
+                               Int32Type, Int32Type, NULL);
+  Type * EntryPtrType = PointerType::getUnqual (EntryType);
+  BatchFunc = dyn_cast<Function>
+    (M.getOrInsertFunction ("poolcheck_batch",
+                            VoidType, EntryPtrType, Int32Type, NULL));
+  BatchUIFunc = dyn_cast<Function>
+    (M.getOrInsertFunction ("poolcheckui_batch",
+                            VoidType, EntryPtrType, Int32Type, NULL));
+  if (!BatchFunc || !BatchUIFunc)
+    return false;
+
+  SourceFiles.clear();
+  bool modified = false;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F)
+    if (!F->isDeclaration())
+      modified |= batchFunction (*F);
+
+  //
+  // Do not leave declarations of the batch functions in modules without
+  // batches.
+  //
+  if (BatchFunc->use_empty())
+    BatchFunc->eraseFromParent();
+  if (BatchUIFunc->use_empty())
+    BatchUIFunc->eraseFromParent();
+  return modified;
+}
+
+}
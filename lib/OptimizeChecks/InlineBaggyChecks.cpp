@@ -0,0 +1,562 @@
+//===- InlineBaggyChecks.cpp - Inline baggy bounds checks -----------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass expands the checks of the baggy bounds run-time into inline code.
+// A load/store check of len bytes at ptr becomes:
+//
+//   e = fine[ptr >> 4] ? fine[ptr >> 4] : coarse[ptr >> 20];
+//   if (e != 0) {
+//     start = ptr & -(1 << e);
+//     size = ((BBMetaData *) (start + (1 << e)) - 1)->size;
+//     if (ptr - start + len <= size)
+//       goto done;
+//   } else if (!(InvalidLower < ptr && ptr < InvalidUpper)) {
+//     goto done;
+//   }
+//   poolcheck (...);                // in a block at the end of the function
+// done:
+//
+// A bounds check compares both the source and the result pointer with the
+// object in which the source pointer lies, or, if the source pointer is in
+// no object, tests whether it is a rewritten pointer as the load/store check
+// does.  An exact check compares the result pointer with the bounds that it
+// is given.  The calls to the run-time are kept for the pointers that the
+// inline code finds out of bounds or rewritten; the run-time then rewrites
+// them, translates them back, or reports the error.
+//
+// On 64-bit targets, the run-time tags most out-of-bounds pointers by setting
+// their top bit.  Such pointers have no entry in the size table, so the
+// load/store and bounds checks send every negative pointer to the run-time
+// before they look up its size.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "inline-baggy-checks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/MDBuilder.h"
+
+#include "safecode/InlineBaggyChecks.h"
+
+#include <vector>
+
+namespace {
+  STATISTIC (InlinedLSChecks, "Number of load/store checks inlined");
+  STATISTIC (InlinedBoundsChecks, "Number of bounds checks inlined");
+  STATISTIC (InlinedExactChecks, "Number of exact checks inlined");
+}
+
+namespace llvm {
+
+char InlineBaggyChecks::ID = 0;
+
+static RegisterPass<InlineBaggyChecks>
+X ("inline-baggy-checks", "Inline baggy bounds run-time checks");
+
+//
+// Binary logarithms of the granularity of the fine and coarse size tables.
+// These must match SLOT_SIZE and COARSE_SLOT_SIZE in the baggy bounds
+// run-time.
+//
+static const unsigned SlotLog = 4;
+static const unsigned CoarseSlotLog = 16;
+
+//
+// The run-time does not check bounds within objects of more than 2^12 bytes,
+// as it cannot align such objects on every system.
+//
+static const unsigned MaxBoundsLog = 12;
+
+enum CheckKind {
+  LSCheck,
+  BoundsCheck,
+  ExactCheck
+};
+
+//
+// The checks of the baggy bounds run-time.  The checks that compiled code
+// calls and the ones that the run-time gives C linkage are both included.
+// Load/store checks without debug information check a single byte.
+//
+static const struct {
+  const char * Name;
+  CheckKind Kind;
+} Checks[] = {
+  {"bb_poolcheck",           LSCheck},
+  {"bb_poolcheckui",         LSCheck},
+  {"bb_poolcheck_debug",     LSCheck},
+  {"bb_poolcheckui_debug",   LSCheck},
+  {"poolcheckui_debug",      LSCheck},
+  {"bb_boundscheck",         BoundsCheck},
+  {"bb_boundscheckui",       BoundsCheck},
+  {"bb_boundscheck_debug",   BoundsCheck},
+  {"bb_boundscheckui_debug", BoundsCheck},
+  {"boundscheckui_debug",    BoundsCheck},
+  {"bb_exactcheck2",         ExactCheck},
+  {"bb_exactcheck2_debug",   ExactCheck},
+  {"exactcheck2_debug",      ExactCheck},
+  {0, LSCheck}
+};
+
+//
+// Function: hasCheckType()
+//
+// Description:
+//  Determine whether a function has the argument types of a run-time check of
+//  the given kind.
+//
+static bool
+hasCheckType (Function * F, CheckKind Kind) {
+  FunctionType * FTy = F->getFunctionType();
+  switch (Kind) {
+    case LSCheck:
+      return (FTy->getNumParams() >= 2) &&
+             FTy->getParamType (1)->isPointerTy() &&
+             ((FTy->getNumParams() == 2) ||
+              FTy->getParamType (2)->isIntegerTy());
+
+    case BoundsCheck:
+      return (FTy->getNumParams() >= 3) &&
+             FTy->getParamType (1)->isPointerTy() &&
+             FTy->getParamType (2)->isPointerTy() &&
+             FTy->getReturnType()->isPointerTy();
+
+    case ExactCheck:
+      return (FTy->getNumParams() >= 4) &&
+             FTy->getParamType (1)->isPointerTy() &&
+             FTy->getParamType (2)->isPointerTy() &&
+             FTy->getParamType (3)->isIntegerTy() &&
+             FTy->getReturnType()->isPointerTy();
+  }
+  return false;
+}
+
+//
+// Function: splitCheck()
+//
+// Description:
+//  Move a check into a block of its own at the end of its function.  The
+//  block that held the check branches to it, and it branches to a new block
+//  holding the instructions that followed the check.
+//
+static void
+splitCheck (CallInst * CI, BasicBlock *& Slow, BasicBlock *& Done) {
+  BasicBlock * Head = CI->getParent();
+  Slow = Head->splitBasicBlock (CI, "baggy.slow");
+  BasicBlock::iterator After = CI;
+  ++After;
+  Done = Slow->splitBasicBlock (After, "baggy.done");
+  Slow->moveAfter (&(Head->getParent()->back()));
+}
+
+//
+// Function: branchTo()
+//
+// Description:
+//  Replace the terminator of a block with a branch that usually goes to the
+//  Likely block.
+//
+static void
+branchTo (BasicBlock * BB, Value * Cond,
+          BasicBlock * Likely, BasicBlock * Unlikely, bool LikelyIfTrue) {
+  Instruction * Term = BB->getTerminator();
+  BranchInst * Branch;
+  MDNode * Weights;
+  MDBuilder MDB (BB->getContext());
+  if (LikelyIfTrue) {
+    Branch = BranchInst::Create (Likely, Unlikely, Cond, Term);
+    Weights = MDB.createBranchWeights (64, 1);
+  } else {
+    Branch = BranchInst::Create (Unlikely, Likely, Cond, Term);
+    Weights = MDB.createBranchWeights (1, 64);
+  }
+  Branch->setMetadata (LLVMContext::MD_prof, Weights);
+  Term->eraseFromParent();
+}
+
+//
+// Method: lookupSize()
+//
+// Description:
+//  Add code that loads the binary logarithm of the size of the object that
+//  covers the given address from the baggy bounds table, as lookupSize() in
+//  the run-time does.  The result is 0 if there is no such object.
+//
+Value *
+InlineBaggyChecks::lookupSize (Value * Ptr, Instruction * InsertPt) {
+  Type * IntPtrType = Ptr->getType();
+  Type * Int8Type = Type::getInt8Ty (Ptr->getContext());
+
+  Value * Tables[] = {SizeTable, CoarseTable};
+  unsigned Logs[] = {SlotLog, CoarseSlotLog};
+  Value * Entries[2];
+  for (unsigned index = 0; index < 2; ++index) {
+    Value * Table = new LoadInst (Tables[index], "baggy.table", InsertPt);
+    Value * Slot = BinaryOperator::CreateLShr (Ptr,
+                                               ConstantInt::get (IntPtrType,
+                                                                 Logs[index]),
+                                               "",
+                                               InsertPt);
+    Value * Entry = GetElementPtrInst::CreateInBounds (Table, Slot,
+                                                       "", InsertPt);
+    Entries[index] = new LoadInst (Entry, "", InsertPt);
+  }
+
+  Value * IsFine = new ICmpInst (InsertPt,
+                                 ICmpInst::ICMP_NE,
+                                 Entries[0],
+                                 ConstantInt::get (Int8Type, 0));
+  return SelectInst::Create (IsFine, Entries[0], Entries[1],
+                             "baggy.log", InsertPt);
+}
+
+//
+// Method: loadObjectSize()
+//
+// Description:
+//  Add code that finds the start of the object of 2^Size bytes in which the
+//  given address lies and loads the size recorded in its metadata.
+//
+Value *
+InlineBaggyChecks::loadObjectSize (Value * Ptr, Value * Size, Value *& Start,
+                                   Instruction * InsertPt) {
+  LLVMContext & Context = Ptr->getContext();
+  Type * IntPtrType = Ptr->getType();
+  Type * Int32Type = Type::getInt32Ty (Context);
+
+  Value * Log = new ZExtInst (Size, IntPtrType, "", InsertPt);
+  Value * SlotBytes = BinaryOperator::CreateShl (ConstantInt::get (IntPtrType,
+                                                                   1),
+                                                 Log,
+                                                 "",
+                                                 InsertPt);
+  Value * Mask = BinaryOperator::CreateNeg (SlotBytes, "", InsertPt);
+  Start = BinaryOperator::CreateAnd (Ptr, Mask, "baggy.start", InsertPt);
+
+  Value * End = BinaryOperator::CreateAdd (Start, SlotBytes, "", InsertPt);
+  Value * MetaData = BinaryOperator::CreateSub (End,
+                                                ConstantInt::get (IntPtrType,
+                                                                  MetaDataSize),
+                                                "",
+                                                InsertPt);
+  Value * SizePtr = new IntToPtrInst (MetaData,
+                                      PointerType::getUnqual (Int32Type),
+                                      "",
+                                      InsertPt);
+  LoadInst * ObjSize = new LoadInst (SizePtr, "baggy.objsize", InsertPt);
+  ObjSize->setAlignment (TD->getABITypeAlignment (Int32Type));
+  return new ZExtInst (ObjSize, IntPtrType, "", InsertPt);
+}
+
+//
+// Method: checkTag()
+//
+// Description:
+//  On 64-bit targets, add code to the end of the Head block that sends tagged
+//  out-of-bounds pointers, whose top bit is set, to the Slow block.  Return
+//  the block in which the check continues for other pointers.
+//
+BasicBlock *
+InlineBaggyChecks::checkTag (BasicBlock * Head, Value * Ptr,
+                             BasicBlock * Slow, BasicBlock * Before) {
+  if (TD->getPointerSizeInBits() != 64)
+    return Head;
+
+  BasicBlock * Lookup = BasicBlock::Create (Head->getContext(),
+                                            "baggy.lookup",
+                                            Head->getParent(),
+                                            Before);
+  BranchInst::Create (Before, Lookup);
+  Value * IsTagged = new ICmpInst (Head->getTerminator(),
+                                   ICmpInst::ICMP_SLT,
+                                   Ptr,
+                                   ConstantInt::get (Ptr->getType(), 0));
+  branchTo (Head, IsTagged, Lookup, Slow, false);
+  return Lookup;
+}
+
+//
+// Method: isRewritten()
+//
+// Description:
+//  Add code that determines whether the given address lies in the range of
+//  rewritten out-of-bounds pointers.
+//
+Value *
+InlineBaggyChecks::isRewritten (Value * Ptr, Instruction * InsertPt) {
+  LoadInst * Lower = new LoadInst (InvalidLower, "", InsertPt);
+  LoadInst * Upper = new LoadInst (InvalidUpper, "", InsertPt);
+  Lower->setAlignment (TD->getABITypeAlignment (Ptr->getType()));
+  Upper->setAlignment (TD->getABITypeAlignment (Ptr->getType()));
+  return BinaryOperator::CreateAnd (
+    new ICmpInst (InsertPt, ICmpInst::ICMP_ULT, Lower, Ptr),
+    new ICmpInst (InsertPt, ICmpInst::ICMP_ULT, Ptr, Upper),
+    "baggy.rewritten",
+    InsertPt);
+}
+
+//
+// Method: inlineLSCheck()
+//
+// Description:
+//  Perform a load/store check inline.  Pointers into registered objects
+//  pass if the bytes accessed are within the object; pointers outside of all
+//  registered objects pass unless they are rewritten out-of-bounds pointers.
+//
+void
+InlineBaggyChecks::inlineLSCheck (CallInst * CI) {
+  Function * F = CI->getParent()->getParent();
+  LLVMContext & Context = F->getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+
+  BasicBlock * Head = CI->getParent();
+  BasicBlock * Slow;
+  BasicBlock * Done;
+  splitCheck (CI, Slow, Done);
+  BasicBlock * Check = BasicBlock::Create (Context, "baggy.check", F, Done);
+  BasicBlock * Unreg = BasicBlock::Create (Context, "baggy.unreg", F, Done);
+
+  //
+  // Look up the size of the object that the pointer points into.
+  //
+  Value * Ptr = new PtrToIntInst (CI->getArgOperand (1), IntPtrType,
+                                  "", Head->getTerminator());
+  BasicBlock * Lookup = checkTag (Head, Ptr, Slow, Check);
+  Instruction * Term = Lookup->getTerminator();
+  Value * Size = lookupSize (Ptr, Term);
+  Value * IsReg = new ICmpInst (Term,
+                                ICmpInst::ICMP_NE,
+                                Size,
+                                ConstantInt::get (Size->getType(), 0));
+  branchTo (Lookup, IsReg, Check, Unreg, true);
+
+  //
+  // Check that the last byte accessed is within the object.
+  //
+  Term = BranchInst::Create (Done, Check);
+  Value * Length = ConstantInt::get (IntPtrType, 1);
+  if (CI->getNumArgOperands() > 2)
+    Length = new ZExtInst (CI->getArgOperand (2), IntPtrType, "", Term);
+  Value * Start;
+  Value * ObjSize = loadObjectSize (Ptr, Size, Start, Term);
+  Value * Offset = BinaryOperator::CreateSub (Ptr, Start, "", Term);
+  Value * Last = BinaryOperator::CreateAdd (Offset, Length, "", Term);
+  Value * Within = new ICmpInst (Term, ICmpInst::ICMP_ULE, Last, ObjSize);
+  branchTo (Check, Within, Done, Slow, true);
+
+  //
+  // Only rewritten out-of-bounds pointers fail outside of objects.
+  //
+  Term = BranchInst::Create (Done, Unreg);
+  Value * IsRewritten = isRewritten (Ptr, Term);
+  branchTo (Unreg, IsRewritten, Done, Slow, false);
+
+  ++InlinedLSChecks;
+}
+
+//
+// Method: inlineBoundsCheck()
+//
+// Description:
+//  Perform a bounds check inline.  The check passes if both the source and
+//  the result pointer are within the object that the source pointer points
+//  into, or if the run-time would not check the object.  A source pointer
+//  that is a rewritten out-of-bounds pointer is left to the run-time, which
+//  translates the result back into a real pointer.
+//
+void
+InlineBaggyChecks::inlineBoundsCheck (CallInst * CI) {
+  Function * F = CI->getParent()->getParent();
+  LLVMContext & Context = F->getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+
+  BasicBlock * Head = CI->getParent();
+  BasicBlock * Slow;
+  BasicBlock * Done;
+  splitCheck (CI, Slow, Done);
+  BasicBlock * Check = BasicBlock::Create (Context, "baggy.check", F, Done);
+  BasicBlock * Unchecked = BasicBlock::Create (Context, "baggy.unchecked",
+                                               F, Done);
+
+  //
+  // Pointers outside of registered objects and pointers into objects that
+  // are too large to be checked have a size that is not between 1 and
+  // MaxBoundsLog.
+  //
+  Instruction * Term = Head->getTerminator();
+  Value * Dest = CI->getArgOperand (2);
+  if (Dest->getType() != CI->getType())
+    Dest = new BitCastInst (Dest, CI->getType(), "", Term);
+  Value * Source = new PtrToIntInst (CI->getArgOperand (1), IntPtrType,
+                                     "", Term);
+  BasicBlock * Lookup = checkTag (Head, Source, Slow, Check);
+  Term = Lookup->getTerminator();
+  Value * Size = lookupSize (Source, Term);
+  Value * SizeLess1 = BinaryOperator::CreateSub (Size,
+                                                 ConstantInt::get (
+                                                   Size->getType(), 1),
+                                                 "",
+                                                 Term);
+  Value * IsUnchecked = new ICmpInst (Term,
+                                      ICmpInst::ICMP_UGE,
+                                      SizeLess1,
+                                      ConstantInt::get (Size->getType(),
+                                                        MaxBoundsLog));
+  branchTo (Lookup, IsUnchecked, Check, Unchecked, false);
+
+  //
+  // Such pointers pass unless they are rewritten out-of-bounds pointers,
+  // which are outside of all registered objects.
+  //
+  Term = BranchInst::Create (Done, Unchecked);
+  Value * IsUnreg = new ICmpInst (Term,
+                                  ICmpInst::ICMP_EQ,
+                                  Size,
+                                  ConstantInt::get (Size->getType(), 0));
+  Value * IsRewritten = BinaryOperator::CreateAnd (IsUnreg,
+                                                   isRewritten (Source, Term),
+                                                   "",
+                                                   Term);
+  branchTo (Unchecked, IsRewritten, Done, Slow, false);
+
+  //
+  // Check that both pointers are within the object.
+  //
+  Term = BranchInst::Create (Done, Check);
+  Value * Start;
+  Value * ObjSize = loadObjectSize (Source, Size, Start, Term);
+  Value * Result = new PtrToIntInst (CI->getArgOperand (2), IntPtrType,
+                                     "", Term);
+  Value * SourceOffset = BinaryOperator::CreateSub (Source, Start, "", Term);
+  Value * ResultOffset = BinaryOperator::CreateSub (Result, Start, "", Term);
+  Value * Within = BinaryOperator::CreateAnd (
+    new ICmpInst (Term, ICmpInst::ICMP_ULT, SourceOffset, ObjSize),
+    new ICmpInst (Term, ICmpInst::ICMP_ULT, ResultOffset, ObjSize),
+    "",
+    Term);
+  branchTo (Check, Within, Done, Slow, true);
+
+  //
+  // The check returns the result pointer unless the run-time rewrites it.
+  //
+  if (!CI->use_empty()) {
+    PHINode * Checked = PHINode::Create (CI->getType(), 3, "baggy.checked",
+                                         &Done->front());
+    CI->replaceAllUsesWith (Checked);
+    Checked->addIncoming (Dest, Unchecked);
+    Checked->addIncoming (Dest, Check);
+    Checked->addIncoming (CI, Slow);
+  }
+
+  ++InlinedBoundsChecks;
+}
+
+//
+// Method: inlineExactCheck()
+//
+// Description:
+//  Perform an exact check inline.  The check passes if the result pointer is
+//  within the bounds given to it.
+//
+void
+InlineBaggyChecks::inlineExactCheck (CallInst * CI) {
+  LLVMContext & Context = CI->getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+
+  BasicBlock * Head = CI->getParent();
+  BasicBlock * Slow;
+  BasicBlock * Done;
+  splitCheck (CI, Slow, Done);
+
+  Instruction * Term = Head->getTerminator();
+  Value * Dest = CI->getArgOperand (2);
+  if (Dest->getType() != CI->getType())
+    Dest = new BitCastInst (Dest, CI->getType(), "", Term);
+  Value * Base = new PtrToIntInst (CI->getArgOperand (1), IntPtrType,
+                                   "", Term);
+  Value * Result = new PtrToIntInst (CI->getArgOperand (2), IntPtrType,
+                                     "", Term);
+  Value * Size = new ZExtInst (CI->getArgOperand (3), IntPtrType, "", Term);
+  Value * Offset = BinaryOperator::CreateSub (Result, Base, "", Term);
+  Value * Within = new ICmpInst (Term, ICmpInst::ICMP_ULT, Offset, Size);
+  branchTo (Head, Within, Done, Slow, true);
+
+  if (!CI->use_empty()) {
+    PHINode * Checked = PHINode::Create (CI->getType(), 2, "baggy.checked",
+                                         &Done->front());
+    CI->replaceAllUsesWith (Checked);
+    Checked->addIncoming (Dest, Head);
+    Checked->addIncoming (CI, Slow);
+  }
+
+  ++InlinedExactChecks;
+}
+
+bool
+InlineBaggyChecks::runOnModule (Module & M) {
+  TD = &getAnalysis<DataLayout>();
+
+  //
+  // Find the calls to the checks.
+  //
+  std::vector<std::pair<CallInst *, CheckKind> > Calls;
+  for (unsigned index = 0; Checks[index].Name; ++index) {
+    Function * F = M.getFunction (Checks[index].Name);
+    if (!F || !hasCheckType (F, Checks[index].Kind))
+      continue;
+
+    for (Value::use_iterator U = F->use_begin(); U != F->use_end(); ++U)
+      if (CallInst * CI = dyn_cast<CallInst>(*U))
+        if (CI->getCalledValue() == F)
+          Calls.push_back (std::make_pair (CI, Checks[index].Kind));
+  }
+
+  if (Calls.empty())
+    return false;
+
+  //
+  // Get the tables and the globals of the run-time that the checks read.
+  //
+  LLVMContext & Context = M.getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+  Type * VoidPtrType = Type::getInt8PtrTy (Context);
+  SizeTable = M.getOrInsertGlobal ("__baggybounds_size_table_begin",
+                                   VoidPtrType);
+  CoarseTable = M.getOrInsertGlobal ("__baggybounds_coarse_table_begin",
+                                     VoidPtrType);
+  InvalidLower = M.getOrInsertGlobal ("InvalidLower", IntPtrType);
+  InvalidUpper = M.getOrInsertGlobal ("InvalidUpper", IntPtrType);
+
+  //
+  // The metadata of an object (BBMetaData) holds its size and its pool.
+  //
+  Type * MetaDataType = StructType::get (Type::getInt32Ty (Context),
+                                         VoidPtrType,
+                                         NULL);
+  MetaDataSize = TD->getTypeAllocSize (MetaDataType);
+
+  for (unsigned index = 0; index < Calls.size(); ++index) {
+    switch (Calls[index].second) {
+      case LSCheck:
+        inlineLSCheck (Calls[index].first);
+        break;
+      case BoundsCheck:
+        inlineBoundsCheck (Calls[index].first);
+        break;
+      case ExactCheck:
+        inlineExactCheck (Calls[index].first);
+        break;
+    }
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,287 @@
+//===- ParallelChecks.cpp - Run checks on checker threads -----------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass makes the program hand its run-time checks to the checker threads
+// of the debug run-time.  Every check and registration is replaced with its
+// __sc_par_* version, which takes the same arguments without the debug
+// information; the checker threads report violations without a source
+// location.
+//
+// A violation that the checker threads have not found yet must not escape the
+// program, so the pass inserts a wait for the checker threads before every
+// call that may have an effect outside the program.  Calls to functions that
+// are defined in the module need no wait since the calls within them have
+// their own; neither do calls to intrinsics, to functions that only read
+// memory, and to the checks that stay synchronous (fastlscheck and funccheck
+// do not use the object registry).  Every other external function needs a
+// wait, including the allocators, which may update the object registry that
+// the checker threads use.  Within a block, a wait is only inserted if a
+// check may have been sent since the last wait.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "parallel-checks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CallSite.h"
+
+#include "safecode/ParallelChecks.h"
+
+#include <vector>
+
+namespace {
+  STATISTIC (SentChecks, "Number of checks sent to checker threads");
+  STATISTIC (Waits,      "Number of waits for the checker threads");
+}
+
+namespace llvm {
+
+char ParallelChecks::ID = 0;
+
+static RegisterPass<ParallelChecks>
+X ("sc-parallel-checks", "Run run-time checks on checker threads");
+
+//
+// The checks and registrations sent to the checker threads, their parallel
+// versions, and the number of arguments that the parallel versions take.  The
+// initialization of the run-time is replaced so that it starts the checker
+// threads.
+//
+static const struct {
+  const char * Name;
+  const char * ParName;
+  unsigned NumArgs;
+} Checks[] = {
+  {"pool_init_runtime",           "__sc_par_pool_init_runtime",     3},
+  {"poolargvregister",            "__sc_par_poolargvregister",      2},
+  {"pool_register",               "__sc_par_pool_register",         3},
+  {"pool_register_debug",         "__sc_par_pool_register",         3},
+  {"pool_register_stack",         "__sc_par_pool_register_stack",   3},
+  {"pool_register_stack_debug",   "__sc_par_pool_register_stack",   3},
+  {"pool_register_global",        "__sc_par_pool_register_global",  3},
+  {"pool_register_global_debug",  "__sc_par_pool_register_global",  3},
+  {"pool_reregister",             "__sc_par_pool_reregister",       4},
+  {"pool_reregister_debug",       "__sc_par_pool_reregister",       4},
+  {"pool_unregister",             "__sc_par_pool_unregister",       2},
+  {"pool_unregister_debug",       "__sc_par_pool_unregister",       2},
+  {"pool_unregister_stack",       "__sc_par_pool_unregister_stack", 2},
+  {"pool_unregister_stack_debug", "__sc_par_pool_unregister_stack", 2},
+  {"poolcheck",                   "__sc_par_poolcheck",             3},
+  {"poolcheck_debug",             "__sc_par_poolcheck",             3},
+  {"poolcheckui",                 "__sc_par_poolcheckui",           3},
+  {"poolcheckui_debug",           "__sc_par_poolcheckui",           3},
+  {"poolcheckalign",              "__sc_par_poolcheckalign",        3},
+  {"poolcheckalign_debug",        "__sc_par_poolcheckalign",        3},
+  {"boundscheck",                 "__sc_par_boundscheck",           3},
+  {"boundscheck_debug",           "__sc_par_boundscheck",           3},
+  {"boundscheckui",               "__sc_par_boundscheckui",         3},
+  {"boundscheckui_debug",         "__sc_par_boundscheckui",         3},
+  {"exactcheck2",                 "__sc_par_exactcheck2",           4},
+  {"exactcheck2_debug",           "__sc_par_exactcheck2",           4},
+  {"poolcheck_free",              "__sc_par_poolcheck_free",        2},
+  {"poolcheck_free_debug",        "__sc_par_poolcheck_free",        2},
+  {"poolcheck_freeui",            "__sc_par_poolcheck_freeui",      2},
+  {"poolcheck_freeui_debug",      "__sc_par_poolcheck_freeui",      2},
+  {0, 0, 0}
+};
+
+// The prefix of the functions of the run-time that send checks
+static const char * const ParPrefix = "__sc_par_";
+
+//
+// External functions that need no wait for the checker threads: the checks
+// that stay synchronous and the helpers of the lowered checks.
+//
+static const char * const SafeFunctions[] = {
+  "fastlscheck",
+  "fastlscheck_debug",
+  "funccheck",
+  "funccheck_debug",
+  "funccheckui",
+  "funccheckui_debug",
+  "pchk_getActualValue",
+  "__sc_sample_begin",
+  "__sc_sample_end",
+  0
+};
+
+//
+// Method: isSafeCallee()
+//
+// Description:
+//  Determine whether a call to the given external function can be made
+//  without waiting for the checker threads.
+//
+bool
+ParallelChecks::isSafeCallee (const Function * F) const {
+  if (F->isIntrinsic() || F->onlyReadsMemory())
+    return true;
+
+  StringRef Name = F->getName();
+  if (Name.startswith (ParPrefix))
+    return true;
+  for (unsigned index = 0; SafeFunctions[index]; ++index)
+    if (Name == SafeFunctions[index])
+      return true;
+  return false;
+}
+
+//
+// Method: sendChecks()
+//
+// Description:
+//  Replace the checks and registrations with their parallel versions.
+//
+bool
+ParallelChecks::sendChecks (Module & M) {
+  bool modified = false;
+  for (unsigned index = 0; Checks[index].Name; ++index) {
+    Function * F = M.getFunction (Checks[index].Name);
+    if (!F)
+      continue;
+
+    FunctionType * FTy = F->getFunctionType();
+    unsigned NumArgs = Checks[index].NumArgs;
+    if (FTy->getNumParams() < NumArgs)
+      continue;
+
+    std::vector<Type *> Params (FTy->param_begin(),
+                                FTy->param_begin() + NumArgs);
+    FunctionType * ParType = FunctionType::get (FTy->getReturnType(),
+                                                Params,
+                                                false);
+    Function * ParCheck = dyn_cast<Function>
+      (M.getOrInsertFunction (Checks[index].ParName, ParType));
+    if (!ParCheck)
+      continue;
+
+    std::vector<CallInst *> Calls;
+    for (Value::use_iterator U = F->use_begin(); U != F->use_end(); ++U)
+      if (CallInst * CI = dyn_cast<CallInst>(*U))
+        if (CI->getCalledValue() == F)
+          Calls.push_back (CI);
+
+    for (unsigned i = 0; i < Calls.size(); ++i) {
+      CallInst * CI = Calls[i];
+      std::vector<Value *> Args;
+      for (unsigned arg = 0; arg < NumArgs; ++arg)
+        Args.push_back (CI->getArgOperand (arg));
+      CallInst * NewCall = CallInst::Create (ParCheck, Args, "", CI);
+      NewCall->setCallingConv (CI->getCallingConv());
+      NewCall->setDebugLoc (CI->getDebugLoc());
+      NewCall->takeName (CI);
+      CI->replaceAllUsesWith (NewCall);
+      CI->eraseFromParent();
+      ++SentChecks;
+    }
+    modified |= !Calls.empty();
+  }
+
+  return modified;
+}
+
+//
+// Method: insertWaits()
+//
+// Description:
+//  Insert a wait for the checker threads before every call in the function
+//  that needs one.
+//
+bool
+ParallelChecks::insertWaits (Function & F) {
+  bool modified = false;
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB) {
+    //
+    // Whether a check may have been sent since the last wait.  Checks may
+    // have been sent before the block was entered.
+    //
+    bool Pending = true;
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      CallSite CS (I);
+      if (!CS)
+        continue;
+
+      bool NeedsWait;
+      if (CS.isInlineAsm()) {
+        NeedsWait = true;
+      } else {
+        Value * Called = CS.getCalledValue()->stripPointerCasts();
+        Function * Callee = dyn_cast<Function>(Called);
+        if (Callee == WaitFunc) {
+          Pending = false;
+          continue;
+        }
+
+        if (!Callee)
+          NeedsWait = UnsafeIndirectCalls;
+        else if (!Callee->isDeclaration())
+          NeedsWait = false;
+        else if (isSafeCallee (Callee))
+          NeedsWait = false;
+        else
+          NeedsWait = true;
+
+        //
+        // A function of the program or a parallel check may send checks.
+        //
+        if (!NeedsWait) {
+          if (!Callee ||
+              !Callee->isDeclaration() ||
+              Callee->getName().startswith (ParPrefix))
+            Pending = true;
+          continue;
+        }
+      }
+
+      if (Pending) {
+        CallInst::Create (WaitFunc, "", I);
+        ++Waits;
+        modified = true;
+      }
+
+      //
+      // The external function may call back into the program, which may send
+      // more checks.
+      //
+      Pending = true;
+    }
+  }
+
+  return modified;
+}
+
+bool
+ParallelChecks::runOnModule (Module & M) {
+  bool modified = sendChecks (M);
+
+  //
+  // Insert the waits even if this module sends no checks itself: the checks
+  // sent by the other modules of the program must not be outrun either.
+  //
+  Type * VoidType = Type::getVoidTy (M.getContext());
+  WaitFunc = cast<Function>
+    (M.getOrInsertFunction ("__sc_par_wait_for_completion", VoidType, NULL));
+
+  //
+  // An indirect call needs a wait if it may call an external function that
+  // needs one.
+  //
+  UnsafeIndirectCalls = false;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F)
+    if (F->isDeclaration() && !isSafeCallee (F) && F->hasAddressTaken())
+      UnsafeIndirectCalls = true;
+
+  for (Module::iterator F = M.begin(); F != M.end(); ++F)
+    if (!F->isDeclaration())
+      modified |= insertWaits (*F);
+
+  return modified;
+}
+
+}
@@ -0,0 +1,463 @@
+//===- ProfileGuidedChecks.cpp - Optimize checks with a profile -----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass reads the check profile written by the debug run-time and
+// optimizes the check sites that account for most of the time spent in checks.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "profile-checks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "safecode/ProfileGuidedChecks.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <vector>
+
+namespace {
+  STATISTIC (HotSites,  "Number of hot check sites");
+  STATISTIC (ColdSites, "Number of cold or unprofiled check sites");
+  STATISTIC (Hoisted,   "Number of hot checks hoisted out of loops");
+  STATISTIC (Inlined,   "Number of hot checks with inlined fast paths");
+}
+
+namespace llvm {
+
+char ProfileGuidedChecks::ID = 0;
+
+static RegisterPass<ProfileGuidedChecks>
+X ("sc-profile-checks", "Optimize run-time checks with a check profile");
+
+static cl::opt<std::string>
+CheckProfile ("sc-check-profile",
+              cl::desc ("Check profile written by the debug run-time"),
+              cl::init (""));
+
+static cl::opt<unsigned>
+HotPercent ("sc-hot-check-percent",
+            cl::desc ("Percentage of the profiled check cost that the hot "
+                      "check sites account for"),
+            cl::init (90));
+
+//
+// The debug versions of the run-time checks that this pass knows about.  The
+// kind of a check is the name under which the run-time profiles it.
+//
+struct CheckInfo {
+  const char * Name;
+  const char * Kind;
+
+  // Whether the fast path of the check can be inlined
+  bool InlineFastPath;
+
+  // Whether the check returns the pointer that it checked
+  bool ReturnsPointer;
+};
+
+static const CheckInfo Checks[] = {
+  {"poolcheck_debug",      "poolcheck",      false, false},
+  {"poolcheckui_debug",    "poolcheckui",    false, false},
+  {"poolcheckalign_debug", "poolcheckalign", false, false},
+  {"boundscheck_debug",    "boundscheck",    false, true},
+  {"boundscheckui_debug",  "boundscheckui",  false, true},
+  {"exactcheck2_debug",    "exactcheck2",    true,  true},
+  {"fastlscheck_debug",    "fastlscheck",    true,  false},
+  {"funccheck_debug",      "funccheck",      false, false},
+  {"funccheckui_debug",    "funccheckui",    false, false},
+  {0, 0, false, false}
+};
+
+//
+// How much more a lookup of each kind costs than the call to the check; see
+// CheckCost in the debug run-time.
+//
+static const double CostWeights[] = {1.0, 8.0, 8.0, 32.0};
+
+//
+// Function: findCheck()
+//
+// Description:
+//  Find the description of the run-time check that the given function
+//  implements.
+//
+// Return value:
+//  NULL     - The function is not a run-time check that this pass knows about.
+//  Otherwise, the description of the check is returned.
+//
+static const CheckInfo *
+findCheck (const Function * F) {
+  if (!F)
+    return 0;
+
+  for (const CheckInfo * Info = Checks; Info->Name; ++Info)
+    if (F->getName() == Info->Name)
+      return Info;
+  return 0;
+}
+
+//
+// Method: readProfile()
+//
+// Description:
+//  Read the check profile and find the cost at which a check site is hot.  The
+//  counts of a site that appears several times in the profile are added up.
+//
+// Return value:
+//  true  - The profile was read and contains at least one site.
+//  false - The profile could not be read or is empty.
+//
+bool
+ProfileGuidedChecks::readProfile (void) {
+  std::ifstream In (ProfileFilename.c_str());
+  if (!In) {
+    errs() << "SAFECode: Cannot read check profile "
+           << ProfileFilename << "\n";
+    return false;
+  }
+
+  SiteCosts.clear();
+  std::string Line;
+  while (std::getline (In, Line)) {
+    if (Line.empty() || (Line[0] == '#'))
+      continue;
+
+    //
+    // Each line holds the kind, tag, line number, execution count, the count
+    // of lookups of each cost, and the source file of a site.
+    //
+    std::istringstream Fields (Line);
+    SiteKey Key;
+    unsigned long Executions;
+    unsigned long Counts[4];
+    if (!(Fields >> Key.Kind >> Key.tag >> Key.lineno >> Executions
+                 >> Counts[0] >> Counts[1] >> Counts[2] >> Counts[3]))
+      continue;
+    Fields.get();
+    std::getline (Fields, Key.SourceFile);
+
+    double Cost = Executions;
+    for (unsigned index = 0; index < 4; ++index)
+      Cost += CostWeights[index] * Counts[index];
+    SiteCosts[Key] += Cost;
+  }
+
+  if (SiteCosts.empty())
+    return false;
+
+  //
+  // The hot sites are the most costly sites that together account for the
+  // requested percentage of the total cost.
+  //
+  std::vector<double> Costs;
+  double Total = 0;
+  for (std::map<SiteKey, double>::iterator i = SiteCosts.begin();
+       i != SiteCosts.end(); ++i) {
+    Costs.push_back (i->second);
+    Total += i->second;
+  }
+  std::sort (Costs.begin(), Costs.end(), std::greater<double>());
+
+  double Covered = 0;
+  double Goal = Total * std::min (HotPercent.getValue(), 100u) / 100.0;
+  HotThreshold = Costs[0];
+  for (unsigned index = 0; index < Costs.size(); ++index) {
+    if (Covered >= Goal)
+      break;
+    HotThreshold = Costs[index];
+    Covered += Costs[index];
+  }
+
+  return true;
+}
+
+//
+// Method: getSiteKey()
+//
+// Description:
+//  Find the key of a check site from the tag, source file, and line number
+//  that the DebugInstrument pass added to the end of its arguments.
+//
+// Return value:
+//  true  - The key was found.
+//  false - The check does not have constant debug arguments.
+//
+bool
+ProfileGuidedChecks::getSiteKey (CallInst * CI, const char * Kind,
+                                 SiteKey & Key) {
+  unsigned NumArgs = CI->getNumArgOperands();
+  if (NumArgs < 3)
+    return false;
+
+  ConstantInt * Tag = dyn_cast<ConstantInt>(CI->getArgOperand (NumArgs - 3));
+  ConstantInt * Line = dyn_cast<ConstantInt>(CI->getArgOperand (NumArgs - 1));
+  if (!Tag || !Line)
+    return false;
+
+  StringRef SourceFile;
+  Value * File = CI->getArgOperand (NumArgs - 2)->stripPointerCasts();
+  if (!getConstantStringInfo (File, SourceFile))
+    SourceFile = "<unknown>";
+
+  Key.Kind = Kind;
+  Key.tag = Tag->getZExtValue();
+  Key.lineno = Line->getZExtValue();
+  Key.SourceFile = SourceFile.str();
+  return true;
+}
+
+//
+// Method: loopMayFree()
+//
+// Description:
+//  Determine whether a loop may free memory.  Any call to a function other
+//  than a run-time check or an intrinsic is assumed to free memory.
+//
+bool
+ProfileGuidedChecks::loopMayFree (Loop * L) {
+  std::map<Loop *, bool>::iterator Cached = LoopMayFree.find (L);
+  if (Cached != LoopMayFree.end())
+    return Cached->second;
+
+  bool MayFree = false;
+  for (Loop::block_iterator BB = L->block_begin();
+       !MayFree && BB != L->block_end(); ++BB) {
+    for (BasicBlock::iterator I = (*BB)->begin(); I != (*BB)->end(); ++I) {
+      if (!isa<CallInst>(I) && !isa<InvokeInst>(I))
+        continue;
+      Function * F = CallSite (&*I).getCalledFunction();
+      if (!F || !(F->isIntrinsic() || findCheck (F))) {
+        MayFree = true;
+        break;
+      }
+    }
+  }
+
+  return LoopMayFree[L] = MayFree;
+}
+
+//
+// Method: hoistCheck()
+//
+// Description:
+//  Move a check of loop invariant values out of a loop and into its preheader.
+//  The check must be executed every time the loop is entered, so only checks
+//  in the loop header that are not preceded by side effects are moved, and
+//  the loop must not free the object that is checked.
+//
+// Return value:
+//  true  - The check was moved.
+//  false - The check was left in the loop.
+//
+bool
+ProfileGuidedChecks::hoistCheck (CallInst * CI, Loop * L) {
+  BasicBlock * Preheader = L->getLoopPreheader();
+  if (!Preheader || (CI->getParent() != L->getHeader()))
+    return false;
+
+  for (unsigned index = 0; index < CI->getNumArgOperands(); ++index)
+    if (!L->isLoopInvariant (CI->getArgOperand (index)))
+      return false;
+
+  //
+  // Earlier checks may stay in front of the check; if they fail, the order
+  // of the reports changes but no program state does.
+  //
+  for (BasicBlock::iterator I = L->getHeader()->begin(); &*I != CI; ++I) {
+    if (CallInst * Call = dyn_cast<CallInst>(I))
+      if (findCheck (Call->getCalledFunction()))
+        continue;
+    if (I->mayHaveSideEffects())
+      return false;
+  }
+
+  if (loopMayFree (L))
+    return false;
+
+  CI->moveBefore (Preheader->getTerminator());
+  return true;
+}
+
+//
+// Method: inlineFastPath()
+//
+// Description:
+//  Replace a call to an exactcheck or fastlscheck with a comparison of the
+//  pointer against the bounds of its object.  The run-time is only called
+//  when the comparison fails.
+//
+// Return value:
+//  true  - The fast path was inlined.
+//  false - The check was left alone.
+//
+bool
+ProfileGuidedChecks::inlineFastPath (CallInst * CI, bool ReturnsPointer) {
+  //
+  // exactcheck2 (source, base, result, size) returns the result.
+  // fastlscheck (base, result, size, lslen) returns nothing.
+  //
+  Value * Base;
+  Value * Result;
+  Value * Size;
+  Value * Length = 0;
+  if (ReturnsPointer) {
+    Base   = CI->getArgOperand (1);
+    Result = CI->getArgOperand (2);
+    Size   = CI->getArgOperand (3);
+    if (Result->getType() != CI->getType())
+      return false;
+  } else {
+    Base   = CI->getArgOperand (0);
+    Result = CI->getArgOperand (1);
+    Size   = CI->getArgOperand (2);
+    Length = CI->getArgOperand (3);
+    if (!Length->getType()->isIntegerTy())
+      return false;
+  }
+  if (!Base->getType()->isPointerTy() ||
+      (Result->getType() != Base->getType()) ||
+      !Size->getType()->isIntegerTy())
+    return false;
+
+  //
+  // Split the check into its own block between the fast path and the code
+  // that follows it.
+  //
+  LLVMContext & Context = CI->getContext();
+  BasicBlock * Head = CI->getParent();
+  BasicBlock * Slow = Head->splitBasicBlock (CI, "check.slow");
+  BasicBlock::iterator After = CI;
+  ++After;
+  BasicBlock * Done = Slow->splitBasicBlock (After, "check.done");
+
+  //
+  // The pointer passes if base <= result and result + lslen <= base + size
+  // for a load/store check, or result < base + size for an exactcheck.
+  //
+  Instruction * Term = Head->getTerminator();
+  Type * Int64Type = Type::getInt64Ty (Context);
+  Value * Offset = new ZExtInst (Size, Int64Type, "", Term);
+  Value * Limit = GetElementPtrInst::Create (Base, Offset, "limit", Term);
+  Value * Lower = new ICmpInst (Term, ICmpInst::ICMP_ULE, Base, Result);
+  Value * Upper;
+  if (Length) {
+    Offset = new ZExtInst (Length, Int64Type, "", Term);
+    Value * End = GetElementPtrInst::Create (Result, Offset, "end", Term);
+    Upper = new ICmpInst (Term, ICmpInst::ICMP_ULE, End, Limit);
+  } else {
+    Upper = new ICmpInst (Term, ICmpInst::ICMP_ULT, Result, Limit);
+  }
+  Value * Passed = BinaryOperator::CreateAnd (Lower, Upper, "inbounds", Term);
+
+  //
+  // Checks of hot sites rarely fail, so weight the branch heavily towards the
+  // fast path.
+  //
+  BranchInst * Branch = BranchInst::Create (Done, Slow, Passed, Term);
+  Branch->setMetadata (LLVMContext::MD_prof,
+                       MDBuilder (Context).createBranchWeights (2000, 1));
+  Term->eraseFromParent();
+
+  //
+  // An exactcheck returns the pointer on the fast path and whatever the
+  // run-time returns on the slow path.
+  //
+  if (ReturnsPointer) {
+    PHINode * Checked = PHINode::Create (CI->getType(), 2, "checked",
+                                         &Done->front());
+    CI->replaceAllUsesWith (Checked);
+    Checked->addIncoming (Result, Head);
+    Checked->addIncoming (CI, Slow);
+  }
+
+  return true;
+}
+
+bool
+ProfileGuidedChecks::runOnModule (Module & M) {
+  if (ProfileFilename.empty())
+    ProfileFilename = CheckProfile;
+  if (ProfileFilename.empty() || !readProfile())
+    return false;
+
+  bool modified = false;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration())
+      continue;
+
+    //
+    // Find the checks of the function's hot sites.
+    //
+    std::vector<std::pair<CallInst *, const CheckInfo *> > HotChecks;
+    for (inst_iterator I = inst_begin (*F); I != inst_end (*F); ++I) {
+      CallInst * CI = dyn_cast<CallInst>(&*I);
+      if (!CI)
+        continue;
+      const CheckInfo * Info = findCheck (CI->getCalledFunction());
+      if (!Info)
+        continue;
+
+      SiteKey Key;
+      std::map<SiteKey, double>::iterator Site = SiteCosts.end();
+      if (getSiteKey (CI, Info->Kind, Key))
+        Site = SiteCosts.find (Key);
+      if ((Site == SiteCosts.end()) || (Site->second < HotThreshold)) {
+        ++ColdSites;
+        continue;
+      }
+
+      ++HotSites;
+      HotChecks.push_back (std::make_pair (CI, Info));
+    }
+
+    if (HotChecks.empty())
+      continue;
+
+    //
+    // Hoist hot checks out of loops first; inlining fast paths changes the
+    // control flow graph and invalidates the loop information.
+    //
+    LoopInfo & LI = getAnalysis<LoopInfo>(*F);
+    LoopMayFree.clear();
+    for (unsigned index = 0; index < HotChecks.size(); ++index) {
+      CallInst * CI = HotChecks[index].first;
+      if (Loop * L = LI.getLoopFor (CI->getParent())) {
+        if (hoistCheck (CI, L)) {
+          ++Hoisted;
+          modified = true;
+        }
+      }
+    }
+
+    for (unsigned index = 0; index < HotChecks.size(); ++index) {
+      const CheckInfo * Info = HotChecks[index].second;
+      if (!Info->InlineFastPath)
+        continue;
+      if (inlineFastPath (HotChecks[index].first, Info->ReturnsPointer)) {
+        ++Inlined;
+        modified = true;
+      }
+    }
+  }
+
+  return modified;
+}
+
+}
@@ -0,0 +1,266 @@
+//===- SiteCacheChecks.cpp - Give check sites inline caches ---------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass gives load/store and bounds check sites inline caches of the last
+// object that they found.  A check becomes:
+//
+//   if (cache.Epoch == __sc_site_epoch &&
+//       cache.lower <= ptr && ptr + len - 1 <= cache.upper &&
+//       cache.Pool == pool && cache.Epoch has not changed)
+//     ;   // the pointer is within the object the check found last time
+//   else
+//     poolcheck_cached (pool, ptr, len, &cache);
+//
+// Bounds checks test both the source and the result pointer against the
+// cached object.  The cache fields are stored as integers so that they can be
+// loaded atomically; the second load of the epoch discards an entry that
+// another thread was filling while its bounds were being read.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sitecache-checks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/MDBuilder.h"
+
+#include "safecode/SiteCacheChecks.h"
+
+#include <vector>
+
+namespace {
+  STATISTIC (CachedChecks, "Number of checks given inline caches");
+}
+
+namespace llvm {
+
+char SiteCacheChecks::ID = 0;
+
+static RegisterPass<SiteCacheChecks>
+X ("sc-sitecache-checks", "Give run-time checks per-site inline caches");
+
+//
+// The checks that get inline caches and their cached versions.  The cached
+// versions take the inline cache after the first three arguments, so the
+// debug information stays at the end of the argument list.
+//
+static const struct {
+  const char * Name;
+  const char * CachedName;
+  bool IsBoundsCheck;
+} Checks[] = {
+  {"poolcheck",           "poolcheck_cached",           false},
+  {"poolcheck_debug",     "poolcheck_cached_debug",     false},
+  {"boundscheck",         "boundscheck_cached",         true},
+  {"boundscheck_debug",   "boundscheck_cached_debug",   true},
+  {"boundscheckui",       "boundscheckui_cached",       true},
+  {"boundscheckui_debug", "boundscheckui_cached_debug", true},
+  {0, 0, false}
+};
+
+// Fields of an inline cache
+enum {
+  LowerField,
+  UpperField,
+  PoolField,
+  EpochField
+};
+
+//
+// Function: loadField()
+//
+// Description:
+//  Atomically load a field of an inline cache.
+//
+static LoadInst *
+loadField (const DataLayout * TD, Constant * Cache, unsigned Field,
+           AtomicOrdering Order, Instruction * InsertPt) {
+  Type * Int32Type = Type::getInt32Ty (Cache->getContext());
+  Constant * Indices[] = {
+    ConstantInt::get (Int32Type, 0),
+    ConstantInt::get (Int32Type, Field)
+  };
+  Constant * Ptr = ConstantExpr::getInBoundsGetElementPtr (Cache, Indices);
+  Type * FieldType = cast<PointerType>(Ptr->getType())->getElementType();
+
+  LoadInst * LI = new LoadInst (Ptr, "", InsertPt);
+  LI->setAlignment (TD->getABITypeAlignment (FieldType));
+  LI->setAtomic (Order);
+  return LI;
+}
+
+//
+// Method: cacheCheck()
+//
+// Description:
+//  Give a check an inline cache and make it call the cached version of the
+//  check when the cache does not hold the object that it needs.
+//
+void
+SiteCacheChecks::cacheCheck (CallInst * CI, Function * Cached,
+                             bool IsBoundsCheck) {
+  BasicBlock * Head = CI->getParent();
+  Function * F = Head->getParent();
+  Module * M = F->getParent();
+  LLVMContext & Context = M->getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+
+  Constant * Cache = new GlobalVariable (*M,
+                                         SiteCacheType,
+                                         false,
+                                         GlobalValue::InternalLinkage,
+                                         Constant::getNullValue (SiteCacheType),
+                                         "sc.sitecache");
+
+  //
+  // Split the check into its own block; the probe of the cache goes between
+  // the two.
+  //
+  BasicBlock * Miss = Head->splitBasicBlock (CI, "sitecache.miss");
+  BasicBlock::iterator After = CI;
+  ++After;
+  BasicBlock * Done = Miss->splitBasicBlock (After, "sitecache.done");
+  BasicBlock * Probe = BasicBlock::Create (Context, "sitecache.probe", F, Miss);
+  MDNode * Weights = MDBuilder (Context).createBranchWeights (64, 1);
+
+  //
+  // Only look at the bounds of the cache if it was filled in this epoch.
+  //
+  Instruction * Term = Head->getTerminator();
+  LoadInst * Epoch = loadField (TD, Cache, EpochField, Acquire, Term);
+  LoadInst * Current = new LoadInst (SiteEpoch, "", Term);
+  Current->setAlignment (TD->getABITypeAlignment (IntPtrType));
+  Current->setAtomic (Monotonic);
+  Value * Valid = new ICmpInst (Term, ICmpInst::ICMP_EQ, Epoch, Current);
+  BranchInst * Branch = BranchInst::Create (Probe, Miss, Valid, Term);
+  Branch->setMetadata (LLVMContext::MD_prof, Weights);
+  Term->eraseFromParent();
+
+  //
+  // Determine whether the pointers are within the cached object.
+  //
+  Term = BranchInst::Create (Done, Miss, ConstantInt::getTrue (Context), Probe);
+  Value * Lower = loadField (TD, Cache, LowerField, Acquire, Term);
+  Value * Upper = loadField (TD, Cache, UpperField, Acquire, Term);
+  Value * Pool = loadField (TD, Cache, PoolField, Acquire, Term);
+  Value * Again = loadField (TD, Cache, EpochField, Monotonic, Term);
+
+  Value * PoolArg = new PtrToIntInst (CI->getArgOperand (0), IntPtrType,
+                                      "", Term);
+  Value * First = new PtrToIntInst (CI->getArgOperand (1), IntPtrType,
+                                    "", Term);
+  Value * Last;
+  if (IsBoundsCheck) {
+    Last = new PtrToIntInst (CI->getArgOperand (2), IntPtrType, "", Term);
+  } else {
+    Value * Length = new ZExtInst (CI->getArgOperand (2), IntPtrType,
+                                   "", Term);
+    Value * End = BinaryOperator::CreateAdd (First, Length, "", Term);
+    Last = BinaryOperator::CreateSub (End,
+                                      ConstantInt::get (IntPtrType, 1),
+                                      "", Term);
+  }
+
+  Value * Hit = new ICmpInst (Term, ICmpInst::ICMP_EQ, Again, Epoch);
+  Value * Tests[] = {
+    new ICmpInst (Term, ICmpInst::ICMP_EQ, Pool, PoolArg),
+    new ICmpInst (Term, ICmpInst::ICMP_ULE, Lower, First),
+    new ICmpInst (Term, ICmpInst::ICMP_ULE, First, Upper),
+    new ICmpInst (Term, ICmpInst::ICMP_ULE, Lower, Last),
+    new ICmpInst (Term, ICmpInst::ICMP_ULE, Last, Upper)
+  };
+  for (unsigned index = 0; index < sizeof (Tests) / sizeof (Tests[0]); ++index)
+    Hit = BinaryOperator::CreateAnd (Hit, Tests[index], "", Term);
+  cast<BranchInst>(Term)->setCondition (Hit);
+  Term->setMetadata (LLVMContext::MD_prof, Weights);
+
+  //
+  // Call the cached version of the check on a miss.
+  //
+  std::vector<Value *> Args;
+  for (unsigned index = 0; index < CI->getNumArgOperands(); ++index)
+    Args.push_back (CI->getArgOperand (index));
+  Args.insert (Args.begin() + 3, Cache);
+  CallInst * NewCall = CallInst::Create (Cached, Args, "", CI);
+  NewCall->setCallingConv (CI->getCallingConv());
+  NewCall->setDebugLoc (CI->getDebugLoc());
+  NewCall->takeName (CI);
+
+  //
+  // A bounds check that hits in the cache returns the result pointer.
+  //
+  if (IsBoundsCheck) {
+    PHINode * Checked = PHINode::Create (CI->getType(), 2, "checked",
+                                         &Done->front());
+    CI->replaceAllUsesWith (Checked);
+    Value * Dest = CI->getArgOperand (2);
+    if (Dest->getType() != CI->getType())
+      Dest = new BitCastInst (Dest, CI->getType(), "", Term);
+    Checked->addIncoming (Dest, Probe);
+    Checked->addIncoming (NewCall, Miss);
+  }
+
+  CI->eraseFromParent();
+  ++CachedChecks;
+}
+
+bool
+SiteCacheChecks::runOnModule (Module & M) {
+  TD = &getAnalysis<DataLayout>();
+  LLVMContext & Context = M.getContext();
+  Type * IntPtrType = TD->getIntPtrType (Context);
+  SiteCacheType = StructType::get (IntPtrType, IntPtrType, IntPtrType,
+                                   IntPtrType, NULL);
+  SiteEpoch = M.getOrInsertGlobal ("__sc_site_epoch", IntPtrType);
+
+  bool modified = false;
+  for (unsigned index = 0; Checks[index].Name; ++index) {
+    Function * F = M.getFunction (Checks[index].Name);
+    if (!F)
+      continue;
+
+    //
+    // Check that the arguments have the types of the run-time's check; the
+    // cached check takes the inline cache as its fourth argument.
+    //
+    FunctionType * FTy = F->getFunctionType();
+    bool IsBoundsCheck = Checks[index].IsBoundsCheck;
+    if ((FTy->getNumParams() < 3) ||
+        !FTy->getParamType (0)->isPointerTy() ||
+        !FTy->getParamType (1)->isPointerTy() ||
+        (IsBoundsCheck && !FTy->getParamType (2)->isPointerTy()) ||
+        (IsBoundsCheck && !FTy->getReturnType()->isPointerTy()) ||
+        (!IsBoundsCheck && !FTy->getParamType (2)->isIntegerTy()))
+      continue;
+
+    std::vector<Type *> Params (FTy->param_begin(), FTy->param_end());
+    Params.insert (Params.begin() + 3, PointerType::getUnqual (SiteCacheType));
+    FunctionType * CachedType = FunctionType::get (FTy->getReturnType(),
+                                                   Params,
+                                                   false);
+    Function * CachedCheck = dyn_cast<Function>
+      (M.getOrInsertFunction (Checks[index].CachedName, CachedType));
+    if (!CachedCheck)
+      continue;
+
+    std::vector<CallInst *> Calls;
+    for (Value::use_iterator U = F->use_begin(); U != F->use_end(); ++U)
+      if (CallInst * CI = dyn_cast<CallInst>(*U))
+        if (CI->getCalledValue() == F)
+          Calls.push_back (CI);
+
+    for (unsigned i = 0; i < Calls.size(); ++i)
+      cacheCheck (Calls[i], CachedCheck, IsBoundsCheck);
+    modified |= !Calls.empty();
+  }
+
+  return modified;
+}
+
+}
@@ -10,8 +10,22 @@
 // This pass lowers all intrinsics added by SAFECode to appropriate calls to
 // run-time functions in the run-time implementation.
 //
+// In sampled mode, every load/store check site gets a counter that is counted
+// down each time the check is reached; the check itself only runs when the
+// counter reaches zero.  The run-time restarts the counter and keeps it
+// negative once the site has found a violation, so that the check then runs
+// every time.  Object registration is never sampled.
+//
+// Bounds checks are never sampled either.  A skipped bounds check would let
+// an out-of-bounds pointer through without rewriting it, and the checks that
+// run later would then find another object, or none, for it and report
+// violations that did not happen.
+//
 //===----------------------------------------------------------------------===//
 
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 
 #include "safecode/LowerSafecodeIntrinsic.h"
@@ -23,12 +37,109 @@ char LowerSafecodeIntrinsic::ID = 0;
 static RegisterPass<LowerSafecodeIntrinsic> passReplaceFunction 
 ("lower-sc-intrinsic", "Replace all uses of a function to another");
 
+//
+// The checks that are sampled in sampled mode, both as intrinsics and as
+// run-time functions.
+//
+static const char * const SampledChecks[] = {
+  "sc.lscheck",
+  "sc.lscheckui",
+  "sc.lscheckalign",
+  "sc.lscheckalignui",
+  "poolcheck",
+  "poolcheckui",
+  "poolcheckalign",
+  "poolcheckalignui",
+  "fastlscheck",
+  0
+};
+
+//
+// Function: isSampledCheck()
+//
+// Description:
+//  Determine whether calls to the named function are sampled.
+//
+static bool
+isSampledCheck (StringRef Name) {
+  for (unsigned index = 0; SampledChecks[index]; ++index) {
+    if (Name == SampledChecks[index])
+      return true;
+  }
+  return false;
+}
+
 namespace llvm {
 
   ////////////////////////////////////////////////////////////////////////////
   // LowerSafecodeIntrinsic Methods
   ////////////////////////////////////////////////////////////////////////////
 
+  //
+  // Method: sampleCheck()
+  //
+  // Description:
+  //  Guard a check with the counter of a new sample site so that it only runs
+  //  when the counter has been counted down to zero or below.
+  //
+  void
+  LowerSafecodeIntrinsic::sampleCheck (CallInst * CI) {
+    BasicBlock * Head = CI->getParent();
+    Function * F = Head->getParent();
+    Module * M = F->getParent();
+    LLVMContext & Context = M->getContext();
+    Type * VoidType  = Type::getVoidTy (Context);
+    Type * Int32Type = Type::getInt32Ty (Context);
+    Type * Int32PtrType = PointerType::getUnqual (Int32Type);
+
+    Constant * Begin = M->getOrInsertFunction ("__sc_sample_begin",
+                                               VoidType,
+                                               Int32PtrType,
+                                               NULL);
+    Constant * End = M->getOrInsertFunction ("__sc_sample_end", VoidType, NULL);
+
+    //
+    // Every site counts down from zero so that its first check always runs.
+    //
+    Constant * Zero = ConstantInt::get (Int32Type, 0);
+    Value * Site = new GlobalVariable (*M,
+                                       Int32Type,
+                                       false,
+                                       GlobalValue::InternalLinkage,
+                                       Zero,
+                                       "sc.sample");
+
+    //
+    // Split the check into its own block and add a block that skips it.
+    //
+    BasicBlock * Check = Head->splitBasicBlock (CI, "sample.check");
+    BasicBlock::iterator After = CI;
+    ++After;
+    BasicBlock * Done = Check->splitBasicBlock (After, "sample.done");
+    BasicBlock * Skip = BasicBlock::Create (Context, "sample.skip", F, Done);
+
+    //
+    // Run the check when the counter is due; checks rarely are.
+    //
+    Instruction * Term = Head->getTerminator();
+    Value * Count = new LoadInst (Site, "count", Term);
+    Value * Due = new ICmpInst (Term, ICmpInst::ICMP_SLE, Count, Zero, "due");
+    BranchInst * Branch = BranchInst::Create (Check, Skip, Due, Term);
+    Branch->setMetadata (LLVMContext::MD_prof,
+                         MDBuilder (Context).createBranchWeights (1, 64));
+    Term->eraseFromParent();
+
+    Value * Next = BinaryOperator::CreateSub (Count,
+                                              ConstantInt::get (Int32Type, 1),
+                                              "next",
+                                              Skip);
+    new StoreInst (Next, Site, Skip);
+    BranchInst::Create (Done, Skip);
+
+    CallInst::Create (Begin, Site, "", CI);
+    CallInst::Create (End, "", Check->getTerminator());
+  }
+
   bool
   LowerSafecodeIntrinsic::runOnModule(Module & M) {
     std::vector<IntrinsicMappingEntry>::const_iterator it=mReplaceList.begin();
@@ -38,18 +149,36 @@ namespace llvm {
       // Get a reference to the original function (if it exists).
       //
       Function * origF = M.getFunction(it->intrinsicName);
+      if (!origF)
+        continue;
+
+      //
+      // Find the checks to sample before their callee is replaced.
+      //
+      std::vector<CallInst *> Checks;
+      if (Sampled && isSampledCheck (it->intrinsicName)) {
+        for (Value::use_iterator U = origF->use_begin();
+             U != origF->use_end(); ++U) {
+          if (CallInst * CI = dyn_cast<CallInst>(*U))
+            if (CI->getCalledValue() == origF)
+              Checks.push_back (CI);
+        }
+      }
 
       //
       // If the new function has a name different from the old function, create
       // a function prototype of the new function and replace uses of the old
       // function with it.
       //
-      if (origF) {
+      if (origF->getName() != it->functionName) {
         Constant * newF = M.getOrInsertFunction (it->functionName,
                                                  origF->getFunctionType());
         origF->replaceAllUsesWith(newF);
         origF->eraseFromParent();
       }
+
+      for (unsigned index = 0; index < Checks.size(); ++index)
+        sampleCheck (Checks[index]);
     }   
     return true;
   }
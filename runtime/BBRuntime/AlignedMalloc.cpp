@@ -1,40 +1,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <malloc.h>
 
 #include "safecode/Runtime/BBMetaData.h"
 
+#include "BuddyAllocator.h"
+
+using namespace NAMESPACE_SC;
+
 /* On a dlmalloc/ptmalloc malloc implementation, memalign is performed by allocating
  * a block of size (alignment+size), and then finding the correctly aligned location
  * within that block, and try to give back the memory before the correctly aligned
  * location. This means that a memalign-based baggy bounds allocator can use up to
- * roughly 2x the amount the memory you'd expect.
+ * roughly 2x the amount the memory you'd expect.  The objects are therefore
+ * allocated by the buddy allocator, which hands out aligned power-of-two slots
+ * directly and enters them in the baggy bounds table.
  */
 
-int next_pow_of_2(size_t size) {
-  unsigned int i ;
-  for (i = 1; i < size; i = i << 1) ;
-  return (i < 16 ? 16 : i);
+static inline BBMetaData *
+getMetaData(void *vp) {
+  size_t aligned_size = (size_t)1 << bbSlotSize(vp);
+  return (BBMetaData*)((uintptr_t)vp + aligned_size - sizeof(BBMetaData));
 }
 
 extern "C" void* malloc(size_t size) {
-  size_t adjusted_size = size + sizeof(BBMetaData);
-  size_t aligned_size = next_pow_of_2(adjusted_size);
-  void *vp;
-  posix_memalign(&vp, aligned_size, aligned_size);
+  if (size > SIZE_MAX - sizeof(BBMetaData))
+    return NULL;
+  void *vp = bbAllocate(size + sizeof(BBMetaData));
+  if (vp == NULL)
+    return NULL;
 
-  BBMetaData *data = (BBMetaData*)((uintptr_t)vp + aligned_size - sizeof(BBMetaData));
+  BBMetaData *data = getMetaData(vp);
   data->size = size;
   data->pool = NULL;
   return vp;
 }
 
 extern "C" void* calloc(size_t nmemb, size_t size) {
-  size_t aligned_size = next_pow_of_2(nmemb*size+sizeof(BBMetaData));
-  void *vp;
-  posix_memalign(&vp, aligned_size, aligned_size);
-  memset(vp, 0, aligned_size);
-  BBMetaData *data = (BBMetaData*)((uintptr_t)vp + aligned_size - sizeof(BBMetaData));
+  if (size && nmemb > (SIZE_MAX - sizeof(BBMetaData)) / size)
+    return NULL;
+  void *vp = bbAllocate(nmemb*size+sizeof(BBMetaData));
+  if (vp == NULL)
+    return NULL;
+  memset(vp, 0, nmemb*size);
+  BBMetaData *data = getMetaData(vp);
   data->size = nmemb*size;
   data->pool = NULL;
   return vp;
@@ -44,15 +54,39 @@ extern "C" void* realloc(void *ptr, size_t size) {
   if (ptr == NULL) {
     return malloc(size);
   }
+  if (size > SIZE_MAX - sizeof(BBMetaData))
+    return NULL;
+
+  //
+  // Memory allocated before this allocator took over belongs to the C
+  // library, which knows its size.
+  //
+  size_t old_size;
+  if (bbSlotSize(ptr)) {
+    //
+    // Keep the object in its slot, or grow the slot in place, if the new
+    // size and the metadata fit; the contents then need not be copied.
+    //
+    void *vp = bbReallocate(ptr, size + sizeof(BBMetaData));
+    if (vp) {
+      BBMetaData *data = getMetaData(vp);
+      data->size = size;
+      data->pool = NULL;
+      return vp;
+    }
+    old_size = getMetaData(ptr)->size;
+  } else {
+    old_size = malloc_usable_size(ptr);
+  }
 
-  size += sizeof(BBMetaData);
-  size_t aligned_size = next_pow_of_2(size);
-  void *vp;
-  posix_memalign(&vp, aligned_size, aligned_size);
-  memcpy(vp, ptr, size);
+  void *vp = malloc(size);
+  if (vp == NULL)
+    return NULL;
+  memcpy(vp, ptr, (old_size < size) ? old_size : size);
   free(ptr);
-  BBMetaData *data = (BBMetaData*)((uintptr_t)vp + aligned_size - sizeof(BBMetaData));
-  data->size = size;
-  data->pool = NULL;
   return vp;
 }
+
+extern "C" void free(void *ptr) {
+  bbFree(ptr);
+}
@@ -20,13 +20,19 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BuddyAllocator.h"
 #include "ConfigData.h"
 #include "DebugReport.h"
 #include "PoolAllocator.h"
 #include "RewritePtr.h"
+#include "SizeTable.h"
 
 #include "../include/CWE.h"
 
+// This file provides the storage and functions of the run-time statistics
+#define SC_STATISTICS_IMPLEMENTATION
+#include "../include/RuntimeStats.h"
+
 #include <cstring>
 #include <cassert>
 #include <cstdio>
@@ -80,12 +86,19 @@ unsigned SLOT_SIZE = 4;
 unsigned SLOTSIZE = 16;
 unsigned WORD_SIZE = 64;
 unsigned char * __baggybounds_size_table_begin;
+unsigned char * __baggybounds_coarse_table_begin;
 #if defined(_LP64)
 const size_t table_size = 1L<<43;
+const size_t coarse_table_size = 1L<<31;
 #else
 const size_t table_size = 1L<<28;
+const size_t coarse_table_size = 1L<<16;
 #endif
 
+// Number of bytes of the size table above which unregistering an object gives
+// the pages of the table back to the operating system instead of clearing them
+const size_t table_release_size = 16384;
+
 
 //===----------------------------------------------------------------------===//
 //
@@ -197,6 +210,25 @@ pool_init_runtime(unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   }
 
 
+  //
+  // Initialize the coarse level of the baggy bounds table.  It must exist
+  // before the fine level, which the allocator checks for.
+  //
+  __baggybounds_coarse_table_begin =
+    (unsigned char*) mmap(0,
+                          coarse_table_size,
+                          PROT_READ|PROT_WRITE,
+                          MAP_PRIVATE|MAP_ANON|MAP_NORESERVE,
+                          -1,
+                          0);
+
+  if (__baggybounds_coarse_table_begin == MAP_FAILED) {
+    fprintf (stderr, "Baggy Bounds Table initialization failed!\n");
+    fflush (stderr);
+    assert(0 && "Table Init Failed");
+    abort();
+  }
+
   // Initialize the baggy bounds table
   __baggybounds_size_table_begin = NULL;
   __baggybounds_size_table_begin =
@@ -217,6 +249,66 @@ pool_init_runtime(unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   return;
 }
 
+//
+// Function: getTableRange()
+//
+// Description:
+//  Find the entries of the size table that describe an object of 2^Size bytes
+//  starting at Base.
+//
+static inline unsigned char *
+getTableRange (uintptr_t Base, unsigned char Size, size_t & Range) {
+  if (Size < COARSE_SLOT_SIZE) {
+    Range = (size_t)1 << (Size - SLOT_SIZE);
+    return __baggybounds_size_table_begin + (Base >> SLOT_SIZE);
+  }
+  Range = (size_t)1 << (Size - COARSE_SLOT_SIZE);
+  return __baggybounds_coarse_table_begin + (Base >> COARSE_SLOT_SIZE);
+}
+
+//
+// Function: enterSize()
+//
+// Description:
+//  Record the binary logarithm of the size of an object in the size table.
+//  Objects that the allocator has already entered are not written again.
+//
+void
+NAMESPACE_SC::enterSize (uintptr_t Base, unsigned char Size) {
+  size_t Range;
+  unsigned char * Entry = getTableRange(Base, Size, Range);
+  if (Range == 1)
+    *Entry = Size;
+  else if ((Entry[0] != Size) || (Entry[Range - 1] != Size))
+    memset(Entry, Size, Range);
+}
+
+//
+// Function: removeSize()
+//
+// Description:
+//  Remove an object from the size table.  Large ranges of the table are given
+//  back to the operating system, which zero-fills them when they are next
+//  touched; this keeps the table from holding on to memory for objects that
+//  no longer exist.
+//
+void
+NAMESPACE_SC::removeSize (uintptr_t Base, unsigned char Size) {
+  size_t Range;
+  unsigned char * Entry = getTableRange(Base, Size, Range);
+#if defined(__linux__)
+  //
+  // The range is a power of two and aligned to its size, so a range of at
+  // least a page covers whole pages of the table.
+  //
+  if (Range >= table_release_size) {
+    madvise(Entry, Range, MADV_DONTNEED);
+    return;
+  }
+#endif
+  memset(Entry, 0, Range);
+}
+
 //
 // Function: __internal_register
 //
@@ -254,16 +346,30 @@ __internal_register(DebugPoolTy *Pool,
     assert(0 && "Memory objects not aligned");
   }
   Source = Source & ~((1<<size)-1);
-  unsigned long index = Source >> SLOT_SIZE;
-  unsigned range = 1 << (size - SLOT_SIZE);
 
   //
   // Store the binary logarithm of the aligned size in the baggy bounds table.
   //
-  memset(__baggybounds_size_table_begin + index, size, range);
+  enterSize(Source, size);
+  SC_STAT_GAUGE (LIVE_OBJECTS, 1);
   return;
 }
 
+//
+// Function: setMetaData()
+//
+// Description:
+//  Record the size and the pool of an object in the metadata at the end of
+//  its slot.
+//
+static inline void
+setMetaData(DebugPoolTy *Pool, void *p, unsigned NumBytes) {
+  uintptr_t SlotSize = (uintptr_t)1 << bbSlotSize(p);
+  BBMetaData *data = (BBMetaData*)((uintptr_t)p + SlotSize) - 1;
+  data->size = NumBytes;
+  data->pool = Pool;
+}
+
 //
 // Function: sc_bb_poolargvregister()
 //
@@ -275,36 +381,19 @@ __sc_bb_poolargvregister(int argc, char **argv) {
   //
   // Adjust the size of argv variable to include its metadata.
   //
-  unsigned int size = 0;
   unsigned int argv_size = sizeof(char *) * (argc+1);
   unsigned int argv_adjustedsize = argv_size + sizeof(BBMetaData);
-  
-  //
-  // Align the size of argv variable to be a power of 2.
-  //
-  while((unsigned)(1<<size) < argv_adjustedsize) {
-      size++;
-  }
-  if (size < SLOT_SIZE)
-    size = SLOT_SIZE;
-  unsigned int alignedSize = 1 << size;
-  
+
   //
-  // Reallocate argv variable to be the aligned size.
+  // Reallocate argv variable in a slot that also holds its metadata; the
+  // allocator initializes the metadata.
   //
   char ** argv_temp = (char **)__sc_bb_src_poolalloc(NULL,
-                                                     alignedSize,
+                                                     argv_size,
                                                      0,
                                                      "main\n",
                                                      0);
-  
-  //
-  // Initialize the metadata of argv variable.
-  //
-  BBMetaData *data = (BBMetaData*)((uintptr_t)argv_temp + alignedSize - sizeof
-                                   (BBMetaData));
-  data->size = argv_size;
-  data->pool = NULL;
+  assert (argv_temp && "Cannot allocate argv!");
 
   //
   // Padding and align each argv string.
@@ -313,38 +402,20 @@ __sc_bb_poolargvregister(int argc, char **argv) {
     //
     //Adjust the size of each argv string to include its metadata.
     //
-    size = 0;
     unsigned int argv_index_size = (strlen(argv[index])+ 1)*sizeof(char);
     unsigned int adjustedSize = argv_index_size + sizeof(BBMetaData);
-   
-    //
-    // Align the size of each argv string to be a power of 2.
-    //
-    while((unsigned)(1<<size) < adjustedSize) {
-      size++;
-    }
-    if (size < SLOT_SIZE)
-      size = SLOT_SIZE;
-    alignedSize = 1 << size;
-    
+
     //
-    // Reallocate each argv string to be the aligned size.
+    // Reallocate each argv string in a slot that also holds its metadata.
     //
     char *argv_index_temp = (char *)__sc_bb_src_poolalloc(NULL,
-                                                          alignedSize,
+                                                          argv_index_size,
                                                           0,
                                                           "main\n",
                                                           0);
+    assert (argv_index_temp && "Cannot allocate argv string!");
     argv_index_temp = strcpy(argv_index_temp, argv[index]);
 
-    //
-    // Initialize the metadata of each argv string.
-    //
-    data = (BBMetaData*)((uintptr_t)argv_index_temp + alignedSize - sizeof
-                        (BBMetaData));
-    data->size = argv_index_size;
-    data->pool = NULL;
-
     //
     // Register each argv string.
     //
@@ -378,6 +449,7 @@ __sc_bb_src_poolregister (DebugPoolTy *Pool,
                           unsigned NumBytes, TAG,
                           const char* SourceFilep,
                           unsigned lineno) {
+  SC_STAT_INC (REGISTER_HEAP);
 
   //TODO: Fix massive hack. 
   // We have to manulally add the size of the allocation, since the size of
@@ -418,6 +490,8 @@ __sc_bb_src_poolregister_stack (DebugPoolTy *Pool,
                                 unsigned NumBytes, TAG,
                                 const char* SourceFilep,
                                 unsigned lineno) {
+  SC_STAT_INC (REGISTER_STACK);
+
   //
   // If the object has zero length, don't do anything.
   //
@@ -482,6 +556,8 @@ __sc_bb_src_poolregister_global_debug (DebugPoolTy *Pool,
                                        unsigned NumBytes,TAG,
                                        const char *SourceFilep,
                                        unsigned lineno) {
+  SC_STAT_INC (REGISTER_GLOBAL);
+
   //
   // If the object has zero length, don't do anything.
   //
@@ -527,18 +603,19 @@ __sc_bb_poolunregister_debug (DebugPoolTy *Pool,
                               TAG,
                               const char* SourceFilep,
                               unsigned lineno) {
+  SC_STAT_INC (UNREGISTER_HEAP);
+
   uintptr_t Source = (uintptr_t)allocaptr;
   unsigned  e;
-  e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
+  e = lookupSize(Source);
   if(e == 0 ) {
     return;
   }
-  uintptr_t size = 1 << e;
+  uintptr_t size = (uintptr_t)1 << e;
   uintptr_t base = Source & ~(size -1);
-  unsigned long index = base >> SLOT_SIZE;
-  unsigned int slots = 1<<(e - SLOT_SIZE);
 
-  memset(__baggybounds_size_table_begin + index, 0, slots);
+  removeSize(base, e);
+  SC_STAT_GAUGE (LIVE_OBJECTS, -1);
 }
 
 void
@@ -553,37 +630,45 @@ __sc_bb_poolunregister_stack_debug (DebugPoolTy *Pool,
                                     TAG,
                                     const char* SourceFilep,
                                     unsigned lineno) {
+  SC_STAT_INC (UNREGISTER_STACK);
+
   uintptr_t Source = (uintptr_t)allocaptr;
 
   unsigned  e;
-  e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
+  e = lookupSize(Source);
   if(e == 0 ) {
     return;
   }
-  uintptr_t size = 1 << e;
+  uintptr_t size = (uintptr_t)1 << e;
   uintptr_t base = Source & ~(size -1);
-  unsigned long index = base >> SLOT_SIZE;
-  unsigned int slots = 1<<(e - SLOT_SIZE);
-  memset(__baggybounds_size_table_begin + index, 0, slots);
+  removeSize(base, e);
+  SC_STAT_GAUGE (LIVE_OBJECTS, -1);
 }
 
+//
+// Function: __sc_bb_src_poolalloc()
+//
+// Description:
+//  Allocate an object in a slot that also holds its metadata, so that it can
+//  be registered with the number of bytes requested.
+//
 void *
 __sc_bb_src_poolalloc(DebugPoolTy *Pool,
                       unsigned NumBytes, TAG,
                       const char * SourceFilep,
                       unsigned lineno) {
+  size_t adjustedSize = (size_t)NumBytes + sizeof(BBMetaData);
   unsigned char size= 0;
-  while((unsigned)(1<<size) < NumBytes) {
+  while(((size_t)1 << size) < adjustedSize) {
     size++;
   }
   if (size < SLOT_SIZE)
     size = SLOT_SIZE;
-  unsigned int alloc = 1 << size;
-  void *p;
-  int result;
-
-  result = posix_memalign(&p, alloc, alloc);
-  assert(!result && "Memory allocation failed");
+  void *p = bbAllocate((size_t)1 << size);
+  assert(p && "Memory allocation failed");
+  if (!p)
+    return 0;
+  setMetaData(Pool, p, NumBytes);
 
   return p;
 }
@@ -593,20 +678,20 @@ __sc_bb_poolmemalign(DebugPoolTy *Pool,
                      unsigned Alignment,
                      unsigned NumBytes) {
 
+  size_t adjustedSize = (size_t)NumBytes + sizeof(BBMetaData);
   unsigned char size= 0;
-  while((unsigned)(1<<size) < NumBytes) {
+  while(((size_t)1 << size) < adjustedSize) {
     size++;
   }
   if (size < SLOT_SIZE)
     size = SLOT_SIZE;
   if (size < Alignment)
     size = Alignment;
-  unsigned int alloc = 1 << size;
-  void *p;
-  int result;
-
-  result = posix_memalign(&p, alloc, alloc);
-  assert(!result && "Memory allocation failed");
+  void *p = bbAllocate((size_t)1 << size);
+  assert(p && "Memory allocation failed");
+  if (!p)
+    return 0;
+  setMetaData(Pool, p, NumBytes);
   __sc_bb_poolregister(Pool, p, NumBytes);
   return p;
 }
@@ -618,20 +703,19 @@ __sc_bb_src_poolcalloc(DebugPoolTy *Pool,
                        const char* SourceFilep,
                        unsigned lineno) {
 
+  size_t adjustedSize = (size_t)NumBytes*Number + sizeof(BBMetaData);
   unsigned char size= 0;
-  while((unsigned)(1<<size) < (NumBytes*Number)) {
+  while(((size_t)1 << size) < adjustedSize) {
     size++;
   }
   if (size < SLOT_SIZE) size = SLOT_SIZE;
-  unsigned int alloc = 1<< size;
-  void *p;
-  int result;
-  result = posix_memalign(&p, alloc, alloc);
-  assert(!result && "Memory allocation failed");
+  void *p = bbAllocate((size_t)1 << size);
+  assert(p && "Memory allocation failed");
+  if (!p)
+    return 0;
+  setMetaData(Pool, p, Number*NumBytes);
   __sc_bb_src_poolregister(Pool, p, (Number*NumBytes), tag, SourceFilep, lineno);
-  if (p) {
-    bzero(p, Number*NumBytes);
-  }
+  bzero(p, Number*NumBytes);
   return p;
 }
 
@@ -656,7 +740,8 @@ __sc_bb_poolrealloc(DebugPoolTy *Pool,
                     unsigned NumBytes) {
   if (Node == 0) {
     void *New = __sc_bb_poolalloc(Pool, NumBytes);
-    __sc_bb_poolregister(Pool, New, NumBytes);
+    if (New)
+      __sc_bb_poolregister(Pool, New, NumBytes);
     return New;
   }
 
@@ -670,36 +755,52 @@ __sc_bb_poolrealloc(DebugPoolTy *Pool,
     return 0;
   }
 
-  void *New = __sc_bb_poolalloc(Pool, NumBytes);
-  if(New == 0)
+  if (NumBytes > SIZE_MAX - sizeof(BBMetaData)) {
     return 0;
-  __sc_bb_poolregister(Pool, New, NumBytes);
-
-  uintptr_t Source = (uintptr_t)Node;
-  unsigned  char e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
-  unsigned int size_old = 1 << e;
-  uintptr_t Source_new = (uintptr_t)New;
-  unsigned  char e_new = __baggybounds_size_table_begin[Source_new >> SLOT_SIZE];
-  unsigned int size_new = 1 << e_new;
+  }
 
-  if(size_new > size_old)
-    memcpy(New, Node, size_old);
-  else
-    memcpy(New, Node, size_new);
+  //
+  // Find the size of the old object in its metadata so that it can be
+  // registered again if it cannot be reallocated.
+  //
+  unsigned char e = bbSlotSize(Node);
+  if (!e)
+    return 0;
+  size_t size_old = ((size_t)1 << e) - sizeof(BBMetaData);
+  unsigned NumBytesOld = ((BBMetaData*)((uintptr_t)Node + size_old))->size;
 
+  //
+  // If the slot of the object can hold the new size and its metadata, or can
+  // be resized without moving its contents, register the object again in
+  // its slot instead of copying it.
+  //
   __sc_bb_poolunregister(Pool, Node);
+  void *New = bbReallocate(Node, (size_t)NumBytes + sizeof(BBMetaData));
+  if (New) {
+    setMetaData(Pool, New, NumBytes);
+    __sc_bb_poolregister(Pool, New, NumBytes);
+    return New;
+  }
+
+  New = __sc_bb_poolalloc(Pool, NumBytes);
+  if(New == 0) {
+    __sc_bb_poolregister(Pool, Node, NumBytesOld);
+    return 0;
+  }
+  __sc_bb_poolregister(Pool, New, NumBytes);
+
+  //
+  // Copy the contents of the old object, but not its metadata.
+  //
+  memcpy(New, Node, (size_old < NumBytes) ? size_old : NumBytes);
+
   __sc_bb_poolfree(Pool, Node);
   return New;
 }
 
 unsigned char baggybounds_getdata(void* ptr) {
   uintptr_t x = (uintptr_t)ptr;
-  return __baggybounds_size_table_begin[x >> SLOT_SIZE];
-}
-
-void baggybounds_getdata(void* ptr, unsigned char data) {
-  uintptr_t x = (uintptr_t)ptr;
-  __baggybounds_size_table_begin[x >> SLOT_SIZE] = data;
+  return lookupSize(x);
 }
 
 void *
@@ -713,7 +814,7 @@ __sc_bb_src_poolfree (DebugPoolTy *Pool,
                       void *Node,TAG,
                       const char* SourceFile,
                       unsigned lineno) {
-  free(Node);
+  bbFree(Node);
 }	
 
 void
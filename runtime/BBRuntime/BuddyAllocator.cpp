@@ -0,0 +1,620 @@
+//===- BuddyAllocator.cpp - Allocator for baggy bounds objects ------------===//
+//
+//                         The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the allocator of baggy bounds heap objects.  Baggy
+// bounds gives every object a slot whose size is a power of two and which is
+// aligned to its size.  The C library can only provide such slots through
+// posix_memalign(), which is slow and may waste as much memory as it hands
+// out; this allocator provides them directly:
+//
+//  o) Small slots (up to SmallMaxLog) are carved from runs of pages.  Each
+//     thread keeps a cache of free slots of each size; the caches exchange
+//     slots with central free lists in batches.
+//
+//  o) Runs and medium slots (up to ChunkLog) are blocks of a binary buddy
+//     allocator that splits and coalesces aligned chunks mapped from the
+//     operating system.  A block is naturally aligned to its size.
+//
+//  o) Large slots are mapped from the operating system one at a time.
+//
+// A medium slot grows in place when the blocks that follow it are free, and
+// shrinks in place by freeing its upper halves.  A large slot is resized by
+// moving its pages with mremap() instead of copying them.
+//
+// A page map records, for every page that the allocator manages, the size of
+// the slots that it contains, so that a slot can be freed without a header
+// that would break its alignment.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BuddyAllocator.h"
+#include "SizeTable.h"
+
+#include "../include/SpinLock.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// The C library allocator, which allocated any memory that this one did not
+extern "C" void __libc_free (void * Ptr);
+
+NAMESPACE_SC_BEGIN
+
+// Binary logarithm of the smallest slot
+static const unsigned MinLog = 4;
+
+// Binary logarithm of the largest slot carved from a run
+static const unsigned SmallMaxLog = 11;
+
+// Binary logarithm of the page size and of the size of a run of small slots
+static const unsigned PageLog = 12;
+static const unsigned RunLog = 16;
+
+// Binary logarithm of the size of the chunks of the buddy allocator; larger
+// slots are mapped one at a time
+static const unsigned ChunkLog = 22;
+
+// Number of sizes of small slots and of orders of buddy blocks
+static const unsigned NumSmall = SmallMaxLog - MinLog + 1;
+static const unsigned NumOrders = ChunkLog - PageLog + 1;
+
+// Flag in the page map for the first page of a free buddy block
+static const unsigned char FreeBlock = 0x80;
+
+#if defined(_LP64)
+static const unsigned AddressBits = 47;
+#else
+static const unsigned AddressBits = 32;
+#endif
+
+//
+// Structure: FreeSlot
+//
+// Description:
+//  The link that a free small slot stores in its first word.
+//
+struct FreeSlot {
+  FreeSlot * Next;
+};
+
+//
+// Structure: BuddyBlock
+//
+// Description:
+//  The links that a free buddy block stores in its first words.
+//
+struct BuddyBlock {
+  BuddyBlock * Next;
+  BuddyBlock * Prev;
+};
+
+//
+// Structure: SizeClass
+//
+// Description:
+//  The central free list of small slots of one size.
+//
+struct SizeClass {
+  SpinLock Lock;
+  FreeSlot * Head;
+};
+
+//
+// Structure: ThreadCache
+//
+// Description:
+//  The free small slots of one thread.  It must need no initialization beyond
+//  zero-filling, since it is thread-local.
+//
+struct ThreadCache {
+  FreeSlot * Heads[NumSmall];
+  unsigned Counts[NumSmall];
+  bool Registered;
+};
+
+// The page map; 0 marks pages that the allocator does not manage
+static unsigned char * PageMap;
+
+// The free lists of the buddy allocator, indexed by order
+static SpinLock BuddyLock;
+static BuddyBlock * FreeBlocks[NumOrders];
+
+// The central free lists of small slots, indexed by size
+static SizeClass SizeClasses[NumSmall];
+
+// The cache of the current thread and the key that flushes it at thread exit
+static __thread ThreadCache Cache;
+static pthread_key_t CacheKey;
+static pthread_once_t CacheKeyOnce = PTHREAD_ONCE_INIT;
+
+//
+// Function: log2Ceil()
+//
+// Description:
+//  Return the binary logarithm of the smallest slot of at least NumBytes.
+//
+static inline unsigned
+log2Ceil (size_t NumBytes) {
+  if (NumBytes <= (1u << MinLog))
+    return MinLog;
+  return (sizeof (unsigned long) * 8) - __builtin_clzl (NumBytes - 1);
+}
+
+//
+// Function: batchSize()
+//
+// Description:
+//  Return the number of slots of the given size that a thread cache takes
+//  from, or gives back to, the central free list at once.
+//
+static inline unsigned
+batchSize (unsigned Log) {
+  unsigned Count = (16 * 1024) >> Log;
+  return (Count > 64) ? 64 : Count;
+}
+
+//
+// Function: initPageMap()
+//
+// Description:
+//  Reserve the page map.  Its pages are only backed with memory when the
+//  allocator touches them.
+//
+static bool
+initPageMap (void) {
+  static SpinLock InitLock;
+  SpinLockGuard Guard (InitLock);
+  if (PageMap)
+    return true;
+
+  size_t Size = (size_t) 1 << (AddressBits - PageLog);
+  void * Map = mmap (0, Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  if (Map == MAP_FAILED)
+    return false;
+  writeBarrier ();
+  PageMap = (unsigned char *) Map;
+  return true;
+}
+
+//
+// Function: mapAligned()
+//
+// Description:
+//  Map memory of the given size, aligned to its size, from the operating
+//  system.
+//
+static void *
+mapAligned (unsigned Log) {
+  size_t Size = (size_t) 1 << Log;
+  if (Log >= AddressBits)
+    return 0;
+
+  void * Map = mmap (0, 2 * Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (Map == MAP_FAILED)
+    return 0;
+
+  //
+  // Give back the memory before and after the aligned part.
+  //
+  uintptr_t Start = (uintptr_t) Map;
+  uintptr_t Aligned = (Start + Size - 1) & ~(Size - 1);
+  if (Aligned != Start)
+    munmap (Map, Aligned - Start);
+  if (Aligned + Size != Start + 2 * Size)
+    munmap ((void *) (Aligned + Size), Start + Size - Aligned);
+  return (void *) Aligned;
+}
+
+//
+// Function: pushBlock()
+//
+// Description:
+//  Put a free buddy block on the free list of its order.  The caller holds
+//  the buddy lock.
+//
+static inline void
+pushBlock (uintptr_t Addr, unsigned Order) {
+  BuddyBlock * Block = (BuddyBlock *) Addr;
+  BuddyBlock *& Head = FreeBlocks[Order - PageLog];
+  Block->Prev = 0;
+  Block->Next = Head;
+  if (Head)
+    Head->Prev = Block;
+  Head = Block;
+  PageMap[Addr >> PageLog] = Order | FreeBlock;
+}
+
+//
+// Function: removeBlock()
+//
+// Description:
+//  Take a free buddy block off the free list of its order.  The caller holds
+//  the buddy lock.
+//
+static inline void
+removeBlock (uintptr_t Addr, unsigned Order) {
+  BuddyBlock * Block = (BuddyBlock *) Addr;
+  if (Block->Prev)
+    Block->Prev->Next = Block->Next;
+  else
+    FreeBlocks[Order - PageLog] = Block->Next;
+  if (Block->Next)
+    Block->Next->Prev = Block->Prev;
+  PageMap[Addr >> PageLog] = 0;
+}
+
+//
+// Function: allocBlock()
+//
+// Description:
+//  Allocate a buddy block of the given order, splitting a larger block or a
+//  new chunk if there is no free block of that order.
+//
+static uintptr_t
+allocBlock (unsigned Order) {
+  SpinLockGuard Guard (BuddyLock);
+
+  unsigned Found = Order;
+  while ((Found <= ChunkLog) && !FreeBlocks[Found - PageLog])
+    ++Found;
+
+  uintptr_t Addr;
+  if (Found <= ChunkLog) {
+    Addr = (uintptr_t) FreeBlocks[Found - PageLog];
+    removeBlock (Addr, Found);
+  } else {
+    Addr = (uintptr_t) mapAligned (ChunkLog);
+    if (!Addr)
+      return 0;
+    Found = ChunkLog;
+  }
+
+  //
+  // Give the upper halves back until the block has the right order.
+  //
+  while (Found > Order) {
+    --Found;
+    pushBlock (Addr + ((uintptr_t) 1 << Found), Found);
+  }
+  PageMap[Addr >> PageLog] = Order;
+  return Addr;
+}
+
+//
+// Function: freeBlock()
+//
+// Description:
+//  Free a buddy block and coalesce it with its free buddies.  The memory of
+//  a chunk that becomes entirely free is given back to the operating system,
+//  but the chunk stays mapped.
+//
+static void
+freeBlock (uintptr_t Addr, unsigned Order) {
+  SpinLockGuard Guard (BuddyLock);
+
+  while (Order < ChunkLog) {
+    uintptr_t Buddy = Addr ^ ((uintptr_t) 1 << Order);
+    if (PageMap[Buddy >> PageLog] != (Order | FreeBlock))
+      break;
+    removeBlock (Buddy, Order);
+    PageMap[Addr >> PageLog] = 0;
+    if (Buddy < Addr)
+      Addr = Buddy;
+    ++Order;
+  }
+
+  if (Order == ChunkLog) {
+    size_t PageSize = (size_t) 1 << PageLog;
+    madvise ((void *) (Addr + PageSize),
+             ((size_t) 1 << ChunkLog) - PageSize, MADV_DONTNEED);
+  }
+  pushBlock (Addr, Order);
+}
+
+//
+// Function: growBlock()
+//
+// Description:
+//  Grow an allocated buddy block to the given order by taking its free
+//  buddies.  This is only possible if the block is the lower half of each
+//  larger block up to that order and if each of its buddies is free whole.
+//
+static bool
+growBlock (uintptr_t Addr, unsigned Order, unsigned NewOrder) {
+  SpinLockGuard Guard (BuddyLock);
+
+  for (unsigned O = Order; O < NewOrder; ++O) {
+    uintptr_t Buddy = Addr + ((uintptr_t) 1 << O);
+    if ((Addr & ((uintptr_t) 1 << O)) ||
+        (PageMap[Buddy >> PageLog] != (O | FreeBlock)))
+      return false;
+  }
+
+  for (unsigned O = Order; O < NewOrder; ++O)
+    removeBlock (Addr + ((uintptr_t) 1 << O), O);
+  PageMap[Addr >> PageLog] = NewOrder;
+  return true;
+}
+
+//
+// Function: shrinkBlock()
+//
+// Description:
+//  Shrink an allocated buddy block to the given order by freeing its upper
+//  halves.  Their buddies are the part of the block that remains allocated,
+//  so they cannot be coalesced.
+//
+static void
+shrinkBlock (uintptr_t Addr, unsigned Order, unsigned NewOrder) {
+  SpinLockGuard Guard (BuddyLock);
+
+  while (Order > NewOrder) {
+    --Order;
+    pushBlock (Addr + ((uintptr_t) 1 << Order), Order);
+  }
+  PageMap[Addr >> PageLog] = NewOrder;
+}
+
+//
+// Function: remapSlot()
+//
+// Description:
+//  Resize a large slot that was mapped on its own.  A slot shrinks in place;
+//  a slot grows into a new aligned mapping to which its pages are moved.
+//  Returns the new address of the slot, or 0 if it cannot be remapped.
+//
+static uintptr_t
+remapSlot (uintptr_t Slot, unsigned Log, unsigned NewLog) {
+#if defined(__linux__)
+  size_t Size = (size_t) 1 << Log;
+  size_t NewSize = (size_t) 1 << NewLog;
+  if (NewLog < Log) {
+    if (munmap ((void *) (Slot + NewSize), Size - NewSize))
+      return 0;
+    PageMap[Slot >> PageLog] = NewLog;
+    return Slot;
+  }
+
+  void * Target = mapAligned (NewLog);
+  if (!Target)
+    return 0;
+  void * New = mremap ((void *) Slot, Size, NewSize,
+                       MREMAP_MAYMOVE | MREMAP_FIXED, Target);
+  if (New == MAP_FAILED) {
+    munmap (Target, NewSize);
+    return 0;
+  }
+  PageMap[Slot >> PageLog] = 0;
+  PageMap[(uintptr_t) New >> PageLog] = NewLog;
+  return (uintptr_t) New;
+#else
+  return 0;
+#endif
+}
+
+//
+// Function: carveRun()
+//
+// Description:
+//  Allocate a run of pages and put its slots on the central free list of the
+//  given size.  The caller holds the lock of the size class.
+//
+static bool
+carveRun (unsigned Log) {
+  uintptr_t Run = allocBlock (RunLog);
+  if (!Run)
+    return false;
+
+  memset (PageMap + (Run >> PageLog), Log, 1u << (RunLog - PageLog));
+
+  SizeClass & Class = SizeClasses[Log - MinLog];
+  uintptr_t End = Run + ((uintptr_t) 1 << RunLog);
+  for (uintptr_t Slot = End - ((uintptr_t) 1 << Log); Slot >= Run;
+       Slot -= (uintptr_t) 1 << Log) {
+    FreeSlot * Free = (FreeSlot *) Slot;
+    Free->Next = Class.Head;
+    Class.Head = Free;
+  }
+  return true;
+}
+
+//
+// Function: releaseSlots()
+//
+// Description:
+//  Give up to Count slots of the thread cache back to the central free list.
+//
+static void
+releaseSlots (unsigned Log, unsigned Count) {
+  unsigned index = Log - MinLog;
+  SizeClass & Class = SizeClasses[index];
+  SpinLockGuard Guard (Class.Lock);
+  while (Count-- && Cache.Heads[index]) {
+    FreeSlot * Slot = Cache.Heads[index];
+    Cache.Heads[index] = Slot->Next;
+    --Cache.Counts[index];
+    Slot->Next = Class.Head;
+    Class.Head = Slot;
+  }
+}
+
+//
+// Function: flushCache()
+//
+// Description:
+//  Give all of the slots of a thread's cache back to the central free lists
+//  when the thread exits.
+//
+static void
+flushCache (void *) {
+  for (unsigned Log = MinLog; Log <= SmallMaxLog; ++Log)
+    releaseSlots (Log, ~0u);
+}
+
+static void
+createCacheKey (void) {
+  pthread_key_create (&CacheKey, flushCache);
+}
+
+//
+// Function: refillCache()
+//
+// Description:
+//  Move a batch of slots from the central free list to the thread cache.
+//
+static bool
+refillCache (unsigned Log) {
+  if (!Cache.Registered) {
+    pthread_once (&CacheKeyOnce, createCacheKey);
+    pthread_setspecific (CacheKey, &Cache);
+    Cache.Registered = true;
+  }
+
+  unsigned index = Log - MinLog;
+  SizeClass & Class = SizeClasses[index];
+  SpinLockGuard Guard (Class.Lock);
+  if (!Class.Head && !carveRun (Log))
+    return false;
+
+  for (unsigned Count = batchSize (Log); Count && Class.Head; --Count) {
+    FreeSlot * Slot = Class.Head;
+    Class.Head = Slot->Next;
+    Slot->Next = Cache.Heads[index];
+    Cache.Heads[index] = Slot;
+    ++Cache.Counts[index];
+  }
+  return true;
+}
+
+void *
+bbAllocate (size_t NumBytes) {
+  if (!PageMap && !initPageMap ())
+    return 0;
+
+  unsigned Log = log2Ceil (NumBytes);
+  uintptr_t Slot;
+  if (Log <= SmallMaxLog) {
+    unsigned index = Log - MinLog;
+    if (!Cache.Heads[index] && !refillCache (Log))
+      return 0;
+    FreeSlot * Free = Cache.Heads[index];
+    Cache.Heads[index] = Free->Next;
+    --Cache.Counts[index];
+    Slot = (uintptr_t) Free;
+  } else if (Log <= ChunkLog) {
+    Slot = allocBlock (Log);
+  } else {
+    Slot = (uintptr_t) mapAligned (Log);
+    if (Slot)
+      PageMap[Slot >> PageLog] = Log;
+  }
+
+  if (!Slot)
+    return 0;
+  if (__baggybounds_size_table_begin)
+    enterSize (Slot, Log);
+  return (void *) Slot;
+}
+
+void *
+bbReallocate (void * Ptr, size_t NumBytes) {
+  unsigned Log = bbSlotSize (Ptr);
+  if (!Log)
+    return 0;
+
+  unsigned NewLog = log2Ceil (NumBytes);
+  if (NewLog == Log)
+    return Ptr;
+
+  //
+  // Small slots are all of one size within their run, and medium slots
+  // cannot become large ones or the reverse without being copied.
+  //
+  uintptr_t Slot = (uintptr_t) Ptr;
+  bool Entered = __baggybounds_size_table_begin && lookupSize (Slot);
+  if ((Log > SmallMaxLog) && (Log <= ChunkLog) &&
+      (NewLog > SmallMaxLog) && (NewLog <= ChunkLog)) {
+    if ((NewLog > Log) && !growBlock (Slot, Log, NewLog))
+      return 0;
+  } else if ((Log <= ChunkLog) || (NewLog <= ChunkLog)) {
+    return 0;
+  }
+
+  //
+  // Remove the slot from the size table before any part of it is released,
+  // as bbFree() does; another thread may allocate the released memory and
+  // enter its own objects right away.
+  //
+  if (Entered)
+    removeSize (Slot, Log);
+
+  uintptr_t New = Slot;
+  if (Log > ChunkLog) {
+    New = remapSlot (Slot, Log, NewLog);
+    if (!New) {
+      if (Entered)
+        enterSize (Slot, Log);
+      return 0;
+    }
+  } else if (NewLog < Log) {
+    shrinkBlock (Slot, Log, NewLog);
+  }
+
+  if (Entered)
+    enterSize (New, NewLog);
+  return (void *) New;
+}
+
+unsigned char
+bbSlotSize (void * Slot) {
+  uintptr_t Addr = (uintptr_t) Slot;
+  if (!PageMap || (Addr >> AddressBits))
+    return 0;
+  unsigned char Entry = PageMap[Addr >> PageLog];
+  return (Entry & FreeBlock) ? 0 : Entry;
+}
+
+void
+bbFree (void * Ptr) {
+  if (!Ptr)
+    return;
+
+  unsigned Log = bbSlotSize (Ptr);
+  if (!Log) {
+    __libc_free (Ptr);
+    return;
+  }
+
+  uintptr_t Slot = (uintptr_t) Ptr;
+  assert (!(Slot & (((uintptr_t) 1 << Log) - 1)) && "Freeing a bad slot!");
+  if (__baggybounds_size_table_begin && lookupSize (Slot))
+    removeSize (Slot, Log);
+
+  if (Log <= SmallMaxLog) {
+    unsigned index = Log - MinLog;
+    FreeSlot * Free = (FreeSlot *) Ptr;
+    Free->Next = Cache.Heads[index];
+    Cache.Heads[index] = Free;
+    if (++Cache.Counts[index] > 2 * batchSize (Log))
+      releaseSlots (Log, batchSize (Log));
+  } else if (Log <= ChunkLog) {
+    freeBlock (Slot, Log);
+  } else {
+    PageMap[Slot >> PageLog] = 0;
+    munmap (Ptr, (size_t) 1 << Log);
+  }
+}
+
+NAMESPACE_SC_END
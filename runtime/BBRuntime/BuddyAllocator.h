@@ -0,0 +1,56 @@
+//===- BuddyAllocator.h - Allocator for baggy bounds objects ----*- C++ -*-===//
+//
+//                         The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the interface of the allocator that provides the memory
+// of heap objects in baggy bounds mode.  Every object is given a slot whose
+// size is a power of two and which is aligned to its size, as the baggy bounds
+// table requires.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_BUDDYALLOCATOR_H
+#define _SC_BUDDYALLOCATOR_H
+
+#include "safecode/SAFECode.h"
+
+#include <stddef.h>
+
+NAMESPACE_SC_BEGIN
+
+//
+// Allocate a slot of at least NumBytes bytes.  The slot is entered in the
+// baggy bounds table, if it has been created, with the binary logarithm of
+// its size.  Returns NULL if no memory is left.
+//
+void * bbAllocate (size_t NumBytes);
+
+//
+// Free a slot and remove it from the baggy bounds table.  Memory that was not
+// allocated by bbAllocate() is given back to the C library.
+//
+void bbFree (void * Slot);
+
+//
+// Resize a slot to hold at least NumBytes bytes without copying its contents.
+// The slot keeps its address if it already has the right size or if its
+// buddies are free; large slots are remapped and may move.  The slot keeps
+// its entry in the baggy bounds table, if it has one, with its new size.
+// Returns the slot, or NULL if it cannot be resized this way.
+//
+void * bbReallocate (void * Slot, size_t NumBytes);
+
+//
+// Return the binary logarithm of the size of the slot that starts at the given
+// address, or 0 if it was not allocated by bbAllocate().
+//
+unsigned char bbSlotSize (void * Slot);
+
+NAMESPACE_SC_END
+
+#endif
@@ -14,6 +14,7 @@
 #include "DebugReport.h"
 #include "PoolAllocator.h"
 #include "RewritePtr.h"
+#include "SizeTable.h"
 
 #include "safecode/Runtime/BBRuntime.h"
 
@@ -26,7 +27,6 @@
 #define TAG unsigned tag
 #define SRC_INFO const char *SourceFile, unsigned lineNo
 
-extern unsigned char* __baggybounds_size_table_begin; 
 extern unsigned SLOT_SIZE;
 extern unsigned WORD_SIZE;
 extern const unsigned int logregs;
@@ -131,7 +131,7 @@ char *bb_pool_strcpy_debug(DebugPoolTy *dstPool, DebugPoolTy *srcPool, char *dst
   }
 
   // Check that both the destination and source pointers fall within their respective bounds.
-  unsigned char e = __baggybounds_size_table_begin[(uintptr_t)dst >> SLOT_SIZE];
+  unsigned char e = lookupSize((uintptr_t)dst);
   if (e) {
     std::cout << "Destination pointer out of bounds!\n";
 
@@ -149,7 +149,7 @@ char *bb_pool_strcpy_debug(DebugPoolTy *dstPool, DebugPoolTy *srcPool, char *dst
 
     ReportMemoryViolation(&v);
   }
-  e = __baggybounds_size_table_begin[(uintptr_t)src >> SLOT_SIZE];
+  e = lookupSize((uintptr_t)src);
 
   if (e) {
     std::cout << "Source pointer out of bounds!\n";
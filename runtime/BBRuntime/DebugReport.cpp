@@ -17,6 +17,13 @@
 
 NAMESPACE_SC_BEGIN
 
+void
+DebugViolationInfo::getSourceLocation(const char * & File,
+                                      unsigned & Line) const {
+  File = this->SourceFile;
+  Line = this->lineNo;
+}
+
 void
 DebugViolationInfo::print(std::ostream & OS) const {
   //
@@ -29,6 +29,8 @@ struct DebugViolationInfo : public ViolationInfo {
   const char * SourceFile;
   unsigned int lineNo;
   virtual void print (std::ostream & OS) const;
+  virtual void getSourceLocation (const char * & SourceFile,
+                                  unsigned & lineNo) const;
   DebugViolationInfo() : dbgMetaData(0), SourceFile(0), lineNo(0) {}
 };
 
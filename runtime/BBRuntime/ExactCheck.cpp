@@ -16,17 +16,18 @@
 #include "ConfigData.h"
 #include "PoolAllocator.h"
 #include "RewritePtr.h"
+#include "SizeTable.h"
 
 #include "safecode/Config/config.h"
 #include "safecode/Runtime/BBRuntime.h"
 #include "safecode/Runtime/BBMetaData.h"
+#include "../include/RuntimeStats.h"
 
 #include <stdint.h>
 
 #include <cstdio>
 
 extern FILE * ReportLog;
-extern unsigned char* __baggybounds_size_table_begin;
 extern unsigned SLOT_SIZE;
 
 using namespace NAMESPACE_SC;
@@ -54,6 +55,8 @@ exactcheck_check (void *source, void * ObjStart, void * ObjEnd,
  */
 void *
 bb_exactcheck2 (char *source, char *base, char *result, unsigned size) {
+  SC_STAT_INC (EXACTCHECK);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -92,6 +95,8 @@ exactcheck2_debug (char *source,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT_INC (EXACTCHECK);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -157,14 +162,29 @@ exactcheck_check (void * Source,
      RealDest = (void *)((intptr_t) RealSrc + 
                         ((intptr_t) Dest - (intptr_t) Source));
     /*
-     * Retrieve the original bounds of the object.
+     * Retrieve the original bounds of the object.  A tagged pointer records
+     * the object from which it originates; otherwise, look up the object in
+     * which the real source pointer lies.
      */
-    unsigned char e;
-    e = __baggybounds_size_table_begin[(uintptr_t)RealSrc >> SLOT_SIZE];
-
-    uintptr_t RealObjStart = (uintptr_t)RealSrc & ~((1<<e)-1);
-    BBMetaData *data = (BBMetaData*)(RealObjStart + (1<<e) - sizeof(BBMetaData));
-    uintptr_t RealObjEnd = RealObjStart + data->size - 1;
+    void * OOBStart = 0;
+    void * OOBEnd = 0;
+    if (isTaggedPtr (Source))
+      getTaggedObject (Source, OOBStart, OOBEnd);
+
+    uintptr_t RealObjStart;
+    uintptr_t RealObjEnd;
+    if (OOBStart) {
+      RealObjStart = (uintptr_t)OOBStart;
+      RealObjEnd = (uintptr_t)OOBEnd;
+    } else {
+      unsigned char e;
+      e = lookupSize((uintptr_t)RealSrc);
+
+      RealObjStart = (uintptr_t)RealSrc & ~((1<<e)-1);
+      BBMetaData *data =
+        (BBMetaData*)(RealObjStart + (1<<e) - sizeof(BBMetaData));
+      RealObjEnd = RealObjStart + data->size - 1;
+    }
 
 
     /* 
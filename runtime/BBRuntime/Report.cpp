@@ -15,6 +15,8 @@
 #include "safecode/Runtime/Report.h"
 #include "safecode/Config/config.h"
 
+#include "../include/ViolationQueue.h"
+
 #include <iostream>
 #include <cstdlib>
 
@@ -25,6 +27,13 @@ NAMESPACE_SC_BEGIN
 
 ViolationInfo::~ViolationInfo() {}
 
+void
+ViolationInfo::getSourceLocation(const char * & SourceFile,
+                                 unsigned & lineNo) const {
+  SourceFile = 0;
+  lineNo = 0;
+}
+
 void
 ViolationInfo::print(std::ostream & OS) const {
   //
@@ -97,31 +106,18 @@ ViolationInfo::print(std::ostream & OS) const {
   OS << "= Program counter                       :\t" << this->faultPC << "\n";
 }
 
+//
+// Function: ReportMemoryViolation()
+//
+// Description:
+//  Report a memory violation.
+//
 void
 ReportMemoryViolation(const ViolationInfo *v) {
   // Flag for whether to terminate when an error is detected.
   extern unsigned StopOnError;
 
-  //
-  // Print the error to the error log.
-  //
-  v->print(*ErrorLog);
-  *ErrorLog << std::flush;
-
-  //
-  // If we need to terminate now, do that.
-  //
-  if (StopOnError)
-    abort();
-
-  //
-  // Otherwise, report a certain number of errors before terminating the
-  // program.
-  //
-  static unsigned count = 20;
-  --count;
-  if (!count) abort();
-  return;
+  queueViolation (v, StopOnError);
 }
 
 NAMESPACE_SC_END
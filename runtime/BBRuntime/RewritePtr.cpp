@@ -14,8 +14,11 @@
 #include "PoolAllocator.h"
 #include "DebugReport.h"
 #include "RewritePtr.h"
+#include "SizeTable.h"
 
+#include "safecode/Runtime/BBMetaData.h"
 #include "safecode/Runtime/BBRuntime.h"
+#include "../include/RuntimeStats.h"
 #include "llvm/ADT/DenseMap.h"
 
 #include <cstdio>
@@ -36,6 +39,76 @@ std::map<const void *, const void *> RewrittenPointers;
 // Record from which object an OOB pointer originates
 llvm::DenseMap<void *, std::pair<void *, void * > > RewrittenObjs;
 
+#if defined(_LP64)
+//
+// Function: tagPtr()
+//
+// Description:
+//  Tag an out-of-bounds pointer with the size of the slot of its object and
+//  the number of slots from the object to the pointer.
+//
+// Return value:
+//  The tagged pointer, or NULL if the object is not registered or if the
+//  pointer is too far from it to be tagged.
+//
+static void *
+tagPtr (const void * p, const void * ObjStart) {
+  uintptr_t Ptr = (uintptr_t) p;
+  uintptr_t Start = (uintptr_t) ObjStart;
+  if ((Ptr > OOBAddressMask) || (Start > OOBAddressMask))
+    return 0;
+
+  unsigned char e = lookupSize (Start);
+  if (e == 0)
+    return 0;
+
+  intptr_t Slots = (intptr_t) (Ptr >> e) - (intptr_t) (Start >> e);
+  intptr_t MaxSlots = (intptr_t) 1 << (OOBSlotBits - 1);
+  if ((Slots < -MaxSlots) || (Slots >= MaxSlots))
+    return 0;
+
+  uintptr_t SlotMask = ((uintptr_t) 1 << OOBSlotBits) - 1;
+  return (void *) (OOBTag |
+                   ((uintptr_t) e << OOBSizeShift) |
+                   (((uintptr_t) Slots & SlotMask) << OOBAddressBits) |
+                   Ptr);
+}
+#endif
+
+//
+// Function: getTaggedObject()
+//
+// Description:
+//  Find the object of a tagged out-of-bounds pointer from its tag.
+//
+// Outputs:
+//  start - The first address of the memory object, or NULL if the object is
+//          no longer registered.
+//  end   - The last valid address of the memory object, or NULL if the object
+//          is no longer registered.
+//
+void
+getTaggedObject (const void * p, void * & start, void * & end) {
+  start = end = 0;
+#if defined(_LP64)
+  uintptr_t Ptr = (uintptr_t) p;
+  unsigned char e = (Ptr >> OOBSizeShift) & 0x3f;
+  intptr_t Slots = (intptr_t) (Ptr << (64 - OOBSizeShift)) >>
+                   (64 - OOBSlotBits);
+  uintptr_t Start = (((Ptr & OOBAddressMask) >> e) - Slots) << e;
+
+  //
+  // The object may have been freed since the pointer was tagged; only read
+  // its metadata if the slot is still registered with the same size.
+  //
+  if (lookupSize (Start) != e)
+    return;
+  BBMetaData * data = (BBMetaData *) (Start + ((uintptr_t) 1 << e)) - 1;
+  start = (void *) Start;
+  end = (void *) (Start + data->size - 1);
+#endif
+}
+
 //
 // Function: rewrite_ptr()
 //
@@ -63,6 +136,19 @@ rewrite_ptr (DebugPoolTy * Pool,
 
   static unsigned char * invalidptr = 0;
 
+#if defined(_LP64)
+  //
+  // Tag the pointer if it is close enough to its object.  This needs neither
+  // a rewrite pointer nor an entry in the maps below.
+  //
+  if (ObjStart) {
+    if (void * Tagged = tagPtr (p, ObjStart)) {
+      SC_STAT_INC (OOB_TAGS);
+      return Tagged;
+    }
+  }
+#endif
+
   //
   // If this pointer has already been rewritten, do not rewrite it again.
   //
@@ -92,6 +178,7 @@ rewrite_ptr (DebugPoolTy * Pool,
   // special Out of Bounds Pointer pool.
   //
   if (!Pool) Pool = &OOBPool;
+  SC_STAT_INC (OOB_REWRITES);
 
   //
   // Determine if this pointer value has already been rewritten.  If so, just
@@ -129,6 +216,12 @@ using namespace safecode;
 //
 void *
 pchk_getActualValue (DebugPoolTy * Pool, void * p) {
+  //
+  // A tagged pointer holds its actual value below the tag.
+  //
+  if (isTaggedPtr (p))
+    return getTaggedValue (p);
+
   //
   // If the pointer is not within the rewrite pointer range, then it is not a
   // rewritten pointer.  Simply return its current value.
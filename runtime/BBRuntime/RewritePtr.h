@@ -35,8 +35,40 @@ NAMESPACE_SC_BEGIN
 //  o) Other platforms - We allocate a range of memory and disable read and
 //                       write permissions for the pages contained within it.
 //
-extern uintptr_t InvalidUpper;
-extern uintptr_t InvalidLower;
+// The bounds have C linkage because compiled code that performs checks inline
+// reads them (see InlineBaggyChecks).
+//
+extern "C" uintptr_t InvalidUpper;
+extern "C" uintptr_t InvalidLower;
+
+#if defined(_LP64)
+//
+// On 64-bit systems, most out-of-bounds pointers are not rewritten into the
+// range above.  A pointer that stays within 512 slots of its object is tagged
+// instead: its top bit is set, which makes it non-canonical so that loads and
+// stores through it fault, and the bits below the tag record the binary
+// logarithm of the size of the object's slot and the number of slots from the
+// object to the pointer:
+//
+//   63 62       57 56        47 46                0
+//   [1][   size   ][  slots   ][      address      ]
+//
+// The actual value and the object of a tagged pointer are thus computed
+// without the rewrite tables.  Pointers further from their objects, and
+// pointers whose objects are not registered, are still rewritten.
+//
+static const unsigned OOBAddressBits = 47;
+static const unsigned OOBSlotBits = 10;
+static const unsigned OOBSizeShift = 57;
+static const uintptr_t OOBTag = (uintptr_t) 1 << 63;
+static const uintptr_t OOBAddressMask = ((uintptr_t) 1 << OOBAddressBits) - 1;
+#endif
+
+//
+// Find the object of a tagged out-of-bounds pointer.  The bounds are null if
+// the object has been unregistered.
+//
+void getTaggedObject (const void * p, void * & start, void * & end);
 
 // Map between rewrite pointer and source file information
 extern llvm::DenseMap<void *, const char*>  RewriteSourcefile;
@@ -60,11 +92,46 @@ static inline bool
 isRewritePtr (void * p) {
   uintptr_t ptr = (uintptr_t) p;
 
+#if defined(_LP64)
+  if (ptr & OOBTag)
+    return true;
+#endif
   if ((InvalidLower < ptr ) && (ptr < InvalidUpper))
     return true;
   return false;
 }
 
+//
+// Function: isTaggedPtr()
+//
+// Description:
+//  Determines whether the specified pointer value is a tagged Out-of-Bounds
+//  pointer value.
+//
+static inline bool
+isTaggedPtr (const void * p) {
+#if defined(_LP64)
+  return (uintptr_t) p & OOBTag;
+#else
+  return false;
+#endif
+}
+
+//
+// Function: getTaggedValue()
+//
+// Description:
+//  Return the actual value of a tagged Out-of-Bounds pointer.
+//
+static inline void *
+getTaggedValue (const void * p) {
+#if defined(_LP64)
+  return (void *) ((uintptr_t) p & OOBAddressMask);
+#else
+  return const_cast<void *>(p);
+#endif
+}
+
 //
 // Function: getOOBObject()
 //
@@ -89,6 +156,11 @@ getOOBObject (void * p, void * & start, void * & end) {
   extern llvm::DenseMap<void *, std::pair<void *, void * > >
   RewrittenObjs;
 
+  if (isTaggedPtr (p)) {
+    getTaggedObject (p, start, end);
+    return true;
+  }
+
   if (isRewritePtr (p)) {
     // FIXME: the casts are hacks to deal with the C++ type system
     start = const_cast<void*>(RewrittenObjs[p].first);
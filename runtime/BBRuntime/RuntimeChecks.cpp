@@ -21,11 +21,13 @@
 #include "DebugReport.h"
 #include "PoolAllocator.h"
 #include "RewritePtr.h"
+#include "SizeTable.h"
 
 #include "safecode/Runtime/BBMetaData.h"
 #include "safecode/Runtime/BBRuntime.h"
 
 #include "../include/CWE.h"
+#include "../include/RuntimeStats.h"
 
 #include <map>
 #include <cstdarg>
@@ -38,7 +40,6 @@
 #include <stdio.h>
 
 extern FILE * ReportLog;
-extern unsigned char* __baggybounds_size_table_begin; 
 extern unsigned SLOT_SIZE;
 extern unsigned SLOTSIZE;
 extern unsigned WORD_SIZE;
@@ -55,17 +56,23 @@ using namespace NAMESPACE_SC;
 //  Source   - The source pointer used in the indexing operation (the GEP).
 //  Dest     - The result pointer of the indexing operation (the GEP).
 //
+// Outputs:
+//  ObjStart - The first address of the object in which Source was found.
+//  ObjEnd   - The last valid address of the object in which Source was found.
+//             Both are left unchanged if the object cannot be checked.
+//
 // Return:
 //  0:  The Dest is within the valid object in which Source was found.
 //  1:  The Dest is not within the valid object in which Source was found.
 //
 static inline int
-_barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest) {
+_barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest,
+                             uintptr_t & ObjStart, uintptr_t & ObjEnd) {
   //
   // Look for the bounds in the table.
   //
   unsigned char e;
-  e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
+  e = lookupSize(Source);
   // The object is not registed, so it cannot be checked.
   if (e == 0) return 0; 
   //
@@ -80,6 +87,8 @@ _barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest) {
   BBMetaData *data = (BBMetaData*)(begin + (1<<e) - sizeof(BBMetaData));
   if (data->size == 0) return 0;
   uintptr_t end = begin + data->size;
+  ObjStart = begin;
+  ObjEnd = end - 1;
   //
   // If the Dest is within the valid object in which Source was found,
   // return 0; else return 1.
@@ -100,44 +109,50 @@ _barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest) {
 //
 static inline void*
 _barebone_boundscheck (uintptr_t Source, uintptr_t Dest) {
-
-  uintptr_t val = 1 ;
-  void * RealSrc = (void *)Source;
-  void * RealDest = (void *)Dest;
-
-  //
-  // Check the bounds of the pointers.
-  //
-  val = _barebone_pointers_in_bounds(Source, Dest);
-  if(!val) return RealDest;
+  uintptr_t ObjStart = 0;
+  uintptr_t ObjEnd = 0;
 
   //
-  // Either:
-  //  1) Dest is not within the valid object in which Source was found or
-  //  2) Source is an OOB pointer.
+  // Check the bounds of the pointers.  If Dest is not within the valid
+  // object in which Source was found, rewrite it.  The source pointer of an
+  // OOB pointer must not be looked up in the table: a tagged pointer has no
+  // entry there.
   //
   if (!isRewritePtr((void *)Source)) {
-    // Dest is not within the valid object in which Source was found.
-    RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
-    return RealDest;
+    if (!_barebone_pointers_in_bounds(Source, Dest, ObjStart, ObjEnd))
+      return (void *)Dest;
+    return rewrite_ptr(NULL, (void *)Dest,
+                       (void *)ObjStart, (void *)ObjEnd, 0, 0);
   }
 
   //
-  // This means that Source is an OOB pointer. Compute the original source.
+  // This means that Source is an OOB pointer. Compute the original source
+  // and the real result pointer.
   //
-  RealSrc = pchk_getActualValue(NULL, (void *)Source);
-  //
-  // Compute the real result pointer.
-  //
-  RealDest = (void *)((intptr_t) RealSrc + Dest - Source);
+  uintptr_t RealSrc = (uintptr_t)pchk_getActualValue(NULL, (void *)Source);
+  uintptr_t RealDest = RealSrc + Dest - Source;
+
   //
-  // Re-check the real result pointer.
+  // Re-check the real result pointer against the object from which Source
+  // originates if Source is tagged, or else against the object in which the
+  // actual source pointer lies.
   //
-  val = _barebone_pointers_in_bounds((uintptr_t)RealSrc, (uintptr_t)RealDest);
-  if (!val) return RealDest;
-   
-  RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
-  return RealDest;
+  void * OOBStart = 0;
+  void * OOBEnd = 0;
+  if (isTaggedPtr((void *)Source))
+    getTaggedObject((void *)Source, OOBStart, OOBEnd);
+  if (OOBStart) {
+    ObjStart = (uintptr_t)OOBStart;
+    ObjEnd = (uintptr_t)OOBEnd;
+    if ((ObjStart <= RealDest) && (RealDest <= ObjEnd))
+      return (void *)RealDest;
+  } else if (!_barebone_pointers_in_bounds(RealSrc, RealDest,
+                                           ObjStart, ObjEnd)) {
+    return (void *)RealDest;
+  }
+
+  return rewrite_ptr(NULL, (void *)RealDest,
+                     (void *)ObjStart, (void *)ObjEnd, 0, 0);
 }
 
 //
@@ -154,6 +169,8 @@ bb_poolcheck_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+
   // If the address being checked is errno, then the check can pass.
   unsigned char * errnoPtr = (unsigned char *) &errno;
   if ((unsigned char *)Node == errnoPtr) return;
@@ -180,7 +197,7 @@ bb_poolcheck_debug (DebugPoolTy *Pool,
   // object.  If so, then the check succeeds, so just return to the caller.
   //
   unsigned char e;
-  e = __baggybounds_size_table_begin[(uintptr_t)Node >> SLOT_SIZE];
+  e = lookupSize((uintptr_t)Node);
   if (e == 0) return;
 
   uintptr_t ObjStart = (uintptr_t)Node & ~((1<<e)-1);
@@ -211,6 +228,8 @@ bb_poolcheckui_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+
   // If the address being checked is errno, then the check can pass.
   unsigned char * errnoPtr = (unsigned char *) &errno;
   if ((unsigned char *)Node == errnoPtr) return;
@@ -236,7 +255,7 @@ bb_poolcheckui_debug (DebugPoolTy *Pool,
   // object.  If so, then the check succeeds, so just return to the caller.
   //
   unsigned char e;
-  e = __baggybounds_size_table_begin[(uintptr_t)Node >> SLOT_SIZE];
+  e = lookupSize((uintptr_t)Node);
   if (e == 0) return;
 
   uintptr_t ObjStart = (uintptr_t)Node & ~((1<<e)-1);
@@ -287,6 +306,8 @@ bb_poolcheckalign_debug (DebugPoolTy *Pool,
                          unsigned Offset, TAG, 
                          const char * SourceFile, 
                          unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+
   //
   // Check if is an OOB pointer
   //
@@ -332,6 +353,8 @@ bb_boundscheck_debug (DebugPoolTy * Pool,
                       void * Dest, TAG, 
                       const char * SourceFile, 
                       unsigned lineno) {
+  SC_STAT_INC (BOUNDSCHECK);
+
   if (!isRewritePtr((void *)Source) && (Source == Dest)) return Dest;
   return _barebone_boundscheck((uintptr_t)Source, (uintptr_t)Dest);
 }
@@ -357,6 +380,8 @@ bb_boundscheckui_debug (DebugPoolTy * Pool,
                      void * Dest, TAG,
                      const char * SourceFile,
                      unsigned int lineno) {
+  SC_STAT_INC (BOUNDSCHECK);
+
   return  _barebone_boundscheck((uintptr_t)Source, (uintptr_t)Dest);
 }
 
@@ -451,6 +476,8 @@ __sc_bb_funccheck (void *f,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT_INC (FUNCCHECK);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -490,6 +517,8 @@ fastlscheck_debug(const char *base, const char *result, unsigned size,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT_INC (FASTLSCHECK);
+
   // If the address being checked is errno, then the check can pass.
   char * errnoPtr = (char *) &errno;
   if (result == errnoPtr) return;
@@ -546,7 +575,7 @@ bb_poolcheck_freeui_debug (DebugPoolTy *Pool,
   // debug information since we're in debug mode.
   //
   unsigned char e;
-  e = __baggybounds_size_table_begin[(uintptr_t)ptr >> SLOT_SIZE];
+  e = lookupSize((uintptr_t)ptr);
 
   uintptr_t ObjStart = (uintptr_t)ptr & ~((1<<e)-1);
   BBMetaData *data = (BBMetaData*)(ObjStart + (1<<e) - sizeof(BBMetaData));
@@ -684,6 +713,8 @@ funccheck_debug (void *f,
 //
 extern "C" void
 funccheckui (void *f, void * targets[]) {
+  SC_STAT_INC (FUNCCHECK);
+
   //
   // For now, do nothing.  If the list could be incomplete, we don't know when
   // a target is valid.
@@ -708,6 +739,8 @@ funccheckui_debug (void *f,
                    TAG,
                    const char * SourceFilep,
                    unsigned lineno) {
+  SC_STAT_INC (FUNCCHECK);
+
   //
   // For now, do nothing.  If the list could be incomplete, we don't know when
   // a target is valid.
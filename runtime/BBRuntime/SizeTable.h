@@ -0,0 +1,78 @@
+//===- SizeTable.h - The baggy bounds size table ----------------*- C++ -*-===//
+//
+//                         The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the interface of the baggy bounds size table.  The table
+// records, for every slot of memory, the binary logarithm of the size of the
+// object that covers it, or 0 if no registered object does.  It has two
+// levels:
+//
+//  o) The fine table has an entry for every 2^SLOT_SIZE bytes of memory and
+//     records objects smaller than 2^COARSE_SLOT_SIZE bytes.
+//
+//  o) The coarse table has an entry for every 2^COARSE_SLOT_SIZE bytes of
+//     memory and records the larger objects, which are aligned to at least
+//     that many bytes.  Registering a 64 MB object thus writes 1 K entries of
+//     the coarse table instead of 4 M entries of the fine one.
+//
+// An object in the fine table thus has at most 2^(COARSE_SLOT_SIZE - SLOT_SIZE)
+// entries, which fill a single page of the table.
+//
+// An object is recorded in exactly one of the tables, so a lookup reads both
+// and selects the fine entry if it is set without a branch.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_SIZETABLE_H
+#define _SC_SIZETABLE_H
+
+#include "safecode/SAFECode.h"
+
+#include <stdint.h>
+
+// The fine and coarse tables, which pool_init_runtime() creates
+extern unsigned char * __baggybounds_size_table_begin;
+extern unsigned char * __baggybounds_coarse_table_begin;
+extern unsigned SLOT_SIZE;
+
+NAMESPACE_SC_BEGIN
+
+// Binary logarithm of the granularity of the coarse table
+static const unsigned COARSE_SLOT_SIZE = 16;
+
+//
+// Function: lookupSize()
+//
+// Description:
+//  Return the binary logarithm of the size of the registered object that
+//  covers the given address, or 0 if there is none.
+//
+static inline unsigned char
+lookupSize (uintptr_t Addr) {
+  unsigned char Fine = __baggybounds_size_table_begin[Addr >> SLOT_SIZE];
+  unsigned char Coarse =
+    __baggybounds_coarse_table_begin[Addr >> COARSE_SLOT_SIZE];
+  return Fine ? Fine : Coarse;
+}
+
+//
+// Record an object of 2^Size bytes that starts at the given address, which
+// must be aligned to its size, in the size table.
+//
+void enterSize (uintptr_t Base, unsigned char Size);
+
+//
+// Remove an object of 2^Size bytes that starts at the given address from the
+// size table.  Pages of the table that the object covers entirely are given
+// back to the operating system.
+//
+void removeSize (uintptr_t Base, unsigned char Size);
+
+NAMESPACE_SC_END
+
+#endif
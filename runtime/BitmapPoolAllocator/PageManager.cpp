@@ -35,6 +35,13 @@ namespace llvm {
 
 FreePagesListType FreePages;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+SpinLock FreePagesLock;
+
+// Lock protecting the list of mapped ranges and the reserved ranges
+static SpinLock MappingLock;
+#endif
+
 // Define this if we want to use memalign instead of mmap to get pages.
 // Empirically, this slows down the pool allocator a LOT.
 #define USE_MEMALIGN 0
@@ -42,7 +49,114 @@ extern "C" {
 uintptr_t PageSize = 0;
 }
 
-static unsigned poolmemusage = 0;
+//
+// Function: getMappedRanges()
+//
+// Description:
+//  Return the list of the ranges of memory mapped by GetPages().  It is a
+//  function-level static so that it is constructed before its first use.
+//
+static std::vector<std::pair<char *, size_t> > &
+getMappedRanges() {
+  static std::vector<std::pair<char *, size_t> > MappedRanges;
+  return MappedRanges;
+}
+
+// Number of bytes of virtual memory mapped by GetPages()
+static size_t PoolMemReserved = 0;
+
+#if SC_RESERVE_PAGES
+//
+// In this mode, GetPages() hands out pages from large ranges of virtual memory
+// that are mapped once.  The kernel backs the pages with zeroed memory when
+// they are first touched, so they are neither touched nor memset when they
+// are handed out.  Once the pools have grown large, the kernel is allowed to
+// back the ranges with transparent huge pages.
+//
+
+// Size of each range of reserved virtual memory
+static const size_t ReservationSize =
+  (sizeof (void *) == 8) ? ((size_t) 1 << 30) : ((size_t) 64 << 20);
+
+// Alignment of the start of each range (the size of a huge page).  Pages are
+// handed out of a range back to back, so only the first request from a range
+// is aligned; consecutive requests fill the same huge pages.
+static const size_t ReservationAlign = (size_t) 2 << 20;
+
+// Number of bytes handed out after which huge pages are used
+static const size_t HugePageThreshold = (size_t) 64 << 20;
+
+// The part of the current range that has not been handed out
+static char * ReserveNext = 0;
+static char * ReserveEnd = 0;
+
+// Number of bytes handed out of the ranges
+static size_t PoolMemHandedOut = 0;
+
+//
+// Function: allowHugePages()
+//
+// Description:
+//  Allow the kernel to back the specified memory with transparent huge pages.
+//
+static void
+allowHugePages (char * Start, char * End) {
+#ifdef MADV_HUGEPAGE
+  uintptr_t First = ((uintptr_t) Start + ReservationAlign - 1) &
+                    ~(ReservationAlign - 1);
+  if (First < (uintptr_t) End)
+    madvise ((void *) First, (uintptr_t) End - First, MADV_HUGEPAGE);
+#endif
+}
+
+//
+// Function: ReservePages()
+//
+// Description:
+//  Hand out the specified number of bytes of memory from the reserved ranges,
+//  reserving a new range if the current one is exhausted.  The memory is
+//  shared so that the dangling pointer detector can remap it.
+//
+static void *
+ReservePages (size_t Size) {
+  if ((size_t)(ReserveEnd - ReserveNext) < Size) {
+    size_t Length = ((Size > ReservationSize) ? Size : ReservationSize) +
+                    ReservationAlign;
+    int Flags = MAP_SHARED | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    Flags |= MAP_NORESERVE;
+#endif
+    char * Start = (char *) mmap (0, Length, PROT_READ|PROT_WRITE, Flags,
+                                  -1, 0);
+    if (Start == MAP_FAILED) {
+      perror ("mmap:");
+      fflush (stdout);
+      fflush (stderr);
+      assert(0 && "reserving pages failed\n");
+      abort ();
+    }
+    getMappedRanges().push_back (std::make_pair (Start, Length));
+    PoolMemReserved += Length;
+
+    ReserveNext = (char *) (((uintptr_t) Start + ReservationAlign - 1) &
+                            ~(ReservationAlign - 1));
+    ReserveEnd = Start + Length;
+    if (PoolMemHandedOut >= HugePageThreshold)
+      allowHugePages (ReserveNext, ReserveEnd);
+  }
+
+  char * Addr = ReserveNext;
+  ReserveNext += Size;
+
+  size_t OldHandedOut = PoolMemHandedOut;
+  PoolMemHandedOut += Size;
+  if ((OldHandedOut < HugePageThreshold) &&
+      (PoolMemHandedOut >= HugePageThreshold))
+    allowHugePages (ReserveNext, ReserveEnd);
+
+  return Addr;
+}
+#endif
 
 // Physical page size
 uintptr_t PPageSize;
@@ -70,6 +184,16 @@ InitializePageManager() {
 
 #if !USE_MEMALIGN
 void *GetPages(unsigned NumPages) {
+#if SC_RESERVE_PAGES
+  // Reserved pages are zero until they are written
+  if (initvalue == 0) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+    SpinLockGuard Guard (MappingLock);
+#endif
+    return ReservePages (NumPages * PageSize);
+  }
+#endif
+
 #if defined(i386) || defined(__i386__) || defined(__x86__) || defined(__x86_64__)
   /* Linux and *BSD tend to have these flags named differently. */
 #if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
@@ -123,7 +247,15 @@ void *GetPages(unsigned NumPages) {
    }
 #endif
 #endif
-  poolmemusage += NumPages * PageSize;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MappingLock.lock ();
+#endif
+  getMappedRanges().push_back (std::make_pair ((char *) Addr,
+                                             NumPages * PageSize));
+  PoolMemReserved += NumPages * PageSize;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MappingLock.unlock ();
+#endif
 
   // Initialize the page to contain safe inital values
   memset(Addr, initvalue, NumPages *PageSize);
@@ -139,6 +271,9 @@ __attribute__((weak)) void * AllocatePage() {
 
   FreePagesListType &FPL = FreePages;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (FreePagesLock);
+#endif
   if (!FPL.empty()) {
     void *Result = FPL.back();
       FPL.pop_back();
@@ -165,7 +300,43 @@ void *AllocateNPages(unsigned Num) {
 /// future allocation.
 void FreePage(void *Page) {
   FreePagesListType &FPL = FreePages;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (FreePagesLock);
+#endif
   FPL.push_back(Page);
 }
 
+//
+// Function: poolmemusage()
+//
+// Description:
+//  Report how much memory the page manager has obtained from the operating
+//  system.
+//
+// Outputs:
+//  Reserved - The number of bytes of virtual memory mapped for pages.
+//  Resident - The number of bytes of that memory that is resident in physical
+//             memory.
+//
+void
+poolmemusage (size_t & Reserved, size_t & Resident) {
+  std::vector<std::pair<char *, size_t> > & Ranges = getMappedRanges();
+  std::vector<unsigned char> InCore;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (MappingLock);
+#endif
+  Reserved = PoolMemReserved;
+  Resident = 0;
+  for (unsigned index = 0; index < Ranges.size(); ++index) {
+    size_t NumPPages = (Ranges[index].second + PPageSize - 1) / PPageSize;
+    InCore.resize (NumPPages);
+    if (mincore (Ranges[index].first, Ranges[index].second, &InCore[0]))
+      continue;
+    for (size_t page = 0; page < NumPPages; ++page)
+      if (InCore[page] & 1)
+        Resident += PPageSize;
+  }
+}
+
 }
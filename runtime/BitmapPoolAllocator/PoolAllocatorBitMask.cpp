@@ -60,6 +60,10 @@ poolinit(BitmapPoolTy *Pool, unsigned NodeSize) {
   // Initialize the splay tree
   Pool->Ptr1 = Pool->Ptr2 = 0;
   Pool->LargeArrays = 0;
+  for (unsigned i = 0; i < BitmapPoolTy::NumLargeArrayBuckets; ++i)
+    Pool->FreeLargeArrays[i] = 0;
+  Pool->LargeArrayClock = Pool->OrdinaryOps = 0;
+  Pool->LargeArraysReused = Pool->LargeArraysFresh = 0;
   Pool->StackSlabs = Pool->FreeStackSlabs = 0;
   // For SAFECode, we set FreeablePool to 0 always
   //  Pool->FreeablePool = 0;
@@ -69,6 +73,10 @@ poolinit(BitmapPoolTy *Pool, unsigned NodeSize) {
     Pool->SlabAddressArray[i] = 0;
   }
   Pool->NumSlabs = 0;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  // Pool descriptors on the stack are not constructed
+  Pool->Lock.unlock ();
+#endif
 }
 
 // pooldestroy - Release all memory allocated for a pool
@@ -108,6 +116,16 @@ pooldestroy(BitmapPoolTy *Pool) {
     PS = Next;
   }
 
+  // Free the large arrays that have been freed by the program
+  for (unsigned i = 0; i < BitmapPoolTy::NumLargeArrayBuckets; ++i) {
+    PS = (PoolSlab*)Pool->FreeLargeArrays[i];
+    while (PS) {
+      PoolSlab *Next = PS->Next;
+      PS->destroy();
+      PS = Next;
+    }
+  }
+
 }
 
 //
@@ -126,6 +144,10 @@ poolalloc(BitmapPoolTy *Pool, unsigned NumBytes) {
   void *retAddress = NULL;
   assert(Pool && "Null pool pointer passed into poolalloc!\n");
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (Pool->Lock);
+#endif
+
   // FIXME: Is it necessary?
   // Ensure that we're always allocating at least 1 byte.
   if (NumBytes == 0)
@@ -389,6 +411,10 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
   //
   if (Node == 0) return;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (Pool->Lock);
+#endif
+
   // Canonical pointer for the pointer we're freeing
   void * CanonNode = Node;
 
@@ -402,7 +428,19 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
   //
   if (!PS) return;
   assert (PS && "poolfree: No poolslab found for object!\n");
+
+  //
+  // Large arrays are kept by the pool for reuse.  Only a pointer to the
+  // beginning of the array frees it.
+  //
+  if (PS->isSingleArray) {
+    if (Node == PS->getElementAddress(0, 0))
+      PS->freeSingleArray(Pool);
+    return;
+  }
+
   PS->freeElement(Idx);
+  PoolSlab::noteOrdinaryOp(Pool);
 
   //
   // If we could not find the slab in which the node belongs, then we were
@@ -462,55 +500,30 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
 }
 
 
-// SearchForContainingSlab - Do a brute force search through the list of
-// allocated slabs for the node in question.
+//
+// Function: SearchForContainingSlab()
+//
+// Description:
+//  Find the slab of the specified pool that contains the node in question.
+//  The slab map yields the only slab that can contain the node, so the cost
+//  of the search does not depend upon the number of slabs in the pool.
+//
+// Outputs:
+//  TheIndex - The index of the node within the slab.
+//
+// Return value:
+//  NULL - The node is not within a slab of the pool.
+//  Otherwise, a pointer to the slab containing the node is returned.
 //
 static PoolSlab *
 SearchForContainingSlab(BitmapPoolTy *Pool, void *Node, unsigned &TheIndex) {
-  PoolSlab *PS = (PoolSlab*)Pool->Ptr1;
-  unsigned NodeSize = Pool->NodeSize;
-
-  // Search the partially allocated slab list for the slab that contains this
-  // node.
   int Idx = -1;
-  if (PS) {               // Pool->Ptr1 could be null if Ptr2 isn't
-    for (; PS; PS = PS->Next) {
-      Idx = PS->containsElement(Node, NodeSize);
-      if (Idx != -1) break;
-    }
-  }
-
-  // If the partially allocated slab list doesn't contain it, maybe the
-  // completely allocated list does.
-  if (PS == 0) {
-    PS = (PoolSlab*)Pool->Ptr2;
-    assert(Idx == -1 && "Found node but don't have PS?");
-    
-    while (PS) {
-      assert(PS && "poolfree: node being free'd not found in allocation "
-             " pool specified!\n");
-      Idx = PS->containsElement(Node, NodeSize);
-      if (Idx != -1) break;
-      PS = PS->Next;
-    }
-  }
-  
-  // Otherwise, maybe its a block within LargeArrays
-  if(PS == 0) {
-    PS = (PoolSlab*)Pool->LargeArrays;
-    assert(Idx == -1  && "Found node but don't have PS?");
-    
-    while (PS) {
-      assert(PS && "poolfree: node being free'd not found in allocation "
-             " pool specified!\n");
-      Idx = PS->containsElement(Node, NodeSize);
-      if (Idx != -1) break;
-      PS = PS->Next;
-    }
-  }
+  PoolSlab *PS = SlabMap::lookup(Node);
+  if (PS && (PS->Owner == Pool) && !(PS->isFreeArray))
+    Idx = PS->containsElement(Node, Pool->NodeSize);
 
   TheIndex = Idx;
-  return PS;
+  return (Idx != -1) ? PS : 0;
 }
 
 //
@@ -539,3 +552,17 @@ __pa_bitmap_poolcheck (BitmapPoolTy * Pool, void * Node) {
   return 0;
 }
 
+//
+// Function: __pa_bitmap_largestats()
+//
+// Description:
+//  Report how many large array allocations from the specified pool reused a
+//  freed large array and how many needed fresh pages.
+//
+void
+__pa_bitmap_largestats (BitmapPoolTy * Pool,
+                        unsigned long * Reused,
+                        unsigned long * Fresh) {
+  *Reused = Pool->LargeArraysReused;
+  *Fresh = Pool->LargeArraysFresh;
+}
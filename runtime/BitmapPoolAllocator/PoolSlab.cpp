@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "PoolSlab.h"
+#include "../include/MMAPSupport.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -19,6 +20,57 @@
 
 namespace llvm {
 
+// Number of large array allocations and frees after which a free large array
+// is considered idle, and the interval at which idle arrays are looked for
+static const unsigned LargeArrayIdleTicks = 64;
+static const unsigned LargeArrayScanInterval = 16;
+
+// The first level of the table mapping pages to slabs
+PoolSlab *** volatile SlabMap::Directory = 0;
+
+//
+// Method: setRange()
+//
+// Description:
+//  Set the table entries of every page in the specified range of memory.
+//  The directory and the leaves are allocated on demand.
+//
+void
+SlabMap::setRange (void * Start, unsigned Size, PoolSlab * PS) {
+  uintptr_t FirstPage = ((uintptr_t) Start) >> PageShift;
+  uintptr_t LastPage = ((uintptr_t) Start + Size - 1) >> PageShift;
+  assert (!(LastPage >> (LeafBits + DirBits)) && "Slab beyond the slab map!");
+
+  //
+  // Racing threads may both allocate the directory or a leaf; the loser
+  // releases its copy.
+  //
+  PoolSlab *** Dir = Directory;
+  if (!Dir) {
+    if (!PS) return;
+    size_t DirSize = sizeof (PoolSlab **) << DirBits;
+    PoolSlab *** NewDir = (PoolSlab ***) AllocateSpaceWithMMAP (DirSize, true);
+    if (!__sync_bool_compare_and_swap (&Directory, (PoolSlab ***) 0, NewDir))
+      munmap (NewDir, DirSize);
+    Dir = Directory;
+  }
+
+  for (uintptr_t Page = FirstPage; Page <= LastPage; ++Page) {
+    PoolSlab ** volatile * LeafPtr = &(Dir[Page >> LeafBits]);
+    PoolSlab ** Leaf = *LeafPtr;
+    if (!Leaf) {
+      if (!PS) continue;
+      size_t LeafSize = sizeof (PoolSlab *) << LeafBits;
+      PoolSlab ** NewLeaf =
+        (PoolSlab **) AllocateSpaceWithMMAP (LeafSize, true);
+      if (!__sync_bool_compare_and_swap (LeafPtr, (PoolSlab **) 0, NewLeaf))
+        munmap (NewLeaf, LeafSize);
+      Leaf = *LeafPtr;
+    }
+    Leaf[Page & ((1u << LeafBits) - 1)] = PS;
+  }
+}
+
 // create - Create a new (empty) slab and add it to the end of the Pools list.
 PoolSlab *
 PoolSlab::create(BitmapPoolTy *Pool) {
@@ -30,6 +82,7 @@ PoolSlab::create(BitmapPoolTy *Pool) {
   assert(Size <= PageSize && "Trying to allocate a slab larger than a page!");
 #endif
   PoolSlab *PS = (PoolSlab*)AllocatePage();
+  noteOrdinaryOp(Pool);
 
   assert(PS && "Allocating a page failed!");
   memset(PS, 0, sizeof(PoolSlab));
@@ -39,6 +92,8 @@ PoolSlab::create(BitmapPoolTy *Pool) {
   PS->UsedBegin   = 0;    // Nothing allocated.
   PS->UsedEnd     = 0;    // Nothing allocated.
   PS->allocated   = 0;    // No bytes allocated.
+  PS->NoRunOf     = NoRunUnknown;
+  PS->Owner       = Pool;
 
   for (unsigned i = 0; i < PS->getSlabSize(); ++i)
     {
@@ -46,12 +101,55 @@ PoolSlab::create(BitmapPoolTy *Pool) {
       PS->clearStartBit(i);
     }
 
-  // Add the slab to the list...
+  // Add the slab to the list and to the slab map...
   PS->addToList((PoolSlab**)&Pool->Ptr1);
+  SlabMap::insert(PS);
   //  printf(" creating a slab %x\n", PS);
   return PS;
 }
 
+//
+// Function: getArrayBucket()
+//
+// Description:
+//  Return the bucket of free large arrays holding arrays of NumPages pages.
+//
+static unsigned
+getArrayBucket(unsigned NumPages) {
+  unsigned Bucket = 31 - __builtin_clz(NumPages);
+  if (Bucket >= BitmapPoolTy::NumLargeArrayBuckets)
+    Bucket = BitmapPoolTy::NumLargeArrayBuckets - 1;
+  return Bucket;
+}
+
+//
+// Method: initSingleArray()
+//
+// Description:
+//  Initialize the header of a single array slab.
+//
+// Inputs:
+//  Mem      - The memory of the slab.
+//  Pool     - The pool to which the slab belongs.
+//  Mapping  - The memory returned by the page manager of which the slab is a
+//             part; only slabs from the same mapping are merged.
+//  NumPages - The number of pages in the slab.
+//
+PoolSlab *
+PoolSlab::initSingleArray(void *Mem, BitmapPoolTy *Pool, char *Mapping,
+                          unsigned NumPages) {
+  PoolSlab *PS = (PoolSlab*)Mem;
+  memset(PS, 0, sizeof(PoolSlab));
+  PS->allocated   = 0xffffffff;    // No bytes allocated.
+  PS->isSingleArray = 1;
+  PS->NumNodesInSlab = PoolSlab::getSlabSize(Pool);
+  PS->SizeOfSlab     = (NumPages * PageSize);
+  PS->FirstUnused = NumPages;
+  PS->Owner = Pool;
+  PS->Mapping = Mapping;
+  return PS;
+}
+
 void *
 PoolSlab::createSingleArray(BitmapPoolTy *Pool, unsigned NumNodes) {
   // FIXME: This wastes memory by allocating space for the NodeFlagsVector
@@ -59,9 +157,21 @@ PoolSlab::createSingleArray(BitmapPoolTy *Pool, unsigned NumNodes) {
   assert(NumNodes > NodesPerSlab && "No need to create a single array!");
 
   unsigned NumPages = (NumNodes+NodesPerSlab-1)/NodesPerSlab;
-  PoolSlab *PS = (PoolSlab*)AllocateNPages(NumPages);
+  ++Pool->LargeArrayClock;
 
-  assert(PS && "poolalloc: Could not allocate memory!");
+  //
+  // Reuse a large array that has been freed if there is one large enough.
+  //
+  if (PoolSlab *PS = reuseSingleArray(Pool, NumPages)) {
+    ++Pool->LargeArraysReused;
+    PS->addToList((PoolSlab**)&Pool->LargeArrays);
+    releaseIdleArrays(Pool);
+    return PS->getElementAddress(0, 0);
+  }
+
+  void *Mem = AllocateNPages(NumPages);
+  assert(Mem && "poolalloc: Could not allocate memory!");
+  PoolSlab *PS = initSingleArray(Mem, Pool, (char*)Mem, NumPages);
 
   if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize)
     Pool->Slabs->insert((void*)PS);
@@ -77,18 +187,178 @@ PoolSlab::createSingleArray(BitmapPoolTy *Pool, unsigned NumNodes) {
   }
   Pool->NumSlabs++;
 
+  ++Pool->LargeArraysFresh;
   PS->addToList((PoolSlab**)&Pool->LargeArrays);
-
-  PS->allocated   = 0xffffffff;    // No bytes allocated.
-  PS->isSingleArray = 1;
-  PS->NumNodesInSlab = NodesPerSlab;
-  PS->SizeOfSlab     = (NumPages * PageSize);
-  PS->FirstUnused = NumPages;
+  SlabMap::insert(PS);
   return PS->getElementAddress(0, 0);
 }
 
+//
+// Method: reuseSingleArray()
+//
+// Description:
+//  Find a free large array of at least NumPages pages in the pool and prepare
+//  it for reuse.  The first array large enough is taken; pages beyond the
+//  first NumPages are split off into a free array of their own.
+//
+// Return value:
+//  NULL - The pool has no free large array that is large enough.
+//  Otherwise, the slab of the array, unlinked from all lists, is returned.
+//
+PoolSlab *
+PoolSlab::reuseSingleArray(BitmapPoolTy *Pool, unsigned NumPages) {
+  for (unsigned Bucket = getArrayBucket(NumPages);
+       Bucket < BitmapPoolTy::NumLargeArrayBuckets; ++Bucket) {
+    PoolSlab *PS = (PoolSlab*)Pool->FreeLargeArrays[Bucket];
+    for (; PS; PS = PS->Next) {
+      if (PS->FirstUnused < NumPages)
+        continue;
+
+      PS->unlinkFromList();
+      if (PS->FirstUnused > NumPages) {
+        char *RestMem = (char*)PS + NumPages * PageSize;
+        unsigned RestPages = PS->FirstUnused - NumPages;
+        PoolSlab *Rest = initSingleArray(RestMem, Pool, PS->Mapping, RestPages);
+        Rest->isFreeArray = 1;
+        Rest->isReleased = PS->isReleased;
+        Rest->FreedAt = PS->FreedAt;
+        SlabMap::insert(Rest);
+        Rest->addToFreeArrays(Pool);
+
+        PS->FirstUnused = NumPages;
+        PS->SizeOfSlab = NumPages * PageSize;
+      }
+
+      PS->isFreeArray = 0;
+      PS->isReleased = 0;
+      return PS;
+    }
+  }
+
+  return 0;
+}
+
+//
+// Method: addToFreeArrays()
+//
+// Description:
+//  Add this free single array slab to the bucket of the pool for its size.
+//
+void
+PoolSlab::addToFreeArrays(BitmapPoolTy *Pool) {
+  unsigned Bucket = getArrayBucket(FirstUnused);
+  addToList((PoolSlab**)&Pool->FreeLargeArrays[Bucket]);
+}
+
+//
+// Method: freeSingleArray()
+//
+// Description:
+//  Move this single array slab from the pool's list of large arrays to its
+//  free large arrays.  Free large arrays adjacent to it that were carved out
+//  of the same mapping are merged with it, undoing the splits made by
+//  reuseSingleArray().
+//
+void
+PoolSlab::freeSingleArray(BitmapPoolTy *Pool) {
+  assert(isSingleArray && !isFreeArray && "Freeing a slab that is not in use!");
+  unlinkFromList();
+  ++Pool->LargeArrayClock;
+
+  //
+  // Merge the free array that follows this one into it.
+  //
+  PoolSlab *PS = this;
+  PoolSlab *After = (PoolSlab*)((char*)this + SizeOfSlab);
+  if ((SlabMap::lookup(After) == After) &&
+      (After->isFreeArray) && (After->Mapping == Mapping)) {
+    After->unlinkFromList();
+    FirstUnused += After->FirstUnused;
+    SizeOfSlab += After->SizeOfSlab;
+  }
+
+  //
+  // Merge this array into the free array that precedes it.
+  //
+  PoolSlab *Before = SlabMap::lookup((char*)this - 1);
+  if (Before && (Before->isFreeArray) && (Before->Mapping == Mapping) &&
+      ((char*)Before + Before->SizeOfSlab == (char*)this)) {
+    Before->unlinkFromList();
+    Before->FirstUnused += FirstUnused;
+    Before->SizeOfSlab += SizeOfSlab;
+    PS = Before;
+  }
+
+  PS->isFreeArray = 1;
+  PS->isReleased = 0;
+  PS->FreedAt = Pool->LargeArrayClock;
+  SlabMap::insert(PS);
+  PS->addToFreeArrays(Pool);
+  releaseIdleArrays(Pool);
+}
+
+//
+// Method: releaseIdleArrays()
+//
+// Description:
+//  Return the pages of the free large arrays of the pool that have not been
+//  reused within the last LargeArrayIdleTicks large array allocations and
+//  frees to the operating system.  The first physical page of each array,
+//  which holds its header, is kept.  The arrays stay in their buckets; their
+//  pages are faulted back in, filled with zeros, when they are reused.
+//
+// Notes:
+//  The free arrays are only examined every LargeArrayScanInterval ticks of
+//  the pool's clock, which keeps the cost of the scan low.  The clock also
+//  ticks for every OrdinaryOpsPerTick frees of ordinary objects and new
+//  slabs, so that idle arrays are found after large arrays are no longer
+//  allocated; pooldestroy() unmaps the arrays that remain.
+//
+void
+PoolSlab::releaseIdleArrays(BitmapPoolTy *Pool) {
+  if (Pool->LargeArrayClock % LargeArrayScanInterval)
+    return;
+
+  for (unsigned Bucket = 0;
+       Bucket < BitmapPoolTy::NumLargeArrayBuckets; ++Bucket) {
+    PoolSlab *PS = (PoolSlab*)Pool->FreeLargeArrays[Bucket];
+    for (; PS; PS = PS->Next) {
+      if (PS->isReleased ||
+          (Pool->LargeArrayClock - PS->FreedAt < LargeArrayIdleTicks))
+        continue;
+
+      char *Start = (char*)PS + PPageSize;
+      size_t Length = PS->SizeOfSlab - PPageSize;
+#if defined(MADV_REMOVE)
+      // GetPages() maps pages shared so that they can be remapped, and the
+      // kernel only frees shared pages when they are removed.
+      madvise(Start, Length, MADV_REMOVE);
+#else
+      madvise(Start, Length, MADV_DONTNEED);
+#endif
+      PS->isReleased = 1;
+    }
+  }
+}
+
+//
+// Method: tickArrayClock()
+//
+// Description:
+//  Advance the large array clock of the pool on behalf of its other activity.
+//  Without these ticks, the clock, and so the release of idle arrays, would
+//  stop with the last large array allocation or free of the program.
+//
+void
+PoolSlab::tickArrayClock(BitmapPoolTy *Pool) {
+  ++Pool->LargeArrayClock;
+  releaseIdleArrays(Pool);
+}
+
 void
 PoolSlab::destroy() {
+  SlabMap::remove(this);
+
   if (isSingleArray)
     for (unsigned NumPages = FirstUnused; NumPages != 1;--NumPages)
       FreePage((char*)this + (NumPages-1)*PageSize);
@@ -138,12 +408,7 @@ PoolSlab::allocateSingle() {
     setStartBit(Idx);
     
     // Increment FirstUnused to point to the new first unused value...
-    // FIXME: this should be optimized
-    unsigned short FU = FirstUnused;
-    do {
-      ++FU;
-    } while ((FU != SlabSize) && (isNodeAllocated(FU)));
-    FirstUnused = FU;
+    FirstUnused = findFreeNode(Idx + 1, SlabSize);
 
     // Updated the UsedBegin field if necessary
     if (UsedBegin > Idx) UsedBegin = Idx;
@@ -176,14 +441,18 @@ PoolSlab::allocateMultiple(unsigned Size) {
   // Do not allocate small arrays in SingleArray slabs
   if (isSingleArray) return -1;
 
+  // A previous search found no run of free nodes this large.
+  if (Size >= NoRunOf) return -1;
+
+  unsigned SlabSize = getSlabSize();
+
   // For small array allocation, check to see if there are empty entries at the
   // end of the slab...
-  if (UsedEnd+Size <= getSlabSize()) {
+  if (UsedEnd+Size <= SlabSize) {
     // Mark the returned entry used and set the start bit
     unsigned UE = UsedEnd;
     setStartBit(UE);
-    for (unsigned i = UE; i != UE+Size; ++i)
-      markNodeAllocated(i);
+    markNodesAllocated(UE, UE+Size);
     
     // If we are allocating out the first unused field, bump its index also
     if (FirstUnused == UE)
@@ -202,42 +471,26 @@ PoolSlab::allocateMultiple(unsigned Size) {
   }
 
   //
-  // If not, check to see if this node has a declared "FirstUnused" value
-  // starting which Size nodes can be allocated
+  // If not, search for Size free nodes starting at FirstUnused.  Each step
+  // skips from a free node to the next allocated node and from there to the
+  // next free node, a word of flags at a time.
   //
   unsigned Idx = FirstUnused;
-  while (Idx+Size <= getSlabSize()) {
+  while (Idx+Size <= SlabSize) {
     assert(!isNodeAllocated(Idx) && "FirstUsed is not accurate!");
 
-    // Check if there is a continuous array of Size nodes starting FirstUnused
-    unsigned LastUnused = Idx+1;
-    for (; (LastUnused != Idx+Size) && (!isNodeAllocated(LastUnused)); ++LastUnused)
-      /*empty*/;
-
     // If we found an unused section of this pool which is large enough, USE IT!
+    unsigned LastUnused = findAllocatedNode(Idx+1, Idx+Size);
     if (LastUnused == Idx+Size) {
       setStartBit(Idx);
-      // FIXME: this loop can be made more efficient!
-      for (unsigned i = Idx; i != Idx + Size; ++i)
-        markNodeAllocated(i);
+      markNodesAllocated(Idx, Idx+Size);
 
-      // This should not be allocating on the end of the pool, so we don't need
-      // to bump the UsedEnd pointer.
-      assert(Idx != UsedEnd && "Shouldn't allocate at end of pool!");
+      // The free nodes may run past the end of the used part of the slab.
+      if (Idx+Size > UsedEnd) UsedEnd = Idx+Size;
 
       // If we are allocating out the first unused field, bump its index also.
-      if (Idx == FirstUnused) {
-        unsigned SlabSize = getSlabSize();
-        unsigned i;
-        for (i = FirstUnused+Size; i < UsedEnd; ++i) {
-          if (!isNodeAllocated(i)) {
-            break;
-          }
-        }
-        FirstUnused = i;
-        if (isNodeAllocated(i))
-          FirstUnused = SlabSize;
-      }
+      if (Idx == FirstUnused)
+        FirstUnused = findFreeNode(Idx+Size, SlabSize);
       
       // Updated the UsedBegin field if necessary
       if (UsedBegin > Idx) UsedBegin = Idx;
@@ -249,15 +502,85 @@ PoolSlab::allocateMultiple(unsigned Size) {
     }
 
     // Otherwise, try later in the pool.  Find the next unused entry.
-    Idx = LastUnused;
-    while (Idx+Size <= getSlabSize() && isNodeAllocated(Idx))
-      ++Idx;
+    Idx = findFreeNode(LastUnused+1, SlabSize);
   }
 
+  // Remember that there is no room for an allocation this large.
+  NoRunOf = Size;
   assertOkay();
   return -1;
 }
 
+//
+// Method: markNodesAllocated()
+//
+// Description:
+//  Mark the nodes in [Begin, End) as allocated, setting the bits of up to 16
+//  nodes at once.
+//
+void
+PoolSlab::markNodesAllocated(unsigned Begin, unsigned End) {
+  while (Begin < End) {
+    unsigned Bit = Begin & 15;
+    unsigned Count = End - Begin;
+    if (Count > 16 - Bit) Count = 16 - Bit;
+    NodeFlagsVector[Begin/16] |= ((1u << Count) - 1) << Bit;
+    Begin += Count;
+  }
+}
+
+//
+// Method: findFreeNode()
+//
+// Description:
+//  Find the first free node in [NodeNum, End) by scanning the allocated bits
+//  of the nodes a word at a time.
+//
+// Return value:
+//  The index of the first free node is returned.  If all of the nodes are
+//  allocated, End is returned.
+//
+unsigned
+PoolSlab::findFreeNode(unsigned NodeNum, unsigned End) const {
+  if (NodeNum >= End) return End;
+
+  unsigned Word = NodeNum/16;
+  unsigned Free = ~NodeFlagsVector[Word] & (0xFFFFu << (NodeNum & 15)) & 0xFFFF;
+  while (!Free) {
+    if (++Word*16 >= End) return End;
+    Free = ~NodeFlagsVector[Word] & 0xFFFF;
+  }
+
+  unsigned Idx = Word*16 + __builtin_ctz(Free);
+  return (Idx < End) ? Idx : End;
+}
+
+//
+// Method: findAllocatedNode()
+//
+// Description:
+//  Find the first allocated node in [NodeNum, End) by scanning the allocated
+//  bits of the nodes a word at a time.
+//
+// Return value:
+//  The index of the first allocated node is returned.  If all of the nodes
+//  are free, End is returned.
+//
+unsigned
+PoolSlab::findAllocatedNode(unsigned NodeNum, unsigned End) const {
+  if (NodeNum >= End) return End;
+
+  unsigned Word = NodeNum/16;
+  unsigned Used = NodeFlagsVector[Word] & (0xFFFFu << (NodeNum & 15)) & 0xFFFF;
+  while (!Used) {
+    if (++Word*16 >= End) return End;
+    Used = NodeFlagsVector[Word] & 0xFFFF;
+  }
+
+  unsigned Idx = Word*16 + __builtin_ctz(Used);
+  return (Idx < End) ? Idx : End;
+}
+
 // getSize
 unsigned PoolSlab::getSize(void *Ptr, unsigned ElementSize) {
   if (isSingleArray) abort();
@@ -364,6 +687,7 @@ PoolSlab::freeElement(unsigned short ElementIdx) {
   // Mark this element as being free!
   markNodeFree(ElementIdx);
   --allocated;
+  NoRunOf = NoRunUnknown;
 
   // If this slab is not a SingleArray
   assert(isStartOfAllocation(ElementIdx) &&
@@ -457,18 +781,9 @@ PoolSlab::lastNodeAllocated(unsigned ScanIdx) {
  ContainsAllocatedNode:
   // Figure out exactly which node is allocated in this word now.  The node
   // allocated is the one with the highest bit set in 'Flags'.
-  //
-  // This should use __builtin_clz to get the value, but this builtin is only
-  // available with GCC 3.4 and above.  :(
   assert(Flags && "Should have allocated node!");
   
-  unsigned short MSB;
-#if GCC3_4_EVENTUALLY
-  MSB = 16 - ::__builtin_clz(Flags);
-#else
-  for (MSB = 15; (Flags & (1U << MSB)) == 0; --MSB)
-    /*empty*/;
-#endif
+  unsigned short MSB = 31 - __builtin_clz(Flags);
 
   assert((1U << MSB) & Flags);   // The bit should be set
   assert((~(1U << MSB) & Flags) < Flags);// Removing it should make flag smaller
@@ -38,8 +38,13 @@ namespace llvm {
 struct PoolSlab {
   PoolSlab **PrevPtr, *Next;
   bool isSingleArray;   // If this slab is used for exactly one array
+  bool isFreeArray;     // If this single array slab has been freed
+  bool isReleased;      // If this free array's pages were returned to the OS
   unsigned allocated; // Number of bytes allocated
   PoolSlab * Canonical; // For stack slabs, the canonical page
+  BitmapPoolTy * Owner; // The pool from which the slab was allocated
+  char * Mapping;       // For single arrays, the pages the slab was carved from
+  unsigned FreedAt;     // For free arrays, the pool's LargeArrayClock at free
 
 private:
   // FirstUnused - First empty node in slab
@@ -51,6 +56,12 @@ private:
   // UsedEnd - 1 past the last allocated node in slab. 0 if slab is empty
   unsigned short UsedEnd;
 
+  // NoRunOf - A search of the slab found no run of this many free nodes, so
+  // allocateMultiple() need not search for one this large or larger.  Freeing
+  // an element resets it to NoRunUnknown.
+  unsigned short NoRunOf;
+  static const unsigned short NoRunUnknown = 0xFFFF;
+
   // NumNodesInSlab - This contains the number of nodes in this slab, which
   // effects the size of the NodeFlags vector, and indicates the number of nodes
   // which are in the slab.
@@ -69,7 +80,9 @@ private:
   // start of an allocation.
   //
   // This is a variable sized array, which has 2*NumNodesInSlab bits (rounded up
-  // to 4 bytes).
+  // to 4 bytes).  Each word describes 16 nodes: the low half holds their
+  // allocated bits and the high half holds their start bits, so free nodes
+  // can be found a word at a time.
   unsigned NodeFlagsVector[1];
   
   bool isNodeAllocated(unsigned NodeNum) {
@@ -84,6 +97,17 @@ private:
     NodeFlagsVector[NodeNum/16] &= ~(1 << (NodeNum & 15));
   }
 
+  // markNodesAllocated - Mark the nodes in [Begin, End) allocated.
+  void markNodesAllocated(unsigned Begin, unsigned End);
+
+  // findFreeNode - Return the first free node in [NodeNum, End), or End if
+  // there is none.
+  unsigned findFreeNode(unsigned NodeNum, unsigned End) const;
+
+  // findAllocatedNode - Return the first allocated node in [NodeNum, End), or
+  // End if there is none.
+  unsigned findAllocatedNode(unsigned NodeNum, unsigned End) const;
+
   void setStartBit(unsigned NodeNum) {
     NodeFlagsVector[NodeNum/16] |= 1 << ((NodeNum & 15)+16);
   }
@@ -111,6 +135,43 @@ public:
   // entries in it, returning the pointer into the pool directly.
   static void *createSingleArray(BitmapPoolTy  *Pool, unsigned NumNodes);
 
+  // freeSingleArray - Move this single array slab to the pool's free large
+  // arrays, merging it with free neighbors.
+  void freeSingleArray(BitmapPoolTy *Pool);
+
+  // releaseIdleArrays - Return the pages of free large arrays that have not
+  // been reused for a while to the operating system.
+  static void releaseIdleArrays(BitmapPoolTy *Pool);
+
+  // noteOrdinaryOp - Count a free of an ordinary object or a new slab.  Every
+  // OrdinaryOpsPerTick of them tick the large array clock of the pool, so
+  // that free large arrays are released once the program stops making large
+  // arrays but keeps using the pool.
+  static const unsigned OrdinaryOpsPerTick = 1024;
+  static void noteOrdinaryOp(BitmapPoolTy *Pool) {
+    if (__builtin_expect(++Pool->OrdinaryOps % OrdinaryOpsPerTick == 0, 0))
+      tickArrayClock(Pool);
+  }
+
+  // tickArrayClock - Advance the large array clock of the pool and release
+  // the free arrays that have become idle.
+  static void tickArrayClock(BitmapPoolTy *Pool);
+
+private:
+  // initSingleArray - Initialize the header of a single array slab of
+  // NumPages pages carved out of the pages at Mapping.
+  static PoolSlab *initSingleArray(void *Mem, BitmapPoolTy *Pool,
+                                   char *Mapping, unsigned NumPages);
+
+  // reuseSingleArray - Take a free large array of at least NumPages pages
+  // from the pool, splitting off and keeping any excess pages.
+  static PoolSlab *reuseSingleArray(BitmapPoolTy *Pool, unsigned NumPages);
+
+  // addToFreeArrays - Add this free single array to its size bucket.
+  void addToFreeArrays(BitmapPoolTy *Pool);
+
+public:
+
   // getSlabSize - Return the number of nodes that each slab should contain.
   static unsigned getSlabSize(BitmapPoolTy  *Pool) {
     // We need space for the header...
@@ -144,6 +205,12 @@ public:
     return NumNodesInSlab;
   }
 
+  // getExtent - Return the number of bytes of memory occupied by this slab,
+  // including its header.
+  unsigned getExtent() const {
+    return isSingleArray ? SizeOfSlab : PageSize;
+  }
+
   // destroy - Release the memory for the current object.
   void destroy();
 
@@ -191,6 +258,95 @@ public:
   unsigned lastNodeAllocated(unsigned ScanIdx);
 };
 
+//===----------------------------------------------------------------------===//
+//
+//  SlabMap implementation
+//
+//===----------------------------------------------------------------------===//
+
+//
+// Class: SlabMap
+//
+// Description:
+//  A two-level table that maps every physical page of memory to the pool slab
+//  (or single array slab) occupying it.  It lets poolfree() and the run-time
+//  checks find the slab containing a pointer with a few loads instead of
+//  walking the lists of slabs of a pool, so their cost does not grow with the
+//  size of the pool.
+//
+//  Slabs are aligned on physical page boundaries, so each entry describes
+//  4 KB of address space (the smallest physical page size supported) and no
+//  two slabs share an entry.  The table is reserved with
+//  mmap() when the first slab is created; the kernel only backs the leaves
+//  that are actually touched.
+//
+class SlabMap {
+ public:
+  // Geometry of the table
+  static const unsigned PageShift = 12;
+  static const unsigned LeafBits = 16;
+#if defined(_LP64)
+  static const unsigned AddressBits = 48;
+#else
+  static const unsigned AddressBits = 32;
+#endif
+  static const unsigned DirBits = AddressBits - PageShift - LeafBits;
+
+  // First level of the table; each leaf has 2^LeafBits entries
+  static PoolSlab *** volatile Directory;
+
+ private:
+  static void setRange (void * Start, unsigned Size, PoolSlab * PS);
+
+ public:
+  //
+  // Method: insert()
+  //
+  // Description:
+  //  Record that the specified slab occupies the memory from its start to the
+  //  end of its extent.
+  //
+  static void insert (PoolSlab * PS) {
+    setRange (PS, PS->getExtent(), PS);
+  }
+
+  //
+  // Method: remove()
+  //
+  // Description:
+  //  Forget the specified slab.  This must be done before its memory is
+  //  returned to the page manager.
+  //
+  static void remove (PoolSlab * PS) {
+    setRange (PS, PS->getExtent(), 0);
+  }
+
+  //
+  // Method: lookup()
+  //
+  // Description:
+  //  Find the slab occupying the page that contains the specified address.
+  //
+  // Return value:
+  //  NULL - No slab occupies the page.
+  //  Otherwise, a pointer to the slab is returned.  The caller must still
+  //  check that the slab belongs to the desired pool and that the address
+  //  is within one of its elements.
+  //
+  static PoolSlab * lookup (void * p) {
+    uintptr_t Page = ((uintptr_t) p) >> PageShift;
+    PoolSlab *** Dir = Directory;
+    if (!Dir || (Page >> (LeafBits + DirBits)))
+      return 0;
+
+    PoolSlab ** Leaf = Dir[Page >> LeafBits];
+    if (!Leaf)
+      return 0;
+
+    return Leaf[Page & ((1u << LeafBits) - 1)];
+  }
+};
+
 //===----------------------------------------------------------------------===//
 //
 //  StackSlab implementation
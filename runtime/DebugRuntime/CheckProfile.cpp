@@ -0,0 +1,137 @@
+//===- CheckProfile.cpp - Execution profile of run-time checks ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the table of check sites that the debug run-time
+// profiles when it is built with SC_CHECK_PROFILE defined, and writes the
+// profile when the program exits.
+//
+// The profile is appended to the file named by the SC_PROFILE environment
+// variable, or to safecode.prof in the current directory if it is not set.
+// Each line describes one site:
+//
+//   kind tag line executions cache tree bitmap miss file
+//
+// The file name comes last so that it may contain spaces.  Profiles of
+// several runs may be appended to the same file; the compiler adds up the
+// counts of lines with the same site.
+//
+//===----------------------------------------------------------------------===//
+
+#ifdef SC_CHECK_PROFILE
+
+#include "CheckProfile.h"
+
+#include "../include/SpinLock.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <sched.h>
+#include <stdint.h>
+
+namespace llvm {
+
+__thread CheckSite * CurrentCheckSite = 0;
+
+// Table of check sites; the number of sites is a power of two
+static const unsigned NumCheckSites = 1 << 16;
+static CheckSite CheckSites[NumCheckSites];
+
+// Whether the profile will be written when the program exits
+static volatile int ProfileStarted = 0;
+
+//
+// Function: writeCheckProfile()
+//
+// Description:
+//  Append the profile of every check site that was executed to the profile
+//  file.
+//
+static void
+writeCheckProfile (void) {
+  const char * Name = getenv ("SC_PROFILE");
+  if (!Name || !Name[0])
+    Name = "safecode.prof";
+
+  FILE * Out = fopen (Name, "a");
+  if (!Out) {
+    fprintf (stderr, "SAFECode: Cannot write check profile to %s\n", Name);
+    return;
+  }
+
+  fprintf (Out, "# kind tag line executions cache tree bitmap miss file\n");
+  for (unsigned index = 0; index < NumCheckSites; ++index) {
+    const CheckSite & Site = CheckSites[index];
+    if ((Site.State != 2) || !Site.Executions)
+      continue;
+    fprintf (Out, "%s %u %u %lu %lu %lu %lu %lu %s\n",
+             Site.Kind, Site.tag, Site.lineno, Site.Executions,
+             Site.Costs[CostCache], Site.Costs[CostTree],
+             Site.Costs[CostBitmap], Site.Costs[CostMiss],
+             Site.SourceFile ? Site.SourceFile : "<unknown>");
+  }
+  fclose (Out);
+}
+
+//
+// Function: findCheckSite()
+//
+// Description:
+//  Find the site of a check, adding it to the table of sites if it is not
+//  there.  Sites are never removed, so this needs no locks.
+//
+// Return value:
+//  NULL     - The table of sites is full.
+//  Otherwise, a pointer to the site is returned.
+//
+CheckSite *
+findCheckSite (const char * Kind, unsigned tag,
+               const char * SourceFile, unsigned lineno) {
+  uintptr_t Hash = (uintptr_t) Kind ^ (uintptr_t) SourceFile;
+  Hash ^= (uintptr_t) (lineno * 0x45d9f3b) ^ (tag * 0x9e3779b1u);
+  Hash = (Hash ^ (Hash >> 16)) * 0x45d9f3b;
+  Hash ^= Hash >> 16;
+
+  for (unsigned probe = 0; probe < NumCheckSites; ++probe) {
+    CheckSite & Site = CheckSites[(Hash + probe) & (NumCheckSites - 1)];
+
+    //
+    // Claim a free site for this key.  The first site claimed arranges for
+    // the profile to be written.
+    //
+    if ((Site.State == 0) && __sync_bool_compare_and_swap (&Site.State, 0, 1)) {
+      Site.Kind = Kind;
+      Site.tag = tag;
+      Site.SourceFile = SourceFile;
+      Site.lineno = lineno;
+      writeBarrier ();
+      Site.State = 2;
+      if (__sync_bool_compare_and_swap (&ProfileStarted, 0, 1))
+        atexit (writeCheckProfile);
+      return &Site;
+    }
+
+    //
+    // Wait for another thread to finish filling in the key of the site.
+    //
+    while (Site.State != 2)
+      sched_yield ();
+    readBarrier ();
+
+    if ((Site.tag == tag) && (Site.lineno == lineno) &&
+        (Site.Kind == Kind) && (Site.SourceFile == SourceFile))
+      return &Site;
+  }
+
+  return 0;
+}
+
+}
+
+#endif
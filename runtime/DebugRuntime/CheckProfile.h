@@ -0,0 +1,112 @@
+//===- CheckProfile.h - Execution profile of run-time checks ----*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the profile of the run-time checks that the debug
+// run-time records when it is built with SC_CHECK_PROFILE defined.
+//
+// Every check site is identified by the kind of the check and the tag, source
+// file, and line number that the DebugInstrument pass gave it.  For each site,
+// the profile counts how often the check was executed and how the object that
+// it needed was found: in the object cache, in the object index of the pool,
+// in the slabs of the pool, or not at all.  The profile is appended to a file
+// when the program exits; the profile-guided check optimization of the
+// compiler reads it back.
+//
+// Without SC_CHECK_PROFILE, the macros below expand to nothing.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_CHECKPROFILE_H
+#define _SC_CHECKPROFILE_H
+
+namespace llvm {
+
+#ifdef SC_CHECK_PROFILE
+
+//
+// How a check found the object that it needed.  A check that needs no object
+// (such as an exactcheck) counts no cost at all.
+//
+enum CheckCost {
+  CostCache,     // Found in the object cache
+  CostTree,      // Found in the object index of the pool
+  CostBitmap,    // Found in the slabs of the pool
+  CostMiss,      // Not found; the check took its slow path
+  NumCheckCosts
+};
+
+//
+// Structure: CheckSite
+//
+// Description:
+//  The profile of one check site.  The counts are incremented without atomic
+//  instructions, so a few increments may be lost when several threads execute
+//  the same check at once.
+//
+struct CheckSite {
+  // 0 if the site is free, 1 while its key is being filled in, 2 afterwards
+  volatile unsigned State;
+
+  // The key of the site
+  const char * Kind;
+  unsigned tag;
+  const char * SourceFile;
+  unsigned lineno;
+
+  unsigned long Executions;
+  unsigned long Costs[NumCheckCosts];
+};
+
+// The site of the check that the current thread is executing
+extern __thread CheckSite * CurrentCheckSite;
+
+extern CheckSite * findCheckSite (const char * Kind, unsigned tag,
+                                  const char * SourceFile, unsigned lineno);
+
+//
+// Class: CheckProfileScope
+//
+// Description:
+//  Count an execution of a check and charge the costs of the lookups done
+//  while the object lives to the check's site.
+//
+class CheckProfileScope {
+ public:
+  CheckProfileScope (const char * Kind, unsigned tag,
+                     const char * SourceFile, unsigned lineno) {
+    CurrentCheckSite = findCheckSite (Kind, tag, SourceFile, lineno);
+    if (CurrentCheckSite)
+      ++CurrentCheckSite->Executions;
+  }
+
+  ~CheckProfileScope () {
+    CurrentCheckSite = 0;
+  }
+};
+
+static inline void
+profileCheckCost (CheckCost Cost) {
+  if (CheckSite * Site = CurrentCheckSite)
+    ++Site->Costs[Cost];
+}
+
+#define SC_PROFILE_CHECK(Kind, Tag, SourceFile, Line) \
+  CheckProfileScope ProfileScope ((Kind), (Tag), (SourceFile), (Line))
+#define SC_PROFILE_COST(Cost) profileCheckCost (Cost)
+
+#else
+
+#define SC_PROFILE_CHECK(Kind, Tag, SourceFile, Line) ((void) 0)
+#define SC_PROFILE_COST(Cost) ((void) 0)
+
+#endif
+
+}
+
+#endif
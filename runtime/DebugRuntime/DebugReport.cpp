@@ -18,6 +18,20 @@
 
 namespace llvm {
 
+void
+DebugViolationInfo::getSourceLocation(const char * & File,
+                                      unsigned & Line) const {
+  File = this->SourceFile;
+  Line = this->lineNo;
+
+  //
+  // Checks compiled in site table mode pass no source location; look theirs
+  // up while the check is still on the stack.
+  //
+  if (!File)
+    findSourceSite (this->faultPC, File, Line);
+}
+
 void
 DebugViolationInfo::print(std::ostream & OS) const {
   //
@@ -28,9 +42,12 @@ DebugViolationInfo::print(std::ostream & OS) const {
   //
   // Print the source filename and line number.
   //
+  const char * File;
+  unsigned Line;
+  getSourceLocation (File, Line);
   OS << "= Fault PC Source                       :\t"
-     << (this->SourceFile ? this->SourceFile : "UNKNOWN")
-     << ":" << std::dec << this->lineNo << "\n";
+     << (File ? File : "UNKNOWN")
+     << ":" << std::dec << Line << "\n";
 
   //
   // Print the pool handle.
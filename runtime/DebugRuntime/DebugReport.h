@@ -29,6 +29,8 @@ struct DebugViolationInfo : public ViolationInfo {
   const char * SourceFile;
   unsigned int lineNo;
   virtual void print (std::ostream & OS) const;
+  virtual void getSourceLocation (const char * & SourceFile,
+                                  unsigned & lineNo) const;
   DebugViolationInfo() : dbgMetaData(0), SourceFile(0), lineNo(0) {}
 };
 
@@ -59,6 +61,12 @@ struct CStdLibViolation : public DebugViolationInfo {
   CStdLibViolation() : function(0) {}
 };
 
+/// Find the source location of a check in the table of check sites that
+/// DebugInstrument builds in site table mode
+bool findSourceSite (const void * faultPC,
+                     const char * & SourceFile,
+                     unsigned & lineNo);
+
 }
 
 #endif
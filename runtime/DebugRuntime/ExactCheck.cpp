@@ -12,11 +12,13 @@
 /*                                                                            */
 /*===----------------------------------------------------------------------===*/
 
+#include "CheckProfile.h"
 #include "DebugReport.h"
 #include "ConfigData.h"
 
 #include "../include/BitmapAllocator.h"
 #include "../include/CWE.h"
+#include "../include/RuntimeStats.h"
 
 
 #include "PoolAllocator.h"
@@ -78,6 +80,8 @@ failLSCheck (const char *base,
 void
 fastlscheck (const char *base, const char *result, unsigned size,
              unsigned lslen) {
+  SC_STAT_INC (FASTLSCHECK);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -96,7 +100,7 @@ fastlscheck (const char *base, const char *result, unsigned size,
   if (!lslen)
     return;
 
-  failLSCheck (base, result, size, "unknown", 0);
+  failLSCheck (base, result, size, NULL, 0);
   return;
 }
 
@@ -118,6 +122,9 @@ fastlscheck_debug (const char *base, const char *result, unsigned size,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT_INC (FASTLSCHECK);
+  SC_PROFILE_CHECK ("fastlscheck", tag, SourceFile, lineno);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -159,6 +166,7 @@ fastlscheck_debug (const char *base, const char *result, unsigned size,
  */
 void *
 exactcheck2 (char * source, char *base, char *result, unsigned size) {
+  SC_STAT_INC (EXACTCHECK);
 
   /*
    * If the pointer is within the object, the check passes.  Return the checked
@@ -197,6 +205,9 @@ exactcheck2_debug (char *source,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT_INC (EXACTCHECK);
+  SC_PROFILE_CHECK ("exactcheck2", tag, SourceFile, lineno);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -209,6 +220,45 @@ exactcheck2_debug (char *source,
                            SourceFile, lineno);
 }
 
+/*
+ * Function: exactcheck_speculative()
+ *
+ * Description:
+ *  This function performs an exactcheck on behalf of a program that has
+ *  already used the result pointer.  The pointer can no longer be rewritten,
+ *  so the check only reports a result that the configuration would not have
+ *  rewritten.
+ *
+ * Inputs:
+ *  base   - The address of the first byte of a memory object.
+ *  result - The pointer that is being checked.
+ *  size   - The size of the object in bytes.
+ */
+void
+llvm::exactcheck_speculative (char * base, char * result, unsigned size) {
+  SC_STAT_INC (EXACTCHECK);
+
+  if ((result >= base) && (result < (base + size)))
+    return;
+
+  if ((!(ConfigData.StrictIndexing)) || (result == base + size))
+    return;
+
+  OutOfBoundsViolation v;
+  v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
+    v.faultPC = __builtin_return_address(0),
+    v.faultPtr = result,
+    v.CWE = CWEBufferOverflow,
+    v.PoolHandle = 0,
+    v.dbgMetaData = NULL,
+    v.SourceFile = NULL,
+    v.objStart = base,
+    v.objLen = size,
+    v.lineNo = 0;
+
+  ReportMemoryViolation(&v);
+}
+
 /*
  * Function: exactcheck_check()
  *
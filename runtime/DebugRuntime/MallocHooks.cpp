@@ -13,7 +13,7 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "../include/SplayTree.h"
+#include "../include/DebugRuntime.h"
 
 #if defined(__APPLE__)
 #include <malloc/malloc.h>
@@ -21,8 +21,8 @@
 
 namespace llvm {
 
-// Splay tree for recording external allocations
-RangeSplaySet<> * ExternalObjects;
+// Index for recording external allocations
+ObjectSetTy * ExternalObjects;
 
 #if defined(__APPLE__)
 // The real allocation functions
@@ -0,0 +1,251 @@
+//===- ObjectCache.h - Cache of recently found memory objects ---*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the cache of recently found memory objects that the
+// run-time checks consult before searching the object index of a pool.
+//
+// Every thread has a cache of its own.  The cache is fully associative: any
+// entry may hold any object, and a lookup compares the pointer with every
+// entry.  Each object needs a single entry however large it is, so a loop
+// walking several arrays at once stays on the fast path as long as the cache
+// has an entry for each of them.  Choosing a set from the address instead
+// would map arrays of equal size walked in lockstep to the same set.
+//
+// Entries are invalidated lazily.  Each entry is stamped with an epoch taken
+// from a global table indexed by the page for which the entry was filled.
+// Unregistering an object advances the epochs of the pages it covers, which
+// invalidates the entries for the object in the caches of all threads without
+// touching them.
+//
+// The inline caches that the compiler places beside check sites (see
+// SiteCache) are invalidated the same way, but with a single epoch: the
+// compiled code cannot afford to find the epoch of a page.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_OBJECTCACHE_H
+#define _SC_OBJECTCACHE_H
+
+#include "../include/DebugRuntime.h"
+#include "../include/RuntimeStats.h"
+
+#include <stdint.h>
+
+namespace llvm {
+
+//
+// The number of entries in each thread's cache.  It may be set to 8 or 16
+// when building the run-time (see the Makefile).
+//
+#ifndef SC_OBJECT_CACHE_ENTRIES
+#define SC_OBJECT_CACHE_ENTRIES 8
+#endif
+
+static const unsigned ObjectCacheEntries = SC_OBJECT_CACHE_ENTRIES;
+static const unsigned ObjectCachePageShift = 12;
+
+// Number of epochs used to invalidate cache entries
+static const unsigned NumCacheEpochs = 64;
+
+struct ObjectCacheEntry {
+  void * lower;
+  void * upper;
+  DebugPoolTy * Pool;
+  unsigned Epoch;
+  unsigned EpochIndex;
+};
+
+struct ThreadObjectCache {
+  ObjectCacheEntry Entries[ObjectCacheEntries];
+
+  // The entry to replace next
+  unsigned NextEntry;
+
+  // The epoch index and epoch observed by the last miss; objects found in
+  // the pool after the miss are cached with them so that an unregistration
+  // racing with the search invalidates them.
+  unsigned MissEpochIndex;
+  unsigned MissEpoch;
+
+  // Statistics
+  unsigned long Hits;
+  unsigned long Misses;
+};
+
+// Epochs of the cache entries; advanced when objects are unregistered
+extern volatile unsigned CacheEpochs[NumCacheEpochs];
+
+// The cache of the current thread
+extern __thread ThreadObjectCache ObjectCache;
+
+static inline unsigned
+getCacheEpochIndex (uintptr_t Page) {
+  return Page & (NumCacheEpochs - 1);
+}
+
+//
+// Function: findInCache()
+//
+// Description:
+//  Determine whether the specified pointer is within an object in the cache.
+//
+// Outputs:
+//  Start - The first valid address of the cached object.
+//  End   - The last valid address of the cached object.
+//
+// Return value:
+//  true  - The pointer was found in the cache.
+//  false - The pointer was not found in the cache.
+//
+static inline bool
+findInCache (DebugPoolTy * Pool, void * p, void * & Start, void * & End) {
+  for (unsigned index = 0; index < ObjectCacheEntries; ++index) {
+    ObjectCacheEntry & Entry = ObjectCache.Entries[index];
+    if ((Entry.lower <= p) && (p <= Entry.upper) && (Entry.Pool == Pool) &&
+        (Entry.Epoch == CacheEpochs[Entry.EpochIndex])) {
+      Start = Entry.lower;
+      End = Entry.upper;
+      ++ObjectCache.Hits;
+      SC_STAT_INC (CACHE_HITS);
+      return true;
+    }
+  }
+
+  ++ObjectCache.Misses;
+  SC_STAT_INC (CACHE_MISSES);
+  uintptr_t Page = ((uintptr_t) p) >> ObjectCachePageShift;
+  ObjectCache.MissEpochIndex = getCacheEpochIndex (Page);
+  ObjectCache.MissEpoch = CacheEpochs[ObjectCache.MissEpochIndex];
+  readBarrier ();
+  return false;
+}
+
+//
+// Function: updateCache()
+//
+// Description:
+//  Add an object that was found in the pool after a cache miss to the cache.
+//  The pointer that missed must be within the object.
+//
+static inline void
+updateCache (DebugPoolTy * Pool, void * p, void * Start, void * End) {
+  unsigned index = ObjectCache.NextEntry;
+  ObjectCache.NextEntry = (index + 1) % ObjectCacheEntries;
+
+  ObjectCacheEntry & Entry = ObjectCache.Entries[index];
+  Entry.lower = Start;
+  Entry.upper = End;
+  Entry.Pool = Pool;
+  Entry.EpochIndex = ObjectCache.MissEpochIndex;
+  Entry.Epoch = ObjectCache.MissEpoch;
+  return;
+}
+
+//
+// Function: fillSiteCache()
+//
+// Description:
+//  Cache an object in the inline cache of a check site.  Epoch must have been
+//  read from __sc_site_epoch before the object was looked up so that an
+//  unregistration racing with the lookup invalidates the entry.
+//
+// Notes:
+//  The compiled code reads the epoch of the entry before and after its bounds
+//  and ignores the entry if the two differ.  In the thread safe run-time, a
+//  thread claims the entry by setting its epoch to ~0, which never matches
+//  __sc_site_epoch, and gives up if another thread is filling it.
+//
+static inline void
+fillSiteCache (SiteCache * Cache, DebugPoolTy * Pool, void * Start, void * End,
+               uintptr_t Epoch) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  uintptr_t Old = Cache->Epoch;
+  if ((Old == ~(uintptr_t) 0) ||
+      !__sync_bool_compare_and_swap (&Cache->Epoch, Old, ~(uintptr_t) 0))
+    return;
+#endif
+  Cache->lower = Start;
+  Cache->upper = End;
+  Cache->Pool = Pool;
+  writeBarrier ();
+  Cache->Epoch = Epoch;
+  return;
+}
+
+//
+// Function: advanceSiteEpoch()
+//
+// Description:
+//  Invalidate the inline caches of all check sites.
+//
+static inline void
+advanceSiteEpoch (void) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  __sync_fetch_and_add (&__sc_site_epoch, 1);
+#else
+  __sc_site_epoch = __sc_site_epoch + 1;
+#endif
+}
+
+//
+// Function: advanceCacheEpoch()
+//
+// Description:
+//  Invalidate every cache entry that was filled for a page with the given
+//  epoch index.
+//
+static inline void
+advanceCacheEpoch (unsigned EpochIndex) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  __sync_fetch_and_add (&CacheEpochs[EpochIndex], 1);
+#else
+  CacheEpochs[EpochIndex] = CacheEpochs[EpochIndex] + 1;
+#endif
+}
+
+//
+// Function: evictFromCache()
+//
+// Description:
+//  Remove the specified object from the caches of all threads.  This must be
+//  called after the object has been removed from the object index.
+//
+static inline void
+evictFromCache (void * Start, void * End) {
+  advanceSiteEpoch ();
+
+  uintptr_t FirstPage = ((uintptr_t) Start) >> ObjectCachePageShift;
+  uintptr_t LastPage = ((uintptr_t) End) >> ObjectCachePageShift;
+  if (LastPage - FirstPage >= NumCacheEpochs) {
+    for (unsigned index = 0; index < NumCacheEpochs; ++index)
+      advanceCacheEpoch (index);
+  } else {
+    for (uintptr_t Page = FirstPage; Page <= LastPage; ++Page)
+      advanceCacheEpoch (getCacheEpochIndex (Page));
+  }
+  return;
+}
+
+//
+// Function: flushCache()
+//
+// Description:
+//  Remove every object from the caches of all threads.
+//
+static inline void
+flushCache (void) {
+  advanceSiteEpoch ();
+  for (unsigned index = 0; index < NumCacheEpochs; ++index)
+    advanceCacheEpoch (index);
+  return;
+}
+
+}
+
+#endif
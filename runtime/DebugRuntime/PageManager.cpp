@@ -21,9 +21,11 @@
 #include "../include/MMAPSupport.h"
 #include "../include/HashExtras.h"
 #include "../include/BitmapAllocator.h"
+#include "../include/SpinLock.h"
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
@@ -62,6 +64,11 @@ static hash_map<void *,std::vector<struct ShadowInfo> > & ShadowPages (void) {
   return realShadowPages;
 }
 
+// Number of system calls made to create, protect, and recycle shadow pages
+static unsigned long ShadowRemapCalls = 0;
+static unsigned long ShadowProtectCalls = 0;
+static unsigned long ShadowRecycleCalls = 0;
+
 // If not compiling on Mac OS X, define types and values to make the same code
 // work on multiple platforms.
 #if !defined(__APPLE__)
@@ -121,6 +128,7 @@ RemapPages (void * va, unsigned length) {
     (void *) length, NumPPage, (void *) offset, (void *) byteToMap);
     fflush(stderr);
   }
+  ++ShadowRemapCalls;
   kr = mach_vm_remap (self,
                       &target_addr,
                       byteToMap,
@@ -193,6 +201,7 @@ RemapPages (void * va, unsigned length) {
 fprintf (stderr, "remap: %p %x -> %p %x\n", va, map_length, source_addr, map_length);
 fflush (stderr);
 #endif
+  ++ShadowRemapCalls;
   target_addr = mremap (source_addr, 0, map_length, MREMAP_MAYMOVE);
   if (target_addr == MAP_FAILED) {
     perror ("RemapPage: Failed to create shadow page: ");
@@ -220,6 +229,390 @@ RemapPages (void * va, unsigned length) {
 #endif
 #endif
 
+#if SC_BATCH_SHADOWS
+#if !defined(__linux__)
+#error "Batched shadow pages are only implemented for Linux"
+#endif
+
+//
+// In this mode, the shadow pages of objects are carved out of shadow copies of
+// whole batches of canonical pages (the pages that AllocatePage() gets from
+// the operating system at once).  A copy is created with a single mremap()
+// into a region of virtual memory reserved for shadows, and every physical
+// page of a copy is handed to at most one object.  Once all of the objects
+// that used a copy have left the quarantine of freed objects, the copy is
+// recycled by mapping the batch over it again, which also makes its pages
+// accessible again.
+//
+
+// Number of physical pages in a batch of canonical pages
+static const unsigned BatchPPages = NumToAllocate * PageMultiplier;
+
+// Number of words holding the flag bits of the physical pages of a copy
+static const unsigned BatchWords = (BatchPPages + 63) / 64;
+
+// Number of the newest copies of a batch searched for unused pages before a
+// new copy is created
+static const unsigned CopySearchLimit = 8;
+
+// Size of the region of virtual memory reserved for shadow copies
+static const size_t ShadowRegionSize =
+  (sizeof (void *) == 8) ? ((size_t) 64 << 30) : ((size_t) 256 << 20);
+
+struct ShadowBatch;
+
+//
+// Structure: ShadowCopy
+//
+// Description:
+//  This structure describes one shadow mapping of a batch of canonical pages.
+//
+struct ShadowCopy {
+  // The batch of canonical pages that is mapped
+  struct ShadowBatch * Batch;
+
+  // Start of the copy within the shadow region
+  char * Start;
+
+  // Flag bits indicating which physical pages of the copy have been handed to
+  // objects and which of those belong to objects that have not been freed
+  uint64_t InUse[BatchWords];
+  uint64_t Live[BatchWords];
+
+  // Number of objects using the copy whose shadows have not been released
+  unsigned NumObjects;
+};
+
+//
+// Structure: ShadowBatch
+//
+// Description:
+//  This structure describes a batch of canonical pages and its shadow copies.
+//
+struct ShadowBatch {
+  // Start of the canonical pages
+  char * Canon;
+
+  // The copies of the batch that have been handed to objects, oldest first
+  std::vector<struct ShadowCopy *> Copies;
+
+  // The copies of the batch that have been recycled and are unused
+  std::vector<struct ShadowCopy *> SpareCopies;
+};
+
+// Map canonical physical pages to the batches containing them
+static hash_map<void *, struct ShadowBatch *> & ShadowBatches (void) {
+  static hash_map<void *, struct ShadowBatch *> realShadowBatches;
+  return realShadowBatches;
+}
+
+// Shadow copies indexed by their position within the shadow region
+static std::vector<struct ShadowCopy *> & ShadowSlots (void) {
+  static std::vector<struct ShadowCopy *> realShadowSlots;
+  return realShadowSlots;
+}
+
+// The shadow region and the part of it that has not been used
+static char * ShadowRegion = 0;
+static char * ShadowRegionNext = 0;
+static char * ShadowRegionEnd = 0;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the batches and their shadow copies
+static SpinLock ShadowLock;
+#endif
+
+//
+// Function: recordShadowBatch()
+//
+// Description:
+//  Record that the specified pages were allocated together so that shadow
+//  copies of all of them can be made at once.
+//
+static void
+recordShadowBatch (char * Canon) {
+  struct ShadowBatch * Batch = new ShadowBatch;
+  Batch->Canon = Canon;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.lock ();
+#endif
+  for (unsigned page = 0; page < BatchPPages; ++page)
+    ShadowBatches()[Canon + page * PPageSize] = Batch;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.unlock ();
+#endif
+}
+
+//
+// Function: createShadowCopy()
+//
+// Description:
+//  Map a new shadow copy of the specified batch into the shadow region.
+//
+// Return value:
+//  0 - The shadow region is exhausted or the copy could not be created.
+//  Otherwise, a pointer to the description of the new copy is returned.
+//
+static struct ShadowCopy *
+createShadowCopy (struct ShadowBatch * Batch) {
+  size_t BatchBytes = NumToAllocate * PageSize;
+
+  //
+  // Reserve the shadow region when the first copy is created.
+  //
+  if (!ShadowRegion) {
+    int Flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    ++ShadowRemapCalls;
+    void * Region = mmap (0, ShadowRegionSize, PROT_NONE, Flags, -1, 0);
+    if (Region == MAP_FAILED) {
+      perror ("mmap:");
+      fflush (stderr);
+      assert (0 && "reserving the shadow region failed\n");
+      abort ();
+    }
+    ShadowRegion = ShadowRegionNext = (char *) Region;
+    ShadowRegionEnd = ShadowRegion + ShadowRegionSize;
+    ShadowSlots().resize (ShadowRegionSize / BatchBytes);
+  }
+
+  if ((size_t)(ShadowRegionEnd - ShadowRegionNext) < BatchBytes)
+    return 0;
+
+  char * Start = ShadowRegionNext;
+  ++ShadowRemapCalls;
+  void * Addr = mremap (Batch->Canon, 0, BatchBytes,
+                        MREMAP_MAYMOVE | MREMAP_FIXED, Start);
+  if (Addr == MAP_FAILED) {
+    perror ("RemapPage: Failed to create shadow copy: ");
+    return 0;
+  }
+  ShadowRegionNext += BatchBytes;
+
+  struct ShadowCopy * Copy = new ShadowCopy;
+  Copy->Batch = Batch;
+  Copy->Start = Start;
+  memset (Copy->InUse, 0, sizeof (Copy->InUse));
+  memset (Copy->Live, 0, sizeof (Copy->Live));
+  Copy->NumObjects = 0;
+  ShadowSlots()[(Start - ShadowRegion) / BatchBytes] = Copy;
+  Batch->Copies.push_back (Copy);
+  return Copy;
+}
+
+//
+// Function: pagesUnused()
+//
+// Description:
+//  Determine whether the specified physical pages of a copy have not been
+//  handed to an object since the copy was created or recycled.
+//
+static inline bool
+pagesUnused (struct ShadowCopy * Copy, uintptr_t First, uintptr_t Last) {
+  for (uintptr_t page = First; page <= Last; ++page)
+    if (Copy->InUse[page / 64] & ((uint64_t) 1 << (page % 64)))
+      return false;
+  return true;
+}
+
+//
+// Function: getBatchedShadow()
+//
+// Description:
+//  Find shadow pages for the specified object within a copy of its batch of
+//  canonical pages, creating a new copy if the newest ones have no room.
+//
+// Return value:
+//  0 - The object does not lie within a batch or no copy could be created.
+//  Otherwise, a pointer to the shadow of the object's first page is returned.
+//
+static void *
+getBatchedShadow (void * va, unsigned length) {
+  char * FirstPage = (char *)((uintptr_t)va & ~(PPageSize - 1));
+  hash_map<void *, struct ShadowBatch *>::iterator I =
+    ShadowBatches().find (FirstPage);
+  if (I == ShadowBatches().end())
+    return 0;
+
+  struct ShadowBatch * Batch = I->second;
+  uintptr_t First = (FirstPage - Batch->Canon) / PPageSize;
+  uintptr_t Last = ((char *) va + (length ? length : 1) - 1 - Batch->Canon) /
+                   PPageSize;
+  if (Last >= BatchPPages)
+    return 0;
+
+  struct ShadowCopy * Copy = 0;
+  unsigned NumCopies = Batch->Copies.size();
+  for (unsigned index = NumCopies;
+       (index > 0) && (index + CopySearchLimit > NumCopies);
+       --index) {
+    if (pagesUnused (Batch->Copies[index - 1], First, Last)) {
+      Copy = Batch->Copies[index - 1];
+      break;
+    }
+  }
+
+  //
+  // Use a recycled copy before creating a new one.
+  //
+  if ((!Copy) && (!Batch->SpareCopies.empty())) {
+    Copy = Batch->SpareCopies.back();
+    Batch->SpareCopies.pop_back();
+    Batch->Copies.push_back (Copy);
+  }
+
+  if ((!Copy) && (!(Copy = createShadowCopy (Batch))))
+    return 0;
+
+  for (uintptr_t page = First; page <= Last; ++page) {
+    Copy->InUse[page / 64] |= ((uint64_t) 1 << (page % 64));
+    Copy->Live[page / 64] |= ((uint64_t) 1 << (page % 64));
+  }
+  ++(Copy->NumObjects);
+  return Copy->Start + First * PPageSize;
+}
+
+//
+// Function: getShadowCopy()
+//
+// Description:
+//  Return the copy containing the specified shadow page, or 0 if the page
+//  lies outside of the shadow region or no copy has been created there.
+//
+static inline struct ShadowCopy *
+getShadowCopy (char * Page) {
+  if ((Page < ShadowRegion) || (ShadowRegionEnd <= Page))
+    return 0;
+  size_t BatchBytes = NumToAllocate * PageSize;
+  return ShadowSlots()[(Page - ShadowRegion) / BatchBytes];
+}
+
+//
+// Function: consumeShadowPages()
+//
+// Description:
+//  Determine whether the shadow pages between Start and End within the shadow
+//  region can be protected along with the freed objects around them.  This is
+//  the case when none of them belongs to an object that has not been freed.
+//  Pages that have not been handed out are then marked as used so that they
+//  are not handed to an object while they are protected.
+//
+static bool
+consumeShadowPages (char * Start, char * End) {
+  if ((Start < ShadowRegion) || (ShadowRegionEnd < End))
+    return false;
+
+  for (char * Page = Start; Page < End; Page += PPageSize) {
+    if (struct ShadowCopy * Copy = getShadowCopy (Page)) {
+      uintptr_t page = (Page - Copy->Start) / PPageSize;
+      if (Copy->Live[page / 64] & ((uint64_t) 1 << (page % 64)))
+        return false;
+    }
+  }
+
+  for (char * Page = Start; Page < End; Page += PPageSize) {
+    if (struct ShadowCopy * Copy = getShadowCopy (Page)) {
+      uintptr_t page = (Page - Copy->Start) / PPageSize;
+      Copy->InUse[page / 64] |= ((uint64_t) 1 << (page % 64));
+    }
+  }
+  return true;
+}
+
+static bool
+lessPage (const std::pair<void *, unsigned> & A,
+          const std::pair<void *, unsigned> & B) {
+  return A.first < B.first;
+}
+
+//
+// Function: ProtectShadowPages()
+//
+// Description:
+//  Protect the shadow pages of a set of freed objects.  The ranges of pages
+//  are sorted, and neighboring ranges are protected with a single call when
+//  no page between them belongs to an object that is still live.
+//
+// Inputs:
+//  Pages    - The first shadow page of each object and the number of physical
+//             pages it spans.  The array is sorted in place.
+//  NumPages - The number of elements in Pages.
+//
+void
+ProtectShadowPages (std::pair<void *, unsigned> * Pages, unsigned NumPages) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.lock ();
+#endif
+  //
+  // Mark the pages of the objects as no longer live.
+  //
+  for (unsigned index = 0; index < NumPages; ++index) {
+    char * Page = (char *) Pages[index].first;
+    if (struct ShadowCopy * Copy = getShadowCopy (Page)) {
+      uintptr_t First = (Page - Copy->Start) / PPageSize;
+      uintptr_t Last = First + Pages[index].second;
+      if (Last > BatchPPages) Last = BatchPPages;
+      for (uintptr_t page = First; page < Last; ++page)
+        Copy->Live[page / 64] &= ~((uint64_t) 1 << (page % 64));
+    }
+  }
+
+  std::sort (Pages, Pages + NumPages, lessPage);
+  unsigned index = 0;
+  while (index < NumPages) {
+    char * Start = (char *) Pages[index].first;
+    char * End = Start + Pages[index].second * PPageSize;
+    for (++index; index < NumPages; ++index) {
+      char * Next = (char *) Pages[index].first;
+      if ((Next > End) &&
+          (((size_t)(Next - End) > NumToAllocate * PageSize) ||
+           (!consumeShadowPages (End, Next))))
+        break;
+      char * NextEnd = Next + Pages[index].second * PPageSize;
+      if (NextEnd > End) End = NextEnd;
+    }
+    ProtectShadowPage (Start, (End - Start) / PPageSize);
+  }
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.unlock ();
+#endif
+}
+
+//
+// Function: ReleaseShadowPage()
+//
+// Description:
+//  Release the shadow pages of a freed object once it has left the quarantine.
+//  When no object uses its copy anymore, the copy is recycled: the batch is
+//  mapped over it again, and it is kept as a spare copy of the batch.
+//  Shadows created outside of the shadow region are never reused.
+//
+void
+ReleaseShadowPage (void * beginPage, unsigned NumPPages) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.lock ();
+#endif
+  struct ShadowCopy * Copy = getShadowCopy ((char *) beginPage);
+  if (Copy && (--(Copy->NumObjects) == 0)) {
+    ++ShadowRecycleCalls;
+    void * Addr = mremap (Copy->Batch->Canon, 0, NumToAllocate * PageSize,
+                          MREMAP_MAYMOVE | MREMAP_FIXED, Copy->Start);
+    if (Addr == MAP_FAILED) {
+      perror ("ReleaseShadowPage: Failed to recycle shadow copy: ");
+    } else {
+      memset (Copy->InUse, 0, sizeof (Copy->InUse));
+
+      std::vector<struct ShadowCopy *> & Copies = Copy->Batch->Copies;
+      Copies.erase (std::find (Copies.begin(), Copies.end(), Copy));
+      Copy->Batch->SpareCopies.push_back (Copy);
+    }
+  }
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.unlock ();
+#endif
+}
+#endif
+
 //
 // Function: RemapObject()
 //
@@ -273,6 +666,23 @@ RemapObject (void * va, unsigned length) {
   if (ConfigData.RemapObjects == false)
     return (void *)(phy_page_start);
 
+#if SC_BATCH_SHADOWS
+  //
+  // Carve the shadow out of a copy of the object's batch of pages.  Objects
+  // that do not lie within a batch (such as large arrays) are remapped on
+  // their own below.
+  //
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.lock ();
+#endif
+  void * BatchedShadow = getBatchedShadow (va, length);
+#ifdef SC_THREAD_SAFE_RUNTIME
+  ShadowLock.unlock ();
+#endif
+  if (BatchedShadow)
+    return BatchedShadow;
+#endif
+
   // Create a mask to easily tell if the needed pages are available
   uintptr_t mask = 0;
   for (uintptr_t i = StartPage; i < PageMultiplier; ++i) {
@@ -323,9 +733,15 @@ RemapObject (void * va, unsigned length) {
 void *AllocatePage() {
   FreePagesListType &FPL = FreePages;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+  FreePagesLock.lock ();
+#endif
   if (!FPL.empty()) {
     void *Result = FPL.back();
       FPL.pop_back();
+#ifdef SC_THREAD_SAFE_RUNTIME
+      FreePagesLock.unlock ();
+#endif
       return Result;
   }
 
@@ -336,9 +752,16 @@ void *AllocatePage() {
   for (unsigned i = 1; i != NumToAllocate; ++i) {
     FPL.push_back (Ptr+i*PageSize);
   }
+#ifdef SC_THREAD_SAFE_RUNTIME
+  FreePagesLock.unlock ();
+#endif
 
   // Create several shadow mappings of all the pages
   if (ConfigData.RemapObjects) {
+#if SC_BATCH_SHADOWS
+    // Shadow copies of the pages are created when objects need them
+    recordShadowBatch (Ptr);
+#else
     char * NewShadows[NumShadows];
     for (unsigned i=0; i < NumShadows; ++i) {
       NewShadows[i] = (char *) RemapPages (Ptr, NumToAllocate * PageSize);
@@ -354,6 +777,7 @@ void *AllocatePage() {
         Shadows[j].InUse       = 0;
       }
     }
+#endif
   }
 
   return Ptr;
@@ -367,6 +791,7 @@ ProtectShadowPage (void * beginPage, unsigned NumPPages)
 {
   kern_return_t kr;
   if (ConfigData.RemapObjects) {
+    ++ShadowProtectCalls;
     kr = mprotect(beginPage, NumPPages * PPageSize, PROT_NONE);
     if (kr != KERN_SUCCESS)
       perror(" mprotect error: Failed to protect shadow page\n");
@@ -381,6 +806,7 @@ void
 UnprotectShadowPage (void * beginPage, unsigned NumPPages)
 {
   kern_return_t kr;
+  ++ShadowProtectCalls;
   kr = mprotect(beginPage, NumPPages * PPageSize, PROT_READ | PROT_WRITE);
   if (kr != KERN_SUCCESS)
     perror(" unprotect error: Failed to make shadow page accessible \n");
@@ -388,3 +814,19 @@ UnprotectShadowPage (void * beginPage, unsigned NumPPages)
 }
 
 }
+
+//
+// Function: __sc_dbg_shadowstats()
+//
+// Description:
+//  Report how many system calls the run-time has made to create shadow pages,
+//  to change their protections, and to recycle them.
+//
+extern "C" void
+__sc_dbg_shadowstats (unsigned long * Remaps,
+                      unsigned long * Protects,
+                      unsigned long * Recycles) {
+  *Remaps = llvm::ShadowRemapCalls;
+  *Protects = llvm::ShadowProtectCalls;
+  *Recycles = llvm::ShadowRecycleCalls;
+}
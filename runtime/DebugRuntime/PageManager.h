@@ -17,6 +17,8 @@
 
 #include "../include/PageManager.h"
 
+#include <utility>
+
 namespace llvm {
 
 /// Special implemetation for dangling pointer detection
@@ -38,5 +40,13 @@ void ProtectShadowPage(void * beginPage, unsigned NumPPages);
 //                       resume execution
 void UnprotectShadowPage(void * beginPage, unsigned NumPPage);
 
+// ProtectShadowPages - Protects the shadow pages of several freed objects,
+//                      merging neighboring pages into a single call
+void ProtectShadowPages(std::pair<void *, unsigned> * Pages, unsigned NumPages);
+
+// ReleaseShadowPage - Allows the shadow pages of a freed object to be reused
+//                     once the object has left the quarantine
+void ReleaseShadowPage(void * beginPage, unsigned NumPPages);
+
 }
 #endif
@@ -0,0 +1,420 @@
+//===- ParallelChecks.cpp - Run-time checks on checker threads ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements speculative checking: the program does not wait for
+// its run-time checks.  Instead, the compiler replaces the checks and object
+// registrations with calls to the __sc_par_* functions below, which record
+// them in a ring and return at once; checker threads take the records off the
+// rings and run them.  Before a call that could let a violation escape the
+// program, such as a system call, the compiler inserts a call to
+// __sc_par_wait_for_completion(), which waits until every check recorded so
+// far has run.
+//
+// Only the thread that initialized the run-time records checks.  Records are
+// sent to a ring chosen by their pool, so the checks and registrations of a
+// pool run in program order on a single checker thread, and only the checker
+// threads touch the object registry while the program runs.  The checker
+// threads use SC_CHECKER_THREADS rings (one by default on a multiprocessor and
+// none on a uniprocessor); the run-time must be built with SC_THREADS=1 to use
+// more than one.
+//
+// Bounds checks return the unchecked pointer, so checker threads cannot
+// rewrite pointers that go out of bounds; they only report the pointers that
+// the configuration would not have rewritten.  Checks and registrations made
+// by other threads, or before the checker threads have started, run at once.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DebugRuntime.h"
+
+#include "../include/CheckQueue.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace {
+  // The kinds of records sent to the checker threads
+  enum CheckKind {
+    KindPoolcheck,
+    KindPoolcheckUI,
+    KindPoolcheckAlign,
+    KindBoundscheck,
+    KindExactcheck,
+    KindPoolcheckFree,
+    KindPoolcheckFreeUI,
+    KindRegister,
+    KindRegisterStack,
+    KindRegisterGlobal,
+    KindReregister,
+    KindUnregister,
+    KindUnregisterStack
+  };
+
+  //
+  // Structure: CheckRecord
+  //
+  // Description:
+  //  A check or registration sent to a checker thread.  Each kind uses the
+  //  fields in the order of the arguments of its run-time function.
+  //
+  struct CheckRecord {
+    unsigned Kind;
+    unsigned Length;
+    DebugPoolTy * Pool;
+    void * First;
+    void * Second;
+  };
+}
+
+// Maximum number of checker threads
+static const unsigned MaxCheckers = 8;
+
+// Each ring holds 2^LogQueueSize records
+static const unsigned LogQueueSize = 15;
+
+// Number of polls of an empty ring before a checker thread yields the
+// processor, and before it starts to sleep between polls
+static const unsigned SpinsBeforeYield = 1u << 10;
+static const unsigned SpinsBeforeSleep = 1u << 16;
+
+typedef CheckQueue<CheckRecord, LogQueueSize> QueueTy;
+
+// The rings; ring i is emptied by checker thread i
+static QueueTy Queues[MaxCheckers];
+
+// Number of checker threads running; zero until they have started
+static unsigned NumCheckers = 0;
+
+// Whether the current thread sends its checks to the checker threads
+static __thread bool Producing = false;
+
+//
+// Function: selectQueue()
+//
+// Description:
+//  Return the ring to which records about the given pool or object are sent.
+//
+static inline QueueTy &
+selectQueue (void * Key) {
+  if (NumCheckers == 1)
+    return Queues[0];
+  return Queues[(((uintptr_t) Key) >> 4) % NumCheckers];
+}
+
+//
+// Function: enqueue()
+//
+// Description:
+//  Send a record to a checker thread if the current thread may.
+//
+// Return value:
+//  true  - The record has been sent.
+//  false - The caller must run the check itself.
+//
+static inline bool
+enqueue (unsigned Kind,
+         void * Key,
+         DebugPoolTy * Pool,
+         void * First,
+         void * Second,
+         unsigned Length) {
+  if (__builtin_expect (!Producing, 0))
+    return false;
+
+  QueueTy & Queue = selectQueue (Key);
+  CheckRecord & Record = Queue.reserve ();
+  Record.Kind = Kind;
+  Record.Length = Length;
+  Record.Pool = Pool;
+  Record.First = First;
+  Record.Second = Second;
+  Queue.push ();
+  return true;
+}
+
+//
+// Function: runCheck()
+//
+// Description:
+//  Run a check or registration on a checker thread.
+//
+static void
+runCheck (const CheckRecord & Record) {
+  DebugPoolTy * Pool = Record.Pool;
+  switch (Record.Kind) {
+    case KindPoolcheck:
+      poolcheck (Pool, Record.First, Record.Length);
+      break;
+    case KindPoolcheckUI:
+      poolcheckui (Pool, Record.First, Record.Length);
+      break;
+    case KindPoolcheckAlign:
+      poolcheckalign (Pool, Record.First, Record.Length);
+      break;
+    case KindBoundscheck:
+      boundscheck_speculative (Pool, Record.First, Record.Second);
+      break;
+    case KindExactcheck:
+      exactcheck_speculative ((char *) Record.First,
+                              (char *) Record.Second,
+                              Record.Length);
+      break;
+    case KindPoolcheckFree:
+      poolcheck_free (Pool, Record.First);
+      break;
+    case KindPoolcheckFreeUI:
+      poolcheck_freeui (Pool, Record.First);
+      break;
+    case KindRegister:
+      pool_register (Pool, Record.First, Record.Length);
+      break;
+    case KindRegisterStack:
+      pool_register_stack (Pool, Record.First, Record.Length);
+      break;
+    case KindRegisterGlobal:
+      pool_register_global (Pool, Record.First, Record.Length);
+      break;
+    case KindReregister:
+      pool_reregister (Pool, Record.First, Record.Second, Record.Length);
+      break;
+    case KindUnregister:
+      pool_unregister (Pool, Record.First);
+      break;
+    case KindUnregisterStack:
+      pool_unregister_stack (Pool, Record.First);
+      break;
+  }
+}
+
+//
+// Function: runChecker()
+//
+// Description:
+//  The body of a checker thread: run the records of its ring forever.  The
+//  thread spins while its ring is briefly empty, yields the processor while
+//  it stays empty, and then sleeps between polls so that an idle program
+//  does not keep a processor busy.
+//
+static void *
+runChecker (void * Arg) {
+  QueueTy & Queue = *(QueueTy *) Arg;
+  unsigned Idle = 0;
+  for (;;) {
+    if (CheckRecord * Record = Queue.front ()) {
+      runCheck (*Record);
+      Queue.pop ();
+      Idle = 0;
+    } else if (Idle < SpinsBeforeYield) {
+      ++Idle;
+      cpuRelax ();
+    } else if (Idle < SpinsBeforeSleep) {
+      ++Idle;
+      sched_yield ();
+    } else {
+      struct timespec Pause = {0, 100000};
+      nanosleep (&Pause, 0);
+    }
+  }
+  return 0;
+}
+
+//
+// Function: __sc_par_pool_init_runtime()
+//
+// Description:
+//  Initialize the run-time and start the checker threads.  The thread that
+//  calls this function sends its checks to them from now on.
+//
+void
+__sc_par_pool_init_runtime (unsigned Dangling,
+                            unsigned RewriteOOB,
+                            unsigned Terminate) {
+  pool_init_runtime (Dangling, RewriteOOB, Terminate);
+  if (NumCheckers)
+    return;
+
+  //
+  // A checker thread only helps if it has a processor of its own, so by
+  // default, a program on a uniprocessor runs its own checks.
+  //
+  unsigned Wanted = (sysconf (_SC_NPROCESSORS_ONLN) > 1) ? 1 : 0;
+  if (const char * Env = getenv ("SC_CHECKER_THREADS"))
+    Wanted = strtoul (Env, 0, 10);
+#if !defined(SC_THREAD_SAFE_RUNTIME)
+  if (Wanted > 1)
+    Wanted = 1;
+#endif
+  if (Wanted > MaxCheckers)
+    Wanted = MaxCheckers;
+
+  //
+  // Start the checker threads.  If one cannot be started, use the ones that
+  // did start; if none did, the program runs its own checks.
+  //
+  pthread_attr_t Attr;
+  pthread_attr_init (&Attr);
+  pthread_attr_setdetachstate (&Attr, PTHREAD_CREATE_DETACHED);
+  unsigned Started = 0;
+  for (; Started < Wanted; ++Started) {
+    pthread_t Checker;
+    if (pthread_create (&Checker, &Attr, runChecker, &Queues[Started]))
+      break;
+  }
+  pthread_attr_destroy (&Attr);
+
+  if (Started) {
+    NumCheckers = Started;
+    Producing = true;
+    atexit (__sc_par_wait_for_completion);
+  }
+}
+
+//
+// Function: __sc_par_wait_for_completion()
+//
+// Description:
+//  Wait until the checker threads have run every record that the current
+//  thread has sent them.
+//
+void
+__sc_par_wait_for_completion (void) {
+  if (!Producing)
+    return;
+
+  for (unsigned Index = 0; Index < NumCheckers; ++Index) {
+    unsigned Spins = 0;
+    while (!Queues[Index].drained ())
+      spinWait (Spins);
+  }
+}
+
+//
+// Function: __sc_par_poolargvregister()
+//
+// Description:
+//  Register the program arguments.  The arguments are registered at once so
+//  that the caller gets their copy back.
+//
+void *
+__sc_par_poolargvregister (int argc, char ** argv) {
+  __sc_par_wait_for_completion ();
+  return poolargvregister (argc, argv);
+}
+
+void
+__sc_par_pool_register (DebugPoolTy * Pool, void * p, unsigned size) {
+  if (!enqueue (KindRegister, Pool, Pool, p, 0, size))
+    pool_register (Pool, p, size);
+}
+
+void
+__sc_par_pool_register_stack (DebugPoolTy * Pool, void * p, unsigned size) {
+  if (!enqueue (KindRegisterStack, Pool, Pool, p, 0, size))
+    pool_register_stack (Pool, p, size);
+}
+
+void
+__sc_par_pool_register_global (DebugPoolTy * Pool, void * p, unsigned size) {
+  if (!enqueue (KindRegisterGlobal, Pool, Pool, p, 0, size))
+    pool_register_global (Pool, p, size);
+}
+
+void
+__sc_par_pool_reregister (DebugPoolTy * Pool,
+                          void * p,
+                          void * q,
+                          unsigned size) {
+  if (!enqueue (KindReregister, Pool, Pool, p, q, size))
+    pool_reregister (Pool, p, q, size);
+}
+
+void
+__sc_par_pool_unregister (DebugPoolTy * Pool, void * p) {
+  if (!enqueue (KindUnregister, Pool, Pool, p, 0, 0))
+    pool_unregister (Pool, p);
+}
+
+void
+__sc_par_pool_unregister_stack (DebugPoolTy * Pool, void * p) {
+  if (!enqueue (KindUnregisterStack, Pool, Pool, p, 0, 0))
+    pool_unregister_stack (Pool, p);
+}
+
+void
+__sc_par_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length) {
+  if (!enqueue (KindPoolcheck, Pool, Pool, Node, 0, length))
+    poolcheck (Pool, Node, length);
+}
+
+void
+__sc_par_poolcheckui (DebugPoolTy * Pool, void * Node, unsigned length) {
+  if (!enqueue (KindPoolcheckUI, Pool, Pool, Node, 0, length))
+    poolcheckui (Pool, Node, length);
+}
+
+void
+__sc_par_poolcheckalign (DebugPoolTy * Pool, void * Node, unsigned Offset) {
+  if (!enqueue (KindPoolcheckAlign, Pool, Pool, Node, 0, Offset))
+    poolcheckalign (Pool, Node, Offset);
+}
+
+//
+// Function: __sc_par_boundscheck()
+//
+// Description:
+//  Send a bounds check to a checker thread and return the unchecked result of
+//  the indexing operation.
+//
+void *
+__sc_par_boundscheck (DebugPoolTy * Pool, void * Source, void * Dest) {
+  if (!enqueue (KindBoundscheck, Pool, Pool, Source, Dest, 0))
+    return boundscheck (Pool, Source, Dest);
+  return Dest;
+}
+
+void *
+__sc_par_boundscheckui (DebugPoolTy * Pool, void * Source, void * Dest) {
+  if (!enqueue (KindBoundscheck, Pool, Pool, Source, Dest, 0))
+    return boundscheckui (Pool, Source, Dest);
+  return Dest;
+}
+
+//
+// Function: __sc_par_exactcheck2()
+//
+// Description:
+//  Send an exactcheck to a checker thread and return the unchecked pointer.
+//  The check needs no pool, so it is sent to the ring chosen by the object.
+//
+void *
+__sc_par_exactcheck2 (char * source, char * base, char * result,
+                      unsigned size) {
+  if (!enqueue (KindExactcheck, base, 0, base, result, size))
+    return exactcheck2 (source, base, result, size);
+  return result;
+}
+
+void
+__sc_par_poolcheck_free (DebugPoolTy * Pool, void * ptr) {
+  if (!enqueue (KindPoolcheckFree, Pool, Pool, ptr, 0, 0))
+    poolcheck_free (Pool, ptr);
+}
+
+void
+__sc_par_poolcheck_freeui (DebugPoolTy * Pool, void * ptr) {
+  if (!enqueue (KindPoolcheckFreeUI, Pool, Pool, ptr, 0, 0))
+    poolcheck_freeui (Pool, ptr);
+}
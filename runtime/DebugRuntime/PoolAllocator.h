@@ -26,12 +26,17 @@ namespace llvm {
 extern DebugPoolTy dummyPool;
 
 // Splay tree of external objects
-extern RangeSplaySet<> * ExternalObjects;
+extern ObjectSetTy * ExternalObjects;
 
 // Records Out of Bounds pointer rewrites; also used by OOB rewrites for
 // exactcheck() calls
 extern DebugPoolTy OOBPool;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the allocation and deallocation sequence numbers
+extern SpinLock MetaDataLock;
+#endif
+
 // Record from which object an OOB pointer originates
 //extern llvm::DenseMap<void *, std::pair<const void *, const void * > > RewrittenObjs;
 
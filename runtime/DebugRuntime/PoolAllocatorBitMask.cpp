@@ -34,11 +34,16 @@
 //
 //===----------------------------------------------------------------------===//
 
+// This file provides the storage and functions of the run-time statistics
+#define SC_STATISTICS_IMPLEMENTATION
+#include "../include/RuntimeStats.h"
+
 #include "ConfigData.h"
 #include "PoolAllocator.h"
 #include "PageManager.h"
 #include "DebugReport.h"
 #include "RewritePtr.h"
+#include "ObjectCache.h"
 
 #include "../include/CWE.h"
 #include "../include/DebugRuntime.h"
@@ -84,13 +89,18 @@ uintptr_t InvalidUpper = 0x00000000;
 uintptr_t InvalidLower = 0x00000003;
 
 // Splay tree for mapping shadow pointers to canonical pointers
-static RangeSplayMap<void *> & ShadowMap (void) {
-  static RangeSplayMap<void *> realShadowMap;
+static OOBMapTy & ShadowMap (void) {
+  static OOBMapTy realShadowMap;
   return realShadowMap;
 }
 
 // Configuration for C code; flags that we should stop on the first error
 unsigned StopOnError = 0;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the allocation and deallocation sequence numbers
+SpinLock MetaDataLock;
+#endif
 }
 
 using namespace llvm;
@@ -242,7 +252,7 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   //
   // Initialize the splay tree of external objects.
   //
-  ExternalObjects = new RangeSplaySet<>;
+  ExternalObjects = new ObjectSetTy;
   return;
 }
 
@@ -310,8 +320,9 @@ __sc_dbg_pooldestroy(DebugPoolTy * Pool) {
   // Deallocate all object meta-data stored in the pool.
   //
   Pool->Objects.clear();
-  Pool->OOB.clear();
   Pool->DPTree.clear();
+  releasePoolRewrites (Pool);
+  flushCache ();
 
   //
   // Let the pool allocator run-time free all objects allocated within the
@@ -437,11 +448,13 @@ _internal_poolregister (DebugPoolTy *Pool,
   if (!allocaptr)
     return;
 
+  SC_STAT_INC_BY (REGISTER_GLOBAL, allocationType);
+
   //
   // If there was no pool specified, use the splay tree associated with
   // externally allocated objects.
   //
-  RangeSplaySet<> * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
+  ObjectSetTy * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
 
   //
   // Add the object to the pool's splay of valid objects.
@@ -491,10 +504,13 @@ _internal_poolregister (DebugPoolTy *Pool,
         void * end;
         SPTree->find (allocaptr, start, end);
         SPTree->remove (start);
+        releaseRewrites (start);
         SPTree->insert(allocaptr, (char*) allocaptr + NumBytes - 1);
         break;
       }
     }
+  } else {
+    SC_STAT_GAUGE (LIVE_OBJECTS, 1);
   }
 
   return;
@@ -586,7 +602,13 @@ pool_register_debug (DebugPoolTy *Pool,
   // Generate a generation number for this object registration.  We only do
   // this for heap allocations.
   //
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MetaDataLock.lock ();
+#endif
   unsigned allocID = ((*allocSeqMap)[tag] += 1);
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MetaDataLock.unlock ();
+#endif
 
   //
   // Create the meta data object containing the debug information for this
@@ -1136,7 +1158,13 @@ updateMDOnFree (DebugPoolTy *Pool,
   //
   // Increment the ID number for this deallocation.
   //
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MetaDataLock.lock ();
+#endif
   unsigned freeID = ((*freeSeqMap)[tag] += 1);
+#ifdef SC_THREAD_SAFE_RUNTIME
+  MetaDataLock.unlock ();
+#endif
 
   //
   // Ignore frees of NULL pointers.  These are okay.
@@ -1184,8 +1212,9 @@ updateMDOnFree (DebugPoolTy *Pool,
   // and so we don't want to try to re-look up their old start and end values.
   //
   if ((Type == Stack) || (!(ConfigData.RemapObjects))) {
-    free (debugmetadataptr);
     dummyPool.DPTree.remove (allocaptr);
+    free (debugmetadataptr);
+    SC_STAT_GAUGE (METADATA_BYTES, -(long) sizeof (DebugMetaData));
   }
 
   return;
@@ -1229,29 +1258,38 @@ _internal_poolunregister (DebugPoolTy *Pool,
   //
   if (!allocaptr) return;
 
+  SC_STAT_INC_BY (UNREGISTER_GLOBAL, Type);
+
   //
   // If there was no pool specified, use the splay tree associated with
   // externally allocated objects.
   //
-  RangeSplaySet<> * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
+  ObjectSetTy * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
 
   //
   // Remove the object from the pool's splay tree.
   //
-  SPTree->remove (allocaptr);
+  void * start = allocaptr;
+  void * end = allocaptr;
+  if (SPTree->find (allocaptr, start, end)) {
+    SPTree->remove (allocaptr);
+    SC_STAT_GAUGE (LIVE_OBJECTS, -1);
+  } else if (Pool)
+    end = (unsigned char *) allocaptr + Pool->NodeSize - 1;
 
   //
-  // Eject the pointer from the pool's cache if necessary.
+  // Eject the object from the object caches.  Objects that were not
+  // registered may still have been cached by a check that found them within
+  // the pool's slabs.
   //
-  if (Pool) {
-    if ((Pool->objectCache[0].lower <= allocaptr) &&
-        (allocaptr <= Pool->objectCache[0].upper))
-      Pool->objectCache[0].lower = Pool->objectCache[0].upper = 0;
+  if (Pool)
+    evictFromCache (start, end);
 
-    if ((Pool->objectCache[1].lower <= allocaptr) &&
-        (allocaptr <= Pool->objectCache[1].upper))
-      Pool->objectCache[1].lower = Pool->objectCache[1].upper = 0;
-  }
+  //
+  // Release the rewrite pointers of the OOB pointers that came from the
+  // object.
+  //
+  releaseRewrites (start);
 
   //
   // Generate some debugging output.
@@ -1371,6 +1409,7 @@ createPtrMetaData (unsigned AllocID,
   //  allocation.  We need to use some internal allocation routine.
   //
   PDebugMetaData ret = (PDebugMetaData) malloc (sizeof(DebugMetaData));
+  SC_STAT_GAUGE (METADATA_BYTES, sizeof (DebugMetaData));
   ret->allocID = AllocID;
   ret->freeID = FreeID;
   ret->allocPC = AllocPC;
@@ -1507,17 +1546,26 @@ bus_error_handler (int sig, siginfo_t * info, void * context) {
   // perhaps it is an Out of Bounds Rewrite Pointer.  Check for that now.
   //
   if (0 == fs) {
-    void * start = faultAddr;
-    void * tag = 0;
-    void * end;
-    if (OOBPool.OOB.find (faultAddr, start, end, tag)) {
-      const char * Filename = (const char *)(RewriteSourcefile()[faultAddr]);
-      unsigned lineno = RewriteLineno()[faultAddr];
+#ifdef SC_THREAD_SAFE_RUNTIME
+    RewriteLock.lock ();
+#endif
+    RewriteEntry * Rewrite = getRewriteEntry (faultAddr);
+    RewriteEntry Entry;
+    if (Rewrite)
+      Entry = *Rewrite;
+#ifdef SC_THREAD_SAFE_RUNTIME
+    RewriteLock.unlock ();
+#endif
+    if (Rewrite) {
+      void * tag = const_cast<void *>(Entry.Actual);
+      const char * Filename = Entry.SourceFile;
+      unsigned lineno = Entry.lineno;
 
       //
       // Get the bounds of the original object.
       //
-      getOOBObject (faultAddr, start, end);
+      void * start = Entry.ObjStart;
+      void * end = Entry.ObjEnd;
       OutOfBoundsViolation v;
       v.type = ViolationInfo::FAULT_LOAD_STORE,
         v.faultPC = (const void*)program_counter,
@@ -1623,7 +1671,9 @@ getCanonicalPtr (void * ShadowPtr) {
 //  Given the pointer to the beginning of an object, create a shadow object.
 //  This means that the physical memory is mapped to a new virtual address
 //  (i.e., the shadow address).  This shadow address is never re-used, so we
-//  can use it for dangling pointer detection.
+//  can use it for dangling pointer detection.  When the run-time is built with
+//  SC_BATCH_SHADOWS, the shadow address is reused once the object has been
+//  freed and has left the quarantine.
 //
 // Inputs:
 //  CanonPtr - The pointer to remap.  This *must* be a pointer to the beginning
@@ -1662,6 +1712,128 @@ pool_shadow (void * CanonPtr, unsigned NumBytes) {
   return shadowptr;
 }
 
+#if SC_BATCH_SHADOWS
+//
+// Freed heap objects wait in a quarantine before their shadow pages are
+// released for reuse.  The shadow pages of freed objects are protected in
+// batches so that the pages of neighboring objects are protected with a
+// single system call; a dangling pointer to a freed object is therefore only
+// detected once the batch containing the object has been protected.
+//
+
+// Number of freed objects whose shadow pages are protected at once
+static const unsigned QuarantineBatch = 128;
+
+// Number of freed objects held in the quarantine
+static const unsigned QuarantineSize = 8192;
+
+//
+// Structure: QuarantineEntry
+//
+// Description:
+//  This structure records a freed object held in the quarantine.
+//
+struct QuarantineEntry {
+  // The shadow pointer to the object
+  void * Shadow;
+
+  // The first shadow page of the object and the number of pages it spans
+  void * Page;
+  unsigned NumPPages;
+};
+
+// Ring buffer of the most recently freed objects; QuarantineHead is the index
+// of the oldest object
+static struct QuarantineEntry Quarantine[QuarantineSize];
+static unsigned QuarantineHead = 0;
+static unsigned QuarantineCount = 0;
+
+// Number of the newest objects whose shadow pages have not been protected
+static unsigned QuarantineUnprotected = 0;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the quarantine
+static SpinLock QuarantineLock;
+#endif
+
+//
+// Function: protectQuarantine()
+//
+// Description:
+//  Protect the shadow pages of the objects in the quarantine that have not
+//  been protected yet.
+//
+static void
+protectQuarantine (void) {
+  std::pair<void *, unsigned> Pages[QuarantineBatch];
+  unsigned NumEntries = QuarantineUnprotected;
+  unsigned First = QuarantineHead + QuarantineCount - NumEntries;
+  for (unsigned index = 0; index < NumEntries; ++index) {
+    struct QuarantineEntry & Entry =
+      Quarantine[(First + index) % QuarantineSize];
+    Pages[index] = std::make_pair (Entry.Page, Entry.NumPPages);
+  }
+  ProtectShadowPages (Pages, NumEntries);
+  QuarantineUnprotected = 0;
+}
+
+//
+// Function: ageQuarantine()
+//
+// Description:
+//  Remove the oldest batch of objects from the quarantine.  Their debug
+//  information is discarded and their shadow pages may be reused.
+//
+static void
+ageQuarantine (void) {
+  for (unsigned index = 0; index < QuarantineBatch; ++index) {
+    struct QuarantineEntry & Entry = Quarantine[QuarantineHead];
+
+    void * start, * end;
+    PDebugMetaData debugmetadataptr = 0;
+    if (dummyPool.DPTree.find (Entry.Shadow, start, end, debugmetadataptr)) {
+      dummyPool.DPTree.remove (start);
+      free (debugmetadataptr);
+      SC_STAT_GAUGE (METADATA_BYTES, -(long) sizeof (DebugMetaData));
+    }
+    ShadowMap().remove (Entry.Shadow);
+    ReleaseShadowPage (Entry.Page, Entry.NumPPages);
+
+    QuarantineHead = (QuarantineHead + 1) % QuarantineSize;
+    --QuarantineCount;
+  }
+}
+
+//
+// Function: quarantineShadow()
+//
+// Description:
+//  Place a freed object into the quarantine, protecting the shadow pages of
+//  the newest objects once a full batch of them has been freed.
+//
+static void
+quarantineShadow (void * Shadow, void * Page, unsigned NumPPages) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  QuarantineLock.lock ();
+#endif
+  if (QuarantineCount == QuarantineSize)
+    ageQuarantine ();
+
+  struct QuarantineEntry & Entry =
+    Quarantine[(QuarantineHead + QuarantineCount) % QuarantineSize];
+  Entry.Shadow = Shadow;
+  Entry.Page = Page;
+  Entry.NumPPages = NumPPages;
+  ++QuarantineCount;
+
+  if (++QuarantineUnprotected == QuarantineBatch)
+    protectQuarantine ();
+#ifdef SC_THREAD_SAFE_RUNTIME
+  QuarantineLock.unlock ();
+#endif
+}
+#endif
+
 //
 // Function: pool_unshadow()
 //
@@ -1725,8 +1897,13 @@ pool_unshadow (void * Node) {
     fflush (stderr);
   }
 
+#if SC_BATCH_SHADOWS
+  // Hold the object in the quarantine, which protects its shadow pages
+  quarantineShadow (Node, (void *)((long)Node & ~(PPageSize - 1)), NumPPage);
+#else
   // Protect the shadow pages of the object
   ProtectShadowPage((void *)((long)Node & ~(PPageSize - 1)), NumPPage);
+#endif
   if (logregs) {
     fprintf (stderr, "pool_unshadow: Done: %p\n", Node);
     fflush (stderr);
@@ -2075,9 +2252,8 @@ __sc_dbg_poolinit(DebugPoolTy *Pool, unsigned NodeSize, unsigned) {
 
   //
   // Call the in-place new operator for the splay tree of objects and, if
-  // applicable, the set of Out of Bound rewrite pointers and the splay tree
-  // used for dangling pointer detection.  This causes their constructors to
-  // be called on the already allocated memory.
+  // applicable, the splay tree used for dangling pointer detection.  This
+  // causes their constructors to be called on the already allocated memory.
   //
   // While this may appear odd, it is what we want.  The allocation of pools
   // are added by the pool allocation transform.  Pools are either global
@@ -2086,18 +2262,14 @@ __sc_dbg_poolinit(DebugPoolTy *Pool, unsigned NodeSize, unsigned) {
   // run-time so in-place new operators must be used to initialize C++ classes
   // within the pool.
   //
-  new (&(Pool->Objects)) RangeSplaySet<>();
-  new (&(Pool->OOB)) RangeSplayMap<void *>();
-  new (&(Pool->DPTree)) RangeSplayMap<PDebugMetaData>();
+  new (&(Pool->Objects)) ObjectSetTy();
+  new (&(Pool->DPTree)) MetaDataMapTy();
 
   //
-  // Initialize the object cache.
+  // Remove any objects of a previous pool at the same address from the
+  // object caches.
   //
-  Pool->objectCache[0].lower = 0;
-  Pool->objectCache[0].upper = 0;
-  Pool->objectCache[1].lower = 0;
-  Pool->objectCache[1].upper = 0;
-  Pool->cacheIndex = 0;
+  flushCache ();
 
   return Pool;
 }
@@ -13,6 +13,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "../include/Report.h"
+#include "../include/ViolationQueue.h"
 
 #include <iostream>
 #include <cstdlib>
@@ -24,6 +25,13 @@ namespace llvm {
 
 ViolationInfo::~ViolationInfo() {}
 
+void
+ViolationInfo::getSourceLocation(const char * & SourceFile,
+                                 unsigned & lineNo) const {
+  SourceFile = 0;
+  lineNo = 0;
+}
+
 void
 ViolationInfo::print(std::ostream & OS) const {
   //
@@ -108,31 +116,22 @@ ViolationInfo::print(std::ostream & OS) const {
   OS << "= Program counter                       :\t" << this->faultPC << "\n";
 }
 
+//
+// Function: ReportMemoryViolation()
+//
+// Description:
+//  Report a memory violation.
+//
 void
 ReportMemoryViolation(const ViolationInfo *v) {
   // Flag for whether to terminate when an error is detected.
   extern unsigned StopOnError;
 
-  //
-  // Print the error to the error log.
-  //
-  v->print(*ErrorLog);
-  *ErrorLog << std::flush;
-
-  //
-  // If we need to terminate now, do that.
-  //
-  if (StopOnError)
-    abort();
+  // Make a sampled check that finds a violation run every time.
+  extern void escalateSampledCheck (void);
+  escalateSampledCheck ();
 
-  //
-  // Otherwise, report a certain number of errors before terminating the
-  // program.
-  //
-  static unsigned count = 20;
-  --count;
-  if (!count) abort();
-  return;
+  queueViolation (v, StopOnError);
 }
 
 }
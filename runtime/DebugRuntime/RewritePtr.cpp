@@ -16,12 +16,14 @@
 #include "DebugReport.h"
 #include "RewritePtr.h"
 
-#include "llvm/ADT/DenseMap.h"
-
 #include "../include/DebugRuntime.h"
+#include "../include/RuntimeStats.h"
 
+#include <cassert>
 #include <cstdio>
-#include <map>
+#include <cstdlib>
+
+#include <sys/mman.h>
 
 extern FILE * ReportLog;
 using namespace llvm; 
@@ -30,33 +32,270 @@ namespace llvm {
 
 DebugPoolTy OOBPool;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+SpinLock RewriteLock;
+#endif
+
+//
+// The table of rewrite entries.  It is allocated when the first pointer is
+// rewritten and is never moved, since the index of an entry is encoded in its
+// rewrite pointer.
 //
-// Functions for returning global variables used for rewrite pointer book
-// keeping.  We use functions to guarantee that the global variables are
-// initialized before they are used (otherwise, we rely on global constructors
-// which may or may not be run before the first pointer rewrite needs to be
-// done).
+RewriteEntry * RewriteEntries = 0;
+unsigned NumRewriteEntries = 0;
+
+// Maximum number of rewrite entries in use at once
+static const unsigned MaxRewriteEntries = 1 << 20;
+
+// Index plus one of the first free rewrite entry
+static unsigned FreeRewriteEntries = 0;
+
+// Number of rewrite entries in use
+static unsigned NumLiveRewrites = 0;
+
+//
+// Structure: RewriteBucket
+//
+// Description:
+//  This structure is a bucket of the open-addressed hash table that indexes
+//  the rewrite entries.  The table holds two kinds of keys: the actual value
+//  of a rewritten pointer, which finds the entry that can be returned again
+//  when the same pointer is rewritten, and the start of an object, which finds
+//  the first of the entries of the OOB pointers that came from the object.
+//
+struct RewriteBucket {
+  // The actual value of a pointer or the start of an object
+  const void * Key;
+
+  // Index plus one of the rewrite entry; zero for an empty bucket
+  unsigned Entry;
+
+  // Whether the key is the start of an object
+  unsigned IsObject;
+};
+
+// The buckets of the hash table; the number of buckets is a power of two
+static RewriteBucket * Buckets = 0;
+static unsigned NumBuckets = 0;
+static unsigned NumUsedBuckets = 0;
 
-// Map between rewrite pointer and source file information
-llvm::DenseMap<void *, const char*>  & RewriteSourcefile (void) {
-  static llvm::DenseMap<void *, const char*>  internalRewriteSourcefile;
-  return internalRewriteSourcefile;
+//
+// Function: getHomeBucket()
+//
+// Description:
+//  Return the index of the first bucket that is probed for a key.
+//
+static inline unsigned
+getHomeBucket (const void * Key, unsigned IsObject) {
+  uintptr_t Hash = (uintptr_t) Key ^ IsObject;
+  Hash = (Hash ^ (Hash >> 16)) * 0x45d9f3b;
+  Hash = (Hash ^ (Hash >> 16)) * 0x45d9f3b;
+  return (unsigned) (Hash ^ (Hash >> 16)) & (NumBuckets - 1);
 }
 
-llvm::DenseMap<void *, unsigned> & RewriteLineno (void) {
-  static llvm::DenseMap<void *, unsigned>     internalRewriteLineno;
-  return internalRewriteLineno;
+//
+// Function: findBucket()
+//
+// Description:
+//  Return the index of the bucket holding the specified key or, if the key is
+//  not in the table, the index of the empty bucket in which it belongs.
+//
+static unsigned
+findBucket (const void * Key, unsigned IsObject) {
+  unsigned index = getHomeBucket (Key, IsObject);
+  while (Buckets[index].Entry) {
+    if ((Buckets[index].Key == Key) && (Buckets[index].IsObject == IsObject))
+      break;
+    index = (index + 1) & (NumBuckets - 1);
+  }
+  return index;
 }
 
-std::map<const void *, const void *> & RewrittenPointers (void) {
-  static std::map<const void *, const void *> internalRewrittenPointers;
-  return internalRewrittenPointers;
+//
+// Function: growBuckets()
+//
+// Description:
+//  Double the number of buckets of the hash table and rehash its keys.
+//
+static void
+growBuckets (void) {
+  RewriteBucket * OldBuckets = Buckets;
+  unsigned NumOldBuckets = NumBuckets;
+  NumBuckets = NumOldBuckets ? (2 * NumOldBuckets) : 1024;
+  Buckets = (RewriteBucket *) calloc (NumBuckets, sizeof (RewriteBucket));
+  assert (Buckets && "Out of memory for rewrite pointers!\n");
+  SC_STAT_GAUGE (METADATA_BYTES,
+                 (long) (NumBuckets - NumOldBuckets) * sizeof (RewriteBucket));
+  for (unsigned index = 0; index < NumOldBuckets; ++index)
+    if (OldBuckets[index].Entry) {
+      const RewriteBucket & Bucket = OldBuckets[index];
+      Buckets[findBucket (Bucket.Key, Bucket.IsObject)] = Bucket;
+    }
+  free (OldBuckets);
 }
 
-// Record from which object an OOB pointer originates
-llvm::DenseMap<void *, std::pair<void *, void * > > & RewrittenObjs (void) {
-  static llvm::DenseMap<void *, std::pair<void *, void * > > intRewrittenObjs;
-  return intRewrittenObjs;
+//
+// Function: insertBucket()
+//
+// Description:
+//  Map a key to a rewrite entry, replacing any entry to which it was mapped.
+//
+static void
+insertBucket (const void * Key, unsigned IsObject, unsigned Entry) {
+  if (2 * (NumUsedBuckets + 1) > NumBuckets)
+    growBuckets ();
+  RewriteBucket & Bucket = Buckets[findBucket (Key, IsObject)];
+  if (!Bucket.Entry)
+    ++NumUsedBuckets;
+  Bucket.Key = Key;
+  Bucket.IsObject = IsObject;
+  Bucket.Entry = Entry;
+}
+
+//
+// Function: eraseBucket()
+//
+// Description:
+//  Empty a bucket of the hash table.  The buckets following it in its probe
+//  sequence are moved back so that no lookup stops at the emptied bucket too
+//  early.
+//
+static void
+eraseBucket (unsigned index) {
+  unsigned Mask = NumBuckets - 1;
+  unsigned next = (index + 1) & Mask;
+  while (Buckets[next].Entry) {
+    //
+    // A bucket may fill the hole if the hole lies between the key's home
+    // bucket and the bucket in which the key is stored.
+    //
+    unsigned Home = getHomeBucket (Buckets[next].Key, Buckets[next].IsObject);
+    if (((next - Home) & Mask) >= ((next - index) & Mask)) {
+      Buckets[index] = Buckets[next];
+      index = next;
+    }
+    next = (next + 1) & Mask;
+  }
+  Buckets[index].Entry = 0;
+  --NumUsedBuckets;
+}
+
+//
+// Function: allocRewriteEntry()
+//
+// Description:
+//  Take a rewrite entry from the free list or from the unused part of the
+//  table.
+//
+// Return value:
+//  0 - There are no entries left.
+//  Otherwise, the index plus one of the entry is returned.
+//
+static unsigned
+allocRewriteEntry (void) {
+  if (unsigned Entry = FreeRewriteEntries) {
+    FreeRewriteEntries = RewriteEntries[Entry - 1].Next;
+    return Entry;
+  }
+
+  //
+  // Allocate the table the first time that it is needed.  Only the pages
+  // holding entries that are used take up memory.
+  //
+  if (!RewriteEntries) {
+    void * Addr = mmap (0, MaxRewriteEntries * sizeof (RewriteEntry),
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (Addr == MAP_FAILED)
+      return 0;
+    RewriteEntries = (RewriteEntry *) Addr;
+  }
+
+  //
+  // Every entry needs a rewrite pointer within the invalid memory range.
+  //
+  if ((NumRewriteEntries == MaxRewriteEntries) ||
+      (NumRewriteEntries >= InvalidUpper - InvalidLower - 1))
+    return 0;
+  SC_STAT_GAUGE (METADATA_BYTES, sizeof (RewriteEntry));
+  return ++NumRewriteEntries;
+}
+
+//
+// Function: releaseObjectRewrites()
+//
+// Description:
+//  Release the rewrite entries of the OOB pointers that came from an object
+//  so that they can be reused.  The caller must hold the RewriteLock.
+//
+static void
+releaseObjectRewrites (void * ObjStart) {
+  unsigned index = findBucket (ObjStart, 1);
+  unsigned Entry = Buckets[index].Entry;
+  if (!Entry)
+    return;
+  eraseBucket (index);
+
+  while (Entry) {
+    RewriteEntry & Rewrite = RewriteEntries[Entry - 1];
+
+    //
+    // Forget the actual value of the pointer unless it was rewritten again
+    // for another object.
+    //
+    index = findBucket (Rewrite.Actual, 0);
+    if (Buckets[index].Entry == Entry)
+      eraseBucket (index);
+
+    unsigned Next = Rewrite.Next;
+    Rewrite.Pool = 0;
+    Rewrite.Next = FreeRewriteEntries;
+    FreeRewriteEntries = Entry;
+    --NumLiveRewrites;
+    Entry = Next;
+  }
+}
+
+//
+// Function: releaseRewrites()
+//
+// Description:
+//  Release the rewrite entries of the OOB pointers that came from an object.
+//  This is called when the object is unregistered.
+//
+void
+releaseRewrites (void * ObjStart) {
+  //
+  // Nothing needs to be done if no pointer has ever been rewritten.
+  //
+  if (!Buckets)
+    return;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (RewriteLock);
+#endif
+  releaseObjectRewrites (ObjStart);
+}
+
+//
+// Function: releasePoolRewrites()
+//
+// Description:
+//  Release the rewrite entries of the OOB pointers that came from the objects
+//  of a pool.  This is used when a pool is destroyed, since its objects are
+//  freed without being unregistered.
+//
+void
+releasePoolRewrites (DebugPoolTy * Pool) {
+  if (!Buckets)
+    return;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (RewriteLock);
+#endif
+  for (unsigned index = 0; index < NumRewriteEntries; ++index)
+    if (RewriteEntries[index].Pool == Pool)
+      releaseObjectRewrites (RewriteEntries[index].ObjStart);
 }
 
 //
@@ -84,66 +323,84 @@ rewrite_ptr (DebugPoolTy * Pool,
              const char * SourceFile,
              unsigned lineno) {
 
-  static unsigned char * invalidptr = 0;
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (RewriteLock);
+#endif
 
   //
-  // If this pointer has already been rewritten, do not rewrite it again.
+  // If no pool was specified (as is the case for an ExactCheck), use a
+  // special Out of Bounds Pointer pool.
   //
-  if (RewrittenPointers().find (p) != RewrittenPointers().end()) {
-    return const_cast<void*>(RewrittenPointers()[p]);
-  }
+  if (!Pool) Pool = &OOBPool;
 
   //
-  // Calculate a new rewrite pointer.
+  // If this pointer has already been rewritten for the same object, do not
+  // rewrite it again.
   //
-  if (invalidptr == 0) invalidptr = (unsigned char*)InvalidLower;
-  ++invalidptr;
+  if (Buckets) {
+    if (unsigned Entry = Buckets[findBucket (p, 0)].Entry) {
+      RewriteEntry & Rewrite = RewriteEntries[Entry - 1];
+      if ((Rewrite.ObjStart == ObjStart) && (Rewrite.ObjEnd == ObjEnd))
+        return (unsigned char *) InvalidLower + Entry;
+    }
+  }
 
   //
-  // Ensure that we haven't run out of rewrite pointers.
+  // Find an entry for a new rewrite pointer.  Ensure that we haven't run out
+  // of rewrite pointers.
   //
-  void* P = invalidptr;
-  if ((uintptr_t) P == InvalidUpper) {
-    fprintf (stderr, "rewrite: out of rewrite ptrs: %p %p, pc=%p\n",
-             (void *) InvalidLower, (void *) InvalidUpper, invalidptr);
+  unsigned Entry = allocRewriteEntry ();
+  if (Entry) {
+    ++NumLiveRewrites;
+    SC_STAT_INC (OOB_REWRITES);
+  } else {
+    fprintf (stderr, "rewrite: out of rewrite ptrs: %p %p, %u in use\n",
+             (void *) InvalidLower, (void *) InvalidUpper, NumLiveRewrites);
     fflush (stderr);
     return const_cast<void*>(p);
   }
+  void * invalidptr = (unsigned char *) InvalidLower + Entry;
 
-  //
-  // If no pool was specified (as is the case for an ExactCheck), use a
-  // special Out of Bounds Pointer pool.
-  //
-  if (!Pool) Pool = &OOBPool;
-
-  //
-  // Determine if this pointer value has already been rewritten.  If so, just
-  // return the previously rewritten value.  Otherwise, insert a mapping from
-  // rewrite pointer to original pointer into the pool.
-  //
-  Pool->OOB.insert (invalidptr, ((unsigned char *)(invalidptr)), const_cast<void*>(p));
-
-  //
-  // If debugging tool support is enabled, then insert it into the global
-  // OOB pool as well; this will ensure that we can find the pointer on a
-  // memory protection violation (on faults, we don't have Pool handle
-  // information).
-  //
   if (logregs) {
     fprintf (ReportLog, "rewrite: %p: %p -> %p\n", (void*) Pool, p, invalidptr);
     fflush (ReportLog);
   }
 
-  OOBPool.OOB.insert (invalidptr, ((unsigned char *)(invalidptr)), const_cast<void*>(p));
-  RewriteSourcefile()[invalidptr] = SourceFile;
-  RewriteLineno()[invalidptr] = lineno;
-  RewrittenPointers()[p] = invalidptr;
-  RewrittenObjs()[invalidptr] = std::make_pair(ObjStart, ObjEnd);
+  //
+  // Record the rewrite and chain its entry to the other entries of the object
+  // so that they can all be released when the object is.
+  //
+  RewriteEntry & Rewrite = RewriteEntries[Entry - 1];
+  Rewrite.Pool = Pool;
+  Rewrite.Actual = p;
+  Rewrite.ObjStart = ObjStart;
+  Rewrite.ObjEnd = ObjEnd;
+  Rewrite.SourceFile = SourceFile;
+  Rewrite.lineno = lineno;
+  Rewrite.Next = Buckets ? Buckets[findBucket (ObjStart, 1)].Entry : 0;
+  insertBucket (ObjStart, 1, Entry);
+  insertBucket (p, 0, Entry);
   return invalidptr;
 }
 
 }
 
+//
+// Function: __sc_dbg_rewritestats()
+//
+// Description:
+//  Report how many rewrite pointers are in use and how many entries of the
+//  rewrite table have ever been used.
+//
+extern "C" void
+__sc_dbg_rewritestats (unsigned long * InUse, unsigned long * Allocated) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+  SpinLockGuard Guard (RewriteLock);
+#endif
+  *InUse = NumLiveRewrites;
+  *Allocated = NumRewriteEntries;
+}
+
 //
 // Function: getActualValue()
 //
@@ -160,32 +417,22 @@ pchk_getActualValue (DebugPoolTy * Pool, void * p) {
     return p;
   }
 
-  void * src = 0;
-  void* tag = 0;
-  void * end = 0;
-
-  //
-  // Look for the pointer in the pool's OOB pointer list.  If we find it,
-  // return its actual value.
-  //
-  if (Pool && (Pool->OOB.find(p, src, end, tag))) {
-    if (logregs) {
-      fprintf (ReportLog, "getActualValue(1): %p: %p -> %p\n", (void*)Pool, p, tag);
-      fflush (ReportLog);
-    }
-    return tag;
-  }
-
   //
-  // If we can't find the pointer in the pool's OOB list, perhaps it's in the
-  // global OOB Pool (this can happen when it's rewritten by an exact check).
+  // The entry of a rewrite pointer is found without searching.  Since all
+  // rewrites are recorded in one table, the pool is not needed to find it.
   //
-  if (OOBPool.OOB.find (p, src, end, tag)) {
-    if (logregs) {
-      fprintf (ReportLog, "getActualValue(2): %p: %p -> %p\n", (void*)&OOBPool, p, tag);
-      fflush (ReportLog);
+  {
+#ifdef SC_THREAD_SAFE_RUNTIME
+    SpinLockGuard Guard (RewriteLock);
+#endif
+    if (RewriteEntry * Entry = getRewriteEntry (p)) {
+      if (logregs) {
+        fprintf (ReportLog, "getActualValue(1): %p: %p -> %p\n",
+                 (void*)Entry->Pool, p, Entry->Actual);
+        fflush (ReportLog);
+      }
+      return const_cast<void*>(Entry->Actual);
     }
-    return tag;
   }
 
   //
@@ -194,7 +441,7 @@ pchk_getActualValue (DebugPoolTy * Pool, void * p) {
   // just return the pointer.
   //
   if (logregs) {
-    fprintf (ReportLog, "getActualValue(3): %p: %p -> %p\n", (void*)Pool, p, p);
+    fprintf (ReportLog, "getActualValue(2): %p: %p -> %p\n", (void*)Pool, p, p);
     fflush (ReportLog);
   }
   return p;
@@ -16,6 +16,8 @@
 
 namespace llvm {
 
+struct DebugPoolTy;
+
 //
 // The lower and upper bound of an unmapped memory region.  This range is used
 // for rewriting pointers that go one beyond the edge of an object so that they
@@ -35,15 +37,54 @@ namespace llvm {
 //  o) Other platforms - We allocate a range of memory and disable read and
 //                       write permissions for the pages contained within it.
 //
-extern uintptr_t InvalidUpper;
-extern uintptr_t InvalidLower;
+// The bounds have C linkage because compiled code that samples checks reads
+// them (see LowerSafecodeIntrinsic).
+//
+extern "C" uintptr_t InvalidUpper;
+extern "C" uintptr_t InvalidLower;
+
+//
+// Structure: RewriteEntry
+//
+// Description:
+//  This structure records one Out-of-Bounds (OOB) pointer rewrite.  The
+//  rewrite pointer of the entry at index i of the rewrite table is
+//  InvalidLower + 1 + i, so the entry of a rewrite pointer is found without
+//  searching.  Entries are released when the object from which the pointer
+//  came is unregistered or its pool is destroyed, and are then reused.
+//
+struct RewriteEntry {
+  // Pool of the object from which the pointer came; NULL for a free entry
+  DebugPoolTy * Pool;
+
+  // The actual value of the OOB pointer
+  const void * Actual;
+
+  // The first and last valid byte of the object from which the pointer came
+  void * ObjStart;
+  void * ObjEnd;
+
+  // Location of the check that rewrote the pointer
+  const char * SourceFile;
+  unsigned lineno;
+
+  // Index plus one of the next entry of the same object or of the next free
+  // entry; zero ends the list
+  unsigned Next;
+};
+
+// Table of rewrite entries and the number of its entries ever used
+extern RewriteEntry * RewriteEntries;
+extern unsigned NumRewriteEntries;
 
-// Map between rewrite pointer and source file information
-extern llvm::DenseMap<void *, const char*>  & RewriteSourcefile (void);
-extern llvm::DenseMap<void *, unsigned>     & RewriteLineno (void);
-extern std::map<const void *, const void *> & RewrittenPointers (void);
-extern llvm::DenseMap<void *,
-                      std::pair<void *, void * > > & RewrittenObjs (void);
+// Release the rewrite entries of an object or of all objects of a pool
+extern void releaseRewrites (void * ObjStart);
+extern void releasePoolRewrites (DebugPoolTy * Pool);
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the rewrite pointer book keeping
+extern SpinLock RewriteLock;
+#endif
 
 //
 // Function: isRewritePtr()
@@ -65,6 +106,26 @@ isRewritePtr (void * p) {
   return false;
 }
 
+//
+// Function: getRewriteEntry()
+//
+// Description:
+//  Find the entry recording the rewrite of an Out-of-Bounds pointer.  The
+//  caller must hold the RewriteLock.
+//
+// Return value:
+//  NULL     - The pointer is not a rewrite pointer that is in use.
+//  Otherwise, a pointer to the entry of the rewrite pointer is returned.
+//
+static inline RewriteEntry *
+getRewriteEntry (void * p) {
+  uintptr_t index = (uintptr_t) p - InvalidLower - 1;
+  if (isRewritePtr (p) && (index < NumRewriteEntries))
+    if (RewriteEntries[index].Pool)
+      return &(RewriteEntries[index]);
+  return 0;
+}
+
 //
 // Function: getOOBObject()
 //
@@ -83,12 +144,22 @@ isRewritePtr (void * p) {
 //  true  - The pointer was an OOB pointer.
 //  false - The pointer was not an OOB pointer.
 //
+// Notes:
+//  The bounds are both NULL if the object of the OOB pointer is no longer
+//  registered.
+//
 static inline bool
 getOOBObject (void * p, void * & start, void * & end) {
   if (isRewritePtr (p)) {
-    // FIXME: the casts are hacks to deal with the C++ type system
-    start = const_cast<void*>(RewrittenObjs()[p].first);
-    end   = const_cast<void*>(RewrittenObjs()[p].second);
+#ifdef SC_THREAD_SAFE_RUNTIME
+    SpinLockGuard Guard (RewriteLock);
+#endif
+    if (RewriteEntry * Entry = getRewriteEntry (p)) {
+      start = Entry->ObjStart;
+      end   = Entry->ObjEnd;
+    } else {
+      start = end = 0;
+    }
     return true;
   }
 
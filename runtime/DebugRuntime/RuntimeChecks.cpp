@@ -31,11 +31,14 @@
 #include "DebugReport.h"
 #include "PoolAllocator.h"
 #include "PageManager.h"
+#include "CheckProfile.h"
 #include "ConfigData.h"
 #include "RewritePtr.h"
+#include "ObjectCache.h"
 
 #include "../include/CWE.h"
 #include "../include/DebugRuntime.h"
+#include "../include/RuntimeStats.h"
 
 #include <errno.h>
 
@@ -50,23 +53,24 @@ extern FILE * ReportLog;
 
 using namespace llvm;
 
-static inline unsigned char
-isInCache (DebugPoolTy * Pool, void * p) {
-  if ((Pool->objectCache[0].lower <= p) && (p <= Pool->objectCache[0].upper))
-    return 0;
+// Epochs of the object cache entries and the per-thread object caches
+volatile unsigned llvm::CacheEpochs[NumCacheEpochs];
+__thread ThreadObjectCache llvm::ObjectCache;
 
-  if ((Pool->objectCache[1].lower <= p) && (p <= Pool->objectCache[1].upper))
-    return 1;
+// Epoch of the inline caches of the check sites; zero is never valid
+volatile uintptr_t __sc_site_epoch = 1;
 
-  return 2;
-}
-
-static inline void
-updateCache (DebugPoolTy * Pool, void * Start, void * End) {
-  Pool->objectCache[Pool->cacheIndex].lower = Start;
-  Pool->objectCache[Pool->cacheIndex].upper = End;
-  Pool->cacheIndex = (Pool->cacheIndex) ? 0 : 1;
-  return;
+//
+// Function: __sc_dbg_cachestats()
+//
+// Description:
+//  Report how many lookups of the calling thread were satisfied by its object
+//  cache and how many had to search the pool.
+//
+void
+__sc_dbg_cachestats (unsigned long * Hits, unsigned long * Misses) {
+  *Hits = ObjectCache.Hits;
+  *Misses = ObjectCache.Misses;
 }
 
 //
@@ -134,21 +138,18 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
   // Otherwise, look through the splay trees for an object in which the
   // pointer points.
   //
-  bool found = false;
-  unsigned char index = isInCache (Pool, Node);
-  if (index < 2) {
-    found = true;
-    ObjStart = Pool->objectCache[index].lower;
-    ObjEnd = Pool->objectCache[index].upper; 
-  } else {
-    found = Pool->Objects.find (Node, ObjStart, ObjEnd);
+  if (findInCache (Pool, Node, ObjStart, ObjEnd)) {
+    SC_PROFILE_COST (CostCache);
+    return true;
   }
 
   //
-  // If the memory access is within bounds, update the cache and return.
+  // If the pointer is within a registered object, cache the object and
+  // return.
   //
-  if ((found) && (ObjStart <= Node) && (Node <= ObjEnd)) {
-    updateCache (Pool, ObjStart, ObjEnd);
+  if (Pool->Objects.find (Node, ObjStart, ObjEnd)) {
+    SC_PROFILE_COST (CostTree);
+    updateCache (Pool, Node, ObjStart, ObjEnd);
     return true;
   }
 
@@ -158,8 +159,9 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
   //
 #if 1
   if ((ObjStart = __pa_bitmap_poolcheck (Pool, Node))) {
+    SC_PROFILE_COST (CostBitmap);
     ObjEnd = (unsigned char *) ObjStart + Pool->NodeSize - 1;
-    updateCache (Pool, ObjStart, ObjEnd);
+    updateCache (Pool, Node, ObjStart, ObjEnd);
     return true;
   }
 #endif
@@ -167,6 +169,7 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
   //
   // The node is not found or is not within bounds; fail!
   //
+  SC_PROFILE_COST (CostMiss);
   return false;
 }
 
@@ -184,6 +187,9 @@ poolcheck_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+  SC_PROFILE_CHECK ("poolcheck", tag, SourceFilep, lineno);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -290,6 +296,9 @@ poolcheck_debug (DebugPoolTy *Pool,
 //
 void
 poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const char * SourceFile, unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+  SC_PROFILE_CHECK ("poolcheckalign", tag, SourceFile, lineno);
+
   //
   // Let null pointers go if the alignment is zero; such pointers are aligned.
   //
@@ -306,19 +315,15 @@ poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const
   //
   void * S = 0;
   void * end = 0;
-  bool found = false;
-  unsigned char index = isInCache (Pool, Node);
-  if (index < 2) {
-    S   = Pool->objectCache[index].lower;
-    end = Pool->objectCache[index].upper;
-    found = true;
-  }
+  bool found = findInCache (Pool, Node, S, end);
+  if (found)
+    SC_PROFILE_COST (CostCache);
 
   //
   // Look for the object in the splay of regular objects.
   //
-  if (!found)
-    found = Pool->Objects.find (Node, S, end);
+  if (!found && (found = Pool->Objects.find (Node, S, end)))
+    SC_PROFILE_COST (CostTree);
 
   //
   // If we can't find the object in the splay tree, try to find it in the pool
@@ -327,11 +332,14 @@ poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const
   if (!found) {
 #if 1
     if (void * start = __pa_bitmap_poolcheck (Pool, Node)) {
+      SC_PROFILE_COST (CostBitmap);
       S = start;
       end = (unsigned char *)start + Pool->NodeSize - 1;
       found = true;
     }
 #endif
+    if (!found)
+      SC_PROFILE_COST (CostMiss);
   }
 
   //
@@ -384,6 +392,9 @@ poolcheckui_debug (DebugPoolTy *Pool,
                    TAG,
                    const char * SourceFilep,
                    unsigned lineno) {
+  SC_STAT_INC (POOLCHECK);
+  SC_PROFILE_CHECK ("poolcheckui", tag, SourceFilep, lineno);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -445,9 +456,7 @@ poolcheckui_debug (DebugPoolTy *Pool,
   //
   ObjStart = 0;
   ObjEnd = 0;
-  if (isRewritePtr (Node)) {
-    ObjStart = RewrittenObjs()[Node].first;
-    ObjEnd   = RewrittenObjs()[Node].second;
+  if (getOOBObject (Node, ObjStart, ObjEnd)) {
     Node = pchk_getActualValue (Pool, Node);
   }
 
@@ -538,18 +547,18 @@ boundscheck_lookup (DebugPoolTy * Pool, void * & Source, void * & End ) {
     //
     // First check the cache of objects to see if the pointer is in there.
     //
-    unsigned char index = isInCache (Pool, Source);
-    if (index < 2) {
-      Source = Pool->objectCache[index].lower;
-      End    = Pool->objectCache[index].upper;
+    void * Node = Source;
+    if (findInCache (Pool, Node, Source, End)) {
+      SC_PROFILE_COST (CostCache);
       return true;
     }
 
     //
     // Search the splay tree.  If we find the object, add it to the cache.
     //
-    if (Pool->Objects.find(Source, Source, End)) {
-      updateCache (Pool, Source, End);
+    if (Pool->Objects.find(Node, Source, End)) {
+      SC_PROFILE_COST (CostTree);
+      updateCache (Pool, Node, Source, End);
       return true;
     }
 
@@ -558,15 +567,18 @@ boundscheck_lookup (DebugPoolTy * Pool, void * & Source, void * & End ) {
     // get the object bounds and recheck the pointer.
     //
 #if 1
-    if (void * start = __pa_bitmap_poolcheck (Pool, Source)) {
+    if (void * start = __pa_bitmap_poolcheck (Pool, Node)) {
+      SC_PROFILE_COST (CostBitmap);
       Source = start;
       End = (unsigned char *)start + Pool->NodeSize - 1;
-      updateCache (Pool, Source, End);
+      updateCache (Pool, Node, Source, End);
       return true;
     }
 #endif
   }
 
+  SC_PROFILE_COST (CostMiss);
+
   //
   // No pool was given, so we cannot find the object.  Let the run-time use the
   // slow path to search for externally allocated objects, argv pointers, and
@@ -874,6 +886,9 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
 // the attribute should be taken once the bug is fixed.
 void * __attribute__((noinline))
 boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const char * SourceFile, unsigned lineno) {
+  SC_STAT_INC (BOUNDSCHECK);
+  SC_PROFILE_CHECK ("boundscheck", tag, SourceFile, lineno);
+
   // This code is inlined at all boundscheck() calls
 
   // Search the splay for Source and return the bounds of the object
@@ -920,6 +935,9 @@ boundscheckui_debug (DebugPoolTy * Pool,
                      void * Dest, TAG,
                      const char * SourceFile,
                      unsigned int lineno) {
+  SC_STAT_INC (BOUNDSCHECK);
+  SC_PROFILE_CHECK ("boundscheckui", tag, SourceFile, lineno);
+
   // This code is inlined at all boundscheckui calls
 
   // Search the splay for Source and return the bounds of the object
@@ -953,6 +971,266 @@ boundscheckui_debug (DebugPoolTy * Pool,
   }
 }
 
+//
+// Function: poolcheck_cached_debug()
+//
+// Description:
+//  Identical to poolcheck_debug() except that the object found is cached in
+//  the inline cache of the check site.
+//
+void
+poolcheck_cached_debug (DebugPoolTy * Pool,
+                        void * Node,
+                        unsigned length,
+                        SiteCache * Cache,
+                        TAG,
+                        const char * SourceFilep,
+                        unsigned lineno) {
+  if (length && Pool) {
+    //
+    // A pointer outside of the pool is counted again by poolcheck_debug()
+    // below.
+    //
+    SC_PROFILE_CHECK ("poolcheck", tag, SourceFilep, lineno);
+    uintptr_t Epoch = __sc_site_epoch;
+    readBarrier ();
+
+    void * ObjStart, * ObjEnd;
+    unsigned char * NodeEnd = (unsigned char *)(Node) + length - 1;
+    if (_barebone_poolcheck (Pool, Node, length, ObjStart, ObjEnd) &&
+        (ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd)) {
+      SC_STAT_INC (POOLCHECK);
+      fillSiteCache (Cache, Pool, ObjStart, ObjEnd, Epoch);
+      return;
+    }
+  }
+
+  //
+  // Let the uncached check search for the object again and report the
+  // violation if there is one.
+  //
+  poolcheck_debug (Pool, Node, length, tag, SourceFilep, lineno);
+}
+
+//
+// Function: boundscheck_cached_common()
+//
+// Description:
+//  Perform a bounds check and cache the object in which it found both
+//  pointers in the inline cache of the check site.
+//
+static inline void *
+boundscheck_cached_common (DebugPoolTy * Pool,
+                           void * Source,
+                           void * Dest,
+                           SiteCache * Cache,
+                           bool CanFail,
+                           const char * SourceFile,
+                           unsigned lineno) {
+  SC_STAT_INC (BOUNDSCHECK);
+  uintptr_t Epoch = __sc_site_epoch;
+  readBarrier ();
+
+  void * ObjStart = Source, * ObjEnd = 0;
+  bool ret = boundscheck_lookup (Pool, ObjStart, ObjEnd);
+  if (__builtin_expect ((ret && (ObjStart <= Dest) &&
+                        ((Dest <= ObjEnd))), 1)) {
+    fillSiteCache (Cache, Pool, ObjStart, ObjEnd, Epoch);
+    return Dest;
+  }
+
+  return boundscheck_check (ret,
+                            ObjStart,
+                            ObjEnd,
+                            Pool,
+                            Source,
+                            Dest,
+                            CanFail,
+                            SourceFile,
+                            lineno);
+}
+
+//
+// Function: boundscheck_cached_debug()
+//
+// Description:
+//  Identical to boundscheck_debug() except that the object found is cached in
+//  the inline cache of the check site.
+//
+void *
+boundscheck_cached_debug (DebugPoolTy * Pool,
+                          void * Source,
+                          void * Dest,
+                          SiteCache * Cache,
+                          TAG,
+                          const char * SourceFile,
+                          unsigned lineno) {
+  SC_PROFILE_CHECK ("boundscheck", tag, SourceFile, lineno);
+  return boundscheck_cached_common (Pool, Source, Dest, Cache, true,
+                                    SourceFile, lineno);
+}
+
+//
+// Function: boundscheckui_cached_debug()
+//
+// Description:
+//  Identical to boundscheckui_debug() except that the object found is cached
+//  in the inline cache of the check site.
+//
+void *
+boundscheckui_cached_debug (DebugPoolTy * Pool,
+                            void * Source,
+                            void * Dest,
+                            SiteCache * Cache,
+                            TAG,
+                            const char * SourceFile,
+                            unsigned lineno) {
+  SC_PROFILE_CHECK ("boundscheckui", tag, SourceFile, lineno);
+  return boundscheck_cached_common (Pool, Source, Dest, Cache, false,
+                                    SourceFile, lineno);
+}
+
+//
+// Function: poolcheck_batch_common()
+//
+// Description:
+//  Perform a batch of load/store checks.  The entries are sorted by pool and
+//  address so that checks of the same object are adjacent; a check within the
+//  object that the previous check found needs no lookup of its own.  A check
+//  that fails is run again by the unbatched check, which reports it.
+//
+// Inputs:
+//  Entries  - The checks; they are sorted in place.
+//  Count    - The number of checks.
+//  Complete - Whether the checks are poolchecks (rather than poolcheckuis).
+//
+static inline void
+poolcheck_batch_common (CheckBatchEntry * Entries,
+                        unsigned Count,
+                        bool Complete) {
+  SC_STAT_INC (BATCHES);
+
+  //
+  // Batches are a handful of checks at most, so an insertion sort suffices.
+  //
+  for (unsigned index = 1; index < Count; ++index) {
+    CheckBatchEntry Entry = Entries[index];
+    unsigned slot = index;
+    for (; slot > 0; --slot) {
+      CheckBatchEntry & Prev = Entries[slot - 1];
+      if ((Prev.Pool < Entry.Pool) ||
+          ((Prev.Pool == Entry.Pool) && (Prev.Node <= Entry.Node)))
+        break;
+      Entries[slot] = Prev;
+    }
+    Entries[slot] = Entry;
+  }
+
+  DebugPoolTy * ObjPool = 0;
+  void * ObjStart = 0, * ObjEnd = 0;
+  bool Found = false;
+  for (unsigned index = 0; index < Count; ++index) {
+    CheckBatchEntry & Entry = Entries[index];
+    if (Entry.length == 0) {
+      SC_STAT_INC (POOLCHECK);
+      continue;
+    }
+
+    void * Node = Entry.Node;
+    void * NodeEnd = (unsigned char *)(Node) + Entry.length - 1;
+    if (Found && (Entry.Pool == ObjPool) &&
+        (ObjStart <= Node) && (NodeEnd <= ObjEnd)) {
+      SC_STAT_INC (POOLCHECK);
+      SC_STAT_INC (BATCH_SHARED);
+      continue;
+    }
+
+    ObjPool = Entry.Pool;
+    Found = _barebone_poolcheck (ObjPool, Node, Entry.length,
+                                 ObjStart, ObjEnd);
+    if (Found && (NodeEnd <= ObjEnd)) {
+      SC_STAT_INC (POOLCHECK);
+      continue;
+    }
+
+    Found = false;
+    if (Complete)
+      poolcheck_debug (Entry.Pool, Node, Entry.length, 0,
+                       Entry.SourceFile, Entry.lineno);
+    else
+      poolcheckui_debug (Entry.Pool, Node, Entry.length, 0,
+                         Entry.SourceFile, Entry.lineno);
+  }
+}
+
+//
+// Function: poolcheck_batch()
+//
+// Description:
+//  Perform a batch of poolchecks that the compiler moved to one point of the
+//  program.
+//
+void
+poolcheck_batch (CheckBatchEntry * Entries, unsigned Count) {
+  poolcheck_batch_common (Entries, Count, true);
+}
+
+//
+// Function: poolcheckui_batch()
+//
+// Description:
+//  Perform a batch of poolcheckuis that the compiler moved to one point of the
+//  program.
+//
+void
+poolcheckui_batch (CheckBatchEntry * Entries, unsigned Count) {
+  poolcheck_batch_common (Entries, Count, false);
+}
+
+//
+// Function: boundscheck_speculative()
+//
+// Description:
+//  Perform a bounds check on behalf of a program that has already used the
+//  result of the indexing operation.  It is too late to rewrite Dest into an
+//  OOB pointer, so the check only reports a Dest that lies outside the object
+//  of Source and that the configuration would not have rewritten.
+//
+//  An unrewritten OOB pointer belongs to no object, so indexing off a pointer
+//  that is not found is not reported; the checks on the uses of the result
+//  find any access outside of an object.
+//
+void
+llvm::boundscheck_speculative (DebugPoolTy * Pool, void * Source, void * Dest) {
+  SC_STAT_INC (BOUNDSCHECK);
+
+  void * ObjStart = Source, * ObjEnd = 0;
+  if (!boundscheck_lookup (Pool, ObjStart, ObjEnd) &&
+      !ExternalObjects->find (Source, ObjStart, ObjEnd))
+    return;
+
+  if (__builtin_expect (((ObjStart <= Dest) && (Dest <= ObjEnd)), 1))
+    return;
+
+  if ((ConfigData.StrictIndexing == false) ||
+      (((char *) Dest) == (((char *)ObjEnd)+1)))
+    return;
+
+  OutOfBoundsViolation v;
+  v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
+    v.faultPC = __builtin_return_address(0),
+    v.faultPtr = Dest,
+    v.CWE = CWEBufferOverflow,
+    v.dbgMetaData = NULL,
+    v.PoolHandle = Pool,
+    v.SourceFile = NULL,
+    v.lineNo = 0,
+    v.objStart = ObjStart,
+    v.objLen = (unsigned)((char*) ObjEnd - (char*)(ObjStart)) + 1;
+
+  ReportMemoryViolation(&v);
+}
+
 //
 // Function: funccheck()
 //
@@ -966,6 +1244,8 @@ boundscheckui_debug (DebugPoolTy * Pool,
 //
 void
 funccheck (void *f, void * targets[]) {
+  SC_STAT_INC (FUNCCHECK);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -1002,6 +1282,9 @@ funccheck_debug (void *f,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT_INC (FUNCCHECK);
+  SC_PROFILE_CHECK ("funccheck", tag, SourceFilep, lineno);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -1034,6 +1317,8 @@ funccheck_debug (void *f,
 //
 void
 funccheckui (void *f, void * targets[]) {
+  SC_STAT_INC (FUNCCHECK);
+
   //
   // For now, do nothing.  If the list could be incomplete, we don't know when
   // a target is valid.
@@ -1058,6 +1343,9 @@ funccheckui_debug (void *f,
                    TAG,
                    const char * SourceFilep,
                    unsigned lineno) {
+  SC_STAT_INC (FUNCCHECK);
+  SC_PROFILE_CHECK ("funccheckui", tag, SourceFilep, lineno);
+
   //
   // For now, do nothing.  If the list could be incomplete, we don't know when
   // a target is valid.
@@ -1074,6 +1362,8 @@ poolcheck (DebugPoolTy *Pool, void *Node, unsigned length) {
 
 void
 poolcheckui (DebugPoolTy *Pool, void *Node, unsigned length) {
+  SC_STAT_INC (POOLCHECK);
+
   //
   // In production mode, do not report an error if an incomplete load/store
   // check fails.  The fact that it is incomplete means that we can't tell for
@@ -1112,6 +1402,24 @@ boundscheckui (DebugPoolTy * Pool, void * Source, void * Dest) {
   return boundscheckui_debug (Pool, Source, Dest, 0, NULL, 0);
 }
 
+void
+poolcheck_cached (DebugPoolTy * Pool, void * Node, unsigned length,
+                  SiteCache * Cache) {
+  poolcheck_cached_debug (Pool, Node, length, Cache, 0, NULL, 0);
+}
+
+void *
+boundscheck_cached (DebugPoolTy * Pool, void * Source, void * Dest,
+                    SiteCache * Cache) {
+  return boundscheck_cached_debug (Pool, Source, Dest, Cache, 0, NULL, 0);
+}
+
+void *
+boundscheckui_cached (DebugPoolTy * Pool, void * Source, void * Dest,
+                      SiteCache * Cache) {
+  return boundscheckui_cached_debug (Pool, Source, Dest, Cache, 0, NULL, 0);
+}
+
 //
 // Function: poolcheckalign()
 //
@@ -0,0 +1,109 @@
+//===- SampledChecks.cpp - Support for sampled run-time checks ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the run-time support for the checks that the compiler
+// lowers with sampling.  Every sampled check site has a counter that the
+// compiled code counts down; when it reaches zero, the code calls
+// __sc_sample_begin(), runs the check, and calls __sc_sample_end().  Object
+// registration is never sampled, so the checks that do run remain exact.
+//
+// A site whose check finds a violation escalates: its counter is made
+// negative, and the compiled code then runs its check every time.
+//
+// The sampling period is read from the SC_SAMPLE_RATE environment variable
+// when the first sampled check runs; a period of N runs one check in N.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DebugRuntime.h"
+
+#include "../include/Report.h"
+
+#include <climits>
+#include <cstdlib>
+
+using namespace llvm;
+
+// Sampling period used when SC_SAMPLE_RATE is not set
+static const int DefaultSamplePeriod = 100;
+
+// Sampling period; zero until it is first needed
+static int SamplePeriod = 0;
+
+// The counter of the sampled check that the current thread is running
+static __thread int * CurrentSampleSite = 0;
+
+//
+// Function: __sc_set_sample_rate()
+//
+// Description:
+//  Run one sampled check in Period from now on.  A period of one runs every
+//  check.
+//
+void
+__sc_set_sample_rate (unsigned Period) {
+  if (Period < 1)
+    Period = 1;
+  if (Period > INT_MAX)
+    Period = INT_MAX;
+  SamplePeriod = (int) Period;
+}
+
+//
+// Function: __sc_sample_begin()
+//
+// Description:
+//  Restart the countdown of a sampled check site that is about to run its
+//  check.  Escalated sites are left escalated.
+//
+void
+__sc_sample_begin (int * Site) {
+  if (!SamplePeriod) {
+    const char * Rate = getenv ("SC_SAMPLE_RATE");
+    __sc_set_sample_rate (Rate ? strtoul (Rate, 0, 10) : DefaultSamplePeriod);
+  }
+
+  if (*Site >= 0)
+    *Site = SamplePeriod - 1;
+  CurrentSampleSite = Site;
+}
+
+//
+// Function: __sc_sample_end()
+//
+// Description:
+//  Note that the current thread has finished running a sampled check.
+//
+void
+__sc_sample_end (void) {
+  CurrentSampleSite = 0;
+}
+
+namespace llvm {
+
+//
+// Function: escalateSampledCheck()
+//
+// Description:
+//  Make the sampled check that the current thread is running, if any, run on
+//  every execution from now on.  This is called whenever a violation is
+//  reported.
+//
+// Notes:
+//  The counter is updated without atomic instructions.  If another thread
+//  counts down the same site at the same moment, the site may remain sampled
+//  until its check finds another violation.
+//
+void
+escalateSampledCheck (void) {
+  if (int * Site = CurrentSampleSite)
+    *Site = INT_MIN;
+}
+
+}
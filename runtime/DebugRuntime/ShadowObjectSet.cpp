@@ -0,0 +1,368 @@
+//===- ShadowObjectSet.cpp - Shadow memory index of objects ---------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the ShadowObjectSet.h interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../include/ShadowObjectSet.h"
+#include "../include/MMAPSupport.h"
+#include "../include/RuntimeStats.h"
+
+#include <cstring>
+
+// The first level of the shadow table shared by all sets
+uintptr_t ** volatile ShadowObjectSet::Directory = 0;
+
+// Sequence locks guarding the entries of the shadow table
+SeqLock ShadowObjectSet::PageLocks[NumPageLocks];
+
+//===----------------------------------------------------------------------===//
+//
+// Type-stable memory for records and buckets
+//
+//===----------------------------------------------------------------------===//
+
+// Number of bucket size classes; class n holds 4 << n objects
+static const unsigned NumSizeClasses = 24;
+
+// Size of the chunks from which records and small buckets are carved
+static const size_t ChunkSize = 1 << 20;
+
+// Lock protecting the free lists and the current chunk
+static SpinLock AllocLock;
+
+// Free lists of records and of buckets of each size class
+static ShadowObjectSet::ObjRecord * FreeRecords = 0;
+static ShadowObjectSet::PageBucket * FreeBuckets[NumSizeClasses];
+
+// The unused part of the current chunk
+static char * ChunkNext = 0;
+static char * ChunkEnd = 0;
+
+static inline unsigned
+getCapacity (unsigned SizeClass) {
+  return 4u << SizeClass;
+}
+
+static inline size_t
+getBucketSize (unsigned SizeClass) {
+  return sizeof (ShadowObjectSet::PageBucket) +
+         (getCapacity (SizeClass) - 1) * sizeof (ShadowObjectSet::ObjRecord *);
+}
+
+//
+// Function: carve()
+//
+// Description:
+//  Allocate memory that will never be returned to the system.  The caller
+//  must hold AllocLock.
+//
+static void *
+carve (size_t Size) {
+  Size = (Size + 15) & ~((size_t) 15);
+  if (Size > ChunkSize / 16) {
+    Size = (Size + 4095) & ~((size_t) 4095);
+    SC_STAT_GAUGE (METADATA_BYTES, Size);
+    return AllocateSpaceWithMMAP (Size, true);
+  }
+
+  if ((size_t)(ChunkEnd - ChunkNext) < Size) {
+    ChunkNext = (char *) AllocateSpaceWithMMAP (ChunkSize, true);
+    ChunkEnd = ChunkNext + ChunkSize;
+    SC_STAT_GAUGE (METADATA_BYTES, ChunkSize);
+  }
+
+  void * Mem = ChunkNext;
+  ChunkNext += Size;
+  return Mem;
+}
+
+static ShadowObjectSet::ObjRecord *
+allocRecord (void) {
+  SpinLockGuard Guard (AllocLock);
+  ShadowObjectSet::ObjRecord * R = FreeRecords;
+  if (R) {
+    FreeRecords = R->Next;
+    return R;
+  }
+  return (ShadowObjectSet::ObjRecord *) carve (sizeof (*R));
+}
+
+static void
+freeRecord (ShadowObjectSet::ObjRecord * R) {
+  SpinLockGuard Guard (AllocLock);
+  R->Next = FreeRecords;
+  FreeRecords = R;
+}
+
+static ShadowObjectSet::PageBucket *
+allocBucket (unsigned SizeClass) {
+  SpinLockGuard Guard (AllocLock);
+  ShadowObjectSet::PageBucket * B = FreeBuckets[SizeClass];
+  if (B) {
+    FreeBuckets[SizeClass] = B->NextFree;
+  } else {
+    B = (ShadowObjectSet::PageBucket *) carve (getBucketSize (SizeClass));
+    B->SizeClass = SizeClass;
+  }
+  B->Count = 0;
+  return B;
+}
+
+static void
+freeBucket (ShadowObjectSet::PageBucket * B) {
+  SpinLockGuard Guard (AllocLock);
+  B->NextFree = FreeBuckets[B->SizeClass];
+  FreeBuckets[B->SizeClass] = B;
+}
+
+//===----------------------------------------------------------------------===//
+//
+// ShadowObjectSet methods
+//
+//===----------------------------------------------------------------------===//
+
+//
+// Method: getEntry()
+//
+// Description:
+//  Find the shadow table entry for the specified shadow page.  The directory
+//  and the leaves are reserved with mmap() on demand; the kernel only backs
+//  the parts of them that are actually touched.
+//
+// Inputs:
+//  Page   - The shadow page number (address >> PageShift).
+//  Create - Flags whether a missing leaf should be allocated.
+//
+// Return value:
+//  A pointer to the entry is returned.  If the page cannot be described by
+//  the shadow table or the leaf is missing and Create is false, NULL is
+//  returned.
+//
+uintptr_t *
+ShadowObjectSet::getEntry (uintptr_t Page, bool Create) {
+  if (Page >> (LeafBits + DirBits))
+    return 0;
+
+  //
+  // Racing threads may both allocate the directory or a leaf; the loser
+  // releases its copy.
+  //
+  uintptr_t ** Dir = Directory;
+  if (!Dir) {
+    if (!Create) return 0;
+    size_t Size = sizeof (uintptr_t *) << DirBits;
+    uintptr_t ** NewDir = (uintptr_t **) AllocateSpaceWithMMAP (Size, true);
+    if (!__sync_bool_compare_and_swap (&Directory, (uintptr_t **) 0, NewDir))
+      munmap (NewDir, Size);
+    else
+      SC_STAT_GAUGE (METADATA_BYTES, Size);
+    Dir = Directory;
+  }
+
+  uintptr_t * volatile * LeafPtr = &(Dir[Page >> LeafBits]);
+  uintptr_t * Leaf = *LeafPtr;
+  if (!Leaf) {
+    if (!Create) return 0;
+    size_t Size = sizeof (uintptr_t) << LeafBits;
+    uintptr_t * NewLeaf = (uintptr_t *) AllocateSpaceWithMMAP (Size, true);
+    if (!__sync_bool_compare_and_swap (LeafPtr, (uintptr_t *) 0, NewLeaf))
+      munmap (NewLeaf, Size);
+    else
+      SC_STAT_GAUGE (METADATA_BYTES, Size);
+    Leaf = *LeafPtr;
+  }
+
+  return &(Leaf[Page & ((1u << LeafBits) - 1)]);
+}
+
+//
+// Method: addToPage()
+//
+// Description:
+//  Record that the specified object overlaps the shadow page described by the
+//  given table entry.  The caller must hold the page's sequence lock.
+//
+void
+ShadowObjectSet::addToPage (uintptr_t * Entry, ObjRecord * R) {
+  PageBucket * Old = 0;
+  PageBucket * B;
+  if (*Entry == 0) {
+    B = allocBucket (0);
+  } else if (*Entry & 1) {
+    //
+    // The page was covered by a single object; turn it into a bucket holding
+    // that object.
+    //
+    B = allocBucket (0);
+    B->Objs[0] = (ObjRecord *) (*Entry & ~(uintptr_t)1);
+    B->Count = 1;
+  } else {
+    B = (PageBucket *) *Entry;
+    if (B->Count == getCapacity (B->SizeClass)) {
+      //
+      // Move the objects into a bucket of the next size class.  The old
+      // bucket is recycled once the new one has been published.
+      //
+      Old = B;
+      B = allocBucket (Old->SizeClass + 1);
+      memcpy (B->Objs, Old->Objs, Old->Count * sizeof (ObjRecord *));
+      B->Count = Old->Count;
+    }
+  }
+
+  //
+  // Keep the objects sorted by their start address.
+  //
+  unsigned index = B->Count;
+  while ((index > 0) && (B->Objs[index - 1]->start > R->start)) {
+    B->Objs[index] = B->Objs[index - 1];
+    --index;
+  }
+  B->Objs[index] = R;
+  writeBarrier ();
+  ++(B->Count);
+
+  writeBarrier ();
+  *Entry = (uintptr_t) B;
+  if (Old) freeBucket (Old);
+}
+
+//
+// Method: removeFromPage()
+//
+// Description:
+//  Remove the specified object from the shadow page described by the given
+//  table entry.  The caller must hold the page's sequence lock.
+//
+void
+ShadowObjectSet::removeFromPage (uintptr_t * Entry, ObjRecord * R) {
+  if (*Entry & 1) {
+    if ((ObjRecord *) (*Entry & ~(uintptr_t)1) == R)
+      *Entry = 0;
+    return;
+  }
+
+  PageBucket * B = (PageBucket *) *Entry;
+  if (!B) return;
+  for (unsigned index = 0; index < B->Count; ++index) {
+    if (B->Objs[index] == R) {
+      memmove (&(B->Objs[index]),
+               &(B->Objs[index + 1]),
+               (B->Count - index - 1) * sizeof (ObjRecord *));
+      if (--(B->Count) == 0) {
+        *Entry = 0;
+        freeBucket (B);
+      }
+      return;
+    }
+  }
+}
+
+//
+// Method: insertRecord()
+//
+// Description:
+//  Add an object to the set.  The caller must hold the set's write lock.
+//
+bool
+ShadowObjectSet::insertRecord (void * start, void * end, void * Data) {
+  //
+  // Reject objects that start within an object already in the set and objects
+  // that the shadow table cannot describe.
+  //
+  void * S, * E, * D;
+  if (lookup (start, S, E, D))
+    return false;
+
+  uintptr_t FirstPage = ((uintptr_t) start) >> PageShift;
+  uintptr_t LastPage  = ((uintptr_t) end) >> PageShift;
+  if ((end < start) || (LastPage >> (LeafBits + DirBits)))
+    return false;
+
+  ObjRecord * R = allocRecord ();
+  R->start = start;
+  R->end = end;
+  R->Data = Data;
+  R->Owner = this;
+  R->Prev = 0;
+  R->Next = Head;
+  if (Head) Head->Prev = R;
+  Head = R;
+  ++NumObjects;
+
+  //
+  // Mark every shadow page overlapped by the object.  Pages that the object
+  // covers completely and that nothing else uses get a direct pointer to the
+  // record so that lookups within large objects never scan a bucket.
+  //
+  for (uintptr_t Page = FirstPage; Page <= LastPage; ++Page) {
+    uintptr_t * Entry = getEntry (Page, true);
+    uintptr_t PageStart = Page << PageShift;
+    uintptr_t PageEnd = PageStart + ((1u << PageShift) - 1);
+    SeqLock & Lock = getPageLock (Page);
+    Lock.writeLock ();
+    if ((*Entry == 0) &&
+        ((uintptr_t) start <= PageStart) && (PageEnd <= (uintptr_t) end))
+      *Entry = ((uintptr_t) R) | 1;
+    else
+      addToPage (Entry, R);
+    Lock.writeUnlock ();
+  }
+
+  return true;
+}
+
+//
+// Method: erase()
+//
+// Description:
+//  Remove the specified record from the shadow table and from the set.  The
+//  caller must hold the set's write lock.
+//
+void
+ShadowObjectSet::erase (ObjRecord * R) {
+  uintptr_t FirstPage = ((uintptr_t) R->start) >> PageShift;
+  uintptr_t LastPage  = ((uintptr_t) R->end) >> PageShift;
+  for (uintptr_t Page = FirstPage; Page <= LastPage; ++Page) {
+    SeqLock & Lock = getPageLock (Page);
+    Lock.writeLock ();
+    removeFromPage (getEntry (Page, false), R);
+    Lock.writeUnlock ();
+  }
+
+  if (R->Prev) R->Prev->Next = R->Next; else Head = R->Next;
+  if (R->Next) R->Next->Prev = R->Prev;
+  --NumObjects;
+  freeRecord (R);
+}
+
+//
+// Method: remove()
+//
+// Description:
+//  Remove the object containing the specified address from the set.
+//
+bool
+ShadowObjectSet::remove (void * key) {
+  SpinLockGuard Guard (WriteLock);
+  void * S, * E, * D;
+  ObjRecord * R = lookup (key, S, E, D);
+  if (!R) return false;
+  erase (R);
+  return true;
+}
+
+void
+ShadowObjectSet::clear (void) {
+  SpinLockGuard Guard (WriteLock);
+  while (Head)
+    erase (Head);
+}
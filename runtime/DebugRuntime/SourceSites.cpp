@@ -0,0 +1,162 @@
+//===- SourceSites.cpp - Find the source locations of checks --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file finds the source locations of the run-time checks that
+// DebugInstrument compiled in site table mode.  Such checks take no debug
+// arguments; instead, every call to one has an entry in the sc_srcinfo section
+// giving the code around the call, its tag, its source file, and its line
+// number.  The linker concatenates the entries of all of the object files, so
+// the table is sorted the first time that a violation needs it and is then
+// binary searched.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DebugReport.h"
+
+#include "../include/SpinLock.h"
+
+#include <algorithm>
+
+#if defined(__ELF__)
+#include <execinfo.h>
+#endif
+
+namespace llvm {
+
+//
+// Structure: SourceSite
+//
+// Description:
+//  An entry of the site table.  The return address of the call to the check
+//  lies after Begin and no later than End.
+//
+struct SourceSite {
+  const char * Begin;
+  const char * End;
+  const char * SourceFile;
+  unsigned tag;
+  unsigned lineno;
+};
+
+}
+
+using namespace llvm;
+
+#if defined(__ELF__)
+// The bounds of the site table; the linker defines them if there is one
+extern "C" SourceSite __start_sc_srcinfo[] __attribute__((weak));
+extern "C" SourceSite __stop_sc_srcinfo[] __attribute__((weak));
+
+// Number of return addresses on the stack searched for a check
+static const int MaxFrames = 16;
+
+// Lock serializing the sorting of the table and whether it has been sorted
+static SpinLock TableLock;
+static volatile int TableSorted = 0;
+
+static bool
+endsBefore (const SourceSite & Site, const char * PC) {
+  return Site.End < PC;
+}
+
+static bool
+siteBefore (const SourceSite & A, const SourceSite & B) {
+  return A.End < B.End;
+}
+
+//
+// Function: sortSites()
+//
+// Description:
+//  Sort the site table by the code that the entries cover.
+//
+static void
+sortSites (void) {
+  SpinLockGuard Guard (TableLock);
+  if (!TableSorted) {
+    std::sort (__start_sc_srcinfo, __stop_sc_srcinfo, siteBefore);
+    writeBarrier ();
+    TableSorted = 1;
+  }
+}
+
+//
+// Function: lookupSite()
+//
+// Description:
+//  Find the entry of the site table covering the specified return address.
+//
+// Return value:
+//  NULL     - The return address is not that of a check in the table.
+//  Otherwise, a pointer to the entry is returned.
+//
+static const SourceSite *
+lookupSite (const void * PC) {
+  const char * Addr = (const char *) PC;
+  SourceSite * Site = std::lower_bound (__start_sc_srcinfo,
+                                        __stop_sc_srcinfo,
+                                        Addr,
+                                        endsBefore);
+  if ((Site != __stop_sc_srcinfo) && (Site->Begin < Addr))
+    return Site;
+  return 0;
+}
+#endif
+
+namespace llvm {
+
+//
+// Function: findSourceSite()
+//
+// Description:
+//  Find the source location of the check that found a violation in the site
+//  table.  The program counter of the violation is tried first; the run-time
+//  may have reached the code reporting the violation through a number of
+//  calls, so the return addresses on the stack of the current thread are
+//  tried next.  This must be called while the check is still on the stack.
+//
+// Outputs:
+//  SourceFile - The source file of the check.
+//  lineNo     - The line number of the check.
+//
+// Return value:
+//  true  - The check was found in the site table.
+//  false - The check is not in the site table; the outputs are unchanged.
+//
+bool
+findSourceSite (const void * faultPC,
+                const char * & SourceFile,
+                unsigned & lineNo) {
+#if defined(__ELF__)
+  if (&__start_sc_srcinfo[0] == &__stop_sc_srcinfo[0])
+    return false;
+
+  if (TableSorted)
+    readBarrier ();
+  else
+    sortSites ();
+
+  const SourceSite * Site = lookupSite (faultPC);
+  if (!Site) {
+    void * Frames[MaxFrames];
+    int NumFrames = backtrace (Frames, MaxFrames);
+    for (int index = 0; (index < NumFrames) && !Site; ++index)
+      Site = lookupSite (Frames[index]);
+  }
+
+  if (Site) {
+    SourceFile = Site->SourceFile;
+    lineNo = Site->lineno;
+    return true;
+  }
+#endif
+  return false;
+}
+
+}
@@ -50,6 +50,8 @@
 #if !defined(__FreeBSD__)
 #include <execinfo.h>
 #endif
+// This file provides the storage and functions of the run-time statistics
+#define SC_STATISTICS_IMPLEMENTATION
 #include "softboundcets.h"
 
 __softboundcets_trie_entry_t** __softboundcets_trie_primary_table;
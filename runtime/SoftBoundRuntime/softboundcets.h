@@ -51,6 +51,8 @@
 #include <unistd.h>
 #include <assert.h>
 
+#include "../include/RuntimeStats.h"
+
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
 extern size_t __softboundcets_statistics_spatial_load_dereference_checks;
 extern size_t __softboundcets_statistics_spatial_store_dereference_checks ;
@@ -241,7 +243,12 @@ static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = ((size_t) 4 *
 #endif
 
 
+/* GCC refuses to inline a weak function into the run-time's own callers */
+#if defined(__clang__)
 #define __WEAK_INLINE __attribute__((__weak__,__always_inline__)) 
+#else
+#define __WEAK_INLINE __attribute__((__weak__))
+#endif
 
 #if __WORDSIZE == 32
 #define __METADATA_INLINE __attribute__((__weak__))
@@ -445,6 +452,7 @@ __WEAK_INLINE __softboundcets_trie_entry_t* __softboundcets_trie_allocate(){
   __softboundcets_trie_entry_t* secondary_entry;
   size_t length = (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES) * sizeof(__softboundcets_trie_entry_t);
   secondary_entry = __softboundcets_safe_mmap(0, length, PROT_READ| PROT_WRITE, SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
+  SC_STAT_GAUGE (METADATA_BYTES, length);
   //assert(secondary_entry != (void*)-1); 
   //printf("snd trie table %p %lx\n", secondary_entry, length);
   return secondary_entry;
@@ -606,6 +614,7 @@ __WEAK_INLINE void __softboundcets_spatial_load_dereference_check(void *base, vo
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_spatial_load_dereference_checks++;
 #endif
+  SC_STAT_INC (SPATIAL_LOAD_CHECKS);
 
   if (__SOFTBOUNDCETS_DISABLE) {
     return;
@@ -628,6 +637,7 @@ __WEAK_INLINE void __softboundcets_spatial_store_dereference_check(void *base, v
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_spatial_store_dereference_checks++;
 #endif
+  SC_STAT_INC (SPATIAL_STORE_CHECKS);
 
   if (__SOFTBOUNDCETS_DISABLE) {
     return;
@@ -713,6 +723,7 @@ __METADATA_INLINE void __softboundcets_metadata_store(void* addr_of_ptr, void* b
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_metadata_stores++;
 #endif
+  SC_STAT_INC (METADATA_STORES);
 
   if(!__SOFTBOUNDCETS_TRIE)
     return;
@@ -802,6 +813,7 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_metadata_loads++;
 #endif
+  SC_STAT_INC (METADATA_LOADS);
 
   if (__SOFTBOUNDCETS_DISABLE) {
     return;
@@ -901,6 +913,7 @@ __softboundcets_temporal_load_dereference_check(void* pointer_lock,
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_temporal_load_dereference_checks++;
 #endif
+  SC_STAT_INC (TEMPORAL_LOAD_CHECKS);
   
   /* URGENT: I should think about removing this condition check */
   if(!pointer_lock){
@@ -940,6 +953,7 @@ __softboundcets_temporal_store_dereference_check(void* pointer_lock,
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_temporal_store_dereference_checks++;
 #endif
+  SC_STAT_INC (TEMPORAL_STORE_CHECKS);
 
   if(!pointer_lock){
     __softboundcets_printf("lock null?");
@@ -966,6 +980,7 @@ __WEAK_INLINE void __softboundcets_stack_memory_deallocation(size_t ptr_key){
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_stack_deallocations++;
 #endif
+  SC_STAT_INC (UNREGISTER_STACK);
   
 #ifndef __SOFTBOUNDCETS_CONSTANT_STACK_KEY_LOCK
 
@@ -984,6 +999,8 @@ __softboundcets_memory_deallocation(void* ptr_lock, size_t ptr_key) {
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_heap_deallocations++;
 #endif
+  SC_STAT_INC (UNREGISTER_HEAP);
+  SC_STAT_GAUGE (LIVE_OBJECTS, -1);
   
   if(__SOFTBOUNDCETS_DEBUG){
     __softboundcets_printf("[Hdealloc] pointer_lock = %p, *pointer_lock=%zx\n", 
@@ -1095,6 +1112,7 @@ __softboundcets_stack_memory_allocation(void** ptr_lock, size_t* ptr_key) {
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_stack_allocations++;
 #endif
+  SC_STAT_INC (REGISTER_STACK);
 
 #ifdef __SOFTBOUNDCETS_CONSTANT_STACK_KEY_LOCK
   *((size_t*) ptr_key) = 1;
@@ -1114,6 +1132,8 @@ __softboundcets_memory_allocation(void* ptr, void** ptr_lock, size_t* ptr_key){
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
   __softboundcets_statistics_heap_allocations++;
 #endif
+  SC_STAT_INC (REGISTER_HEAP);
+  SC_STAT_GAUGE (LIVE_OBJECTS, 1);
 
   size_t temp_id = __softboundcets_key_id_counter++;
 
@@ -18,6 +18,10 @@
 #include <string>
 #include <set>
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+#include "SpinLock.h"
+#endif
+
 // Use a macro for the const attribute.  This allows const to be disabled for
 // debugging, allowing a programmer to change logregs during a debugging
 // session.
@@ -34,6 +38,10 @@ namespace llvm {
 /// never delete a BitmapPoolTy* directly!
 struct BitmapPoolTy {
   static const unsigned AddrArrSize = 2;
+
+  // Number of size buckets of freed large arrays
+  static const unsigned NumLargeArrayBuckets = 16;
+
   // Linked list of slabs used for stack allocations
   void * StackSlabs;
 
@@ -66,11 +74,32 @@ struct BitmapPoolTy {
   // NodeSize - Keep track of the object size tracked by this pool
   unsigned short NodeSize;
 
-  // Large arrays. In SAFECode, these are currently not freed or reused. 
-  // A better implementation could split them up into single slabs for reuse,
-  // upon being freed.
+  // Large arrays that are in use.
   void *LargeArrays;
-  void *FreeLargeArrays;
+
+  // Large arrays that have been freed.  Bucket N holds the arrays of at least
+  // 2^N pages (and fewer than 2^(N+1) pages, except for the last bucket).
+  // Freed arrays are split to satisfy smaller requests and coalesced with
+  // freed neighbors that came from the same mapping.
+  void *FreeLargeArrays[NumLargeArrayBuckets];
+
+  // Number of large array allocations and frees; used to find the freed
+  // arrays that have been idle long enough to return their pages to the OS
+  unsigned LargeArrayClock;
+
+  // Number of frees of ordinary objects and of new slabs; every
+  // OrdinaryOpsPerTick of them also tick LargeArrayClock
+  unsigned OrdinaryOps;
+
+  // Number of large array allocations satisfied by reusing a freed array and
+  // by getting fresh pages
+  unsigned long LargeArraysReused;
+  unsigned long LargeArraysFresh;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  // Lock serializing the allocations and deallocations of the pool
+  SpinLock Lock;
+#endif
 };
 
 #if 0
@@ -124,6 +153,9 @@ extern "C" {
   void * poolstrdup(llvm::BitmapPoolTy *Pool, void *Node);
   void poolfree(llvm::BitmapPoolTy *Pool, void *Node);
   void * __pa_bitmap_poolcheck(llvm::BitmapPoolTy *Pool, void *Node);
+  void __pa_bitmap_largestats(llvm::BitmapPoolTy *Pool,
+                              unsigned long * Reused,
+                              unsigned long * Fresh);
 }
 
 #endif
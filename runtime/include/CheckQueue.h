@@ -0,0 +1,210 @@
+//===- CheckQueue.h - Single-producer, single-consumer ring -----*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the ring through which a program thread hands run-time
+// checks to a checker thread.  Exactly one thread may produce records and
+// exactly one may consume them.  Each side keeps its own index and a copy of
+// the other side's index on its own cache line; it only reads the other
+// side's index when its copy says the ring is full or empty, and it only
+// publishes its own index once per batch of records, so in the steady state
+// the two threads rarely touch the same cache line.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_CHECKQUEUE_H_
+#define _SC_CHECKQUEUE_H_
+
+#include "SpinLock.h"
+
+#include <sched.h>
+#include <stddef.h>
+
+namespace llvm {
+
+// Size of a cache line on the targets of the run-time
+static const size_t CacheLineSize = 64;
+
+//
+// Function: cpuRelax()
+//
+// Description:
+//  Tell the processor that this thread is spinning on a shared location.
+//
+static inline void
+cpuRelax (void) {
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__ ("pause" ::: "memory");
+#else
+  compilerBarrier ();
+#endif
+}
+
+//
+// Function: spinWait()
+//
+// Description:
+//  Wait a moment for another thread to update a shared location.  The caller
+//  counts the times that it has waited in Spins; after a few short waits, the
+//  thread yields the processor so that the thread it waits for can run even
+//  if they share a processor.
+//
+static inline void
+spinWait (unsigned & Spins) {
+  if (++Spins < 64)
+    cpuRelax ();
+  else
+    sched_yield ();
+}
+
+//
+// Class: CheckQueue
+//
+// Description:
+//  A ring of 2^LogSize records.  The producer fills the record returned by
+//  reserve() and then calls push(); the consumer reads the record returned by
+//  front() and then calls pop().  Neither side waits for the other except
+//  when the ring is full.
+//
+//  The producer publishes its records every PublishBatch records and when it
+//  calls flush(); the consumer publishes the records it has finished every
+//  PublishBatch records and whenever it finds the ring empty.  The producer
+//  knows that the consumer has finished every record that it pushed once
+//  drained() is true.
+//
+// Notes:
+//  The class has no constructor so that a ring with static storage is ready
+//  before any constructor of the program runs; a ring with any other storage
+//  must be zero-filled before use.
+//
+template <typename RecordT, unsigned LogSize, unsigned PublishBatch = 16>
+class CheckQueue {
+  static const unsigned long Size = 1UL << LogSize;
+  static const unsigned long Mask = Size - 1;
+
+  // The producer's side: the published and private ends of the ring, and the
+  // last start of the ring that the producer read
+  volatile unsigned long Tail __attribute__((aligned(CacheLineSize)));
+  unsigned long ProducerTail;
+  unsigned long ProducerHead;
+
+  // The consumer's side, likewise
+  volatile unsigned long Head __attribute__((aligned(CacheLineSize)));
+  unsigned long ConsumerHead;
+  unsigned long ConsumerTail;
+
+  RecordT Records[Size] __attribute__((aligned(CacheLineSize)));
+
+ public:
+
+  //
+  // Method: reserve()
+  //
+  // Description:
+  //  Return the record that the producer fills next, waiting for the
+  //  consumer if the ring is full.
+  //
+  RecordT & reserve (void) {
+    if (__builtin_expect (ProducerTail - ProducerHead == Size, 0)) {
+      flush ();
+      unsigned Spins = 0;
+      while ((ProducerHead = Head) + Size == ProducerTail)
+        spinWait (Spins);
+    }
+    return Records[ProducerTail & Mask];
+  }
+
+  //
+  // Method: push()
+  //
+  // Description:
+  //  Add the record returned by reserve() to the ring.
+  //
+  void push (void) {
+    if ((++ProducerTail & (PublishBatch - 1)) == 0)
+      flush ();
+  }
+
+  //
+  // Method: flush()
+  //
+  // Description:
+  //  Make all of the pushed records visible to the consumer.
+  //
+  void flush (void) {
+    writeBarrier ();
+    Tail = ProducerTail;
+  }
+
+  //
+  // Method: drained()
+  //
+  // Description:
+  //  Publish the pushed records and determine whether the consumer has
+  //  finished all of them.
+  //
+  bool drained (void) {
+    if (Tail != ProducerTail)
+      flush ();
+    return (ProducerHead = Head) == ProducerTail;
+  }
+
+  //
+  // Method: front()
+  //
+  // Description:
+  //  Return the next record for the consumer or NULL if the ring is empty.
+  //  When it is empty, the consumer tells the producer that it has finished
+  //  every record.
+  //
+  RecordT * front (void) {
+    if (ConsumerHead == ConsumerTail) {
+      ConsumerTail = Tail;
+      readBarrier ();
+      if (ConsumerHead == ConsumerTail) {
+        if (Head != ConsumerHead)
+          release ();
+        return 0;
+      }
+    }
+    return &Records[ConsumerHead & Mask];
+  }
+
+  //
+  // Method: pop()
+  //
+  // Description:
+  //  Finish the record returned by front().
+  //
+  void pop (void) {
+    if ((++ConsumerHead & (PublishBatch - 1)) == 0)
+      release ();
+  }
+
+ private:
+  //
+  // Method: release()
+  //
+  // Description:
+  //  Give the records that the consumer has finished back to the producer.
+  //  The consumer must be done reading them first, so this orders its loads
+  //  as well as its stores with the store of the index.
+  //
+  void release (void) {
+#if defined(__i386__) || defined(__x86_64__)
+    compilerBarrier ();
+#else
+    __sync_synchronize ();
+#endif
+    Head = ConsumerHead;
+  }
+};
+
+}
+
+#endif
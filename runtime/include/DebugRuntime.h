@@ -16,6 +16,8 @@
 
 #include "BitmapAllocator.h"
 #include "SplayTree.h"
+#include "NodeArenaAllocator.h"
+#include "ShadowObjectSet.h"
 
 #include <iosfwd>
 #include <stdint.h>
@@ -78,29 +80,91 @@ typedef struct DebugMetaData {
 } DebugMetaData;
 typedef DebugMetaData * PDebugMetaData;
 
-struct DebugPoolTy : public BitmapPoolTy {
-  // Splay tree used for object registration
-  RangeSplaySet<> Objects;
+//
+// Types: ObjectSetTy, OOBMapTy, MetaDataMapTy
+//
+// Description:
+//  The data structures used to find the object containing an address.  By
+//  default, these are splay trees whose nodes are allocated from an arena
+//  owned by each tree, so that clearing a tree when its pool is destroyed
+//  releases all of its nodes at once.  Building the runtime with
+//  SC_SHADOW_OBJECT_INDEX defined selects the shadow memory index for the
+//  registered objects instead, which provides constant time lookups
+//  regardless of the number of objects.
+//
+//  Building the runtime with SC_THREAD_SAFE_RUNTIME defined uses the shadow
+//  memory index for every object registry.  Splay trees restructure
+//  themselves on every lookup and cannot be shared between threads; lookups
+//  in the shadow memory index do not write to memory and do not take locks.
+//
+#ifdef SC_THREAD_SAFE_RUNTIME
+#ifndef SC_SHADOW_OBJECT_INDEX
+#define SC_SHADOW_OBJECT_INDEX 1
+#endif
+typedef ShadowObjectMap<void *> OOBMapTy;
+typedef ShadowObjectMap<PDebugMetaData> MetaDataMapTy;
+#else
+typedef RangeSplayMap<void *, NodeArenaAllocator<void *> > OOBMapTy;
+typedef RangeSplayMap<PDebugMetaData,
+                      NodeArenaAllocator<PDebugMetaData> > MetaDataMapTy;
+#endif
 
-  // Splay tree used for out of bound objects
-  RangeSplayMap<void *> OOB;
+#ifdef SC_SHADOW_OBJECT_INDEX
+typedef ShadowObjectSet ObjectSetTy;
+#else
+typedef RangeSplaySet<NodeArenaAllocator<void> > ObjectSetTy;
+#endif
 
-  // Splay tree used by dangling pointer runtime
-  RangeSplayMap<PDebugMetaData> DPTree;
+struct DebugPoolTy : public BitmapPoolTy {
+  // Index used for object registration
+  ObjectSetTy Objects;
 
-  // Cache of recently found memory objects
-  struct {
-    void * lower;
-    void * upper;
-  } objectCache[2];
+  // Index used by dangling pointer runtime
+  MetaDataMapTy DPTree;
+};
 
-  unsigned char cacheIndex;
+//
+// Structure: SiteCache
+//
+// Description:
+//  The inline cache of one check site.  The compiler places one of these
+//  beside every cached check; the compiled code skips the call to the
+//  run-time when the pointers being checked lie within the cached object, and
+//  the run-time fills it with the object that it found.  The entry is valid
+//  while its epoch matches __sc_site_epoch, which is advanced whenever an
+//  object is unregistered.  The compiler lays this structure out itself, so
+//  it must not change.
+//
+struct SiteCache {
+  void * lower;
+  void * upper;
+  DebugPoolTy * Pool;
+  volatile uintptr_t Epoch;
 };
 
 void * rewrite_ptr (DebugPoolTy * Pool, const void * p, void * ObjStart,
 void * ObjEnd, const char * SourceFile, unsigned lineno);
 void installAllocHooks (void);
 
+//
+// Structure: CheckBatchEntry
+//
+// Description:
+//  One load/store check of a batch that the compiler gives to
+//  poolcheck_batch() or poolcheckui_batch().
+//
+struct CheckBatchEntry {
+  DebugPoolTy * Pool;
+  void * Node;
+  const char * SourceFile;
+  unsigned length;
+  unsigned lineno;
+};
+
+// Checks run by the checker threads after the program has used the pointer
+void boundscheck_speculative (DebugPoolTy * Pool, void * Source, void * Dest);
+void exactcheck_speculative (char * base, char * result, unsigned size);
+
 }
 
 // Use macros so that I won't polluate the namespace
@@ -156,6 +220,10 @@ extern "C" {
   void poolcheck_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
   void poolcheckui_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
 
+  // Batches of load/store checks made at one point of the program
+  void poolcheck_batch (llvm::CheckBatchEntry * Entries, unsigned Count);
+  void poolcheckui_batch (llvm::CheckBatchEntry * Entries, unsigned Count);
+
   void poolcheckalign(PPOOL, void *Node, unsigned Offset);
   void poolcheckalign_debug (PPOOL, void *Node, unsigned Offset, TAG, SRC_INFO);
 
@@ -178,6 +246,51 @@ extern "C" {
 
   void * pchk_getActualValue (PPOOL, void * src);
 
+  // Checks with per-site inline caches
+  extern volatile uintptr_t __sc_site_epoch;
+  void poolcheck_cached (PPOOL, void * Node, unsigned length,
+                         llvm::SiteCache * Cache);
+  void poolcheck_cached_debug (PPOOL, void * Node, unsigned length,
+                               llvm::SiteCache * Cache, TAG, SRC_INFO);
+  void * boundscheck_cached (PPOOL, void * Source, void * Dest,
+                             llvm::SiteCache * Cache);
+  void * boundscheckui_cached (PPOOL, void * Source, void * Dest,
+                               llvm::SiteCache * Cache);
+  void * boundscheck_cached_debug (PPOOL, void * S, void * D,
+                                   llvm::SiteCache * Cache, TAG, SRC_INFO);
+  void * boundscheckui_cached_debug (PPOOL, void * S, void * D,
+                                     llvm::SiteCache * Cache, TAG, SRC_INFO);
+
+  // Sampled checks
+  void __sc_set_sample_rate (unsigned Period);
+  void __sc_sample_begin (int * Site);
+  void __sc_sample_end (void);
+
+  // Checks and registrations handed to the checker threads
+  void __sc_par_pool_init_runtime (unsigned Dangling,
+                                   unsigned RewriteOOB,
+                                   unsigned Terminate);
+  void __sc_par_wait_for_completion (void);
+  void * __sc_par_poolargvregister (int argc, char ** argv);
+  void __sc_par_pool_register (PPOOL, void * p, unsigned size);
+  void __sc_par_pool_register_stack (PPOOL, void * p, unsigned size);
+  void __sc_par_pool_register_global (PPOOL, void * p, unsigned size);
+  void __sc_par_pool_reregister (PPOOL, void * p, void * q, unsigned size);
+  void __sc_par_pool_unregister (PPOOL, void * p);
+  void __sc_par_pool_unregister_stack (PPOOL, void * p);
+  void __sc_par_poolcheck (PPOOL, void * Node, unsigned length);
+  void __sc_par_poolcheckui (PPOOL, void * Node, unsigned length);
+  void __sc_par_poolcheckalign (PPOOL, void * Node, unsigned Offset);
+  void * __sc_par_boundscheck (PPOOL, void * Source, void * Dest);
+  void * __sc_par_boundscheckui (PPOOL, void * Source, void * Dest);
+  void * __sc_par_exactcheck2 (char * source, char * base, char * result,
+                               unsigned size);
+  void __sc_par_poolcheck_free (PPOOL, void * ptr);
+  void __sc_par_poolcheck_freeui (PPOOL, void * ptr);
+
+  // Statistics of the calling thread's object cache
+  void __sc_dbg_cachestats (unsigned long * Hits, unsigned long * Misses);
+
   // Indirect function call checks
   void funccheck   (void *f, void * targets[]);
   void funccheckui (void *f, void * targets[]);
@@ -188,6 +301,15 @@ extern "C" {
   void * pool_shadow (void * Node, unsigned NumBytes);
   void * pool_unshadow (void * Node);
 
+  // Number of system calls made to create, protect, and recycle shadows
+  void __sc_dbg_shadowstats (unsigned long * Remaps,
+                             unsigned long * Protects,
+                             unsigned long * Recycles);
+
+  // Number of rewrite pointers in use and ever allocated
+  void __sc_dbg_rewritestats (unsigned long * InUse,
+                              unsigned long * Allocated);
+
   // Check for invalid frees for non-resistent allocators
   void poolcheck_free   (PPOOL, void * ptr);
   void poolcheck_freeui (PPOOL, void * ptr);
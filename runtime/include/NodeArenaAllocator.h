@@ -0,0 +1,210 @@
+//===- NodeArenaAllocator.h - Arena allocator for tree nodes ----*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines NodeArenaAllocator, an STL compatible allocator for
+// containers that allocate one node at a time, such as the splay trees used
+// by the run-time.
+//
+// Every allocator object owns an arena of chunks of nodes.  Nodes are carved
+// out of the chunks contiguously and recycled through a LIFO free list, so
+// registering and unregistering an object (as is done for every stack frame)
+// reuses the node that was freed last without calling malloc().  The whole
+// arena can be released at once, which lets a splay tree be cleared without
+// visiting its nodes.
+//
+// Copies of an allocator start with an empty arena of their own; memory must
+// be deallocated through the allocator object that allocated it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_NODEARENAALLOCATOR_H_
+#define _SC_NODEARENAALLOCATOR_H_
+
+#include "RuntimeStats.h"
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+namespace llvm {
+
+template<typename T>
+class NodeArenaAllocator {
+  // A free node; it overlays the memory of an allocated node
+  struct FreeNode {
+    FreeNode * Next;
+  };
+
+  // The header of a chunk of nodes
+  struct Chunk {
+    Chunk * Next;
+    size_t Size;
+  };
+
+  // Size of each node, rounded up so that a free node fits
+  static const size_t NodeSize =
+    (sizeof(T) > sizeof(FreeNode)) ? sizeof(T) : sizeof(FreeNode);
+
+  // Offset of the first node within a chunk
+  static const size_t HeaderSize = (sizeof(Chunk) + 15) & ~((size_t) 15);
+
+  // Number of nodes in the first chunk and the largest number in any chunk
+  static const size_t MinChunkNodes = 32;
+  static const size_t MaxChunkNodes = 4096;
+
+  // List of chunks owned by this arena
+  Chunk * Chunks;
+
+  // Free list of nodes
+  FreeNode * FreeList;
+
+  // The part of the newest chunk that has not been handed out
+  char * Next;
+  char * End;
+
+  // Number of nodes in the next chunk
+  size_t ChunkNodes;
+
+  void * allocateSlow (void) {
+    Chunk * C = (Chunk *) malloc (HeaderSize + ChunkNodes * NodeSize);
+    C->Next = Chunks;
+    C->Size = HeaderSize + ChunkNodes * NodeSize;
+    SC_STAT_GAUGE (METADATA_BYTES, C->Size);
+    Chunks = C;
+    Next = ((char *) C) + HeaderSize;
+    End = Next + ChunkNodes * NodeSize;
+    if (ChunkNodes < MaxChunkNodes)
+      ChunkNodes *= 2;
+
+    void * p = Next;
+    Next += NodeSize;
+    return p;
+  }
+
+ public:
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef T value_type;
+  template <class U> struct rebind {
+    typedef NodeArenaAllocator<U> other;
+  };
+
+  NodeArenaAllocator() : Chunks(0), FreeList(0), Next(0), End(0),
+                         ChunkNodes(MinChunkNodes) {}
+
+  NodeArenaAllocator(const NodeArenaAllocator &) :
+    Chunks(0), FreeList(0), Next(0), End(0), ChunkNodes(MinChunkNodes) {}
+
+  template<typename R>
+  NodeArenaAllocator(const NodeArenaAllocator<R> &) :
+    Chunks(0), FreeList(0), Next(0), End(0), ChunkNodes(MinChunkNodes) {}
+
+  ~NodeArenaAllocator() { release(); }
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+  size_type max_size() const { return 1; }
+
+  //
+  // Method: allocate()
+  //
+  // Description:
+  //  Allocate memory for a single node.  Arrays of nodes are not supported.
+  //
+  pointer allocate(size_t n, const void * hint = 0) {
+    if (FreeNode * F = FreeList) {
+      FreeList = F->Next;
+      return static_cast<pointer>((void *) F);
+    }
+
+    if (Next != End) {
+      void * p = Next;
+      Next += NodeSize;
+      return static_cast<pointer>(p);
+    }
+
+    return static_cast<pointer>(allocateSlow ());
+  }
+
+  void deallocate(pointer p, size_t n) {
+    FreeNode * F = (FreeNode *) static_cast<void *>(p);
+    F->Next = FreeList;
+    FreeList = F;
+  }
+
+  void construct(pointer p, const T &val) {
+    new(static_cast<void*>(p)) T(val);
+  }
+  void destroy(pointer p) {
+    p->~T();
+  }
+
+  //
+  // Method: release()
+  //
+  // Description:
+  //  Return the memory of every node allocated from this arena to the system
+  //  at once.  Destructors are not run, so this is only appropriate for nodes
+  //  that are trivially destructible.
+  //
+  void release() {
+    while (Chunks) {
+      Chunk * C = Chunks;
+      Chunks = C->Next;
+      SC_STAT_GAUGE (METADATA_BYTES, -(long) C->Size);
+      free (C);
+    }
+    FreeList = 0;
+    Next = End = 0;
+    ChunkNodes = MinChunkNodes;
+  }
+};
+
+template<>
+class NodeArenaAllocator<void> {
+ public:
+  typedef void* pointer;
+  typedef const void* const_pointer;
+  typedef void value_type;
+  template <class U> struct rebind {
+    typedef NodeArenaAllocator<U> other;
+  };
+};
+
+template<typename T>
+inline bool operator==(const NodeArenaAllocator<T> & A,
+                       const NodeArenaAllocator<T> & B) {
+  return &A == &B;
+}
+template<typename T>
+inline bool operator!=(const NodeArenaAllocator<T> & A,
+                       const NodeArenaAllocator<T> & B) {
+  return &A != &B;
+}
+
+//
+// Function: release_all_nodes()
+//
+// Description:
+//  Overload of the hook used by RangeSplayTree::__clear() to release all of a
+//  tree's nodes at once.
+//
+template<typename T>
+inline bool release_all_nodes(NodeArenaAllocator<T> & A) {
+  A.release();
+  return true;
+}
+
+} // End llvm namespace
+
+#endif
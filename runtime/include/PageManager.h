@@ -15,10 +15,15 @@
 #ifndef PAGEMANAGER_H
 #define PAGEMANAGER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <vector>
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+#include "SpinLock.h"
+#endif
+
 namespace llvm {
 
 //
@@ -89,10 +94,19 @@ void UnprotectShadowPage(void * beginPage, unsigned NumPPage);
 /// future allocation.
 void FreePage(void *Page);
 
+/// poolmemusage - Report the number of bytes of virtual memory the page
+/// manager has mapped and the number of those bytes that are resident.
+void poolmemusage(size_t &Reserved, size_t &Resident);
+
 // The set of free memory pages we retrieved from the OS.
 typedef std::vector<void*> FreePagesListType;
 extern FreePagesListType FreePages;
 
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Lock protecting the set of free memory pages
+extern SpinLock FreePagesLock;
+#endif
+
 }
 
 #endif
@@ -0,0 +1,434 @@
+//===- RuntimeStats.h - Statistics gathered by the run-time -----*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the statistics that the run-time libraries can gather
+// about themselves: how many checks of each kind were executed, how well the
+// object caches and splay trees did, how many objects were registered, and
+// how much memory the meta-data takes up.
+//
+// The statistics are only gathered when a run-time is built with
+// SC_STATISTICS defined; otherwise, the macros below expand to nothing.  Each
+// thread counts in its own block of counters, so counting takes no locks and
+// no atomic instructions.  When the SC_STATS environment variable is set, the
+// counters of all threads are summed and written when the program exits and
+// whenever it receives SIGUSR1.  The variable names the file to which to
+// write them; an empty value or "-" selects standard error.
+//
+// The header may be included by both C and C++ code.  Exactly one source file
+// of each run-time library defines SC_STATISTICS_IMPLEMENTATION before
+// including it to provide the storage and functions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_RUNTIMESTATS_H_
+#define _SC_RUNTIMESTATS_H_
+
+#ifdef SC_STATISTICS
+
+//
+// The counters: their enumerator suffixes and the names with which they are
+// written.  The register and unregister counters are in allocType order.
+//
+#define SC_STATISTICS_COUNTERS \
+  SC_COUNTER(POOLCHECK,             "poolcheck") \
+  SC_COUNTER(BOUNDSCHECK,           "boundscheck") \
+  SC_COUNTER(EXACTCHECK,            "exactcheck2") \
+  SC_COUNTER(FASTLSCHECK,           "fastlscheck") \
+  SC_COUNTER(FUNCCHECK,             "funccheck") \
+  SC_COUNTER(BATCHES,               "poolcheck-batches") \
+  SC_COUNTER(BATCH_SHARED,          "batch-shared-lookups") \
+  SC_COUNTER(CACHE_HITS,            "object-cache-hits") \
+  SC_COUNTER(CACHE_MISSES,          "object-cache-misses") \
+  SC_COUNTER(SPLAYS,                "splay-lookups") \
+  SC_COUNTER(SPLAY_DEPTH,           "splay-depth-total") \
+  SC_COUNTER(REGISTER_GLOBAL,       "register-global") \
+  SC_COUNTER(REGISTER_STACK,        "register-stack") \
+  SC_COUNTER(REGISTER_HEAP,         "register-heap") \
+  SC_COUNTER(UNREGISTER_GLOBAL,     "unregister-global") \
+  SC_COUNTER(UNREGISTER_STACK,      "unregister-stack") \
+  SC_COUNTER(UNREGISTER_HEAP,       "unregister-heap") \
+  SC_COUNTER(OOB_REWRITES,          "oob-rewrites") \
+  SC_COUNTER(OOB_TAGS,              "oob-tags") \
+  SC_COUNTER(SPATIAL_LOAD_CHECKS,   "spatial-load-checks") \
+  SC_COUNTER(SPATIAL_STORE_CHECKS,  "spatial-store-checks") \
+  SC_COUNTER(TEMPORAL_LOAD_CHECKS,  "temporal-load-checks") \
+  SC_COUNTER(TEMPORAL_STORE_CHECKS, "temporal-store-checks") \
+  SC_COUNTER(METADATA_LOADS,        "metadata-loads") \
+  SC_COUNTER(METADATA_STORES,       "metadata-stores")
+
+//
+// The gauges: values that go up and down and whose peak is also recorded.
+// Each thread accumulates its changes and adds them to the shared value once
+// they exceed the gauge's batch size, so the peak may be off by that much for
+// each thread.
+//
+#define SC_STATISTICS_GAUGES \
+  SC_GAUGE(LIVE_OBJECTS,   "live-objects",   64) \
+  SC_GAUGE(METADATA_BYTES, "metadata-bytes", 65536)
+
+#define SC_COUNTER(Name, Str) SC_STAT_##Name,
+#define SC_GAUGE(Name, Str, Batch) SC_GAUGE_##Name,
+enum sc_stat_counter { SC_STATISTICS_COUNTERS SC_NUM_COUNTERS };
+enum sc_stat_gauge { SC_STATISTICS_GAUGES SC_NUM_GAUGES };
+#undef SC_COUNTER
+#undef SC_GAUGE
+
+//
+// Structure: sc_thread_stats
+//
+// Description:
+//  The statistics of one thread.  The blocks are allocated when a thread
+//  first counts something and are kept after the thread exits so that its
+//  counts are still written.
+//
+struct sc_thread_stats {
+  unsigned long Counters[SC_NUM_COUNTERS];
+
+  // Changes to the gauges not yet added to the shared values
+  long Gauges[SC_NUM_GAUGES];
+
+  // The block of the next thread
+  struct sc_thread_stats * Next;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The statistics of the current thread
+extern __thread struct sc_thread_stats * __sc_thread_stats;
+
+struct sc_thread_stats * __sc_stats_attach (void);
+void __sc_stats_flush_gauge (struct sc_thread_stats * Stats, unsigned Gauge);
+void __sc_stats_write (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+//
+// Function: sc_stats()
+//
+// Description:
+//  Return the statistics block of the current thread.
+//
+static inline struct sc_thread_stats *
+sc_stats (void) {
+  struct sc_thread_stats * Stats = __sc_thread_stats;
+  if (__builtin_expect (Stats == 0, 0))
+    Stats = __sc_stats_attach ();
+  return Stats;
+}
+
+//
+// Function: sc_stats_gauge()
+//
+// Description:
+//  Change a gauge by the specified amount.
+//
+static inline void
+sc_stats_gauge (unsigned Gauge, long Delta, long Batch) {
+  struct sc_thread_stats * Stats = sc_stats ();
+  long Pending = (Stats->Gauges[Gauge] += Delta);
+  if ((Pending >= Batch) || (Pending <= -Batch))
+    __sc_stats_flush_gauge (Stats, Gauge);
+}
+
+#define SC_STAT_ADD(Name, N) (sc_stats ()->Counters[SC_STAT_##Name] += (N))
+#define SC_STAT_INC(Name) SC_STAT_ADD (Name, 1)
+#define SC_STAT_INC_BY(First, Offset) \
+  (++sc_stats ()->Counters[SC_STAT_##First + (Offset)])
+
+#define SC_COUNTER(Name, Str)
+#define SC_GAUGE(Name, Str, Batch) \
+  static inline void sc_gauge_##Name (long Delta) { \
+    sc_stats_gauge (SC_GAUGE_##Name, Delta, Batch); \
+  }
+SC_STATISTICS_GAUGES
+#undef SC_COUNTER
+#undef SC_GAUGE
+
+#define SC_STAT_GAUGE(Name, Delta) sc_gauge_##Name (Delta)
+
+#ifdef SC_STATISTICS_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+__thread struct sc_thread_stats * __sc_thread_stats = 0;
+
+// The blocks of all threads
+static struct sc_thread_stats * volatile __sc_stats_threads = 0;
+
+// The shared values of the gauges and their peaks
+static volatile long __sc_stats_gauges[SC_NUM_GAUGES];
+static volatile long __sc_stats_peaks[SC_NUM_GAUGES];
+
+// The file descriptor to which to write the statistics; -1 if none
+static int __sc_stats_fd = -1;
+static volatile int __sc_stats_started = 0;
+
+#define SC_COUNTER(Name, Str) Str,
+#define SC_GAUGE(Name, Str, Batch) Str,
+static const char * const __sc_stats_counter_names[] = {
+  SC_STATISTICS_COUNTERS 0
+};
+static const char * const __sc_stats_gauge_names[] = {
+  SC_STATISTICS_GAUGES 0
+};
+#undef SC_COUNTER
+#undef SC_GAUGE
+
+//
+// Function: __sc_stats_append()
+//
+// Description:
+//  Append a string to a buffer, truncating it if the buffer is full.
+//
+static void
+__sc_stats_append (char * Buf, size_t Size, size_t * Len, const char * Str) {
+  while (*Str && (*Len + 1 < Size))
+    Buf[(*Len)++] = *Str++;
+}
+
+//
+// Function: __sc_stats_append_num()
+//
+// Description:
+//  Append an unsigned number in decimal to a buffer.  The digits are produced
+//  with integer arithmetic because the formatting functions of the C library
+//  are not async-signal-safe.  If Width is nonzero, the number is padded with
+//  leading zeros to that many digits.
+//
+static void
+__sc_stats_append_num (char * Buf, size_t Size, size_t * Len,
+                       unsigned long Value, unsigned Width) {
+  char Digits[24];
+  unsigned Num = 0;
+  do {
+    Digits[Num++] = '0' + (Value % 10);
+    Value /= 10;
+  } while (Value || (Num < Width));
+  while (Num && (*Len + 1 < Size))
+    Buf[(*Len)++] = Digits[--Num];
+}
+
+//
+// Function: __sc_stats_append_long()
+//
+// Description:
+//  Append a signed number in decimal to a buffer.
+//
+static void
+__sc_stats_append_long (char * Buf, size_t Size, size_t * Len, long Value) {
+  unsigned long Magnitude = (unsigned long) Value;
+  if (Value < 0) {
+    __sc_stats_append (Buf, Size, Len, "-");
+    Magnitude = -Magnitude;
+  }
+  __sc_stats_append_num (Buf, Size, Len, Magnitude, 0);
+}
+
+//
+// Function: __sc_stats_append_name()
+//
+// Description:
+//  Append the name of a statistic, padded to a fixed width, to a buffer.
+//
+static void
+__sc_stats_append_name (char * Buf, size_t Size, size_t * Len,
+                        const char * Name) {
+  __sc_stats_append (Buf, Size, Len, "  ");
+  __sc_stats_append (Buf, Size, Len, Name);
+  size_t NameLen = strlen (Name);
+  for (; NameLen < 24; ++NameLen)
+    __sc_stats_append (Buf, Size, Len, " ");
+  __sc_stats_append (Buf, Size, Len, ": ");
+}
+
+//
+// Function: __sc_stats_write()
+//
+// Description:
+//  Sum the statistics of all threads and write them out.  It formats the
+//  numbers itself and only calls async-signal-safe functions so that it may
+//  be called from a signal handler.  The counts of other threads are read while
+//  those threads may still be changing them.
+//
+void
+__sc_stats_write (void) {
+  if (__sc_stats_fd < 0)
+    return;
+
+  unsigned long Counters[SC_NUM_COUNTERS];
+  long Gauges[SC_NUM_GAUGES];
+  unsigned NumThreads = 0;
+  unsigned index;
+  memset (Counters, 0, sizeof (Counters));
+  for (index = 0; index < SC_NUM_GAUGES; ++index)
+    Gauges[index] = __sc_stats_gauges[index];
+
+  struct sc_thread_stats * Stats;
+  for (Stats = __sc_stats_threads; Stats; Stats = Stats->Next) {
+    ++NumThreads;
+    for (index = 0; index < SC_NUM_COUNTERS; ++index)
+      Counters[index] += Stats->Counters[index];
+    for (index = 0; index < SC_NUM_GAUGES; ++index)
+      Gauges[index] += Stats->Gauges[index];
+  }
+
+  char Buf[4096];
+  size_t Len = 0;
+  __sc_stats_append (Buf, sizeof (Buf), &Len, "SAFECode statistics (");
+  __sc_stats_append_long (Buf, sizeof (Buf), &Len, (long) getpid ());
+  __sc_stats_append (Buf, sizeof (Buf), &Len, "): ");
+  __sc_stats_append_num (Buf, sizeof (Buf), &Len, NumThreads, 0);
+  __sc_stats_append (Buf, sizeof (Buf), &Len, " threads\n");
+
+  for (index = 0; index < SC_NUM_COUNTERS; ++index) {
+    if (!Counters[index])
+      continue;
+    __sc_stats_append_name (Buf, sizeof (Buf), &Len,
+                            __sc_stats_counter_names[index]);
+    __sc_stats_append_num (Buf, sizeof (Buf), &Len, Counters[index], 0);
+    __sc_stats_append (Buf, sizeof (Buf), &Len, "\n");
+  }
+
+  //
+  // Write the average splay depth rounded to two decimal places.
+  //
+  unsigned long Splays = Counters[SC_STAT_SPLAYS];
+  if (Splays) {
+    unsigned long Depth = Counters[SC_STAT_SPLAY_DEPTH];
+    unsigned long Whole = Depth / Splays;
+    unsigned long Hundredths = ((Depth % Splays) * 100 + Splays / 2) / Splays;
+    if (Hundredths == 100) {
+      ++Whole;
+      Hundredths = 0;
+    }
+    __sc_stats_append_name (Buf, sizeof (Buf), &Len, "splay-depth-average");
+    __sc_stats_append_num (Buf, sizeof (Buf), &Len, Whole, 0);
+    __sc_stats_append (Buf, sizeof (Buf), &Len, ".");
+    __sc_stats_append_num (Buf, sizeof (Buf), &Len, Hundredths, 2);
+    __sc_stats_append (Buf, sizeof (Buf), &Len, "\n");
+  }
+
+  for (index = 0; index < SC_NUM_GAUGES; ++index) {
+    long Peak = __sc_stats_peaks[index];
+    if (Gauges[index] > Peak)
+      Peak = Gauges[index];
+    if (!Peak)
+      continue;
+    __sc_stats_append_name (Buf, sizeof (Buf), &Len,
+                            __sc_stats_gauge_names[index]);
+    __sc_stats_append_long (Buf, sizeof (Buf), &Len, Gauges[index]);
+    __sc_stats_append (Buf, sizeof (Buf), &Len, " (peak ");
+    __sc_stats_append_long (Buf, sizeof (Buf), &Len, Peak);
+    __sc_stats_append (Buf, sizeof (Buf), &Len, ")\n");
+  }
+
+  const char * p = Buf;
+  while (Len) {
+    ssize_t Done = write (__sc_stats_fd, p, Len);
+    if (Done <= 0)
+      break;
+    p += Done;
+    Len -= Done;
+  }
+}
+
+static void
+__sc_stats_signal (int sig) {
+  __sc_stats_write ();
+}
+
+//
+// Function: __sc_stats_start()
+//
+// Description:
+//  Determine where, if anywhere, the statistics are written, and arrange for
+//  them to be written at exit and on SIGUSR1.
+//
+static void
+__sc_stats_start (void) {
+  const char * Name = getenv ("SC_STATS");
+  if (!Name)
+    return;
+
+  if ((Name[0] == 0) || (strcmp (Name, "-") == 0))
+    __sc_stats_fd = 2;
+  else
+    __sc_stats_fd = open (Name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (__sc_stats_fd < 0)
+    return;
+
+  struct sigaction sa;
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = __sc_stats_signal;
+  sa.sa_flags = SA_RESTART;
+  sigaction (SIGUSR1, &sa, 0);
+  atexit (__sc_stats_write);
+}
+
+//
+// Function: __sc_stats_attach()
+//
+// Description:
+//  Allocate the statistics block of the current thread and add it to the
+//  list of blocks.
+//
+struct sc_thread_stats *
+__sc_stats_attach (void) {
+  if (__sync_bool_compare_and_swap (&__sc_stats_started, 0, 1))
+    __sc_stats_start ();
+
+  struct sc_thread_stats * Stats =
+    (struct sc_thread_stats *) calloc (1, sizeof (struct sc_thread_stats));
+  do {
+    Stats->Next = __sc_stats_threads;
+  } while (!__sync_bool_compare_and_swap (&__sc_stats_threads,
+                                          Stats->Next, Stats));
+  __sc_thread_stats = Stats;
+  return Stats;
+}
+
+//
+// Function: __sc_stats_flush_gauge()
+//
+// Description:
+//  Add the changes a thread made to a gauge to the shared value and record a
+//  new peak.
+//
+void
+__sc_stats_flush_gauge (struct sc_thread_stats * Stats, unsigned Gauge) {
+  long Value = __sync_add_and_fetch (&__sc_stats_gauges[Gauge],
+                                     Stats->Gauges[Gauge]);
+  Stats->Gauges[Gauge] = 0;
+
+  long Peak = __sc_stats_peaks[Gauge];
+  while ((Value > Peak) &&
+         !__sync_bool_compare_and_swap (&__sc_stats_peaks[Gauge], Peak, Value))
+    Peak = __sc_stats_peaks[Gauge];
+}
+
+#endif /* SC_STATISTICS_IMPLEMENTATION */
+
+#else
+
+#define SC_STAT_ADD(Name, N) ((void) sizeof (N))
+#define SC_STAT_INC(Name) ((void) 0)
+#define SC_STAT_INC_BY(First, Offset) ((void) 0)
+#define SC_STAT_GAUGE(Name, Delta) ((void) 0)
+
+#endif /* SC_STATISTICS */
+
+#endif
@@ -0,0 +1,289 @@
+//===- ShadowObjectSet.h - Shadow memory index of objects -------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines ShadowObjectSet, a drop-in replacement for RangeSplaySet
+// that finds the object containing an address with a two-level, page-granular
+// shadow table, and ShadowObjectMap, its counterpart for RangeSplayMap.  A
+// lookup costs a fixed number of loads no matter how many objects are
+// registered, and, unlike a splay tree, it never writes to the data structure.
+//
+// All sets share a single shadow table.  Every entry of the table describes
+// one shadow page (4 KB of address space) and is either:
+//
+//  o) Zero, if no registered object overlaps the page.
+//  o) A pointer to an ObjRecord with the low bit set, if a single object
+//     covers the whole page.
+//  o) A pointer to a PageBucket listing every object that overlaps the page,
+//     sorted by start address.
+//
+// Each record remembers the set that owns it so that the sets stay logically
+// disjoint even though they share the table.
+//
+// The index may be used by several threads at once:
+//
+//  o) Lookups take no locks.  Each page entry is guarded by one of a fixed
+//     number of sequence locks; a lookup retries if the entry it read was
+//     modified while it was reading it.
+//  o) Writers to the same set are serialized by a per-set lock.  Writers to
+//     different sets only contend when they modify pages hashing to the same
+//     sequence lock.
+//  o) Records and buckets are never returned to the system; they are recycled
+//     through free lists.  A reader holding a stale pointer therefore always
+//     reads mapped memory, and the sequence lock tells it to retry.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_SHADOWOBJECTSET_H_
+#define _SC_SHADOWOBJECTSET_H_
+
+#include "SpinLock.h"
+
+#include <stdint.h>
+
+class ShadowObjectSet {
+ public:
+  // Description of a single registered object
+  struct ObjRecord {
+    void * start;
+    void * end;
+    void * Data;
+    ShadowObjectSet * Owner;
+
+    // Links for the list of objects owned by a set; Next also links free
+    // records
+    ObjRecord * Prev;
+    ObjRecord * Next;
+  };
+
+  // The list of objects overlapping a partially covered shadow page
+  struct PageBucket {
+    unsigned Count;
+    unsigned SizeClass;
+    PageBucket * NextFree;
+    ObjRecord * Objs[1];
+  };
+
+  // Geometry of the shadow table
+  static const unsigned PageShift = 12;
+  static const unsigned LeafBits = 17;
+#if defined(_LP64)
+  static const unsigned AddressBits = 48;
+#else
+  static const unsigned AddressBits = 32;
+#endif
+  static const unsigned DirBits = AddressBits - PageShift - LeafBits;
+
+  // Number of sequence locks guarding the page entries
+  static const unsigned NumPageLocks = 4096;
+
+  // First level of the shadow table; each leaf has 2^LeafBits entries
+  static uintptr_t ** volatile Directory;
+
+  // Sequence locks guarding the page entries
+  static SeqLock PageLocks[NumPageLocks];
+
+ private:
+  // Serializes the writers of this set
+  SpinLock WriteLock;
+
+  // List of objects registered in this set
+  ObjRecord * Head;
+
+  // Number of objects registered in this set
+  unsigned NumObjects;
+
+  static SeqLock & getPageLock (uintptr_t Page) {
+    return PageLocks[(Page ^ (Page >> 12)) & (NumPageLocks - 1)];
+  }
+
+  static uintptr_t * getEntry (uintptr_t Page, bool Create);
+  static void addToPage (uintptr_t * Entry, ObjRecord * R);
+  static void removeFromPage (uintptr_t * Entry, ObjRecord * R);
+  bool insertRecord (void * start, void * end, void * Data);
+  void erase (ObjRecord * R);
+
+  //
+  // Method: readPage()
+  //
+  // Description:
+  //  Search the entry of a single shadow page for the object owned by this set
+  //  that contains the key.  The caller must validate the results with the
+  //  page's sequence lock.
+  //
+  ObjRecord * readPage (uintptr_t E, void * key) const {
+    //
+    // A single object covers the entire page.
+    //
+    if (E & 1) {
+      ObjRecord * R = (ObjRecord *) (E & ~(uintptr_t)1);
+      return (R->Owner == this) ? R : 0;
+    }
+
+    //
+    // Search the objects overlapping the page.  They are sorted by start
+    // address, so find the last one starting at or below the key and walk
+    // backwards from there; the first candidate is nearly always the one.
+    //
+    PageBucket * B = (PageBucket *) E;
+    unsigned low = 0;
+    unsigned high = B->Count;
+    while (low < high) {
+      unsigned mid = (low + high) / 2;
+      ObjRecord * R = B->Objs[mid];
+      if (R && (R->start <= key))
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    for (unsigned index = low; index > 0; --index) {
+      ObjRecord * R = B->Objs[index - 1];
+      if (R && (R->start <= key) && (key <= R->end) && (R->Owner == this))
+        return R;
+    }
+    return 0;
+  }
+
+ protected:
+  //
+  // Method: lookup()
+  //
+  // Description:
+  //  Find the object owned by this set that contains the specified address.
+  //  This is the hot path of every check that misses the object cache.
+  //
+  // Outputs:
+  //  start - The first address of the object.
+  //  end   - The last address of the object.
+  //  Data  - The data associated with the object.
+  //
+  // Return value:
+  //  The record of the object is returned.  It may only be dereferenced while
+  //  holding the set's write lock.  If no object contains the address, NULL
+  //  is returned.
+  //
+  ObjRecord * lookup (void * key, void *& start, void *& end,
+                      void *& Data) const {
+    uintptr_t Page = ((uintptr_t) key) >> PageShift;
+    uintptr_t ** Dir = Directory;
+    if (!Dir || (Page >> (LeafBits + DirBits)))
+      return 0;
+
+    uintptr_t * Leaf = Dir[Page >> LeafBits];
+    if (!Leaf)
+      return 0;
+
+    SeqLock & Lock = getPageLock (Page);
+    for (;;) {
+      unsigned Seq = Lock.readBegin ();
+      uintptr_t E = Leaf[Page & ((1u << LeafBits) - 1)];
+      ObjRecord * R = E ? readPage (E, key) : 0;
+      if (R) {
+        start = R->start;
+        end = R->end;
+        Data = R->Data;
+      }
+      if (!Lock.readRetry (Seq))
+        return R;
+    }
+  }
+
+  bool insert (void * start, void * end, void * Data) {
+    SpinLockGuard Guard (WriteLock);
+    return insertRecord (start, end, Data);
+  }
+
+ public:
+  ShadowObjectSet () : Head(0), NumObjects(0) {}
+  ~ShadowObjectSet () { clear(); }
+
+  //
+  // Method: insert()
+  //
+  // Description:
+  //  Insert an object into the set.  As with RangeSplaySet, the insertion
+  //  fails if the start of the object is within an already registered object.
+  //
+  // Inputs:
+  //  start - The first valid address of the object.
+  //  end   - The last valid address of the object.
+  //
+  // Return value:
+  //  true  - The insert succeeded.
+  //  false - The insert failed.
+  //
+  bool insert (void * start, void * end) {
+    return insert (start, end, 0);
+  }
+
+  bool remove (void * key);
+
+  unsigned count () const { return NumObjects; }
+
+  void clear ();
+
+  template <class O>
+  void clear (O& act) {
+    SpinLockGuard Guard (WriteLock);
+    for (ObjRecord * R = Head; R; R = R->Next)
+      act (R->start, R->end);
+    while (Head)
+      erase (Head);
+  }
+
+  bool find (void * key, void *& start, void *& end) const {
+    void * Data;
+    return lookup (key, start, end, Data) != 0;
+  }
+
+  bool find (void * key) const {
+    void * start, * end, * Data;
+    return lookup (key, start, end, Data) != 0;
+  }
+};
+
+//
+// Class: ShadowObjectMap
+//
+// Description:
+//  A shadow memory index that associates a pointer-sized datum with every
+//  object.  It has the same interface as RangeSplayMap.
+//
+template <typename T>
+class ShadowObjectMap : private ShadowObjectSet {
+ public:
+  bool insert (void * start, void * end, T d) {
+    return ShadowObjectSet::insert (start, end, (void *) d);
+  }
+
+  bool remove (void * key) {
+    return ShadowObjectSet::remove (key);
+  }
+
+  unsigned count () const {
+    return ShadowObjectSet::count ();
+  }
+
+  void clear () {
+    ShadowObjectSet::clear ();
+  }
+
+  bool find (void * key, void *& start, void *& end, T& d) const {
+    void * Data;
+    if (!lookup (key, start, end, Data))
+      return false;
+    d = (T) Data;
+    return true;
+  }
+
+  bool find (void * key) const {
+    return ShadowObjectSet::find (key);
+  }
+};
+
+#endif
@@ -0,0 +1,146 @@
+//===- SpinLock.h - Light-weight locks for the run-time ---------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the small synchronization primitives used by the run-time
+// libraries.  The critical sections that they protect are a few instructions
+// long, so spinning is cheaper than sleeping in the kernel.  They are built on
+// the GCC __sync builtins and need no initialization beyond zero-filling, so
+// they may be embedded in statically allocated and placement-new'ed objects.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_SPINLOCK_H_
+#define _SC_SPINLOCK_H_
+
+#include <sched.h>
+
+//
+// Function: compilerBarrier()
+//
+// Description:
+//  Prevent the compiler from moving memory accesses across this point.
+//
+static inline void
+compilerBarrier (void) {
+  __asm__ __volatile__ ("" ::: "memory");
+}
+
+//
+// Function: readBarrier()
+//
+// Description:
+//  Order the loads before this point with the loads after it.  x86 never
+//  reorders loads with other loads, so only the compiler must be restrained.
+//
+static inline void
+readBarrier (void) {
+#if defined(__i386__) || defined(__x86_64__)
+  compilerBarrier ();
+#else
+  __sync_synchronize ();
+#endif
+}
+
+//
+// Function: writeBarrier()
+//
+// Description:
+//  Order the stores before this point with the stores after it.
+//
+static inline void
+writeBarrier (void) {
+#if defined(__i386__) || defined(__x86_64__)
+  compilerBarrier ();
+#else
+  __sync_synchronize ();
+#endif
+}
+
+//
+// Class: SpinLock
+//
+// Description:
+//  A test-and-test-and-set lock.
+//
+class SpinLock {
+  volatile int Locked;
+
+ public:
+  SpinLock () : Locked(0) {}
+
+  void lock (void) {
+    while (__sync_lock_test_and_set (&Locked, 1)) {
+      while (Locked)
+        sched_yield ();
+    }
+  }
+
+  void unlock (void) {
+    __sync_lock_release (&Locked);
+  }
+};
+
+//
+// Class: SpinLockGuard
+//
+// Description:
+//  Hold a SpinLock for the lifetime of the guard object.
+//
+class SpinLockGuard {
+  SpinLock & Lock;
+
+ public:
+  SpinLockGuard (SpinLock & L) : Lock(L) { Lock.lock(); }
+  ~SpinLockGuard () { Lock.unlock(); }
+};
+
+//
+// Class: SeqLock
+//
+// Description:
+//  A sequence lock.  Writers exclude each other and make the sequence number
+//  odd while they modify the protected data.  Readers never write to shared
+//  memory; they read the sequence number before and after reading the data
+//  and retry if a writer was active in between.
+//
+class SeqLock {
+  volatile unsigned Sequence;
+
+ public:
+  SeqLock () : Sequence(0) {}
+
+  unsigned readBegin (void) const {
+    unsigned S;
+    while ((S = Sequence) & 1)
+      sched_yield ();
+    readBarrier ();
+    return S;
+  }
+
+  bool readRetry (unsigned S) const {
+    readBarrier ();
+    return Sequence != S;
+  }
+
+  void writeLock (void) {
+    for (;;) {
+      unsigned S = Sequence;
+      if (!(S & 1) && __sync_bool_compare_and_swap (&Sequence, S, S + 1))
+        return;
+      sched_yield ();
+    }
+  }
+
+  void writeUnlock (void) {
+    writeBarrier ();
+    Sequence = Sequence + 1;
+  }
+};
+
+#endif
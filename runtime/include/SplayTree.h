@@ -11,6 +11,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "RuntimeStats.h"
+
 #include <memory>
 #include <vector>
 
@@ -42,6 +44,19 @@ struct range_tree_node <void>{
   void* end;
 };
 
+//
+// Function: release_all_nodes()
+//
+// Description:
+//  Release every node allocated by the given allocator at once.  Allocators
+//  that can do so provide an overload of this function that returns true;
+//  for all others, the nodes of a tree must be deallocated one by one.
+//
+template<class _Alloc>
+inline bool release_all_nodes(_Alloc &) {
+  return false;
+}
+
 template<typename T, class _Alloc>
 class RangeSplayTree {
  public:
@@ -75,8 +90,10 @@ class RangeSplayTree {
     if (t == 0) return t;
     N.left = N.right = 0;
     l = r = &N;
+    unsigned long depth = 0;
     
     while(1) {
+      ++depth;
       if (key_lt(key, t)) {
         if (t->left == 0) break;
         if (key_lt(key, t->left)) {
@@ -109,6 +126,8 @@ class RangeSplayTree {
     r->left = t->right;
     t->left = N.right;
     t->right = N.left;
+    SC_STAT_INC (SPLAYS);
+    SC_STAT_ADD (SPLAY_DEPTH, depth);
     return t;
   }
 
@@ -215,7 +234,8 @@ class RangeSplayTree {
   }
 
   void __clear() {
-    __clear_internal(Tree);
+    if (!release_all_nodes(__node_alloc))
+      __clear_internal(Tree);
     Tree = 0;
   }
 
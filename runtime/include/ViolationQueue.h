@@ -0,0 +1,424 @@
+//===- ViolationQueue.h - Deduplicated violation reports --------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the reporting of memory safety violations that is
+// shared by the run-time libraries.  Violations are deduplicated by the site
+// of the check that found them, and the report of the first violation at each
+// site is formatted into memory and queued; it is written to the error log by
+// a writer thread in the thread-safe run-times and whenever the queue fills
+// up or the program exits otherwise.  Repeated violations are summarized when
+// the program exits.
+//
+// Each run-time library formats its own reports; exactly one source file of
+// each includes this header and passes its violations to queueViolation().
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_VIOLATIONQUEUE_H_
+#define _SC_VIOLATIONQUEUE_H_
+
+#include "SpinLock.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+
+#include <stdint.h>
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+// Stream to which to send SAFECode error reports
+extern std::ostream * ErrorLog;
+
+//
+// Structure: ViolationSite
+//
+// Description:
+//  This structure records the violations found by one check.  Violations are
+//  deduplicated by the program counter, CWE, and source location of the check
+//  that found them: only the first violation found at a site is reported in
+//  full, and the rest are counted and summarized when the program exits.
+//
+struct ViolationSite {
+  // 0 if the site is free, 1 while its key is being filled in, 2 afterwards
+  volatile unsigned State;
+
+  // The key of the site
+  const void * faultPC;
+  unsigned CWE;
+  const char * SourceFile;
+  unsigned lineNo;
+
+  // The type of the first violation at the site
+  unsigned type;
+
+  // Number of violations found at the site
+  volatile unsigned long Hits;
+
+  // The report of the first violation; freed once it is written
+  char * Text;
+};
+
+// Table of violation sites; the number of sites is a power of two
+static const unsigned NumSites = 1024;
+static ViolationSite Sites[NumSites];
+
+//
+// Structure: QueueCell
+//
+// Description:
+//  A cell of the bounded multi-producer, multi-consumer queue of sites whose
+//  first violation has not been written yet.  A cell is ready to be filled at
+//  queue position P when its sequence number is P and ready to be emptied when
+//  its sequence number is P + 1.  The sequence number is stored less the
+//  index of the cell so that zero-filled cells are ready to be filled.
+//
+struct QueueCell {
+  volatile unsigned long Sequence;
+  ViolationSite * Site;
+};
+
+static const unsigned long QueueSize = 256;
+static QueueCell Queue[QueueSize];
+static volatile unsigned long EnqueuePos = 0;
+static volatile unsigned long DequeuePos = 0;
+
+// Lock serializing the writing of reports to the error log
+static SpinLock WriterLock;
+
+// Number of violations found and the number at which to terminate
+static volatile unsigned long NumViolations = 0;
+static unsigned long MaxViolations = 20;
+
+// Whether reporting has been started and whether it has been finished
+static volatile int ReportingStarted = 0;
+static volatile int ReportingFinished = 0;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+// Count of the sites queued for the writer thread
+static sem_t QueueReady;
+#endif
+
+//
+// Function: findSite()
+//
+// Description:
+//  Find the site with the given key, adding it to the table of sites if it is
+//  not there.  Sites are never removed, so this needs no locks.
+//
+// Outputs:
+//  IsNew - Set to true if the site was added to the table.
+//
+// Return value:
+//  NULL     - The table of sites is full.
+//  Otherwise, a pointer to the site is returned.
+//
+static ViolationSite *
+findSite (const void * faultPC, unsigned CWE, const char * SourceFile,
+          unsigned lineNo, unsigned type, bool & IsNew) {
+  uintptr_t Hash = (uintptr_t) faultPC ^ (uintptr_t) SourceFile;
+  Hash ^= (uintptr_t) (lineNo * 0x45d9f3b) ^ CWE;
+  Hash = (Hash ^ (Hash >> 16)) * 0x45d9f3b;
+  Hash ^= Hash >> 16;
+
+  IsNew = false;
+  for (unsigned probe = 0; probe < NumSites; ++probe) {
+    ViolationSite & Site = Sites[(Hash + probe) & (NumSites - 1)];
+
+    //
+    // Claim a free site for this key.
+    //
+    if ((Site.State == 0) && __sync_bool_compare_and_swap (&Site.State, 0, 1)) {
+      Site.faultPC = faultPC;
+      Site.CWE = CWE;
+      Site.SourceFile = SourceFile;
+      Site.lineNo = lineNo;
+      Site.type = type;
+      writeBarrier ();
+      Site.State = 2;
+      IsNew = true;
+      return &Site;
+    }
+
+    //
+    // Wait for another thread to finish filling in the key of the site.
+    //
+    while (Site.State != 2)
+      sched_yield ();
+    readBarrier ();
+
+    if ((Site.faultPC == faultPC) && (Site.CWE == CWE) &&
+        (Site.SourceFile == SourceFile) && (Site.lineNo == lineNo))
+      return &Site;
+  }
+
+  return 0;
+}
+
+//
+// Function: pushSite()
+//
+// Description:
+//  Add a site to the queue of sites whose first violation has not been written.
+//
+// Return value:
+//  true  - The site was added to the queue.
+//  false - The queue is full.
+//
+static bool
+pushSite (ViolationSite * Site) {
+  unsigned long Pos = EnqueuePos;
+  for (;;) {
+    unsigned long index = Pos & (QueueSize - 1);
+    QueueCell & Cell = Queue[index];
+    long Diff = (long) (Cell.Sequence + index - Pos);
+    if (Diff == 0) {
+      if (__sync_bool_compare_and_swap (&EnqueuePos, Pos, Pos + 1)) {
+        Cell.Site = Site;
+        writeBarrier ();
+        Cell.Sequence = Pos + 1 - index;
+        return true;
+      }
+      Pos = EnqueuePos;
+    } else if (Diff < 0) {
+      return false;
+    } else {
+      Pos = EnqueuePos;
+    }
+  }
+}
+
+//
+// Function: popSite()
+//
+// Description:
+//  Remove the oldest site from the queue.
+//
+// Return value:
+//  NULL     - The queue is empty.
+//  Otherwise, a pointer to the site is returned.
+//
+static ViolationSite *
+popSite (void) {
+  unsigned long Pos = DequeuePos;
+  for (;;) {
+    unsigned long index = Pos & (QueueSize - 1);
+    QueueCell & Cell = Queue[index];
+    long Diff = (long) (Cell.Sequence + index - (Pos + 1));
+    if (Diff == 0) {
+      if (__sync_bool_compare_and_swap (&DequeuePos, Pos, Pos + 1)) {
+        readBarrier ();
+        ViolationSite * Site = Cell.Site;
+        writeBarrier ();
+        Cell.Sequence = Pos + QueueSize - index;
+        return Site;
+      }
+      Pos = DequeuePos;
+    } else if (Diff < 0) {
+      return 0;
+    } else {
+      Pos = DequeuePos;
+    }
+  }
+}
+
+//
+// Function: writeSite()
+//
+// Description:
+//  Write the report of the first violation found at a site to the error log.
+//  The caller must hold the WriterLock.
+//
+static void
+writeSite (ViolationSite * Site) {
+  *ErrorLog << Site->Text << std::flush;
+  free (Site->Text);
+  Site->Text = 0;
+}
+
+//
+// Function: drainViolations()
+//
+// Description:
+//  Write the reports of all of the queued sites to the error log.
+//
+static void
+drainViolations (void) {
+  SpinLockGuard Guard (WriterLock);
+  while (ViolationSite * Site = popSite ())
+    writeSite (Site);
+}
+
+//
+// Function: finishViolations()
+//
+// Description:
+//  Write the queued reports and summarize how often each site was reported.
+//  This is called when the program exits and before the run-time terminates
+//  it.
+//
+static void
+finishViolations (void) {
+  drainViolations ();
+  if (!__sync_bool_compare_and_swap (&ReportingFinished, 0, 1))
+    return;
+
+  SpinLockGuard Guard (WriterLock);
+  for (unsigned index = 0; index < NumSites; ++index) {
+    const ViolationSite & Site = Sites[index];
+    if ((Site.State != 2) || (Site.Hits < 2))
+      continue;
+    *ErrorLog << std::showbase << std::hex
+              << "SAFECode:Repeated Violation Type " << Site.type << " "
+              << "at IP=" << Site.faultPC << " "
+              << "(" << (Site.SourceFile ? Site.SourceFile : "UNKNOWN")
+              << ":" << std::dec << Site.lineNo << "): "
+              << Site.Hits << " times\n";
+  }
+  *ErrorLog << std::flush;
+}
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+//
+// Function: writeViolations()
+//
+// Description:
+//  This is the body of the thread that writes the queued reports so that the
+//  threads finding violations never wait for the error log.
+//
+static void *
+writeViolations (void *) {
+  for (;;) {
+    while (sem_wait (&QueueReady) && (errno == EINTR))
+      ;
+    drainViolations ();
+  }
+  return 0;
+}
+#endif
+
+//
+// Function: startReporting()
+//
+// Description:
+//  Read the configuration of violation reporting and arrange for the queued
+//  reports to be written.
+//
+// Notes:
+//  Set the SC_MAX_REPORTS environment variable to the number of violations at
+//  which to terminate the program; zero never terminates it.
+//
+static void
+startReporting (void) {
+  if (!__sync_bool_compare_and_swap (&ReportingStarted, 0, 1)) {
+    while (ReportingStarted != 2)
+      sched_yield ();
+    return;
+  }
+
+  if (const char * Max = getenv ("SC_MAX_REPORTS"))
+    MaxViolations = strtoul (Max, 0, 10);
+  atexit (finishViolations);
+
+  //
+  // If the writer thread cannot be started, the queue is drained whenever it
+  // fills up and when the program exits.
+  //
+#ifdef SC_THREAD_SAFE_RUNTIME
+  sem_init (&QueueReady, 0, 0);
+  pthread_t Writer;
+  if (pthread_create (&Writer, 0, writeViolations, 0) == 0)
+    pthread_detach (Writer);
+#endif
+
+  writeBarrier ();
+  ReportingStarted = 2;
+}
+
+//
+// Function: queueViolation()
+//
+// Description:
+//  Report a memory violation.  Unless the program is terminated on the first
+//  violation, the report is formatted into memory and queued; the threads
+//  finding violations never write to the error log themselves.
+//
+// Inputs:
+//  v           - The violation.  It is formatted with its print() method.
+//  StopOnError - Whether to terminate the program on the first violation.
+//
+template <class InfoT>
+static void
+queueViolation (const InfoT * v, unsigned StopOnError) {
+  //
+  // If we need to terminate now, print the error to the error log and do
+  // that.
+  //
+  if (StopOnError) {
+    drainViolations ();
+    {
+      SpinLockGuard Guard (WriterLock);
+      v->print(*ErrorLog);
+      *ErrorLog << std::flush;
+    }
+    abort();
+  }
+
+  if (ReportingStarted != 2)
+    startReporting ();
+
+  //
+  // Count the violation at its site.  Only the first violation at a site is
+  // reported in full.
+  //
+  const char * SourceFile;
+  unsigned lineNo;
+  v->getSourceLocation (SourceFile, lineNo);
+
+  bool IsNew;
+  ViolationSite * Site = findSite (v->faultPC, v->CWE, SourceFile, lineNo,
+                                   v->type, IsNew);
+  if (!Site) {
+    SpinLockGuard Guard (WriterLock);
+    v->print(*ErrorLog);
+    *ErrorLog << std::flush;
+  } else {
+    __sync_fetch_and_add (&Site->Hits, 1);
+    if (IsNew) {
+      std::ostringstream OS;
+      v->print(OS);
+      Site->Text = strdup (OS.str().c_str());
+      if (pushSite (Site)) {
+#ifdef SC_THREAD_SAFE_RUNTIME
+        sem_post (&QueueReady);
+#endif
+      } else {
+        drainViolations ();
+        SpinLockGuard Guard (WriterLock);
+        writeSite (Site);
+      }
+    }
+  }
+
+  //
+  // Report a certain number of errors before terminating the program.
+  //
+  unsigned long Count = __sync_add_and_fetch (&NumViolations, 1);
+  if (MaxViolations && (Count >= MaxViolations)) {
+    finishViolations ();
+    abort();
+  }
+}
+
+#endif
@@ -0,0 +1,88 @@
+//
+// KERNEL: allocs
+//
+// Description:
+//  Allocate, grow, and free many heap objects of mixed sizes, and make many
+//  short-lived stack arrays.  Most of the cost of the checking modes is in
+//  registering and unregistering objects.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_SLOTS 8192
+
+static unsigned long Seed = 999;
+
+static unsigned long
+nextRandom (void) {
+  Seed = Seed * 6364136223846793005UL + 1442695040888963407UL;
+  return Seed >> 17;
+}
+
+static unsigned long
+recurse (unsigned Depth) {
+  char Buffer[64];
+  memset (Buffer, Depth, sizeof (Buffer));
+  if (!Depth)
+    return Buffer[63];
+  return Buffer[Depth % 64] + recurse (Depth - 1);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long Scale = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1;
+  unsigned long NumOps = 3000000 * Scale;
+  char * Slots[NUM_SLOTS];
+  size_t Sizes[NUM_SLOTS];
+  unsigned long Sum = 0;
+  unsigned long op;
+  unsigned index;
+
+  memset (Slots, 0, sizeof (Slots));
+  memset (Sizes, 0, sizeof (Sizes));
+  for (op = 0; op < NumOps; ++op) {
+    unsigned long R = nextRandom ();
+    index = R % NUM_SLOTS;
+    switch ((R >> 13) % 4) {
+      case 0:
+      case 1:
+        //
+        // Replace the object with one of a new size.  Most objects are
+        // small; a few are large.
+        //
+        free (Slots[index]);
+        Sizes[index] = ((R >> 16) % 16) ? 8 + (R >> 20) % 120
+                                        : 1024 + (R >> 20) % 8192;
+        Slots[index] = malloc (Sizes[index]);
+        Slots[index][0] = (char) op;
+        Slots[index][Sizes[index] - 1] = (char) index;
+        break;
+
+      case 2:
+        if (Slots[index]) {
+          size_t Size = Sizes[index] + 16 + (R >> 20) % 64;
+          Slots[index] = realloc (Slots[index], Size);
+          Slots[index][Size - 1] = Slots[index][0];
+          Sizes[index] = Size;
+        }
+        break;
+
+      case 3:
+        if (Slots[index])
+          Sum += (unsigned char) Slots[index][0] +
+                 (unsigned char) Slots[index][Sizes[index] - 1];
+        break;
+    }
+
+    if ((op & 1023) == 0)
+      Sum += recurse (16);
+  }
+
+  for (index = 0; index < NUM_SLOTS; ++index)
+    free (Slots[index]);
+
+  printf ("allocs: %lu\n", Sum);
+  return 0;
+}
@@ -0,0 +1,88 @@
+//
+// KERNEL: arrays
+//
+// Description:
+//  Dense loops over global, stack, and heap arrays: a matrix multiply, a
+//  stencil, and a prefix sum.  The checks are on indexed loads and stores
+//  that stay within a few large objects.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 192
+
+static double A[N][N];
+static double B[N][N];
+
+static void
+multiply (double (*C)[N]) {
+  int i, j, k;
+  for (i = 0; i < N; ++i)
+    for (j = 0; j < N; ++j)
+      C[i][j] = 0;
+  for (i = 0; i < N; ++i)
+    for (k = 0; k < N; ++k)
+      for (j = 0; j < N; ++j)
+        C[i][j] += A[i][k] * B[k][j];
+}
+
+static void
+stencil (double * Grid, double * Next, int Size) {
+  int i, j;
+  for (i = 1; i < Size - 1; ++i)
+    for (j = 1; j < Size - 1; ++j)
+      Next[i * Size + j] = 0.25 * (Grid[(i - 1) * Size + j] +
+                                   Grid[(i + 1) * Size + j] +
+                                   Grid[i * Size + j - 1] +
+                                   Grid[i * Size + j + 1]);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long Scale = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1;
+  double Sum = 0;
+  unsigned long round;
+  int i, j;
+
+  for (i = 0; i < N; ++i) {
+    for (j = 0; j < N; ++j) {
+      A[i][j] = (i * 7 + j * 3) % 11;
+      B[i][j] = (i * 5 + j * 13) % 17;
+    }
+  }
+
+  double (*C)[N] = malloc (sizeof (double[N][N]));
+  for (round = 0; round < 24 * Scale; ++round) {
+    multiply (C);
+    Sum += C[round % N][(round * 3) % N];
+  }
+  free (C);
+
+  int Size = 512;
+  double * Grid = calloc (Size * Size, sizeof (double));
+  double * Next = calloc (Size * Size, sizeof (double));
+  for (i = 0; i < Size; ++i)
+    Grid[i] = Next[i] = 100;
+  for (round = 0; round < 96 * Scale; ++round) {
+    double * Tmp;
+    stencil (Grid, Next, Size);
+    Tmp = Grid;
+    Grid = Next;
+    Next = Tmp;
+  }
+  Sum += Grid[(Size / 2) * Size + Size / 2];
+  free (Grid);
+  free (Next);
+
+  long Prefix[4096];
+  for (round = 0; round < 4096 * Scale; ++round) {
+    Prefix[0] = round;
+    for (i = 1; i < 4096; ++i)
+      Prefix[i] = Prefix[i - 1] + (i ^ round);
+    Sum += Prefix[4095] % 1000;
+  }
+
+  printf ("arrays: %.0f\n", Sum);
+  return 0;
+}
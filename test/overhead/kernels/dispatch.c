@@ -0,0 +1,92 @@
+//
+// KERNEL: dispatch
+//
+// Description:
+//  Interpret a small bytecode through a table of function pointers and call
+//  through the function pointers of a set of objects.  Most checks are on
+//  indirect calls.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Machine {
+  long Stack[64];
+  int SP;
+  int PC;
+};
+
+typedef void (*Handler) (struct Machine *, int);
+
+static void opPush (struct Machine * M, int Arg) { M->Stack[M->SP++] = Arg; }
+static void opAdd (struct Machine * M, int Arg) {
+  --M->SP;
+  M->Stack[M->SP - 1] += M->Stack[M->SP];
+}
+static void opMul (struct Machine * M, int Arg) {
+  --M->SP;
+  M->Stack[M->SP - 1] = (M->Stack[M->SP - 1] * M->Stack[M->SP]) % 1000003;
+}
+static void opDup (struct Machine * M, int Arg) {
+  M->Stack[M->SP] = M->Stack[M->SP - 1];
+  ++M->SP;
+}
+static void opSwap (struct Machine * M, int Arg) {
+  long Tmp = M->Stack[M->SP - 1];
+  M->Stack[M->SP - 1] = M->Stack[M->SP - 2];
+  M->Stack[M->SP - 2] = Tmp;
+}
+static void opDrop (struct Machine * M, int Arg) { --M->SP; }
+
+static Handler Handlers[] = { opPush, opAdd, opMul, opDup, opSwap, opDrop };
+
+// A program that leaves the stack as it found it
+static const int Program[][2] = {
+  {0, 3}, {0, 5}, {2, 0}, {3, 0}, {1, 0}, {0, 7}, {4, 0}, {2, 0},
+  {3, 0}, {0, 11}, {1, 0}, {4, 0}, {5, 0}, {1, 0}
+};
+
+struct Shape {
+  long (*Area) (const struct Shape *);
+  long Width;
+  long Height;
+};
+
+static long rectangle (const struct Shape * S) { return S->Width * S->Height; }
+static long triangle (const struct Shape * S) {
+  return S->Width * S->Height / 2;
+}
+static long square (const struct Shape * S) { return S->Width * S->Width; }
+
+int
+main (int argc, char ** argv) {
+  unsigned long Scale = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1;
+  const int Length = sizeof (Program) / sizeof (Program[0]);
+  struct Machine M;
+  long Sum = 0;
+  unsigned long round;
+  int index;
+
+  M.SP = 1;
+  M.Stack[0] = 1;
+  for (round = 0; round < 2000000 * Scale; ++round) {
+    for (M.PC = 0; M.PC < Length; ++M.PC)
+      Handlers[Program[M.PC][0]] (&M, Program[M.PC][1]);
+    Sum += M.Stack[M.SP - 1];
+  }
+
+  struct Shape * Shapes = malloc (1024 * sizeof (struct Shape));
+  for (index = 0; index < 1024; ++index) {
+    Shapes[index].Area = (index % 3 == 0) ? rectangle
+                       : (index % 3 == 1) ? triangle : square;
+    Shapes[index].Width = index % 17 + 1;
+    Shapes[index].Height = index % 13 + 1;
+  }
+  for (round = 0; round < 20000 * Scale; ++round)
+    for (index = 0; index < 1024; ++index)
+      Sum += Shapes[index].Area (&Shapes[index]);
+  free (Shapes);
+
+  printf ("dispatch: %ld\n", Sum);
+  return 0;
+}
@@ -0,0 +1,120 @@
+//
+// KERNEL: strings
+//
+// Description:
+//  Build, copy, compare, and tokenize strings with the C library, and count
+//  words in a hash table.  Most checks are on the library calls and on byte
+//  loads from small heap and stack buffers.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TABLE_SIZE 4096
+
+struct Word {
+  struct Word * Next;
+  char * Text;
+  unsigned long Count;
+};
+
+static struct Word * Table[TABLE_SIZE];
+
+static const char * Syllables[] = {
+  "ka", "lo", "mi", "ne", "ru", "sha", "to", "vi", "xe", "zu"
+};
+
+static unsigned long Seed = 54321;
+
+static unsigned long
+nextRandom (void) {
+  Seed = Seed * 6364136223846793005UL + 1442695040888963407UL;
+  return Seed >> 17;
+}
+
+static unsigned
+hash (const char * Text) {
+  unsigned Hash = 5381;
+  while (*Text)
+    Hash = Hash * 33 + (unsigned char) *Text++;
+  return Hash % TABLE_SIZE;
+}
+
+static void
+countWord (const char * Text) {
+  unsigned Bucket = hash (Text);
+  struct Word * W;
+  for (W = Table[Bucket]; W; W = W->Next) {
+    if (strcmp (W->Text, Text) == 0) {
+      ++W->Count;
+      return;
+    }
+  }
+
+  W = malloc (sizeof (struct Word));
+  W->Text = strdup (Text);
+  W->Count = 1;
+  W->Next = Table[Bucket];
+  Table[Bucket] = W;
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long Scale = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1;
+  unsigned long NumLines = 150000 * Scale;
+  unsigned long Sum = 0;
+  unsigned long line, index;
+
+  for (line = 0; line < NumLines; ++line) {
+    //
+    // Make a line of words out of syllables.
+    //
+    char Line[512];
+    Line[0] = '\0';
+    unsigned Words = 8 + nextRandom () % 24;
+    for (index = 0; index < Words; ++index) {
+      char Word[32];
+      unsigned Parts = 1 + nextRandom () % 3;
+      Word[0] = '\0';
+      while (Parts--)
+        strcat (Word, Syllables[nextRandom () % 10]);
+      if (index)
+        strcat (Line, " ");
+      strcat (Line, Word);
+    }
+
+    //
+    // Copy it, reverse the copy, and tokenize the original.
+    //
+    size_t Length = strlen (Line);
+    char * Copy = malloc (Length + 1);
+    memcpy (Copy, Line, Length + 1);
+    for (index = 0; index < Length / 2; ++index) {
+      char Tmp = Copy[index];
+      Copy[index] = Copy[Length - 1 - index];
+      Copy[Length - 1 - index] = Tmp;
+    }
+    Sum += strcmp (Copy, Line) < 0;
+    Sum += strchr (Copy, 'z') != NULL;
+    free (Copy);
+
+    char * Token;
+    for (Token = strtok (Line, " "); Token; Token = strtok (NULL, " "))
+      countWord (Token);
+  }
+
+  for (index = 0; index < TABLE_SIZE; ++index) {
+    struct Word * W = Table[index];
+    while (W) {
+      struct Word * Next = W->Next;
+      Sum += W->Count * strlen (W->Text);
+      free (W->Text);
+      free (W);
+      W = Next;
+    }
+  }
+
+  printf ("strings: %lu\n", Sum);
+  return 0;
+}
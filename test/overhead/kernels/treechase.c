@@ -0,0 +1,117 @@
+//
+// KERNEL: treechase
+//
+// Description:
+//  Chase pointers through a binary search tree and a linked list.  Every
+//  node is a separate heap object, so most checks are on loads through
+//  pointers loaded from other objects.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Tree {
+  struct Tree * Left;
+  struct Tree * Right;
+  unsigned long Key;
+  unsigned long Value;
+};
+
+struct List {
+  struct List * Next;
+  unsigned long Value;
+};
+
+static unsigned long Seed = 12345;
+
+static unsigned long
+nextRandom (void) {
+  Seed = Seed * 6364136223846793005UL + 1442695040888963407UL;
+  return Seed >> 17;
+}
+
+static struct Tree *
+insert (struct Tree * Root, unsigned long Key) {
+  struct Tree ** Slot = &Root;
+  while (*Slot) {
+    if (Key == (*Slot)->Key) {
+      ++(*Slot)->Value;
+      return Root;
+    }
+    Slot = (Key < (*Slot)->Key) ? &(*Slot)->Left : &(*Slot)->Right;
+  }
+
+  struct Tree * Node = malloc (sizeof (struct Tree));
+  Node->Left = Node->Right = NULL;
+  Node->Key = Key;
+  Node->Value = 1;
+  *Slot = Node;
+  return Root;
+}
+
+static unsigned long
+lookup (struct Tree * Root, unsigned long Key) {
+  while (Root) {
+    if (Key == Root->Key)
+      return Root->Value;
+    Root = (Key < Root->Key) ? Root->Left : Root->Right;
+  }
+  return 0;
+}
+
+static void
+destroy (struct Tree * Root) {
+  if (Root) {
+    destroy (Root->Left);
+    destroy (Root->Right);
+    free (Root);
+  }
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long Scale = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1;
+  unsigned long NumKeys = 1 << 16;
+  unsigned long Sum = 0;
+  unsigned long round, index;
+
+  for (round = 0; round < 2 * Scale; ++round) {
+    struct Tree * Root = NULL;
+    for (index = 0; index < NumKeys; ++index)
+      Root = insert (Root, nextRandom () % (4 * NumKeys));
+    for (index = 0; index < 2 * NumKeys; ++index)
+      Sum += lookup (Root, nextRandom () % (4 * NumKeys));
+    destroy (Root);
+  }
+
+  //
+  // Build a list in an order unrelated to the addresses of its nodes and
+  // walk it repeatedly.
+  //
+  struct List ** Nodes = malloc (NumKeys * sizeof (struct List *));
+  for (index = 0; index < NumKeys; ++index) {
+    Nodes[index] = malloc (sizeof (struct List));
+    Nodes[index]->Value = index;
+  }
+  for (index = NumKeys - 1; index > 0; --index) {
+    unsigned long Other = nextRandom () % (index + 1);
+    struct List * Tmp = Nodes[index];
+    Nodes[index] = Nodes[Other];
+    Nodes[Other] = Tmp;
+  }
+  for (index = 0; index < NumKeys; ++index)
+    Nodes[index]->Next = (index + 1 < NumKeys) ? Nodes[index + 1] : NULL;
+
+  for (round = 0; round < 16 * Scale; ++round) {
+    struct List * Node;
+    for (Node = Nodes[0]; Node; Node = Node->Next)
+      Sum += Node->Value ^ round;
+  }
+
+  for (index = 0; index < NumKeys; ++index)
+    free (Nodes[index]);
+  free (Nodes);
+
+  printf ("treechase: %lu\n", Sum);
+  return 0;
+}
@@ -0,0 +1,91 @@
+//
+// Program: measure
+//
+// Description:
+//  Run a program and write the wall-clock time that it took, in seconds, the
+//  peak resident set size of the process, in kilobytes, and its exit status
+//  on one line:
+//
+//    measure [-o file] program [args...]
+//
+//  The line goes to the file if one is named and to standard error
+//  otherwise.  The program inherits the standard streams of measure.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int
+main (int argc, char ** argv) {
+  const char * OutFile = NULL;
+  int first = 1;
+  if ((argc > 2) && (strcmp (argv[1], "-o") == 0)) {
+    OutFile = argv[2];
+    first = 3;
+  }
+
+  if (first >= argc) {
+    fprintf (stderr, "usage: measure [-o file] program [args...]\n");
+    return 2;
+  }
+
+  struct timeval Start;
+  gettimeofday (&Start, NULL);
+
+  pid_t Child = fork ();
+  if (Child < 0) {
+    perror ("measure: fork");
+    return 2;
+  }
+
+  if (Child == 0) {
+    execvp (argv[first], argv + first);
+    fprintf (stderr, "measure: %s: %s\n", argv[first], strerror (errno));
+    _exit (127);
+  }
+
+  int Status;
+  struct rusage Usage;
+  while (wait4 (Child, &Status, 0, &Usage) < 0) {
+    if (errno != EINTR) {
+      perror ("measure: wait4");
+      return 2;
+    }
+  }
+
+  struct timeval End;
+  gettimeofday (&End, NULL);
+  double Seconds = (End.tv_sec - Start.tv_sec) +
+                   (End.tv_usec - Start.tv_usec) / 1e6;
+
+  //
+  // Report a signal that killed the program as a shell would.
+  //
+  int ExitStatus = WIFEXITED (Status) ? WEXITSTATUS (Status)
+                                      : 128 + WTERMSIG (Status);
+
+  //
+  // Linux reports the peak resident set size in kilobytes, and Darwin in
+  // bytes.
+  //
+  long MaxRSS = Usage.ru_maxrss;
+#ifdef __APPLE__
+  MaxRSS /= 1024;
+#endif
+
+  FILE * Out = stderr;
+  if (OutFile && !(Out = fopen (OutFile, "w"))) {
+    perror (OutFile);
+    return 2;
+  }
+  fprintf (Out, "%.6f %ld %d\n", Seconds, MaxRSS, ExitStatus);
+  if (Out != stderr)
+    fclose (Out);
+  return 0;
+}
@@ -1,38 +1,197 @@
-#include "../../runtime/SafePoolAllocator/ParPoolAllocator.h"
-
-PoolTy Pool;
-
-extern "C" void __sc_par_init_runtime(unsigned, unsigned, unsigned);
-extern "C" void __sc_par_poolcheck(PoolTy *, void *);
-extern "C" void __sc_par_poolcheck_0(void *);
-extern "C" void __sc_par_boundscheck(PoolTy*, void*, void*);
-extern "C" void __sc_par_boundscheck_0(void*, void*);
-extern "C" void __sc_par_wait_for_completion(void);
-extern "C" void __sc_par_cachepool_0(PoolTy*);
-
-int main() {
-
-  __sc_par_pool_init_runtime(0, 0, 1);
-  __sc_par_poolinit(&Pool, 128);
-  __sc_par_cachepool_0(&Pool);
-  char* obj1 = (char*)__sc_par_poolalloc(&Pool, 128);
-#if 0
-  char* obj2 = (char*)__sc_par_poolalloc(&Pool, 128);
-#else
-  (char*)__sc_par_poolalloc(&Pool, 128);
-#endif
-  for (unsigned x = 0; x < 100000000; ++x) {
-    __sc_par_poolcheck_0(obj1 + (x % 128));
-    __sc_par_boundscheck_0(obj1, obj1 + (x % 128));
-#if 0
-    __sc_par_poolcheck(&Pool, obj2 + (x % 128));
-    __sc_par_boundscheck(&Pool, obj2, obj2 + (x % 128));
-#endif
+//===- queue_speed.cpp - Throughput of speculative checking ---------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program measures how quickly a program can hand run-time checks to the
+// checker threads of the debug run-time.
+//
+// Usage: queue_speed [iterations]
+//
+// It measures the ring alone, with a consumer that discards every record, and
+// then the time that the program spends in __sc_par_poolcheck() and
+// __sc_par_boundscheck(), both with and without waiting for the checker
+// thread, against the time spent in the synchronous checks.  Results are
+// printed one per line as comma separated values:
+//
+//   benchmark,variant,iterations,value,unit
+//
+// Unless SC_CHECKER_THREADS is set, one checker thread is used even on a
+// uniprocessor.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DebugRuntime.h"
+#include "CheckQueue.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace llvm;
+
+// A record of the same size as the ones sent to the checker threads
+struct Record {
+  unsigned Kind;
+  unsigned Length;
+  void * Pool;
+  void * First;
+  void * Second;
+};
+
+typedef CheckQueue<Record, 15> QueueTy;
+
+// The ring measured alone; static so that it starts zero-filled
+static QueueTy Ring;
+
+// Set by the producer once it has pushed its last record
+static volatile bool Done = false;
+
+// Number and size of the objects checked
+static const unsigned NumObjects = 256;
+static const unsigned ObjectSize = 64;
+
+static DebugPoolTy Pool;
+static char * Objects[NumObjects];
+
+static uint64_t
+getTimeNS (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+report (const char * Bench, const char * Variant, unsigned long Iterations,
+        uint64_t Elapsed) {
+  printf ("%s,%s,%lu,%.2f,ns/op\n",
+          Bench, Variant, Iterations, (double) Elapsed / Iterations);
+  fflush (stdout);
+}
+
+//
+// Function: discardRecords()
+//
+// Description:
+//  Consume the records of the ring without looking at them.
+//
+static void *
+discardRecords (void *) {
+  unsigned long Count = 0;
+  unsigned Spins = 0;
+  for (;;) {
+    if (Ring.front ()) {
+      Ring.pop ();
+      ++Count;
+      Spins = 0;
+    } else if (Done) {
+      if (!Ring.front ())
+        break;
+    } else {
+      spinWait (Spins);
+    }
   }
-  __sc_par_wait_for_completion();
-  return 0;
+  return (void *) Count;
 }
 
-extern "C" void poolcheckfail(void) {
-  abort();
+//
+// Function: measureRing()
+//
+// Description:
+//  Measure the cost of pushing a record onto the ring while another thread
+//  empties it.
+//
+static void
+measureRing (unsigned long Iterations) {
+  pthread_t Consumer;
+  if (pthread_create (&Consumer, 0, discardRecords, 0)) {
+    fprintf (stderr, "queue_speed: cannot start the consumer thread\n");
+    return;
+  }
+
+  uint64_t Start = getTimeNS ();
+  for (unsigned long Index = 0; Index < Iterations; ++Index) {
+    Record & R = Ring.reserve ();
+    R.Kind = 0;
+    R.Length = 8;
+    R.Pool = &Pool;
+    R.First = (void *) Index;
+    R.Second = 0;
+    Ring.push ();
+  }
+  unsigned Spins = 0;
+  while (!Ring.drained ())
+    spinWait (Spins);
+  uint64_t Elapsed = getTimeNS () - Start;
+
+  Done = true;
+  void * Count;
+  pthread_join (Consumer, &Count);
+  if ((unsigned long) Count != Iterations)
+    fprintf (stderr, "queue_speed: %lu records pushed but %lu popped\n",
+             Iterations, (unsigned long) Count);
+  report ("ring", "push", Iterations, Elapsed);
+}
+
+//
+// Function: measureChecks()
+//
+// Description:
+//  Measure a poolcheck and a boundscheck on registered objects, run by the
+//  program or by the checker thread.
+//
+static void
+measureChecks (unsigned long Iterations) {
+  uint64_t Start = getTimeNS ();
+  for (unsigned long Index = 0; Index < Iterations; ++Index) {
+    char * Object = Objects[Index % NumObjects];
+    poolcheck (&Pool, Object + (Index % (ObjectSize - 8)), 8);
+    boundscheck (&Pool, Object, Object + (Index % ObjectSize));
+  }
+  report ("checks", "sync", Iterations, getTimeNS () - Start);
+
+  Start = getTimeNS ();
+  for (unsigned long Index = 0; Index < Iterations; ++Index) {
+    char * Object = Objects[Index % NumObjects];
+    __sc_par_poolcheck (&Pool, Object + (Index % (ObjectSize - 8)), 8);
+    __sc_par_boundscheck (&Pool, Object, Object + (Index % ObjectSize));
+  }
+  uint64_t Enqueued = getTimeNS () - Start;
+  __sc_par_wait_for_completion ();
+  uint64_t Completed = getTimeNS () - Start;
+  report ("checks", "enqueue", Iterations, Enqueued);
+  report ("checks", "complete", Iterations, Completed);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long Iterations = 10000000;
+  if (argc > 1)
+    Iterations = strtoul (argv[1], 0, 10);
+  if (!Iterations)
+    Iterations = 1;
+
+  setenv ("SC_CHECKER_THREADS", "1", 0);
+  __sc_par_pool_init_runtime (0, 1, 0);
+  __sc_dbg_poolinit (&Pool, ObjectSize, 0);
+  for (unsigned Index = 0; Index < NumObjects; ++Index) {
+    Objects[Index] = (char *) malloc (ObjectSize);
+    __sc_par_pool_register (&Pool, Objects[Index], ObjectSize);
+  }
+  __sc_par_wait_for_completion ();
+
+  measureRing (Iterations);
+  measureChecks (Iterations);
+
+  for (unsigned Index = 0; Index < NumObjects; ++Index)
+    __sc_par_pool_unregister (&Pool, Objects[Index]);
+  __sc_par_wait_for_completion ();
+  return 0;
 }
@@ -0,0 +1,144 @@
+//===- BaggyAlloc.cpp - Benchmark of the baggy bounds allocator -----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file compares the buddy allocator of the baggy bounds run-time with
+// the posix_memalign() path that it replaced.  For each slot size, a set of
+// live objects is allocated and the growth of the resident set is reported;
+// random objects are then freed and replaced by new ones, and the cost of
+// each free/allocate pair is reported.  Objects are registered and
+// unregistered as compiled code does, so the cost of the baggy bounds table
+// is included in both cases.  Each configuration runs in a child process so
+// that it cannot reuse the memory that an earlier one freed.
+//
+// The benchmark is only built against the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+#include "RuntimeBench.h"
+
+#include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/BBRuntime.h"
+#include "../../runtime/BBRuntime/BuddyAllocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace bench;
+using namespace NAMESPACE_SC;
+
+// Number of bytes of live objects of each size
+static const unsigned long LiveBytes = 64 * 1024 * 1024;
+
+// Number of free/allocate pairs timed for each configuration
+static const unsigned long NumPairs = 1 << 20;
+
+//
+// Function: getResidentKB()
+//
+// Description:
+//  Return the size of the resident set of the process in kilobytes.
+//
+static unsigned long
+getResidentKB (void) {
+  unsigned long Size = 0, Resident = 0;
+  FILE * Statm = fopen ("/proc/self/statm", "r");
+  if (!Statm)
+    return 0;
+  if (fscanf (Statm, "%lu %lu", &Size, &Resident) != 2)
+    Resident = 0;
+  fclose (Statm);
+  return Resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static inline void *
+allocSlot (bool Buddy, size_t Size) {
+  void * p;
+  if (Buddy)
+    p = bbAllocate (Size);
+  else if (posix_memalign (&p, Size, Size))
+    p = 0;
+  __sc_bb_poolregister (0, p, Size - sizeof (BBMetaData));
+  return p;
+}
+
+static inline void
+freeSlot (bool Buddy, void * p) {
+  __sc_bb_poolunregister (0, p);
+  if (Buddy)
+    bbFree (p);
+  else
+    free (p);
+}
+
+static void
+runAlloc (const char * Variant,
+          bool Buddy,
+          size_t Size,
+          const BenchOptions & Opts) {
+  uint64_t State = Opts.Seed;
+  unsigned long NumLive = LiveBytes / Size;
+  if (NumLive > Opts.MaxObjects)
+    NumLive = Opts.MaxObjects;
+
+  fflush (stdout);
+  pid_t Child = fork ();
+  if (Child) {
+    waitpid (Child, 0, 0);
+    return;
+  }
+
+  //
+  // Allocate the live objects and fill them, as a program would.
+  //
+  std::vector<void *> Objs (NumLive);
+  unsigned long Before = getResidentKB ();
+  for (unsigned long index = 0; index < NumLive; ++index) {
+    Objs[index] = allocSlot (Buddy, Size);
+    memset (Objs[index], 1, Size - sizeof (BBMetaData));
+  }
+  unsigned long After = getResidentKB ();
+
+  uint64_t Start = getTimeNS ();
+  for (unsigned long pairs = 0; pairs < NumPairs; ++pairs) {
+    void *& p = Objs[nextRandom (State) % NumLive];
+    freeSlot (Buddy, p);
+    p = allocSlot (Buddy, Size);
+  }
+  uint64_t End = getTimeNS ();
+
+  reportResult ("baggy-alloc", Variant, Size,
+                (double) (End - Start) / NumPairs);
+  reportResult ("baggy-alloc-rss", Variant, Size,
+                (double) (After - Before) * 1024 / NumLive, "bytes/object");
+  fflush (stdout);
+  _exit (0);
+}
+
+static void
+runBaggyAlloc (const BenchOptions & Opts) {
+  pool_init_runtime (0, 0, 0);
+
+  static const size_t Sizes[] = {32, 256, 4096, 65536};
+  static const unsigned NumSizes = sizeof (Sizes) / sizeof (Sizes[0]);
+  for (unsigned index = 0; index < NumSizes; ++index) {
+    runAlloc ("memalign", false, Sizes[index], Opts);
+    runAlloc ("buddy", true, Sizes[index], Opts);
+  }
+}
+
+static RegisterBenchmark X ("baggy-alloc", runBaggyAlloc);
+
+#endif
@@ -0,0 +1,239 @@
+//===- BaggyChecks.cpp - Benchmark of inline baggy bounds checks ----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures loops of the overhead corpus without checks, with calls
+// to the baggy bounds checks of the run-time, and with the checks performed
+// inline as the InlineBaggyChecks pass does.  The list loop follows the
+// pointers of a list of small heap objects, as the treechase kernel does,
+// and the stencil loop of the arrays kernel averages the neighbours of each
+// element of a heap array.  The inline checks below mirror the code that the
+// pass generates.
+//
+// The benchmark is only built against the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+#include "RuntimeBench.h"
+
+#include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/BBRuntime.h"
+#include "../../runtime/BBRuntime/SizeTable.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace NAMESPACE_SC;
+
+// The unmapped range that holds rewritten out-of-bounds pointers
+extern "C" uintptr_t InvalidLower;
+extern "C" uintptr_t InvalidUpper;
+
+// Number of nodes of the list
+static const unsigned NumNodes = 1 << 12;
+
+// Number of elements of the arrays of the stencil; with the metadata, each
+// array fills a 4 KB slot, the largest whose bounds are checked
+static const unsigned NumElements = 500;
+
+// Number of passes over the list and the arrays
+static const unsigned NumPasses = 256;
+
+// Keeps the loops from being optimized away
+static volatile double Sink;
+
+struct Node {
+  Node * Next;
+  long Values[4];
+};
+
+enum CheckMode {
+  NoChecks,
+  CallChecks,
+  InlineChecks
+};
+
+//
+// Function: inlinePoolcheck()
+//
+// Description:
+//  Perform a load/store check the way the InlineBaggyChecks pass does.
+//
+static inline void
+inlinePoolcheck (void * Ptr, unsigned Length) {
+  uintptr_t Addr = (uintptr_t) Ptr;
+  if (__builtin_expect ((intptr_t) Addr < 0, 0)) {
+    bb_poolcheckui_debug (0, Ptr, Length, 0, 0, 0);
+    return;
+  }
+  unsigned char e = lookupSize (Addr);
+  if (e) {
+    uintptr_t Start = Addr & -((uintptr_t) 1 << e);
+    BBMetaData * data = (BBMetaData *) (Start + ((uintptr_t) 1 << e)) - 1;
+    if (__builtin_expect (Addr - Start + Length <= data->size, 1))
+      return;
+  } else if (!((InvalidLower < Addr) && (Addr < InvalidUpper))) {
+    return;
+  }
+  bb_poolcheckui_debug (0, Ptr, Length, 0, 0, 0);
+}
+
+//
+// Function: inlineBoundscheck()
+//
+// Description:
+//  Perform a bounds check the way the InlineBaggyChecks pass does.
+//
+static inline void *
+inlineBoundscheck (void * Source, void * Dest) {
+  uintptr_t Src = (uintptr_t) Source;
+  if (__builtin_expect ((intptr_t) Src < 0, 0))
+    return bb_boundscheckui_debug (0, Source, Dest, 0, 0, 0);
+  unsigned char e = lookupSize (Src);
+  if ((unsigned char) (e - 1) >= 12) {
+    if (__builtin_expect (e == 0, 0) &&
+        (InvalidLower < Src) && (Src < InvalidUpper))
+      return bb_boundscheckui_debug (0, Source, Dest, 0, 0, 0);
+    return Dest;
+  }
+  uintptr_t Start = Src & -((uintptr_t) 1 << e);
+  BBMetaData * data = (BBMetaData *) (Start + ((uintptr_t) 1 << e)) - 1;
+  if (__builtin_expect ((Src - Start < data->size) &&
+                        ((uintptr_t) Dest - Start < data->size), 1))
+    return Dest;
+  return bb_boundscheckui_debug (0, Source, Dest, 0, 0, 0);
+}
+
+static inline void
+poolcheck (CheckMode Mode, void * Ptr, unsigned Length) {
+  if (Mode == CallChecks)
+    bb_poolcheckui_debug (0, Ptr, Length, 0, 0, 0);
+  else if (Mode == InlineChecks)
+    inlinePoolcheck (Ptr, Length);
+}
+
+template<typename T>
+static inline T *
+boundscheck (CheckMode Mode, void * Source, T * Dest) {
+  if (Mode == CallChecks)
+    return (T *) bb_boundscheckui_debug (0, Source, Dest, 0, 0, 0);
+  if (Mode == InlineChecks)
+    return (T *) inlineBoundscheck (Source, Dest);
+  return Dest;
+}
+
+//
+// Function: runList()
+//
+// Description:
+//  Sum a field of every node of the list and return the cost per node.
+//
+static double
+runList (Node * Head, CheckMode Mode) {
+  long Sum = 0;
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (Node * N = Head; N; ) {
+      long * Value = boundscheck (Mode, N, &N->Values[pass & 3]);
+      poolcheck (Mode, Value, sizeof (long));
+      Sum += *Value;
+      poolcheck (Mode, &N->Next, sizeof (Node *));
+      N = N->Next;
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Sum;
+  return (End - Start) / ((double) NumPasses * NumNodes);
+}
+
+//
+// Function: runStencil()
+//
+// Description:
+//  Average the neighbours of each interior element of Grid into Next and
+//  return the cost per element.
+//
+static double
+runStencil (double * Grid, double * Next, CheckMode Mode) {
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned i = 1; i < NumElements - 1; ++i) {
+      double * Left = boundscheck (Mode, Grid, &Grid[i - 1]);
+      double * Middle = boundscheck (Mode, Grid, &Grid[i]);
+      double * Right = boundscheck (Mode, Grid, &Grid[i + 1]);
+      double * Out = boundscheck (Mode, Next, &Next[i]);
+      poolcheck (Mode, Left, sizeof (double));
+      poolcheck (Mode, Middle, sizeof (double));
+      poolcheck (Mode, Right, sizeof (double));
+      poolcheck (Mode, Out, sizeof (double));
+      *Out = 0.25 * *Left + 0.5 * *Middle + 0.25 * *Right;
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Next[NumElements / 2];
+  return (End - Start) / ((double) NumPasses * (NumElements - 2));
+}
+
+static void
+runBaggyChecks (const BenchOptions & Opts) {
+  pool_init_runtime (0, 0, 0);
+
+  //
+  // Link the nodes in a random order so that the list is not walked
+  // sequentially in memory.
+  //
+  uint64_t State = Opts.Seed;
+  Node ** Nodes = (Node **) malloc (NumNodes * sizeof (Node *));
+  for (unsigned index = 0; index < NumNodes; ++index) {
+    Nodes[index] = (Node *) calloc (1, sizeof (Node));
+    Nodes[index]->Values[index & 3] = index;
+  }
+  for (unsigned index = NumNodes - 1; index > 0; --index) {
+    unsigned Other = nextRandom (State) % (index + 1);
+    Node * Tmp = Nodes[index];
+    Nodes[index] = Nodes[Other];
+    Nodes[Other] = Tmp;
+  }
+  for (unsigned index = 0; index + 1 < NumNodes; ++index)
+    Nodes[index]->Next = Nodes[index + 1];
+
+  double * Grid = (double *) calloc (NumElements, sizeof (double));
+  double * Next = (double *) calloc (NumElements, sizeof (double));
+  for (unsigned index = 0; index < NumElements; ++index)
+    Grid[index] = index % 7;
+
+  //
+  // The parameter is the number of checks in each iteration.
+  //
+  static const char * ListVariants[] = {
+    "list-unchecked", "list-call", "list-inline"
+  };
+  static const char * StencilVariants[] = {
+    "stencil-unchecked", "stencil-call", "stencil-inline"
+  };
+  for (unsigned Mode = NoChecks; Mode <= InlineChecks; ++Mode)
+    reportResult ("baggy-checks", ListVariants[Mode], 3,
+                  runList (Nodes[0], (CheckMode) Mode));
+  for (unsigned Mode = NoChecks; Mode <= InlineChecks; ++Mode)
+    reportResult ("baggy-checks", StencilVariants[Mode], 8,
+                  runStencil (Grid, Next, (CheckMode) Mode));
+
+  for (unsigned index = 0; index < NumNodes; ++index)
+    free (Nodes[index]);
+  free (Nodes);
+  free (Grid);
+  free (Next);
+}
+
+static RegisterBenchmark X ("baggy-checks", runBaggyChecks);
+
+#endif
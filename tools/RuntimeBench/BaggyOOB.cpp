@@ -0,0 +1,98 @@
+//===- BaggyOOB.cpp - Benchmark of baggy bounds out of bounds pointers ----===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of out-of-bounds pointers in the baggy bounds
+// run-time.  Each iteration computes a pointer just past the end of a heap
+// object, as loops that walk arrays do, and then a pointer back into the
+// object from it; the first bounds check makes an out-of-bounds pointer and
+// the second recovers the actual value.  The near variant steps one element
+// past the end and the far variant steps 1024 slots past it.
+//
+// The benchmark is only built against the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+#include "RuntimeBench.h"
+
+#include "safecode/Runtime/BBRuntime.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace NAMESPACE_SC;
+
+// Number of objects and elements in each object
+static const unsigned NumObjects = 256;
+static const unsigned NumElements = 48;
+
+// Number of passes over the objects
+static const unsigned NumPasses = 256;
+
+// Keeps the loop from being optimized away
+static volatile long Sink;
+
+//
+// Function: runOOB()
+//
+// Description:
+//  Step Distance elements past the end of each object and back again, and
+//  return the cost per object.
+//
+static double
+runOOB (long ** Objects, unsigned Distance) {
+  long Sum = 0;
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned index = 0; index < NumObjects; ++index) {
+      long * Object = Objects[index];
+      long * Past = (long *) bb_boundscheckui_debug (0,
+                                                     Object,
+                                                     Object + NumElements +
+                                                     Distance,
+                                                     0, 0, 0);
+      long * Last = (long *) bb_boundscheckui_debug (0,
+                                                     Past,
+                                                     Past - Distance - 1,
+                                                     0, 0, 0);
+      Sum += *Last;
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Sum;
+  return (End - Start) / ((double) NumPasses * NumObjects);
+}
+
+static void
+runBaggyOOB (const BenchOptions & Opts) {
+  pool_init_runtime (0, 0, 0);
+
+  long ** Objects = (long **) malloc (NumObjects * sizeof (long *));
+  for (unsigned index = 0; index < NumObjects; ++index) {
+    Objects[index] = (long *) calloc (NumElements, sizeof (long));
+    Objects[index][NumElements - 1] = index;
+  }
+
+  //
+  // The parameter is the number of elements stepped past the end.  Each
+  // object fills a 512 byte slot.
+  //
+  reportResult ("baggy-oob", "near", 1, runOOB (Objects, 1));
+  reportResult ("baggy-oob", "far", 65536, runOOB (Objects, 65536));
+
+  for (unsigned index = 0; index < NumObjects; ++index)
+    free (Objects[index]);
+  free (Objects);
+}
+
+static RegisterBenchmark X ("baggy-oob", runBaggyOOB);
+
+#endif
@@ -0,0 +1,115 @@
+//===- BaggyRealloc.cpp - Benchmark of baggy bounds realloc ---------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures buffers that grow through realloc(), as string builders
+// and dynamic arrays do.  The builder variant appends 32 bytes at a time and
+// the array variant grows the buffer by an eighth each time; after each call
+// the new bytes are written.  The realloc variants call the realloc() of the
+// baggy bounds run-time, which keeps objects in their slots when it can, and
+// the copy variants allocate, copy, and free as it did before.  The
+// parameter is the final size of the buffer.
+//
+// The benchmark is only built against the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+#include "RuntimeBench.h"
+
+#include "safecode/Runtime/BBRuntime.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace bench;
+using namespace NAMESPACE_SC;
+
+// Number of bytes appended by the builder
+static const size_t AppendSize = 32;
+
+// Number of bytes of buffers grown from scratch in each measurement
+static const size_t TotalBytes = (size_t) 1 << 22;
+
+// Keeps the buffers from being optimized away
+static volatile char Sink;
+
+//
+// Function: copyRealloc()
+//
+// Description:
+//  Resize a buffer by allocating a new one and copying the old contents.
+//
+static void *
+copyRealloc (void * Old, size_t OldSize, size_t NewSize) {
+  void * New = malloc (NewSize);
+  if (Old) {
+    memcpy (New, Old, (OldSize < NewSize) ? OldSize : NewSize);
+    free (Old);
+  }
+  return New;
+}
+
+//
+// Function: runGrow()
+//
+// Description:
+//  Grow buffers to FinalSize bytes and return the cost per call.
+//
+static double
+runGrow (size_t FinalSize, bool Geometric, bool Copy) {
+  unsigned long Calls = 0;
+  uint64_t Start = getTimeNS ();
+  for (size_t Done = 0; Done < TotalBytes; Done += FinalSize) {
+    char * Buffer = 0;
+    size_t Size = 0;
+    while (Size < FinalSize) {
+      size_t NewSize = Geometric ? Size + Size / 8 + AppendSize
+                                 : Size + AppendSize;
+      if (NewSize > FinalSize)
+        NewSize = FinalSize;
+      if (Copy)
+        Buffer = (char *) copyRealloc (Buffer, Size, NewSize);
+      else
+        Buffer = (char *) realloc (Buffer, NewSize);
+      memset (Buffer + Size, (int) Calls, NewSize - Size);
+      Size = NewSize;
+      ++Calls;
+    }
+    Sink = Buffer[FinalSize / 2];
+    free (Buffer);
+  }
+  uint64_t End = getTimeNS ();
+
+  return (double) (End - Start) / Calls;
+}
+
+static void
+runBaggyRealloc (const BenchOptions & Opts) {
+  pool_init_runtime (0, 0, 0);
+
+  static const size_t BuilderSizes[] = {4096, 65536};
+  static const size_t ArraySizes[] = {65536, 1 << 20, 1 << 26};
+  for (unsigned index = 0; index < 2; ++index) {
+    reportResult ("baggy-realloc", "builder-realloc", BuilderSizes[index],
+                  runGrow (BuilderSizes[index], false, false));
+    reportResult ("baggy-realloc", "builder-copy", BuilderSizes[index],
+                  runGrow (BuilderSizes[index], false, true));
+  }
+  for (unsigned index = 0; index < 3; ++index) {
+    reportResult ("baggy-realloc", "array-realloc", ArraySizes[index],
+                  runGrow (ArraySizes[index], true, false));
+    reportResult ("baggy-realloc", "array-copy", ArraySizes[index],
+                  runGrow (ArraySizes[index], true, true));
+  }
+}
+
+static RegisterBenchmark X ("baggy-realloc", runBaggyRealloc);
+
+#endif
@@ -0,0 +1,118 @@
+//===- BaggyTable.cpp - Benchmark of the baggy bounds size table ----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of registering and unregistering objects of
+// growing sizes in the baggy bounds size table and the memory that the table
+// keeps once the objects are gone.  Registration only writes the table, so
+// the objects are placed in a reserved region that is never touched.  Each
+// size runs in a child process so that it starts with an empty table.
+//
+// The benchmark is only built against the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+#include "RuntimeBench.h"
+
+#include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/BBRuntime.h"
+
+#include <cstdio>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+using namespace bench;
+using namespace NAMESPACE_SC;
+
+// Size of the region in which the objects are placed
+static const uintptr_t RegionSize = (uintptr_t) 1 << 30;
+
+// Largest number of objects registered for each size
+static const unsigned long MaxObjects = 4096;
+
+//
+// Function: getResidentKB()
+//
+// Description:
+//  Return the size of the resident set of the process in kilobytes.
+//
+static unsigned long
+getResidentKB (void) {
+  unsigned long Size = 0, Resident = 0;
+  FILE * Statm = fopen ("/proc/self/statm", "r");
+  if (!Statm)
+    return 0;
+  if (fscanf (Statm, "%lu %lu", &Size, &Resident) != 2)
+    Resident = 0;
+  fclose (Statm);
+  return Resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void
+runTable (uintptr_t Region, uintptr_t Size) {
+  fflush (stdout);
+  pid_t Child = fork ();
+  if (Child) {
+    waitpid (Child, 0, 0);
+    return;
+  }
+
+  unsigned long NumObjects = RegionSize / Size;
+  if (NumObjects > MaxObjects)
+    NumObjects = MaxObjects;
+
+  unsigned long Before = getResidentKB ();
+  uint64_t Start = getTimeNS ();
+  for (unsigned long index = 0; index < NumObjects; ++index) {
+    void * Object = (void *) (Region + index * Size);
+    __sc_bb_poolregister (0, Object, Size - sizeof (BBMetaData));
+    __sc_bb_poolunregister (0, Object);
+  }
+  uint64_t End = getTimeNS ();
+  unsigned long After = getResidentKB ();
+
+  reportResult ("baggy-table", "register-unregister", Size,
+                (double) (End - Start) / NumObjects);
+  reportResult ("baggy-table-rss", "retained", Size,
+                (double) (After - Before), "KB");
+  fflush (stdout);
+  _exit (0);
+}
+
+static void
+runBaggyTable (const BenchOptions & Opts) {
+  pool_init_runtime (0, 0, 0);
+
+  //
+  // Reserve a region aligned to its size, so that it can hold objects of
+  // every size measured.
+  //
+  void * Map = mmap (0, 2 * RegionSize, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  if (Map == MAP_FAILED)
+    return;
+  uintptr_t Region = ((uintptr_t) Map + RegionSize - 1) & ~(RegionSize - 1);
+
+  static const uintptr_t Sizes[] = {
+    4096, 32 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024,
+    64 * 1024 * 1024
+  };
+  static const unsigned NumSizes = sizeof (Sizes) / sizeof (Sizes[0]);
+  for (unsigned index = 0; index < NumSizes; ++index)
+    runTable (Region, Sizes[index]);
+
+  munmap (Map, 2 * RegionSize);
+}
+
+static RegisterBenchmark X ("baggy-table", runBaggyTable);
+
+#endif
@@ -0,0 +1,156 @@
+//===- BatchChecks.cpp - Benchmark of batched load/store checks -----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the multi-array loops of the arrays kernel of the
+// overhead corpus with one call to poolcheck() per access against one call to
+// poolcheck_batch() per iteration, as produced by the BatchChecks pass.  The
+// triad loop reads two arrays and writes a third; the stencil loop reads four
+// elements of one array and writes another.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace llvm;
+
+// Number of elements of each array
+static const unsigned NumElements = 1 << 12;
+
+// Width of the grid of the stencil
+static const unsigned GridSize = 64;
+
+// Number of passes over the arrays
+static const unsigned NumPasses = 64;
+
+// Keeps the loops from being optimized away
+static volatile double Sink;
+
+//
+// Function: fillEntry()
+//
+// Description:
+//  Fill in an entry of a batch the way the BatchChecks pass does.
+//
+static inline void
+fillEntry (CheckBatchEntry & Entry, DebugPoolTy * Pool, void * Node) {
+  Entry.Pool = Pool;
+  Entry.Node = Node;
+  Entry.SourceFile = 0;
+  Entry.length = sizeof (double);
+  Entry.lineno = 0;
+}
+
+//
+// Function: runTriad()
+//
+// Description:
+//  Compute A[i] = B[i] + 3 * C[i] and return the cost per iteration.
+//
+static double
+runTriad (DebugPoolTy * Pool, double * A, double * B, double * C,
+          bool Batched) {
+  CheckBatchEntry Batch[3];
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned i = 0; i < NumElements; ++i) {
+      if (Batched) {
+        fillEntry (Batch[0], Pool, &B[i]);
+        fillEntry (Batch[1], Pool, &C[i]);
+        fillEntry (Batch[2], Pool, &A[i]);
+        poolcheck_batch (Batch, 3);
+      } else {
+        poolcheck (Pool, &B[i], sizeof (double));
+        poolcheck (Pool, &C[i], sizeof (double));
+        poolcheck (Pool, &A[i], sizeof (double));
+      }
+      A[i] = B[i] + 3 * C[i];
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = A[NumElements / 2];
+  return (End - Start) / ((double) NumPasses * NumElements);
+}
+
+//
+// Function: runStencil()
+//
+// Description:
+//  Average the four neighbours of each interior point of Grid into Next and
+//  return the cost per iteration.
+//
+static double
+runStencil (DebugPoolTy * Pool, double * Grid, double * Next, bool Batched) {
+  CheckBatchEntry Batch[5];
+  const unsigned Size = GridSize;
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned i = 1; i < Size - 1; ++i) {
+      for (unsigned j = 1; j < Size - 1; ++j) {
+        double * Up = &Grid[(i - 1) * Size + j];
+        double * Down = &Grid[(i + 1) * Size + j];
+        double * Left = &Grid[i * Size + j - 1];
+        double * Right = &Grid[i * Size + j + 1];
+        double * Out = &Next[i * Size + j];
+        if (Batched) {
+          fillEntry (Batch[0], Pool, Up);
+          fillEntry (Batch[1], Pool, Down);
+          fillEntry (Batch[2], Pool, Left);
+          fillEntry (Batch[3], Pool, Right);
+          fillEntry (Batch[4], Pool, Out);
+          poolcheck_batch (Batch, 5);
+        } else {
+          poolcheck (Pool, Up, sizeof (double));
+          poolcheck (Pool, Down, sizeof (double));
+          poolcheck (Pool, Left, sizeof (double));
+          poolcheck (Pool, Right, sizeof (double));
+          poolcheck (Pool, Out, sizeof (double));
+        }
+        *Out = 0.25 * (*Up + *Down + *Left + *Right);
+      }
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Next[(Size / 2) * Size + Size / 2];
+  return (End - Start) / ((double) NumPasses * (Size - 2) * (Size - 2));
+}
+
+static void
+runBatchChecks (const BenchOptions & Opts) {
+  static DebugPoolTy Pool;
+  __sc_dbg_poolinit (&Pool, 1, 0);
+
+  const unsigned Bytes = NumElements * sizeof (double);
+  double * Arrays[3];
+  for (unsigned index = 0; index < 3; ++index) {
+    Arrays[index] = (double *) calloc (NumElements, sizeof (double));
+    pool_register (&Pool, Arrays[index], Bytes);
+  }
+
+  reportResult ("batch-checks", "triad-poolcheck", 3,
+                runTriad (&Pool, Arrays[0], Arrays[1], Arrays[2], false));
+  reportResult ("batch-checks", "triad-batch", 3,
+                runTriad (&Pool, Arrays[0], Arrays[1], Arrays[2], true));
+  reportResult ("batch-checks", "stencil-poolcheck", 5,
+                runStencil (&Pool, Arrays[0], Arrays[1], false));
+  reportResult ("batch-checks", "stencil-batch", 5,
+                runStencil (&Pool, Arrays[0], Arrays[1], true));
+
+  __sc_dbg_pooldestroy (&Pool);
+  for (unsigned index = 0; index < 3; ++index)
+    free (Arrays[index]);
+}
+
+static RegisterBenchmark X ("batch-checks", runBatchChecks);
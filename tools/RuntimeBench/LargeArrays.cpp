@@ -0,0 +1,98 @@
+//===- LargeArrays.cpp - Benchmark of large array reuse -------------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures a program that repeatedly allocates, fills, and frees
+// buffers of several megabytes from a bitmap pool.  Besides the time per
+// allocation, it reports how much the resident set size of the process grew
+// during the run and how many of the allocations reused a freed large array;
+// the growth should not depend upon the number of iterations.  Finally, the
+// buffers are freed and the pool is used for small objects only; the pages of
+// the freed buffers should be given back.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "BitmapAllocator.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+using namespace bench;
+using namespace llvm;
+
+// Number of buffers that are live at any time
+static const unsigned NumLive = 4;
+
+// Range of the sizes of the buffers
+static const unsigned MinSize = 256 * 1024;
+static const unsigned MaxSize = 4 * 1024 * 1024;
+
+// Number of small allocations and frees made after the buffers are freed
+static const unsigned long NumSmallOps = 1 << 17;
+
+//
+// Function: getResidentMB()
+//
+// Description:
+//  Return the resident set size of the process in megabytes.
+//
+static double
+getResidentMB (void) {
+  unsigned long Size = 0, Resident = 0;
+  if (FILE * F = fopen ("/proc/self/statm", "r")) {
+    if (fscanf (F, "%lu %lu", &Size, &Resident) != 2)
+      Resident = 0;
+    fclose (F);
+  }
+  return (double) Resident * sysconf (_SC_PAGESIZE) / (1024 * 1024);
+}
+
+static void
+runLargeArrays (const BenchOptions & Opts) {
+  for (unsigned long Iters = 64; Iters <= 1024; Iters *= 4) {
+    static BitmapPoolTy Pool;
+    poolinit (&Pool, 16);
+    uint64_t State = Opts.Seed;
+
+    void * Live[NumLive];
+    memset (Live, 0, sizeof (Live));
+    double Resident = getResidentMB ();
+    uint64_t Start = getTimeNS ();
+    for (unsigned long iter = 0; iter < Iters; ++iter) {
+      unsigned Size = MinSize + nextRandom (State) % (MaxSize - MinSize);
+      void *& Slot = Live[iter % NumLive];
+      poolfree (&Pool, Slot);
+      Slot = poolalloc (&Pool, Size);
+      memset (Slot, (int) iter, Size);
+    }
+    uint64_t End = getTimeNS ();
+
+    unsigned long Reused, Fresh;
+    __pa_bitmap_largestats (&Pool, &Reused, &Fresh);
+    reportResult ("large-arrays", "alloc-fill-free", Iters,
+                  (double) (End - Start) / Iters);
+    reportResult ("large-arrays", "resident-growth", Iters,
+                  getResidentMB () - Resident, "MB");
+    reportResult ("large-arrays", "reused", Iters, Reused, "allocs");
+    reportResult ("large-arrays", "fresh", Iters, Fresh, "allocs");
+
+    for (unsigned index = 0; index < NumLive; ++index)
+      poolfree (&Pool, Live[index]);
+    for (unsigned long op = 0; op < NumSmallOps; ++op)
+      poolfree (&Pool, poolalloc (&Pool, 16));
+    reportResult ("large-arrays", "resident-after-small", Iters,
+                  getResidentMB () - Resident, "MB");
+    pooldestroy (&Pool);
+  }
+}
+
+static RegisterBenchmark X ("large-arrays", runLargeArrays);
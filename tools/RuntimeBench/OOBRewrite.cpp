@@ -0,0 +1,76 @@
+//===- OOBRewrite.cpp - Benchmark of out of bounds pointer rewriting ------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures a loop that repeatedly computes pointers one past the
+// end of short-lived objects: each object is registered, a few pointers past
+// its end are rewritten and converted back to their actual values, and the
+// object is unregistered.  Besides the time per object, it reports how many
+// rewrite pointers are in use and how many have ever been allocated at the
+// end of the run; neither should depend upon the number of objects.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+using namespace bench;
+using namespace llvm;
+
+// Number of objects that are live at any time
+static const unsigned NumLive = 64;
+
+// Size of each object and the number of OOB pointers computed from it
+static const unsigned ObjSize = 64;
+static const unsigned NumPtrs = 4;
+
+static DebugPoolTy Pool;
+static char Objs[NumLive][ObjSize + NumPtrs];
+
+static void
+runOOBRewrite (const BenchOptions & Opts) {
+  pool_init_runtime (0, 1, 0);
+  __sc_dbg_poolinit (&Pool, ObjSize, 0);
+  for (unsigned index = 0; index < NumLive; ++index)
+    pool_register_stack (&Pool, Objs[index], ObjSize);
+
+  uint64_t State = Opts.Seed;
+  for (unsigned long NumObjs = 1 << 12; NumObjs <= (1 << 20); NumObjs *= 4) {
+    unsigned long Errors = 0;
+    uint64_t Start = getTimeNS ();
+    for (unsigned long obj = 0; obj < NumObjs; ++obj) {
+      char * Obj = Objs[nextRandom (State) % NumLive];
+      pool_unregister_stack (&Pool, Obj);
+      pool_register_stack (&Pool, Obj, ObjSize);
+      for (unsigned ptr = 0; ptr < NumPtrs; ++ptr) {
+        char * End = Obj + ObjSize + ptr;
+        void * P = rewrite_ptr (&Pool, End, Obj, Obj + ObjSize - 1,
+                                __FILE__, __LINE__);
+        if (pchk_getActualValue (&Pool, P) != End)
+          ++Errors;
+      }
+    }
+    uint64_t End = getTimeNS ();
+
+    unsigned long InUse, Allocated;
+    __sc_dbg_rewritestats (&InUse, &Allocated);
+    reportResult ("oob-rewrite", "register-rewrite-unregister", NumObjs,
+                  (double) (End - Start) / NumObjs);
+    reportResult ("oob-rewrite", "in-use", NumObjs, InUse, "ptrs");
+    reportResult ("oob-rewrite", "allocated", NumObjs, Allocated, "ptrs");
+    if (Errors)
+      reportResult ("oob-rewrite-errors", "register-rewrite-unregister",
+                    NumObjs, Errors, "ptrs");
+  }
+
+  for (unsigned index = 0; index < NumLive; ++index)
+    pool_unregister_stack (&Pool, Objs[index]);
+}
+
+static RegisterBenchmark X ("oob-rewrite", runOOBRewrite);
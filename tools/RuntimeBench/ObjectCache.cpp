@@ -0,0 +1,75 @@
+//===- ObjectCache.cpp - Benchmark of the debug run-time's object cache ---===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This file measures load/store checks in a loop that walks several arrays at
+// once, which is the access pattern that thrashes a small object cache.  For
+// every number of arrays, it reports the cost of a check and the fraction of
+// checks satisfied by the object cache.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace llvm;
+
+// The largest number of arrays walked at once
+static const unsigned MaxArrays = 8;
+
+// Size of each array in bytes
+static const unsigned ArraySize = 1 << 16;
+
+// Number of passes over the arrays
+static const unsigned NumPasses = 64;
+
+static void
+runObjectCache (const BenchOptions & Opts) {
+  static DebugPoolTy Pool;
+  __sc_dbg_poolinit (&Pool, 1, 0);
+
+  unsigned char * Arrays[MaxArrays];
+  for (unsigned index = 0; index < MaxArrays; ++index) {
+    Arrays[index] = (unsigned char *) malloc (ArraySize);
+    pool_register (&Pool, Arrays[index], ArraySize);
+  }
+
+  for (unsigned NumArrays = 1; NumArrays <= MaxArrays; ++NumArrays) {
+    unsigned long Hits, Misses, OldHits, OldMisses;
+    __sc_dbg_cachestats (&OldHits, &OldMisses);
+
+    uint64_t Start = getTimeNS ();
+    for (unsigned pass = 0; pass < NumPasses; ++pass) {
+      for (unsigned offset = 0; offset < ArraySize; offset += 8) {
+        for (unsigned index = 0; index < NumArrays; ++index)
+          poolcheck (&Pool, Arrays[index] + offset, 8);
+      }
+    }
+    uint64_t End = getTimeNS ();
+
+    __sc_dbg_cachestats (&Hits, &Misses);
+    Hits -= OldHits;
+    Misses -= OldMisses;
+
+    double Checks = (double) NumPasses * (ArraySize / 8) * NumArrays;
+    reportResult ("object-cache", "poolcheck", NumArrays,
+                  (End - Start) / Checks);
+    reportResult ("object-cache", "hit-rate", NumArrays,
+                  100.0 * Hits / (Hits + Misses), "%");
+  }
+
+  __sc_dbg_pooldestroy (&Pool);
+  for (unsigned index = 0; index < MaxArrays; ++index)
+    free (Arrays[index]);
+}
+
+static RegisterBenchmark X ("object-cache", runObjectCache);
@@ -0,0 +1,91 @@
+//===- ObjectIndex.cpp - Benchmark of the object registration indices -----===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of registering objects in and finding objects
+// within the data structures that the debug runtime can use for its object
+// index: the splay tree and the shadow memory index.  The number of live
+// objects ranges from 10^3 to the maximum given to the driver.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "SplayTree.h"
+#include "ShadowObjectSet.h"
+
+using namespace bench;
+
+// Number of lookups timed for every configuration
+static const unsigned NumLookups = 1 << 22;
+
+// Objects are laid out at this stride within a fake address range; the
+// memory is never touched.
+static const uintptr_t ObjectStride = 64;
+static const uintptr_t ObjectSize = 48;
+#if defined(_LP64)
+static const uintptr_t ObjectBase = 0x100000000000ul;
+#else
+static const uintptr_t ObjectBase = 0x10000000ul;
+#endif
+
+//
+// Function: runIndex()
+//
+// Description:
+//  Register NumObjects objects in the specified index and then look up
+//  randomly chosen addresses within them.
+//
+template <class IndexTy>
+static void
+runIndex (const char * Variant, unsigned long NumObjects, unsigned Seed) {
+  IndexTy * Index = new IndexTy;
+
+  uint64_t Start = getTimeNS ();
+  for (unsigned long index = 0; index < NumObjects; ++index) {
+    char * obj = (char *) (ObjectBase + index * ObjectStride);
+    Index->insert (obj, obj + ObjectSize - 1);
+  }
+  uint64_t End = getTimeNS ();
+  reportResult ("object-index-insert", Variant, NumObjects,
+                (double) (End - Start) / NumObjects);
+
+  uint64_t State = Seed | 1;
+  unsigned long Found = 0;
+  Start = getTimeNS ();
+  for (unsigned index = 0; index < NumLookups; ++index) {
+    uint64_t R = nextRandom (State);
+    char * p = (char *) (ObjectBase + (R % NumObjects) * ObjectStride +
+                         ((R >> 32) % ObjectSize));
+    void * S, * E;
+    Found += Index->find (p, S, E);
+  }
+  End = getTimeNS ();
+  reportResult ("object-index-lookup", Variant, NumObjects,
+                (double) (End - Start) / NumLookups);
+  if (Found != NumLookups)
+    reportResult ("object-index-lookup-errors", Variant, NumObjects,
+                  NumLookups - Found, "lookups");
+
+  Start = getTimeNS ();
+  Index->clear ();
+  End = getTimeNS ();
+  reportResult ("object-index-clear", Variant, NumObjects,
+                (double) (End - Start) / NumObjects);
+  delete Index;
+}
+
+static void
+runObjectIndex (const BenchOptions & Opts) {
+  for (unsigned long N = 1000; N <= Opts.MaxObjects; N *= 10) {
+    runIndex<RangeSplaySet<> > ("splay", N, Opts.Seed);
+    runIndex<ShadowObjectSet> ("shadow", N, Opts.Seed);
+  }
+}
+
+static RegisterBenchmark X ("object-index", runObjectIndex);
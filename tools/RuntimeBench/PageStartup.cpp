@@ -0,0 +1,85 @@
+//===- PageStartup.cpp - Benchmark of getting fresh pages for pools -------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of growing fresh pools: the time and the page
+// faults taken to allocate the objects of a pool with an increasing number of
+// slabs, and the page faults taken when the program first writes to them.
+// It also reports how much memory the page manager has reserved and how much
+// of it is resident.
+//
+// Build the run-time and this tool with SC_PAGE_RESERVE=1 to measure the page
+// manager that hands out pages from reserved ranges, and without it to measure
+// the one that maps every request.  The pools are not destroyed, so that
+// every configuration gets fresh pages from the operating system; run this
+// benchmark on its own so that no other benchmark leaves free pages behind.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "BitmapAllocator.h"
+#include "PageManager.h"
+
+#include <sys/resource.h>
+
+#include <vector>
+
+using namespace bench;
+using namespace llvm;
+
+#if SC_RESERVE_PAGES
+static const char * const Variant = "reserve";
+#else
+static const char * const Variant = "map-per-request";
+#endif
+
+// Size of the objects allocated from the pools
+static const unsigned ObjSize = 64;
+
+static long
+getMinorFaults (void) {
+  struct rusage Usage;
+  getrusage (RUSAGE_SELF, &Usage);
+  return Usage.ru_minflt;
+}
+
+static void
+runPageStartup (const BenchOptions & Opts) {
+  for (unsigned NumSlabs = 1; NumSlabs <= 1024; NumSlabs *= 4) {
+    BitmapPoolTy * Pool = new BitmapPoolTy;
+    poolinit (Pool, ObjSize);
+
+    std::vector<char *> Objs;
+    long Faults = getMinorFaults ();
+    uint64_t Start = getTimeNS ();
+    while (Pool->NumSlabs < NumSlabs)
+      Objs.push_back ((char *) poolalloc (Pool, ObjSize));
+    uint64_t End = getTimeNS ();
+    long AllocFaults = getMinorFaults () - Faults;
+
+    Faults = getMinorFaults ();
+    for (unsigned long index = 0; index < Objs.size (); ++index)
+      Objs[index][0] = 1;
+    long TouchFaults = getMinorFaults () - Faults;
+
+    reportResult ("page-startup", Variant, NumSlabs,
+                  (double) (End - Start) / NumSlabs, "ns/slab");
+    reportResult ("page-faults-alloc", Variant, NumSlabs,
+                  (double) AllocFaults, "faults");
+    reportResult ("page-faults-touch", Variant, NumSlabs,
+                  (double) TouchFaults, "faults");
+  }
+
+  size_t Reserved, Resident;
+  poolmemusage (Reserved, Resident);
+  reportResult ("page-memory", "reserved", 0, Reserved >> 20, "MB");
+  reportResult ("page-memory", "resident", 0, Resident >> 20, "MB");
+}
+
+static RegisterBenchmark X ("page-startup", runPageStartup);
@@ -0,0 +1,727 @@
+//===- Primitives.cpp - Cost of each primitive of a run-time --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the time per operation of each primitive of the run-time
+// that the benchmarks are built against (see SC_BENCH_RUNTIME in the
+// Makefile): its checks, the registration of objects, and allocation from its
+// pools.  Primitives that a run-time does not have are not reported.
+//
+// Every primitive is measured with a range of numbers of live objects, with
+// each access pattern, and with up to -threads threads when the run-time may
+// be shared by threads.  The checks look at the live objects; registration
+// and allocation work on a batch of objects of each thread while the live
+// objects are registered.  The access pattern orders the objects: sequential
+// follows their addresses, random permutes them, and multi-array interleaves
+// several sequential walks, as a loop over a number of arrays does.
+//
+// The results are reported as the benchmark "primitives" with the variant
+// <primitive>-<pattern> and the number of live objects as the parameter.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#if defined(SC_BENCH_BB_RUNTIME)
+#include "safecode/Config/config.h"
+#include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/BBRuntime.h"
+#elif !defined(SC_BENCH_SOFTBOUND_RUNTIME)
+#include "DebugRuntime.h"
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+using namespace bench;
+
+// Size of the objects; a power of two so that they fill baggy bounds slots
+static const unsigned ObjectSize = 64;
+
+// Distance between the objects.  Baggy bounds keeps the metadata of an object
+// at the end of its slot, so each object takes a slot twice its size.
+#if defined(SC_BENCH_BB_RUNTIME)
+static const unsigned SlotSize = 2 * ObjectSize;
+#else
+static const unsigned SlotSize = ObjectSize;
+#endif
+
+// Number of checks performed by each thread in every configuration
+static const unsigned long ChecksPerThread = 1 << 20;
+
+// Number of objects that each thread registers or allocates in every
+// configuration
+static const unsigned long BatchSize = 1 << 14;
+
+// The largest number of live objects
+static const unsigned long MaxLiveObjects = 1 << 20;
+
+// Number of walks interleaved by the multi-array access pattern
+static const unsigned long NumArrays = 4;
+
+// Keeps the results of the checks from being optimized away
+static volatile uintptr_t Sink;
+
+//
+// Structure: ObjectInfo
+//
+// Description:
+//  An object used by the benchmark along with whatever the run-time needs to
+//  check accesses to it.
+//
+struct ObjectInfo {
+  unsigned char * Base;
+#if defined(SC_BENCH_SOFTBOUND_RUNTIME)
+  void * Lock;
+  size_t Key;
+#endif
+};
+
+// Targets of the indirect call checks
+static void targetA (void) {}
+static void targetB (void) {}
+static void targetC (void) {}
+static void targetD (void) {}
+static void * Targets[] = {
+  (void *) targetA, (void *) targetB, (void *) targetC, (void *) targetD, 0
+};
+
+//
+// Function: pickTarget()
+//
+// Description:
+//  Pick the target of an indirect call from the pointer being checked.
+//
+static inline void *
+pickTarget (unsigned char * P) {
+  return Targets[((uintptr_t) P >> 3) & 3];
+}
+
+#if defined(SC_BENCH_BB_RUNTIME)
+
+///////////////////////////////////////////////////////////////////////////
+// The baggy bounds run-time
+///////////////////////////////////////////////////////////////////////////
+
+using namespace NAMESPACE_SC;
+
+static DebugPoolTy Pool;
+
+// The checks of the run-time look objects up without locks, but objects are
+// registered in splay trees that threads may not share
+static const bool ThreadSafe = false;
+
+static void
+initRuntime (void) {
+  pool_init_runtime (0, 0, 0);
+  __sc_bb_poolinit (&Pool, ObjectSize, 0);
+}
+
+static inline void
+registerObject (ObjectInfo & O) {
+  BBMetaData * Data = (BBMetaData *) (O.Base + SlotSize) - 1;
+  Data->size = ObjectSize;
+  Data->pool = &Pool;
+  __sc_bb_poolregister (&Pool, O.Base, ObjectSize);
+}
+
+static inline void
+unregisterObject (ObjectInfo & O) {
+  __sc_bb_poolunregister (&Pool, O.Base);
+}
+
+struct Poolcheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    bb_poolcheck (&Pool, P);
+    return 0;
+  }
+};
+
+struct Poolcheckui {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    bb_poolcheckui (&Pool, P);
+    return 0;
+  }
+};
+
+struct Boundscheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    return (uintptr_t) bb_boundscheck (&Pool, O.Base, P);
+  }
+};
+
+struct Exactcheck2 {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    char * Base = (char *) O.Base;
+    return (uintptr_t) bb_exactcheck2 (Base, Base, (char *) P, ObjectSize);
+  }
+};
+
+struct Funccheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    __sc_bb_funccheck (pickTarget (P), Targets, 0, NULL, 0);
+    return 0;
+  }
+};
+
+struct Register {
+  void operator() (ObjectInfo & O) const {
+    __sc_bb_poolregister (&Pool, O.Base, ObjectSize);
+  }
+};
+
+struct Unregister {
+  void operator() (ObjectInfo & O) const {
+    __sc_bb_poolunregister (&Pool, O.Base);
+  }
+};
+
+struct RegisterStack {
+  void operator() (ObjectInfo & O) const {
+    __sc_bb_poolregister_stack (&Pool, O.Base, ObjectSize);
+  }
+};
+
+struct UnregisterStack {
+  void operator() (ObjectInfo & O) const {
+    __sc_bb_poolunregister_stack (&Pool, O.Base);
+  }
+};
+
+struct Poolalloc {
+  void operator() (ObjectInfo & O) const {
+    O.Base = (unsigned char *) __sc_bb_poolalloc (&Pool, ObjectSize);
+  }
+};
+
+struct Poolrealloc {
+  void operator() (ObjectInfo & O) const {
+    O.Base = (unsigned char *) __sc_bb_poolrealloc (&Pool, O.Base,
+                                                    2 * ObjectSize);
+  }
+};
+
+struct Poolfree {
+  void operator() (ObjectInfo & O) const {
+    __sc_bb_poolfree (&Pool, O.Base);
+  }
+};
+
+#elif defined(SC_BENCH_SOFTBOUND_RUNTIME)
+
+///////////////////////////////////////////////////////////////////////////
+// The SoftBound+CETS run-time
+///////////////////////////////////////////////////////////////////////////
+
+//
+// The run-time is built with __SOFTBOUNDCETS_TRIE and
+// __SOFTBOUNDCETS_SPATIAL_TEMPORAL; these are the entry points that the
+// compiled code calls with that configuration.  The run-time initializes
+// itself before it calls the benchmark driver.
+//
+extern "C" {
+  void __softboundcets_spatial_load_dereference_check (void * base,
+                                                       void * bound,
+                                                       void * ptr,
+                                                       size_t size);
+  void __softboundcets_temporal_load_dereference_check (void * lock,
+                                                        size_t key,
+                                                        void * base,
+                                                        void * bound);
+  void __softboundcets_metadata_store (void * addr_of_ptr,
+                                       void * base,
+                                       void * bound,
+                                       size_t key,
+                                       void * lock);
+  void __softboundcets_metadata_load (void * addr_of_ptr,
+                                      void ** base,
+                                      void ** bound,
+                                      size_t * key,
+                                      void ** lock);
+  void __softboundcets_memory_allocation (void * ptr,
+                                          void ** lock,
+                                          size_t * key);
+  void __softboundcets_memory_deallocation (void * lock, size_t key);
+}
+
+// The lock and key tables of the run-time are not protected from threads
+static const bool ThreadSafe = false;
+
+static void
+initRuntime (void) {
+}
+
+//
+// Function: registerObject()
+//
+// Description:
+//  Give an object a lock and key and record its metadata as that of the
+//  pointer to it in the ObjectInfo, as the compiled code does when it stores
+//  the pointer returned by malloc().
+//
+static inline void
+registerObject (ObjectInfo & O) {
+  __softboundcets_memory_allocation (O.Base, &O.Lock, &O.Key);
+  __softboundcets_metadata_store (&O.Base, O.Base, O.Base + ObjectSize,
+                                  O.Key, O.Lock);
+}
+
+static inline void
+unregisterObject (ObjectInfo & O) {
+  __softboundcets_memory_deallocation (O.Lock, O.Key);
+}
+
+struct SpatialCheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    __softboundcets_spatial_load_dereference_check (O.Base,
+                                                    O.Base + ObjectSize,
+                                                    P, 8);
+    return 0;
+  }
+};
+
+struct TemporalCheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    __softboundcets_temporal_load_dereference_check (O.Lock, O.Key, O.Base,
+                                                     O.Base + ObjectSize);
+    return 0;
+  }
+};
+
+struct MetadataLoad {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    void * Base;
+    void * Bound;
+    size_t Key;
+    void * Lock;
+    __softboundcets_metadata_load (&O.Base, &Base, &Bound, &Key, &Lock);
+    return (uintptr_t) Base ^ Key;
+  }
+};
+
+struct MetadataStore {
+  void operator() (ObjectInfo & O) const {
+    __softboundcets_metadata_store (&O.Base, O.Base, O.Base + ObjectSize,
+                                    1, 0);
+  }
+};
+
+struct MemoryAllocation {
+  void operator() (ObjectInfo & O) const {
+    __softboundcets_memory_allocation (O.Base, &O.Lock, &O.Key);
+  }
+};
+
+struct MemoryDeallocation {
+  void operator() (ObjectInfo & O) const {
+    __softboundcets_memory_deallocation (O.Lock, O.Key);
+  }
+};
+
+#else
+
+///////////////////////////////////////////////////////////////////////////
+// The debug run-time
+///////////////////////////////////////////////////////////////////////////
+
+using namespace llvm;
+
+static DebugPoolTy Pool;
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+static const bool ThreadSafe = true;
+#else
+static const bool ThreadSafe = false;
+#endif
+
+static void
+initRuntime (void) {
+  pool_init_runtime (0, 0, 0);
+  __sc_dbg_poolinit (&Pool, ObjectSize, 0);
+}
+
+static inline void
+registerObject (ObjectInfo & O) {
+  pool_register (&Pool, O.Base, ObjectSize);
+}
+
+static inline void
+unregisterObject (ObjectInfo & O) {
+  pool_unregister (&Pool, O.Base);
+}
+
+struct Poolcheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    poolcheck (&Pool, P, 8);
+    return 0;
+  }
+};
+
+struct Poolcheckui {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    poolcheckui (&Pool, P, 8);
+    return 0;
+  }
+};
+
+struct Boundscheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    return (uintptr_t) boundscheck (&Pool, O.Base, P);
+  }
+};
+
+struct Exactcheck2 {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    char * Base = (char *) O.Base;
+    return (uintptr_t) exactcheck2 (Base, Base, (char *) P, ObjectSize);
+  }
+};
+
+struct Fastlscheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    fastlscheck ((char *) O.Base, (char *) P, ObjectSize, 8);
+    return 0;
+  }
+};
+
+struct Funccheck {
+  uintptr_t operator() (ObjectInfo & O, unsigned char * P) const {
+    funccheck (pickTarget (P), Targets);
+    return 0;
+  }
+};
+
+struct Register {
+  void operator() (ObjectInfo & O) const {
+    pool_register (&Pool, O.Base, ObjectSize);
+  }
+};
+
+struct Unregister {
+  void operator() (ObjectInfo & O) const {
+    pool_unregister (&Pool, O.Base);
+  }
+};
+
+struct RegisterStack {
+  void operator() (ObjectInfo & O) const {
+    pool_register_stack (&Pool, O.Base, ObjectSize);
+  }
+};
+
+struct UnregisterStack {
+  void operator() (ObjectInfo & O) const {
+    pool_unregister_stack (&Pool, O.Base);
+  }
+};
+
+struct Poolalloc {
+  void operator() (ObjectInfo & O) const {
+    O.Base = (unsigned char *) __sc_dbg_src_poolalloc (&Pool, ObjectSize,
+                                                       0, NULL, 0);
+  }
+};
+
+struct Poolrealloc {
+  void operator() (ObjectInfo & O) const {
+    O.Base = (unsigned char *) poolrealloc (&Pool, O.Base, 2 * ObjectSize);
+  }
+};
+
+struct Poolfree {
+  void operator() (ObjectInfo & O) const {
+    __sc_dbg_src_poolfree (&Pool, O.Base, 0, NULL, 0);
+  }
+};
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+// Running the primitives
+///////////////////////////////////////////////////////////////////////////
+
+// The access patterns
+enum Pattern {
+  Sequential,
+  Random,
+  MultiArray
+};
+
+static const char * const PatternNames[] = {
+  "sequential",
+  "random",
+  "multi-array"
+};
+
+// The live objects and the order in which the checks visit them; the number
+// of live objects is a power of two
+static ObjectInfo * Live;
+static unsigned long NumLive;
+static unsigned long * LiveOrder;
+
+// The batches of the threads, their memory, and the order in which the
+// objects of a batch are used
+static ObjectInfo * Batches;
+static unsigned char * BatchMemory;
+static unsigned long * BatchOrder;
+
+// The pattern and the number of threads being measured
+static Pattern CurrentPattern;
+static unsigned NumThreads;
+
+// Set to start the threads of a configuration
+static volatile int Go;
+
+//
+// Function: fillOrder()
+//
+// Description:
+//  Fill in the order in which Count objects are used by an access pattern.
+//
+static void
+fillOrder (unsigned long * Order, unsigned long Count, Pattern P,
+           uint64_t & State) {
+  for (unsigned long index = 0; index < Count; ++index)
+    Order[index] = index;
+
+  if (P == Random) {
+    for (unsigned long index = Count - 1; index > 0; --index) {
+      unsigned long other = nextRandom (State) % (index + 1);
+      unsigned long Tmp = Order[index];
+      Order[index] = Order[other];
+      Order[other] = Tmp;
+    }
+  } else if ((P == MultiArray) && (Count >= NumArrays)) {
+    unsigned long Length = Count / NumArrays;
+    for (unsigned long index = 0; index < Count; ++index)
+      Order[index] = (index % NumArrays) * Length + index / NumArrays;
+  }
+}
+
+//
+// Function: resetBatches()
+//
+// Description:
+//  Point the objects of every batch back at the memory of the batch.
+//
+static void
+resetBatches (unsigned Threads) {
+  for (unsigned long index = 0; index < Threads * BatchSize; ++index)
+    Batches[index].Base = BatchMemory + index * SlotSize;
+}
+
+//
+// Function: checkBody()
+//
+// Description:
+//  Perform the checks of one thread.  The threads start their walks at
+//  different live objects.
+//
+template <class Check>
+static void
+checkBody (unsigned Id) {
+  Check C;
+  unsigned long Mask = NumLive - 1;
+  unsigned long First = Id * (NumLive / NumThreads);
+  uintptr_t Result = 0;
+  for (unsigned long index = 0; index < ChecksPerThread; ++index) {
+    ObjectInfo & O = Live[LiveOrder[(First + index) & Mask]];
+    Result ^= C (O, O.Base + ((index * 8) & (ObjectSize - 1)));
+  }
+  Sink = Result;
+}
+
+//
+// Function: batchBody()
+//
+// Description:
+//  Apply a registration or allocation primitive to the batch of one thread.
+//
+template <class Op>
+static void
+batchBody (unsigned Id) {
+  Op TheOp;
+  ObjectInfo * Batch = Batches + Id * BatchSize;
+  for (unsigned long index = 0; index < BatchSize; ++index)
+    TheOp (Batch[BatchOrder[index]]);
+}
+
+struct Worker {
+  pthread_t Thread;
+  unsigned Id;
+  void (*Body) (unsigned Id);
+};
+
+static void *
+runWorker (void * Arg) {
+  Worker * W = (Worker *) Arg;
+  while (!Go)
+    ;
+  W->Body (W->Id);
+  return 0;
+}
+
+//
+// Function: runThreads()
+//
+// Description:
+//  Run a body on every thread of the configuration at once.
+//
+// Return value:
+//  The time in nanoseconds from the start of the threads until the last of
+//  them finished.
+//
+static uint64_t
+runThreads (void (*Body) (unsigned Id)) {
+  if (NumThreads == 1) {
+    uint64_t Start = getTimeNS ();
+    Body (0);
+    return getTimeNS () - Start;
+  }
+
+  std::vector<Worker> Workers (NumThreads);
+  Go = 0;
+  for (unsigned index = 0; index < NumThreads; ++index) {
+    Workers[index].Id = index;
+    Workers[index].Body = Body;
+    pthread_create (&(Workers[index].Thread), 0, runWorker, &Workers[index]);
+  }
+
+  uint64_t Start = getTimeNS ();
+  Go = 1;
+  for (unsigned index = 0; index < NumThreads; ++index)
+    pthread_join (Workers[index].Thread, 0);
+  return getTimeNS () - Start;
+}
+
+static void
+reportPrimitive (const char * Name, double NSPerOp) {
+  std::string Variant = std::string (Name) + "-" +
+                        PatternNames[CurrentPattern];
+  reportResult ("primitives", Variant.c_str(), NumLive, NSPerOp, "ns/op",
+                NumThreads);
+}
+
+template <class Check>
+static void
+measureCheck (const char * Name) {
+  uint64_t Time = runThreads (checkBody<Check>);
+  reportPrimitive (Name, Time / (double) ChecksPerThread);
+}
+
+template <class Op>
+static void
+measureBatch (const char * Name) {
+  uint64_t Time = runThreads (batchBody<Op>);
+  reportPrimitive (Name, Time / (double) BatchSize);
+}
+
+//
+// Function: measurePrimitives()
+//
+// Description:
+//  Measure every primitive of the run-time in the current configuration.
+//  The pools of the allocators may not be shared by threads, so allocation
+//  is only measured with one thread.
+//
+static void
+measurePrimitives (void) {
+#if defined(SC_BENCH_SOFTBOUND_RUNTIME)
+  measureCheck<SpatialCheck> ("spatial-check");
+  measureCheck<TemporalCheck> ("temporal-check");
+  measureCheck<MetadataLoad> ("metadata-load");
+
+  resetBatches (NumThreads);
+  measureBatch<MetadataStore> ("metadata-store");
+  measureBatch<MemoryAllocation> ("memory-allocation");
+  measureBatch<MemoryDeallocation> ("memory-deallocation");
+#else
+  measureCheck<Poolcheck> ("poolcheck");
+  measureCheck<Poolcheckui> ("poolcheckui");
+  measureCheck<Boundscheck> ("boundscheck");
+  measureCheck<Exactcheck2> ("exactcheck2");
+#if !defined(SC_BENCH_BB_RUNTIME)
+  measureCheck<Fastlscheck> ("fastlscheck");
+#endif
+  measureCheck<Funccheck> ("funccheck");
+
+  resetBatches (NumThreads);
+  measureBatch<Register> ("pool_register");
+  measureBatch<Unregister> ("pool_unregister");
+  measureBatch<RegisterStack> ("pool_register_stack");
+  measureBatch<UnregisterStack> ("pool_unregister_stack");
+
+  if (NumThreads == 1) {
+    measureBatch<Poolalloc> ("poolalloc");
+    measureBatch<Poolrealloc> ("poolrealloc");
+    measureBatch<Poolfree> ("poolfree");
+  }
+#endif
+}
+
+static void
+runPrimitives (const BenchOptions & Opts) {
+  initRuntime ();
+
+  unsigned MaxThreads = Opts.MaxThreads ? Opts.MaxThreads : 1;
+  if (!ThreadSafe)
+    MaxThreads = 1;
+
+  unsigned long MaxLive = MaxLiveObjects;
+  while (MaxLive > 1 && MaxLive > Opts.MaxObjects)
+    MaxLive >>= 1;
+
+  //
+  // Lay out the objects at multiples of their slot size so that every
+  // run-time can register them.
+  //
+  void * Memory;
+  if (posix_memalign (&Memory, SlotSize, MaxLive * SlotSize))
+    return;
+  unsigned char * LiveMemory = (unsigned char *) Memory;
+  if (posix_memalign (&Memory, SlotSize, MaxThreads * BatchSize * SlotSize))
+    return;
+  BatchMemory = (unsigned char *) Memory;
+
+  Live = new ObjectInfo[MaxLive];
+  LiveOrder = new unsigned long[MaxLive];
+  Batches = new ObjectInfo[MaxThreads * BatchSize];
+  BatchOrder = new unsigned long[BatchSize];
+
+  uint64_t State = ((uint64_t) Opts.Seed << 32) | 1;
+  for (NumLive = 1; NumLive <= MaxLive; NumLive *= 16) {
+    for (unsigned long index = 0; index < NumLive; ++index) {
+      Live[index].Base = LiveMemory + index * SlotSize;
+      registerObject (Live[index]);
+    }
+
+    for (unsigned P = Sequential; P <= MultiArray; ++P) {
+      CurrentPattern = (Pattern) P;
+      fillOrder (LiveOrder, NumLive, CurrentPattern, State);
+      fillOrder (BatchOrder, BatchSize, CurrentPattern, State);
+      for (NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2)
+        measurePrimitives ();
+    }
+
+    for (unsigned long index = 0; index < NumLive; ++index)
+      unregisterObject (Live[index]);
+  }
+
+  delete [] Live;
+  delete [] LiveOrder;
+  delete [] Batches;
+  delete [] BatchOrder;
+  free (LiveMemory);
+  free (BatchMemory);
+}
+
+static RegisterBenchmark X ("primitives", runPrimitives);
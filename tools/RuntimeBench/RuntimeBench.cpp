@@ -0,0 +1,121 @@
+//===- RuntimeBench.cpp - Driver for the runtime microbenchmarks ----------===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This program runs the microbenchmarks of the SAFECode runtime libraries.
+//
+// Usage: sc-runtime-bench [-max-objects N] [-threads N] [-seed N]
+//                         [benchmark...]
+//
+// With no benchmark names, every registered benchmark is run.  Results are
+// printed one per line as comma separated values:
+//
+//   runtime,benchmark,variant,param,threads,value,unit
+//
+// where runtime names the run-time library that the program was built
+// against (see SC_BENCH_RUNTIME in the Makefile).
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+// The name of the run-time library that the benchmarks are built against
+#if defined(SC_BENCH_BB_RUNTIME)
+static const char * const RuntimeName = "bb";
+#elif defined(SC_BENCH_SOFTBOUND_RUNTIME)
+static const char * const RuntimeName = "softbound";
+#else
+static const char * const RuntimeName = "debug";
+#endif
+
+namespace bench {
+
+RegisterBenchmark * RegisterBenchmark::List = 0;
+
+RegisterBenchmark::RegisterBenchmark (const char * name, BenchFunc run) :
+  Name(name), Run(run), Next(List) {
+  List = this;
+}
+
+uint64_t
+getTimeNS (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void
+reportResult (const char * Bench,
+              const char * Variant,
+              unsigned long Param,
+              double Value,
+              const char * Unit,
+              unsigned Threads) {
+  printf ("%s,%s,%s,%lu,%u,%.2f,%s\n",
+          RuntimeName, Bench, Variant, Param, Threads, Value, Unit);
+  fflush (stdout);
+}
+
+}
+
+using namespace bench;
+
+#if defined(SC_BENCH_SOFTBOUND_RUNTIME)
+// The SoftBound+CETS run-time defines main() and calls this once it has
+// initialized itself
+extern "C" int softboundcets_pseudo_main (int argc, char ** argv);
+#define main softboundcets_pseudo_main
+#endif
+
+static void
+usage (const char * argv0) {
+  fprintf (stderr,
+           "Usage: %s [-max-objects N] [-threads N] [-seed N] "
+           "[benchmark...]\n"
+           "Benchmarks:\n", argv0);
+  for (RegisterBenchmark * B = RegisterBenchmark::List; B; B = B->Next)
+    fprintf (stderr, "  %s\n", B->Name);
+  exit (1);
+}
+
+int
+main (int argc, char ** argv) {
+  BenchOptions Opts;
+  Opts.MaxObjects = 10000000;
+  Opts.MaxThreads = 4;
+  Opts.Seed = 1;
+
+  int index;
+  for (index = 1; index < argc && argv[index][0] == '-'; ++index) {
+    if ((!strcmp (argv[index], "-max-objects")) && (index + 1 < argc))
+      Opts.MaxObjects = strtoul (argv[++index], 0, 0);
+    else if ((!strcmp (argv[index], "-threads")) && (index + 1 < argc))
+      Opts.MaxThreads = strtoul (argv[++index], 0, 0);
+    else if ((!strcmp (argv[index], "-seed")) && (index + 1 < argc))
+      Opts.Seed = strtoul (argv[++index], 0, 0);
+    else
+      usage (argv[0]);
+  }
+
+  printf ("runtime,benchmark,variant,param,threads,value,unit\n");
+  for (RegisterBenchmark * B = RegisterBenchmark::List; B; B = B->Next) {
+    bool Selected = (index == argc);
+    for (int arg = index; arg < argc; ++arg)
+      if (!strcmp (argv[arg], B->Name))
+        Selected = true;
+    if (Selected)
+      B->Run (Opts);
+  }
+
+  return 0;
+}
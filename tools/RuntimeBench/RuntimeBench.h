@@ -0,0 +1,86 @@
+//===- RuntimeBench.h - Microbenchmark harness for the runtimes -*- C++ -*-===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This file defines the small harness shared by the SAFECode runtime
+// microbenchmarks.  Each benchmark registers itself with a static
+// RegisterBenchmark object and reports its results through reportResult().
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_RUNTIMEBENCH_H_
+#define _SC_RUNTIMEBENCH_H_
+
+#include <stdint.h>
+
+namespace bench {
+
+//
+// Structure: BenchOptions
+//
+// Description:
+//  Options passed to every benchmark.
+//
+// Fields:
+//  MaxObjects : The largest number of live objects a benchmark should create.
+//  MaxThreads : The largest number of threads a benchmark should run.
+//  Seed       : Seed for the pseudo-random number generator.
+//
+struct BenchOptions {
+  unsigned long MaxObjects;
+  unsigned MaxThreads;
+  unsigned Seed;
+};
+
+typedef void (*BenchFunc) (const BenchOptions & Opts);
+
+//
+// Class: RegisterBenchmark
+//
+// Description:
+//  Constructing a static instance of this class adds a benchmark to the list
+//  of benchmarks run by the driver.
+//
+struct RegisterBenchmark {
+  const char * Name;
+  BenchFunc Run;
+  RegisterBenchmark * Next;
+
+  RegisterBenchmark (const char * name, BenchFunc run);
+  static RegisterBenchmark * List;
+};
+
+// Return a monotonic timestamp in nanoseconds
+uint64_t getTimeNS (void);
+
+// Record the result of one benchmark configuration
+void reportResult (const char * Bench,
+                   const char * Variant,
+                   unsigned long Param,
+                   double Value,
+                   const char * Unit = "ns/op",
+                   unsigned Threads = 1);
+
+//
+// Function: nextRandom()
+//
+// Description:
+//  A small xorshift generator.  It is cheap enough that it does not distort
+//  the measurements of the operations being benchmarked.
+//
+static inline uint64_t
+nextRandom (uint64_t & State) {
+  State ^= State << 13;
+  State ^= State >> 7;
+  State ^= State << 17;
+  return State;
+}
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+//===- SampledChecks.cpp - Benchmark of sampled run-time checks -----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of load/store and bounds checks when sc lowers
+// them with -sample-checks.  The loop below walks a set of arrays with the
+// same code that the sampled lowering produces around each check: the
+// load/store check is sampled and the bounds check always runs.  For every
+// sampling period, it reports the cost per access, along with the cost of
+// the same loop without checks and with checks that are not sampled.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace llvm;
+
+// Number of arrays walked at once
+static const unsigned NumArrays = 64;
+
+// Size of each array in bytes
+static const unsigned ArraySize = 1 << 12;
+
+// Number of passes over the arrays
+static const unsigned NumPasses = 32;
+
+// The counter of the sample site in the loop
+static int LoadSite;
+
+// Keeps the loads of the loop from being optimized away
+static volatile unsigned long Sink;
+
+//
+// Function: sampledPoolcheck()
+//
+// Description:
+//  Do what the sampled lowering of a load/store check does.
+//
+static inline void
+sampledPoolcheck (int & Site, DebugPoolTy * Pool, void * Node, unsigned Len) {
+  int Count = Site;
+  if (Count <= 0) {
+    __sc_sample_begin (&Site);
+    poolcheck (Pool, Node, Len);
+    __sc_sample_end ();
+  } else {
+    Site = Count - 1;
+  }
+}
+
+// How the loop checks its accesses
+enum CheckMode {
+  NoChecks,
+  FullChecks,
+  SampledChecks
+};
+
+//
+// Function: walkArrays()
+//
+// Description:
+//  Read every eighth byte of every array and return the cost per access.
+//
+static double
+walkArrays (DebugPoolTy * Pool, unsigned char ** Arrays, CheckMode Mode) {
+  LoadSite = 0;
+
+  unsigned long Sum = 0;
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned offset = 0; offset < ArraySize; offset += 8) {
+      for (unsigned index = 0; index < NumArrays; ++index) {
+        unsigned char * Base = Arrays[index];
+        unsigned char * P = Base + offset;
+        if (Mode == SampledChecks) {
+          P = (unsigned char *) boundscheck (Pool, Base, P);
+          sampledPoolcheck (LoadSite, Pool, P, 8);
+        } else if (Mode == FullChecks) {
+          P = (unsigned char *) boundscheck (Pool, Base, P);
+          poolcheck (Pool, P, 8);
+        }
+        Sum += *P;
+      }
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Sum;
+  return (End - Start) / ((double) NumPasses * (ArraySize / 8) * NumArrays);
+}
+
+static void
+runSampledChecks (const BenchOptions & Opts) {
+  static DebugPoolTy Pool;
+  __sc_dbg_poolinit (&Pool, 1, 0);
+
+  unsigned char * Arrays[NumArrays];
+  for (unsigned index = 0; index < NumArrays; ++index) {
+    Arrays[index] = (unsigned char *) calloc (1, ArraySize);
+    pool_register (&Pool, Arrays[index], ArraySize);
+  }
+
+  reportResult ("sampled-checks", "unchecked", 0,
+                walkArrays (&Pool, Arrays, NoChecks));
+  reportResult ("sampled-checks", "full", 1,
+                walkArrays (&Pool, Arrays, FullChecks));
+  for (unsigned Period = 1; Period <= 1024; Period *= 4) {
+    __sc_set_sample_rate (Period);
+    reportResult ("sampled-checks", "sampled", Period,
+                  walkArrays (&Pool, Arrays, SampledChecks));
+  }
+
+  __sc_dbg_pooldestroy (&Pool);
+  for (unsigned index = 0; index < NumArrays; ++index)
+    free (Arrays[index]);
+}
+
+static RegisterBenchmark X ("sampled-checks", runSampledChecks);
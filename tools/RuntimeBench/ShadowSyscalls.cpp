@@ -0,0 +1,130 @@
+//===- ShadowSyscalls.cpp - Benchmark of dangling pointer detection -------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the system calls that dangling pointer detection makes
+// to create and protect the shadows of heap objects.  Objects of random sizes
+// are allocated and freed through the debug run-time with dangling pointer
+// detection enabled, either in random order or in the order in which they
+// were allocated; the number of remapping, protection, and recycling calls is
+// reported per million allocations along with the time per allocation.
+//
+// Build the run-time and this tool with SC_SHADOW_BATCH=1 to measure batched
+// shadows and without it to measure a remapping and a protection per object.
+// The latter exhausts the mappings the kernel allows a process to have, so it
+// is only run with a small number of allocations.  Dangling pointer detection
+// cannot be enabled once another benchmark has initialized the run-time, so
+// run this benchmark on its own.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace bench;
+using namespace llvm;
+
+#if SC_BATCH_SHADOWS
+static const char * const RandomVariant = "batched-random";
+static const char * const FifoVariant = "batched-fifo";
+static const unsigned long MaxAllocs = 1 << 20;
+#else
+static const char * const RandomVariant = "per-object-random";
+static const char * const FifoVariant = "per-object-fifo";
+static const unsigned long MaxAllocs = 1 << 14;
+#endif
+
+// Number of objects that are live at any time
+static const unsigned NumLive = 256;
+
+// Range of the sizes of the objects
+static const unsigned MinSize = 16;
+static const unsigned MaxSize = 512;
+
+static DebugPoolTy Pool;
+
+//
+// Function: runPattern()
+//
+// Description:
+//  Allocate an increasing number of objects, freeing a live object before
+//  each allocation once NumLive objects are live.  The object freed is chosen
+//  at random or is the oldest one.
+//
+static void
+runPattern (const char * Variant, bool Fifo, const BenchOptions & Opts) {
+  void * Live[NumLive];
+  memset (Live, 0, sizeof (Live));
+  uint64_t State = Opts.Seed;
+  for (unsigned long NumAllocs = 1 << 12;
+       NumAllocs <= MaxAllocs;
+       NumAllocs *= 4) {
+    unsigned long OldRemaps, OldProtects, OldRecycles;
+    __sc_dbg_shadowstats (&OldRemaps, &OldProtects, &OldRecycles);
+
+    uint64_t Start = getTimeNS ();
+    for (unsigned long index = 0; index < NumAllocs; ++index) {
+      void *& Slot = Live[Fifo ? (index % NumLive)
+                               : (nextRandom (State) % NumLive)];
+      if (Slot)
+        __sc_dbg_poolrealloc_debug (&Pool, Slot, 0, 0, __FILE__, __LINE__);
+      unsigned Size = MinSize + nextRandom (State) % (MaxSize - MinSize);
+      Slot = __sc_dbg_poolrealloc_debug (&Pool, 0, Size, 0,
+                                         __FILE__, __LINE__);
+    }
+    uint64_t End = getTimeNS ();
+
+    unsigned long Remaps, Protects, Recycles;
+    __sc_dbg_shadowstats (&Remaps, &Protects, &Recycles);
+    double Scale = 1000000.0 / NumAllocs;
+    reportResult ("shadow-syscalls", Variant, NumAllocs,
+                  (double) (End - Start) / NumAllocs);
+    reportResult ("shadow-remaps", Variant, NumAllocs,
+                  (Remaps - OldRemaps) * Scale, "calls/1M-allocs");
+    reportResult ("shadow-protects", Variant, NumAllocs,
+                  (Protects - OldProtects) * Scale, "calls/1M-allocs");
+    reportResult ("shadow-recycles", Variant, NumAllocs,
+                  (Recycles - OldRecycles) * Scale, "calls/1M-allocs");
+  }
+
+  for (unsigned index = 0; index < NumLive; ++index)
+    if (Live[index])
+      __sc_dbg_poolrealloc_debug (&Pool, Live[index], 0, 0,
+                                  __FILE__, __LINE__);
+}
+
+static void
+runShadowSyscalls (const BenchOptions & Opts) {
+  pool_init_runtime (1, 0, 0);
+  __sc_dbg_poolinit (&Pool, MinSize, 0);
+
+  //
+  // Make sure that allocations are shadowed at all.
+  //
+  unsigned long Remaps, Protects, Recycles;
+  __sc_dbg_shadowstats (&Remaps, &Protects, &Recycles);
+  void * Probe = __sc_dbg_poolrealloc_debug (&Pool, 0, MinSize, 0,
+                                             __FILE__, __LINE__);
+  unsigned long NewRemaps;
+  __sc_dbg_shadowstats (&NewRemaps, &Protects, &Recycles);
+  __sc_dbg_poolrealloc_debug (&Pool, Probe, 0, 0, __FILE__, __LINE__);
+  if (NewRemaps == Remaps) {
+    fprintf (stderr, "shadow-syscalls: dangling pointer detection is off; "
+                     "run this benchmark on its own\n");
+    return;
+  }
+
+  runPattern (RandomVariant, false, Opts);
+  runPattern (FifoVariant, true, Opts);
+}
+
+static RegisterBenchmark X ("shadow-syscalls", runShadowSyscalls);
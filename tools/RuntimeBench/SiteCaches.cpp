@@ -0,0 +1,137 @@
+//===- SiteCaches.cpp - Benchmark of the inline caches of check sites -----===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures load/store checks that have inline caches, as produced
+// by the SiteCacheChecks pass, against plain calls to poolcheck().  The loop
+// walks each of a number of arrays in turn through a single check site, so
+// the site keeps finding the same object.  The churn variant also registers
+// and unregisters an unrelated object every few checks, which invalidates the
+// inline caches of all sites.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace llvm;
+
+// The largest number of arrays walked
+static const unsigned MaxArrays = 64;
+
+// Size of each array in bytes
+static const unsigned ArraySize = 1 << 12;
+
+// Number of passes over the arrays
+static const unsigned NumPasses = 32;
+
+// Number of checks between registrations in the churn variant
+static const unsigned ChurnPeriod = 64;
+
+// Keeps the loads of the loop from being optimized away
+static volatile unsigned long Sink;
+
+//
+// Function: cachedPoolcheck()
+//
+// Description:
+//  Do what the SiteCacheChecks pass does for a call to poolcheck().
+//
+static inline void
+cachedPoolcheck (SiteCache & Cache, DebugPoolTy * Pool, void * Node,
+                 unsigned Len) {
+  uintptr_t Epoch = Cache.Epoch;
+  if (Epoch == __sc_site_epoch) {
+    uintptr_t First = (uintptr_t) Node;
+    uintptr_t Last = First + Len - 1;
+    if ((Cache.Pool == Pool) &&
+        ((uintptr_t) Cache.lower <= First) &&
+        (Last <= (uintptr_t) Cache.upper) &&
+        (Cache.Epoch == Epoch))
+      return;
+  }
+  poolcheck_cached (Pool, Node, Len, &Cache);
+}
+
+// How the loop checks its accesses
+enum CheckMode {
+  PlainChecks,
+  CachedChecks,
+  CachedChurn
+};
+
+//
+// Function: walkArrays()
+//
+// Description:
+//  Read every eighth byte of each array in turn and return the cost per
+//  access.
+//
+static double
+walkArrays (DebugPoolTy * Pool, unsigned char ** Arrays, unsigned NumArrays,
+            CheckMode Mode) {
+  static SiteCache Cache;
+  static char Scratch[64];
+
+  unsigned long Sum = 0;
+  unsigned Churn = 0;
+  uint64_t Start = getTimeNS ();
+  for (unsigned pass = 0; pass < NumPasses; ++pass) {
+    for (unsigned index = 0; index < NumArrays; ++index) {
+      for (unsigned offset = 0; offset < ArraySize; offset += 8) {
+        unsigned char * P = Arrays[index] + offset;
+        if (Mode == PlainChecks) {
+          poolcheck (Pool, P, 8);
+        } else {
+          cachedPoolcheck (Cache, Pool, P, 8);
+          if ((Mode == CachedChurn) && (++Churn == ChurnPeriod)) {
+            Churn = 0;
+            pool_register (Pool, Scratch, sizeof (Scratch));
+            pool_unregister (Pool, Scratch);
+          }
+        }
+        Sum += *P;
+      }
+    }
+  }
+  uint64_t End = getTimeNS ();
+
+  Sink = Sum;
+  return (End - Start) / ((double) NumPasses * (ArraySize / 8) * NumArrays);
+}
+
+static void
+runSiteCaches (const BenchOptions & Opts) {
+  static DebugPoolTy Pool;
+  __sc_dbg_poolinit (&Pool, 1, 0);
+
+  unsigned char * Arrays[MaxArrays];
+  for (unsigned index = 0; index < MaxArrays; ++index) {
+    Arrays[index] = (unsigned char *) calloc (1, ArraySize);
+    pool_register (&Pool, Arrays[index], ArraySize);
+  }
+
+  for (unsigned NumArrays = 1; NumArrays <= MaxArrays; NumArrays *= 4) {
+    reportResult ("site-caches", "poolcheck", NumArrays,
+                  walkArrays (&Pool, Arrays, NumArrays, PlainChecks));
+    reportResult ("site-caches", "cached", NumArrays,
+                  walkArrays (&Pool, Arrays, NumArrays, CachedChecks));
+    reportResult ("site-caches", "cached-churn", NumArrays,
+                  walkArrays (&Pool, Arrays, NumArrays, CachedChurn));
+  }
+
+  __sc_dbg_pooldestroy (&Pool);
+  for (unsigned index = 0; index < MaxArrays; ++index)
+    free (Arrays[index]);
+}
+
+static RegisterBenchmark X ("site-caches", runSiteCaches);
@@ -0,0 +1,118 @@
+//===- SlabChurn.cpp - Benchmark of allocation churn within slabs ---------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures how quickly the bitmap pool allocator finds free nodes
+// within partially filled slabs.  A pool is filled and then randomly thinned
+// out to the desired fill level; random objects are then freed and replaced
+// by new objects of the same size, which keeps the fill level constant while
+// the allocator searches the fragmented slabs for room.  Objects are replaced
+// in small batches so that the frees and the allocations can be timed
+// separately; each configuration reports the cost of a free, of an
+// allocation, and of the pair.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "BitmapAllocator.h"
+
+#include <string>
+#include <vector>
+
+using namespace bench;
+using namespace llvm;
+
+// Size of each node of the pool
+static const unsigned NodeSize = 16;
+
+// Number of slabs that are filled before the pool is thinned out
+static const unsigned NumSlabs = 16;
+
+// Number of free/allocate pairs timed for each configuration
+static const unsigned long NumPairs = 1 << 20;
+
+// Number of objects freed and then allocated at a time
+static const unsigned long BatchSize = 64;
+
+static void
+runChurn (const char * Variant,
+          unsigned ObjSize,
+          unsigned Fill,
+          const BenchOptions & Opts) {
+  static BitmapPoolTy Pool;
+  poolinit (&Pool, NodeSize);
+  uint64_t State = Opts.Seed;
+
+  //
+  // Fill the slabs and then free randomly chosen objects until the desired
+  // fraction of them is left.
+  //
+  std::vector<void *> Objs;
+  while (Pool.NumSlabs <= NumSlabs)
+    Objs.push_back (poolalloc (&Pool, ObjSize));
+
+  unsigned long NumLive = Objs.size () * Fill / 100;
+  while (Objs.size () > NumLive) {
+    unsigned long index = nextRandom (State) % Objs.size ();
+    poolfree (&Pool, Objs[index]);
+    Objs[index] = Objs.back ();
+    Objs.pop_back ();
+  }
+
+  //
+  // Move a random batch of objects to the end of the list, free them, and
+  // allocate their replacements.
+  //
+  unsigned long Batch = (BatchSize < NumLive) ? BatchSize : NumLive;
+  unsigned long NumBatches = NumPairs / Batch;
+  uint64_t FreeTime = 0;
+  uint64_t AllocTime = 0;
+  for (unsigned long batch = 0; batch < NumBatches; ++batch) {
+    for (unsigned long index = 0; index < Batch; ++index) {
+      unsigned long Last = NumLive - 1 - index;
+      unsigned long Victim = nextRandom (State) % (Last + 1);
+      void * Tmp = Objs[Victim];
+      Objs[Victim] = Objs[Last];
+      Objs[Last] = Tmp;
+    }
+
+    uint64_t Start = getTimeNS ();
+    for (unsigned long index = NumLive - Batch; index < NumLive; ++index)
+      poolfree (&Pool, Objs[index]);
+    uint64_t Middle = getTimeNS ();
+    for (unsigned long index = NumLive - Batch; index < NumLive; ++index)
+      Objs[index] = poolalloc (&Pool, ObjSize);
+    uint64_t End = getTimeNS ();
+
+    FreeTime += Middle - Start;
+    AllocTime += End - Middle;
+  }
+
+  double Ops = (double) NumBatches * Batch;
+  reportResult ("slab-churn", (std::string (Variant) + "-free").c_str (),
+                Fill, FreeTime / Ops);
+  reportResult ("slab-churn", (std::string (Variant) + "-alloc").c_str (),
+                Fill, AllocTime / Ops);
+  reportResult ("slab-churn", Variant, Fill, (FreeTime + AllocTime) / Ops);
+
+  pooldestroy (&Pool);
+}
+
+static void
+runSlabChurn (const BenchOptions & Opts) {
+  static const unsigned Fills[] = {10, 50, 95};
+  static const unsigned NumFills = sizeof (Fills) / sizeof (Fills[0]);
+  for (unsigned index = 0; index < NumFills; ++index) {
+    runChurn ("single", NodeSize, Fills[index], Opts);
+    runChurn ("array-4", 4 * NodeSize, Fills[index], Opts);
+    runChurn ("array-16", 16 * NodeSize, Fills[index], Opts);
+  }
+}
+
+static RegisterBenchmark X ("slab-churn", runSlabChurn);
@@ -0,0 +1,104 @@
+//===- SlabLookup.cpp - Benchmark of finding the slab of a pointer --------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file measures the operations of the bitmap pool allocator that must
+// find the slab containing a pointer: poolfree() and the singleton object
+// check __pa_bitmap_poolcheck().  Pools are filled with an increasing number
+// of slabs; the cost of both operations should not depend upon it.  Objects
+// are freed and replaced in random batches so that poolfree() can be timed
+// apart from the poolalloc() calls that replace the objects.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "BitmapAllocator.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace bench;
+using namespace llvm;
+
+// Size of each object; every slab holds a few dozen of them
+static const unsigned NodeSize = 1024;
+
+// Number of operations timed for each configuration
+static const unsigned long NumOps = 1 << 20;
+
+// Number of objects freed and then allocated at a time
+static const unsigned long BatchSize = 64;
+
+static void
+runSlabLookup (const BenchOptions & Opts) {
+  for (unsigned NumSlabs = 1; NumSlabs <= 1024; NumSlabs *= 4) {
+    static BitmapPoolTy Pool;
+    poolinit (&Pool, NodeSize);
+
+    //
+    // Fill the pool until it has the desired number of slabs.
+    //
+    std::vector<void *> Objs;
+    while (Pool.NumSlabs < NumSlabs)
+      Objs.push_back (poolalloc (&Pool, NodeSize));
+
+    uint64_t State = Opts.Seed;
+    unsigned long Found = 0;
+    uint64_t Start = getTimeNS ();
+    for (unsigned long op = 0; op < NumOps; ++op) {
+      void * p = Objs[nextRandom (State) % Objs.size ()];
+      if (__pa_bitmap_poolcheck (&Pool, p))
+        ++Found;
+    }
+    uint64_t End = getTimeNS ();
+    if (Found != NumOps) abort ();
+    reportResult ("slab-lookup", "poolcheck", NumSlabs,
+                  (double) (End - Start) / NumOps);
+
+    //
+    // Move a random batch of objects to the end of the list, free them, and
+    // allocate replacements for them.
+    //
+    unsigned long NumLive = Objs.size ();
+    unsigned long Batch = (BatchSize < NumLive) ? BatchSize : NumLive;
+    unsigned long NumBatches = NumOps / Batch;
+    uint64_t FreeTime = 0;
+    uint64_t AllocTime = 0;
+    for (unsigned long batch = 0; batch < NumBatches; ++batch) {
+      for (unsigned long index = 0; index < Batch; ++index) {
+        unsigned long Last = NumLive - 1 - index;
+        unsigned long Victim = nextRandom (State) % (Last + 1);
+        void * Tmp = Objs[Victim];
+        Objs[Victim] = Objs[Last];
+        Objs[Last] = Tmp;
+      }
+
+      Start = getTimeNS ();
+      for (unsigned long index = NumLive - Batch; index < NumLive; ++index)
+        poolfree (&Pool, Objs[index]);
+      uint64_t Middle = getTimeNS ();
+      for (unsigned long index = NumLive - Batch; index < NumLive; ++index)
+        Objs[index] = poolalloc (&Pool, NodeSize);
+      End = getTimeNS ();
+
+      FreeTime += Middle - Start;
+      AllocTime += End - Middle;
+    }
+
+    double Ops = (double) NumBatches * Batch;
+    reportResult ("slab-lookup", "free", NumSlabs, FreeTime / Ops);
+    reportResult ("slab-lookup", "alloc", NumSlabs, AllocTime / Ops);
+    reportResult ("slab-lookup", "free-alloc", NumSlabs,
+                  (FreeTime + AllocTime) / Ops);
+
+    pooldestroy (&Pool);
+  }
+}
+
+static RegisterBenchmark X ("slab-lookup", runSlabLookup);
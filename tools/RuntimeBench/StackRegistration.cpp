@@ -0,0 +1,126 @@
+//===- StackRegistration.cpp - Benchmark of stack object registration -----===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This file measures the cost of registering and unregistering stack objects
+// in the pattern produced by function calls: objects are registered on entry
+// and unregistered in the reverse order on exit.  It compares splay trees
+// whose nodes come from std::allocator with splay trees whose nodes come from
+// a NodeArenaAllocator, and it measures the same pattern through the debug
+// run-time's pool_register_stack() and pool_unregister_stack().  It also
+// measures how long clearing a large tree takes, as done by pooldestroy().
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+#include "NodeArenaAllocator.h"
+#include "SplayTree.h"
+
+#include <cstdlib>
+
+using namespace bench;
+using namespace llvm;
+
+// Number of live heap objects registered in addition to the stack objects
+static const unsigned NumHeapObjects = 10000;
+
+// Number of register/unregister pairs timed for each configuration
+static const unsigned long NumPairs = 1 << 21;
+
+// Size of each stack object
+static const unsigned FrameSize = 64;
+
+// The stack and the heap objects live in this fake address range; the memory
+// is never touched.
+static unsigned char * const StackTop = (unsigned char *) 0x40000000;
+static unsigned char * const HeapBase = (unsigned char *) 0x10000000;
+
+template <class SetTy>
+static void
+runSplay (const char * Variant, unsigned Depth) {
+  SetTy * Set = new SetTy;
+  for (unsigned index = 0; index < NumHeapObjects; ++index) {
+    unsigned char * obj = HeapBase + index * 128;
+    Set->insert (obj, obj + 99);
+  }
+
+  uint64_t Start = getTimeNS ();
+  for (unsigned long pairs = 0; pairs < NumPairs; pairs += Depth) {
+    for (unsigned frame = 1; frame <= Depth; ++frame) {
+      unsigned char * obj = StackTop - frame * FrameSize;
+      Set->insert (obj, obj + FrameSize - 1);
+    }
+    for (unsigned frame = Depth; frame > 0; --frame)
+      Set->remove (StackTop - frame * FrameSize);
+  }
+  uint64_t End = getTimeNS ();
+  reportResult ("stack-registration", Variant, Depth,
+                (double) (End - Start) / NumPairs);
+  delete Set;
+}
+
+template <class SetTy>
+static void
+runClear (const char * Variant, unsigned long NumObjects) {
+  SetTy * Set = new SetTy;
+  for (unsigned long index = 0; index < NumObjects; ++index) {
+    unsigned char * obj = HeapBase + index * 128;
+    Set->insert (obj, obj + 99);
+  }
+
+  uint64_t Start = getTimeNS ();
+  Set->clear ();
+  uint64_t End = getTimeNS ();
+  reportResult ("splay-clear", Variant, NumObjects,
+                (double) (End - Start) / NumObjects);
+  delete Set;
+}
+
+static void
+runRuntime (unsigned Depth) {
+  static DebugPoolTy Pool;
+  __sc_dbg_poolinit (&Pool, 1, 0);
+
+  unsigned char * Heap = (unsigned char *) malloc (NumHeapObjects * 128);
+  for (unsigned index = 0; index < NumHeapObjects; ++index)
+    pool_register (&Pool, Heap + index * 128, 100);
+
+  unsigned char Stack[FrameSize * 64];
+  unsigned char * Top = Stack + sizeof (Stack);
+  uint64_t Start = getTimeNS ();
+  for (unsigned long pairs = 0; pairs < NumPairs; pairs += Depth) {
+    for (unsigned frame = 1; frame <= Depth; ++frame)
+      pool_register_stack (&Pool, Top - frame * FrameSize, FrameSize);
+    for (unsigned frame = Depth; frame > 0; --frame)
+      pool_unregister_stack (&Pool, Top - frame * FrameSize);
+  }
+  uint64_t End = getTimeNS ();
+  reportResult ("stack-registration", "runtime", Depth,
+                (double) (End - Start) / NumPairs);
+
+  __sc_dbg_pooldestroy (&Pool);
+  free (Heap);
+}
+
+static void
+runStackRegistration (const BenchOptions & Opts) {
+  for (unsigned Depth = 1; Depth <= 64; Depth *= 4) {
+    runSplay<RangeSplaySet<> > ("std-allocator", Depth);
+    runSplay<RangeSplaySet<NodeArenaAllocator<void> > > ("node-arena", Depth);
+    runRuntime (Depth);
+  }
+
+  for (unsigned long N = 1000; N <= Opts.MaxObjects; N *= 10) {
+    runClear<RangeSplaySet<> > ("std-allocator", N);
+    runClear<RangeSplaySet<NodeArenaAllocator<void> > > ("node-arena", N);
+  }
+}
+
+static RegisterBenchmark X ("stack-registration", runStackRegistration);
@@ -0,0 +1,138 @@
+//===- ThreadedChecks.cpp - Multithreaded stress test of the checks -------===//
+// 
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+// 
+//===----------------------------------------------------------------------===//
+//
+// This file measures the throughput of the debug run-time's load/store and
+// bounds checks when several threads perform them at once.  While checking,
+// each thread also allocates, registers, unregisters, and frees objects of its
+// own in the shared pool so that the pool and the object index are modified
+// concurrently with the lookups.
+//
+// Threads can only share the run-time when it is built with SC_THREADS=1;
+// otherwise, only the single threaded configuration is measured.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RuntimeBench.h"
+
+#include "DebugRuntime.h"
+
+#include <cstdlib>
+#include <pthread.h>
+
+using namespace bench;
+using namespace llvm;
+
+// Number of checks performed by each thread
+static const unsigned long ChecksPerThread = 1 << 22;
+
+// Size of the shared objects that are checked
+static const unsigned ObjectSize = 64;
+
+// Number of private objects each thread keeps registered
+static const unsigned NumPrivate = 16;
+
+// Number of checks between two registrations of a private object
+static const unsigned ChurnInterval = 64;
+
+static DebugPoolTy Pool;
+static unsigned char * Objects;
+static unsigned long NumObjects;
+static volatile int Go;
+
+struct Worker {
+  pthread_t Thread;
+  unsigned Id;
+  unsigned Seed;
+};
+
+static void *
+runWorker (void * Arg) {
+  Worker * W = (Worker *) Arg;
+  uint64_t State = (((uint64_t) W->Id) << 32) | W->Seed | 1;
+
+  unsigned char * Private[NumPrivate];
+  for (unsigned index = 0; index < NumPrivate; ++index) {
+    Private[index] =
+      (unsigned char *) __sc_dbg_src_poolalloc (&Pool, ObjectSize, 0, NULL, 0);
+    pool_register (&Pool, Private[index], ObjectSize);
+  }
+
+  while (!Go)
+    ;
+
+  unsigned NextPrivate = 0;
+  for (unsigned long index = 0; index < ChecksPerThread; index += 2) {
+    uint64_t R = nextRandom (State);
+    unsigned char * Obj = Objects + (R % NumObjects) * ObjectSize;
+    unsigned char * p = Obj + ((R >> 32) % ObjectSize);
+    poolcheck (&Pool, p, 1);
+    boundscheck (&Pool, p, Obj + ((R >> 40) % ObjectSize));
+
+    if ((index % ChurnInterval) == 0) {
+      unsigned char * & Mine = Private[NextPrivate];
+      pool_unregister (&Pool, Mine);
+      __sc_dbg_src_poolfree (&Pool, Mine, 0, NULL, 0);
+      Mine = (unsigned char *) __sc_dbg_src_poolalloc (&Pool, ObjectSize,
+                                                       0, NULL, 0);
+      pool_register (&Pool, Mine, ObjectSize);
+      NextPrivate = (NextPrivate + 1) % NumPrivate;
+    }
+  }
+
+  for (unsigned index = 0; index < NumPrivate; ++index) {
+    pool_unregister (&Pool, Private[index]);
+    __sc_dbg_src_poolfree (&Pool, Private[index], 0, NULL, 0);
+  }
+  return 0;
+}
+
+static void
+runThreadedChecks (const BenchOptions & Opts) {
+  static bool Initialized = false;
+  if (!Initialized) {
+    pool_init_runtime (0, 0, 0);
+    Initialized = true;
+  }
+
+  __sc_dbg_poolinit (&Pool, ObjectSize, 0);
+  NumObjects = (Opts.MaxObjects < 100000) ? Opts.MaxObjects : 100000;
+  Objects = (unsigned char *) malloc (NumObjects * ObjectSize);
+  for (unsigned long index = 0; index < NumObjects; ++index)
+    pool_register (&Pool, Objects + index * ObjectSize, ObjectSize);
+
+#ifdef SC_THREAD_SAFE_RUNTIME
+  static const unsigned MaxThreads = 16;
+#else
+  static const unsigned MaxThreads = 1;
+#endif
+  for (unsigned NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2) {
+    Worker Workers[MaxThreads];
+    Go = 0;
+    for (unsigned index = 0; index < NumThreads; ++index) {
+      Workers[index].Id = index;
+      Workers[index].Seed = Opts.Seed;
+      pthread_create (&(Workers[index].Thread), 0, runWorker, &Workers[index]);
+    }
+
+    uint64_t Start = getTimeNS ();
+    Go = 1;
+    for (unsigned index = 0; index < NumThreads; ++index)
+      pthread_join (Workers[index].Thread, 0);
+    uint64_t End = getTimeNS ();
+
+    double Checks = (double) ChecksPerThread * NumThreads;
+    reportResult ("threaded-checks", "throughput", NumThreads,
+                  Checks * 1e9 / (End - Start), "checks/s", NumThreads);
+  }
+
+  __sc_dbg_pooldestroy (&Pool);
+  free (Objects);
+}
+
+static RegisterBenchmark X ("threaded-checks", runThreadedChecks);
@@ -67,7 +67,12 @@
 #include "safecode/BreakConstantStrings.h"
 #include "safecode/CStdLib.h"
 #endif
+#include "safecode/BatchChecks.h"
 #include "safecode/DebugInstrumentation.h"
+#include "safecode/InlineBaggyChecks.h"
+#include "safecode/ParallelChecks.h"
+#include "safecode/ProfileGuidedChecks.h"
+#include "safecode/SiteCacheChecks.h"
 #if 0
 #include "safecode/DetectDanglingPointers.h"
 #include "safecode/DummyUse.h"
@@ -75,9 +80,9 @@
 #endif
 #include "safecode/OptimizeChecks.h"
 #include "safecode/RewriteOOB.h"
+#include "safecode/LowerSafecodeIntrinsic.h"
 #if 0
 #include "safecode/SpeculativeChecking.h"
-#include "safecode/LowerSafecodeIntrinsic.h"
 #include "safecode/FaultInjector.h"
 #include "safecode/CodeDuplication.h"
 #endif
@@ -180,6 +185,36 @@ static cl::opt<bool>
 EnableCodeDuplication("code-duplication", cl::init(false),
 			 cl::desc("Enable Code Duplication for SAFECode checking"));
 
+static cl::opt<bool>
+SiteCaches("check-site-caches", cl::init(false),
+			 cl::desc("Give load/store and bounds checks inline caches of the "
+			          "last object that they found"));
+
+static cl::opt<bool>
+DebugSiteTable("debug-site-table", cl::init(false),
+			 cl::desc("Find the source locations of failed load/store and "
+			          "bounds checks in a table instead of passing them"));
+
+static cl::opt<bool>
+SampleChecks("sample-checks", cl::init(false),
+			 cl::desc("Run load/store checks at only a sample of their "
+			          "executions (set SC_SAMPLE_RATE at run-time)"));
+
+static cl::opt<bool>
+RunChecksInParallel("parallel-checks", cl::init(false),
+			 cl::desc("Run checks and registrations on checker threads and "
+			          "wait for them before external calls"));
+
+static cl::opt<bool>
+BatchLoadStoreChecks("batch-checks", cl::init(false),
+			 cl::desc("Perform the independent load/store checks of a basic "
+			          "block in one call to the run-time"));
+
+static cl::opt<bool>
+BaggyCalls("baggy-calls", cl::init(false),
+			 cl::desc("Call the run-time for every baggy bounds check instead of "
+			          "performing the checks inline"));
+
 #define NOT_FOR_SVA(X) do { if (!SCConfig.svaEnabled()) X; } while (0);
 
 static void addLowerIntrinsicPass(PassManager & Passes, CheckingRuntimeType type);
@@ -512,8 +547,62 @@ int main(int argc, char **argv) {
     Passes.add(new DetectDanglingPointers());
 #endif
 
-    if (!DisableDebugInfo)
-      Passes.add (new DebugInstrument());
+    //
+    // Sample the load/store checks.  Bounds checks always run so that every
+    // out-of-bounds pointer is rewritten.  This must precede DebugInstrument,
+    // which renames the checks.
+    //
+    if (SampleChecks) {
+      typedef LowerSafecodeIntrinsic::IntrinsicMappingEntry
+              IntrinsicMappingEntry;
+      static IntrinsicMappingEntry SampledChecks[] =
+        { {"poolcheck",          "poolcheck" },
+          {"poolcheckui",        "poolcheckui" },
+          {"poolcheckalign",     "poolcheckalign" },
+          {"poolcheckalignui",   "poolcheckalignui" },
+          {"fastlscheck",        "fastlscheck" },
+        };
+      unsigned NumSampled = sizeof (SampledChecks) / sizeof (SampledChecks[0]);
+      Passes.add (new LowerSafecodeIntrinsic (SampledChecks,
+                                              SampledChecks + NumSampled,
+                                              true));
+    }
+
+    if (!DisableDebugInfo) {
+      Passes.add (new DebugInstrument(DebugSiteTable));
+
+      //
+      // Optimize the hot checks found by the check profile given with the
+      // -sc-check-profile option; the pass does nothing without one.
+      //
+      Passes.add (new ProfileGuidedChecks());
+    }
+
+    //
+    // Perform the baggy bounds checks inline.  Otherwise, send the checks to
+    // checker threads, or else batch the load/store checks and give the
+    // remaining checks inline caches.  These must follow DebugInstrument,
+    // which knows about neither the inline, the parallel, the batched, nor the
+    // cached checks.
+    //
+    if (CheckingRuntime == RUNTIME_BB) {
+      if (!BaggyCalls)
+        Passes.add (new InlineBaggyChecks());
+    } else if (RunChecksInParallel) {
+      Passes.add (new ParallelChecks());
+    } else {
+      if (BatchLoadStoreChecks)
+        Passes.add (new BatchChecks());
+      if (SiteCaches)
+        Passes.add (new SiteCacheChecks());
+    }
+
+    //
+    // Give the checks left without debug arguments their entries in the site
+    // table.  This must follow every pass that moves checks or replaces them.
+    //
+    if (!DisableDebugInfo && DebugSiteTable)
+      Passes.add (new RecordCheckSites());
 
 #if 0
     // Lower the checking intrinsics into appropriate runtime function calls.
@@ -904,7 +993,7 @@ addLowerIntrinsicPass(PassManager & Passes, CheckingRuntimeType type) {
     break;
     
   case RUNTIME_DEBUG:
-    Passes.add(new LowerSafecodeIntrinsic(RuntimeDebug, RuntimeDebug + sizeof(RuntimeDebug) / sizeof(IntrinsicMappingEntry)));
+    Passes.add(new LowerSafecodeIntrinsic(RuntimeDebug, RuntimeDebug + sizeof(RuntimeDebug) / sizeof(IntrinsicMappingEntry), SampleChecks));
     break;
 
   case RUNTIME_SINGLETHREAD:
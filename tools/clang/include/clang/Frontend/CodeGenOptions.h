@@ -125,6 +125,9 @@ public:
   /// The filename to use for logging memory safety violations
   std::string MemSafetyLogFile;
 
+  /// The check profile with which to optimize memory safety checks
+  std::string MemSafetyProfile;
+
 public:
   // Define accessors/mutators for code generation options of enumeration type.
 #define CODEGENOPT(Name, Bits, Default)
@@ -42,20 +42,25 @@
 #include "CommonMemorySafetyPasses.h"
 #include "safecode/ArrayBoundsCheck.h"
 #include "safecode/BaggyBoundsChecks.h"
+#include "safecode/BatchChecks.h"
 #include "safecode/CFIChecks.h"
 #include "safecode/CStdLib.h"
 #include "safecode/DebugInstrumentation.h"
 #include "safecode/FormatStrings.h"
 #include "safecode/InitAllocas.h"
+#include "safecode/InlineBaggyChecks.h"
 #include "safecode/InvalidFreeChecks.h"
 #include "safecode/GEPChecks.h"
 #include "safecode/LoggingFunctions.h"
 #include "safecode/OptimizeChecks.h"
+#include "safecode/ParallelChecks.h"
+#include "safecode/ProfileGuidedChecks.h"
 #include "safecode/RegisterBounds.h"
 #include "safecode/RegisterRuntimeInitializer.h"
 #include "safecode/RewriteOOB.h"
 #include "safecode/SAFECodeMSCInfo.h"
 #include "safecode/SAFECodePasses.h"
+#include "safecode/SiteCacheChecks.h"
 #include "safecode/SpecializeCMSCalls.h"
 #include "SoftBound/InitializeSoftBound.h"
 #include "SoftBound/SoftBoundCETSPass.h"
@@ -420,8 +425,35 @@ void EmitAssemblyHelper::CreatePasses(TargetMachine *TM) {
   // For SAFECode, do the debug instrumentation and OOB rewriting after
   // all optimization is done.
   if (CodeGenOpts.MemSafety) {
-    MPM->add (new DebugInstrument());
+    MPM->add (new DebugInstrument(CodeGenOpts.MemSafetySiteTable));
     MPM->add (new RewriteOOB());
+    if (CodeGenOpts.BaggyBounds) {
+      //
+      // The baggy bounds checks are cheap enough to perform inline; only the
+      // checks that fail call the run-time.
+      //
+      if (!CodeGenOpts.MemSafetyBaggyCalls)
+        MPM->add (new InlineBaggyChecks());
+    } else if (CodeGenOpts.MemSafetyParallel) {
+      //
+      // The checks run on checker threads, so neither the check profile nor
+      // the inline caches of the program's thread apply.
+      //
+      MPM->add (new ParallelChecks());
+    } else {
+      if (!CodeGenOpts.MemSafetyProfile.empty())
+        MPM->add (new ProfileGuidedChecks(CodeGenOpts.MemSafetyProfile));
+      if (CodeGenOpts.MemSafetyBatchChecks)
+        MPM->add (new BatchChecks());
+      if (CodeGenOpts.MemSafetySiteCaches)
+        MPM->add (new SiteCacheChecks());
+    }
+
+    //
+    // Record the sites of the checks once no later pass moves them.
+    //
+    if (CodeGenOpts.MemSafetySiteTable)
+      MPM->add (new RecordCheckSites());
   }
 }
 
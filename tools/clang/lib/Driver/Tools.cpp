@@ -2864,11 +2864,36 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
     CmdArgs.push_back("-fmemsafety-terminate");
   }
 
+  if (Args.getLastArg(options::OPT_msSiteCaches)) {
+    CmdArgs.push_back("-fmemsafety-site-caches");
+  }
+
+  if (Args.getLastArg(options::OPT_msSiteTable)) {
+    CmdArgs.push_back("-fmemsafety-site-table");
+  }
+
+  if (Args.getLastArg(options::OPT_msParallel)) {
+    CmdArgs.push_back("-fmemsafety-parallel");
+  }
+
+  if (Args.getLastArg(options::OPT_msBatchChecks)) {
+    CmdArgs.push_back("-fmemsafety-batch-checks");
+  }
+
+  if (Args.getLastArg(options::OPT_msBaggyCalls)) {
+    CmdArgs.push_back("-fmemsafety-baggy-calls");
+  }
+
   if (Arg *MemSafetyLogOpt = Args.getLastArg(options::OPT_msLogFile)) {
     CmdArgs.push_back("-fmemsafety-logfile");
     CmdArgs.push_back(MemSafetyLogOpt->getValue());
   }
 
+  if (Arg *MemSafetyProfileOpt = Args.getLastArg(options::OPT_msProfile)) {
+    CmdArgs.push_back("-fmemsafety-profile");
+    CmdArgs.push_back(MemSafetyProfileOpt->getValue());
+  }
+
   // --param ssp-buffer-size=
   for (arg_iterator it = Args.filtered_begin(options::OPT__param),
        ie = Args.filtered_end(); it != ie; ++it) {
@@ -5106,9 +5131,12 @@ void auroraux::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }
     CmdArgs.push_back("-lgdtoa"); 
     CmdArgs.push_back("-lstdc++");
@@ -5256,9 +5284,12 @@ void openbsd::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }
     CmdArgs.push_back("-lgdtoa"); 
     CmdArgs.push_back("-lstdc++");
@@ -5647,9 +5678,12 @@ void freebsd::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }    
     CmdArgs.push_back("-lgdtoa"); 
     CmdArgs.push_back("-lstdc++");
@@ -5838,9 +5872,12 @@ void netbsd::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }
     CmdArgs.push_back("-lgdtoa");
     CmdArgs.push_back("-lstdc++");
@@ -6241,9 +6278,12 @@ void gnutools::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }
     CmdArgs.push_back("-lgdtoa");
     CmdArgs.push_back("-lstdc++");
@@ -6539,9 +6579,12 @@ void dragonfly::Link::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_memsafety)) {
     if (Args.hasArg(options::OPT_bbc)) {
       CmdArgs.push_back("-lsc_bb_rt");
+      CmdArgs.push_back("-lpthread");
     } else {
       CmdArgs.push_back("-lsc_dbg_rt");
       CmdArgs.push_back("-lpoolalloc_bitmap");
+      if (Args.hasArg(options::OPT_msParallel))
+        CmdArgs.push_back("-lpthread");
     }
     CmdArgs.push_back("-lgdtoa");
     CmdArgs.push_back("-lstdc++");
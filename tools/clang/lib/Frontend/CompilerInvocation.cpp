@@ -379,11 +379,21 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
   Opts.BaggyBounds = Args.hasArg(OPT_bbc);
   Opts.SoftBound = Args.hasArg(OPT_softbound);
   Opts.MemSafeTerminate = Args.hasArg(OPT_terminate);
+  Opts.MemSafetySiteCaches = Args.hasArg(OPT_msSiteCaches);
+  Opts.MemSafetySiteTable = Args.hasArg(OPT_msSiteTable);
+  Opts.MemSafetyParallel = Args.hasArg(OPT_msParallel);
+  Opts.MemSafetyBatchChecks = Args.hasArg(OPT_msBatchChecks);
+  Opts.MemSafetyBaggyCalls = Args.hasArg(OPT_msBaggyCalls);
   if (Arg *A = Args.getLastArg(OPT_msLogFile)) {
     Opts.MemSafetyLogFile = A->getValue();
   } else {
     Opts.MemSafetyLogFile = "";
   }
+  if (Arg *A = Args.getLastArg(OPT_msProfile)) {
+    Opts.MemSafetyProfile = A->getValue();
+  } else {
+    Opts.MemSafetyProfile = "";
+  }
   Opts.RelocationModel = Args.getLastArgValue(OPT_mrelocation_model, "pic");
   Opts.TrapFuncName = Args.getLastArgValue(OPT_ftrap_function_EQ);
   Opts.UseInitArray = Args.hasArg(OPT_fuse_init_array);